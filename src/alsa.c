@@ -24,15 +24,21 @@
 #endif
 
 #define _GNU_SOURCE /* exp10() */
+#include <errno.h>
+#include <limits.h>
 #include <math.h>
+#include <unistd.h>
+#include <sys/epoll.h>
 #include <glib.h>
 #include <alsa/asoundlib.h>
 
 #include "support-log.h"
 #include "alsa.h"
+#include "backend.h"
 
 #define ALSA_DEFAULT_CARD "(default)"
 #define ALSA_DEFAULT_HCTL "default"
+#define ALSA_DEFAULT_ID   "default"
 
 /*
  * Alsa log and debug macros.
@@ -254,21 +260,351 @@ elem_set_volume_normalized(const char *hctl, snd_mixer_elem_t *elem, double volu
 	return TRUE;
 }
 
-/* Get the mute state, either TRUE or FALSE */
+/*
+ * Volume curves.
+ * A volume curve maps the raw volume steps of an element to a normalized
+ * volume, between 0 and 1. Converting between raw steps, dB values and
+ * normalized volume involves a few alsa queries and some exp10()/log10()
+ * maths, but since the dB scale of an element doesn't change, the curve
+ * is computed once for every raw step, and compiled into a table.
+ * A bucket index over the normalized range allows to go the other way
+ * round in constant time.
+ * Elements with a huge number of raw steps don't get a table, the
+ * functions above are used instead.
+ */
+
+#define ELEM_MAP_MAX_STEPS 65536
+#define ELEM_MAP_EPSILON   1e-9
+
+/* Perceived loudness doubles every 10 dB.
+ * That's the number of dB hundredths it takes to multiply it by 10.
+ */
+#define LOUDNESS_DECADE (1000.0 * M_LN10 / M_LN2)
+
+/* User-defined curve, as a list of normalized volume / dB hundredths points */
+static double *custom_curve_norm;
+static long *custom_curve_db;
+static guint custom_curve_n;
+
+struct elem_map {
+	long min, max;       /* Raw volume range */
+	guint n_steps;       /* Number of raw steps */
+	double *norm;        /* Normalized volume of every raw step */
+	long *db;            /* dB hundredths of every raw step, if available */
+	guint *index;        /* First raw step of every normalized bucket */
+};
+
+typedef struct elem_map ElemMap;
+
+/* Normalize a dB value on an exponential scale, 'decade' being the number
+ * of dB hundredths it takes to multiply the value by 10. If the lowest
+ * dB value is not a mute, the scale is stretched so that it maps to 0.
+ */
+static double
+curve_exponential(long db, long db_min, long db_max, double decade)
+{
+	double normalized, min_norm;
+
+	normalized = exp10((db - db_max) / decade);
+	if (db_min != SND_CTL_TLV_DB_GAIN_MUTE) {
+		min_norm = exp10((db_min - db_max) / decade);
+		normalized = (normalized - min_norm) / (1 - min_norm);
+	}
+
+	return normalized;
+}
+
+/* Normalize a dB value on a user-defined piecewise linear scale */
+static double
+curve_custom(long db)
+{
+	guint i;
+
+	if (db <= custom_curve_db[0])
+		return custom_curve_norm[0];
+
+	for (i = 1; i < custom_curve_n; i++) {
+		long db0 = custom_curve_db[i - 1], db1 = custom_curve_db[i];
+		double norm0 = custom_curve_norm[i - 1], norm1 = custom_curve_norm[i];
+
+		if (db > db1)
+			continue;
+
+		if (db0 == db1)
+			return norm1;
+
+		return norm0 + (norm1 - norm0) * (db - db0) / (double) (db1 - db0);
+	}
+
+	return custom_curve_norm[custom_curve_n - 1];
+}
+
+/* Normalize a dB value according to a curve */
+static double
+curve_normalize(AlsaCurve curve, long db, long db_min, long db_max)
+{
+	switch (curve) {
+	case ALSA_CURVE_LINEAR_DB:
+		return (db - db_min) / (double) (db_max - db_min);
+	case ALSA_CURVE_LOUDNESS:
+		return curve_exponential(db, db_min, db_max, LOUDNESS_DECADE);
+	case ALSA_CURVE_CUSTOM:
+		return curve_custom(db);
+	case ALSA_CURVE_ALSAMIXER:
+	default:
+		if (use_linear_dB_scale(db_min, db_max))
+			return (db - db_min) / (double) (db_max - db_min);
+		return curve_exponential(db, db_min, db_max, 6000.0);
+	}
+}
+
+/* Free a mapping table */
+static void
+elem_map_free(ElemMap *map)
+{
+	if (map == NULL)
+		return;
+
+	g_free(map->norm);
+	g_free(map->db);
+	g_free(map->index);
+	g_free(map);
+}
+
+/* Compile a curve into a mapping table, given the raw volume range and
+ * the dB value of every raw step. The dB values may be NULL, in which case
+ * the curve must be linear. The table takes ownership of them.
+ */
+static ElemMap *
+elem_map_compile(long min, long max, long *db, AlsaCurve curve)
+{
+	ElemMap *map;
+	long db_min = 0, db_max = 0, db_floor = 0;
+	guint i, k;
+
+	map = g_new0(ElemMap, 1);
+	map->min = min;
+	map->max = max;
+	map->n_steps = max - min + 1;
+	map->norm = g_new(double, map->n_steps);
+	map->db = db;
+	map->index = g_new(guint, map->n_steps);
+
+	if (db) {
+		db_min = db[0];
+		db_max = db[map->n_steps - 1];
+		db_floor = db_min;
+	}
+
+	/* A mute has no place on a linear dB scale. The scale starts one
+	 * step below the lowest audible step instead, where the mute step
+	 * is pinned, so that the audible steps spread over the whole range.
+	 */
+	if (db && db_min == SND_CTL_TLV_DB_GAIN_MUTE && map->n_steps > 1) {
+		long step = map->n_steps > 2 ? db[2] - db[1] : 100;
+
+		db_floor = db[1] - MAX(step, 1);
+	}
+
+	/* Normalize every raw step */
+	for (i = 0; i < map->n_steps; i++) {
+		if (curve == ALSA_CURVE_LINEAR)
+			map->norm[i] = i / (double) (map->n_steps - 1);
+		else if (curve != ALSA_CURVE_LINEAR_DB)
+			map->norm[i] = curve_normalize(curve, db[i], db_min, db_max);
+		else if (db[i] == SND_CTL_TLV_DB_GAIN_MUTE)
+			map->norm[i] = 0;
+		else
+			map->norm[i] = curve_normalize(curve, db[i], db_floor, db_max);
+	}
+
+	/* Index the normalized range. Bucket 'k' covers [k/n, (k+1)/n),
+	 * and points to the first raw step whose value is in this bucket
+	 * or above.
+	 */
+	for (i = k = 0; k < map->n_steps; k++) {
+		double lower = k / (double) map->n_steps;
+
+		while (i < map->n_steps - 1 && map->norm[i] < lower)
+			i++;
+		map->index[k] = i;
+	}
+
+	return map;
+}
+
+/* Compile the curve of an element into a mapping table.
+ * Curves based on dB fall back to the linear curve if the element
+ * doesn't have a usable dB scale. The dB value of each step is kept
+ * whatever the curve, so that elements can be combined in the dB domain.
+ * Return NULL if the element has too many steps.
+ */
+static ElemMap *
+elem_map_new(const char *hctl, snd_mixer_elem_t *elem, AlsaCurve curve)
+{
+	long min, max, db_min, db_max;
+	long *db = NULL;
+	guint i, n_steps;
+	int err;
+
+	err = snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+	if (err < 0 || min >= max)
+		return NULL;
+
+	if (max - min >= ELEM_MAP_MAX_STEPS) {
+		ALSA_CARD_DEBUG(hctl, "Too many volume steps (%ld), no mapping table",
+		                max - min + 1);
+		return NULL;
+	}
+
+	if (curve == ALSA_CURVE_CUSTOM && custom_curve_n == 0) {
+		ALSA_CARD_WARN(hctl, "No custom curve defined, using alsamixer curve");
+		curve = ALSA_CURVE_ALSAMIXER;
+	}
+
+	n_steps = max - min + 1;
+
+	/* Get the dB value of every raw step */
+	err = snd_mixer_selem_get_playback_dB_range(elem, &db_min, &db_max);
+	if (err >= 0 && db_min < db_max) {
+		db = g_new(long, n_steps);
+
+		for (i = 0; i < n_steps; i++) {
+			err = snd_mixer_selem_ask_playback_vol_dB(elem, min + i, &db[i]);
+			if (err < 0) {
+				ALSA_CARD_ERR(hctl, err, "Can't convert volume %ld to dB",
+				              min + i);
+				g_free(db);
+				return NULL;
+			}
+		}
+	} else if (curve != ALSA_CURVE_LINEAR) {
+		ALSA_CARD_DEBUG(hctl, "No usable dB scale, using linear curve");
+		curve = ALSA_CURVE_LINEAR;
+	}
+
+	ALSA_CARD_DEBUG(hctl, "Volume mapping table built, %u steps", n_steps);
+
+	return elem_map_compile(min, max, db, curve);
+}
+
+/* Find the raw step (as an offset from the minimum) that matches a
+ * normalized volume: for a positive direction, the smallest step at or
+ * above the volume, for a negative direction, the largest step at or
+ * below the volume, otherwise the nearest step, ties going up.
+ * The bucket index gives a starting point, and there's only a few steps
+ * to walk from there.
+ */
+static guint
+elem_map_find(ElemMap *map, double volume, int dir)
+{
+	guint i, last = map->n_steps - 1;
+	double *norm = map->norm;
+
+	if (volume <= 0)
+		i = 0;
+	else if (volume >= 1)
+		i = last;
+	else
+		i = map->index[(guint) (volume * map->n_steps)];
+
+	if (dir < 0) {
+		while (i < last && norm[i + 1] <= volume + ELEM_MAP_EPSILON)
+			i++;
+		while (i > 0 && norm[i] > volume + ELEM_MAP_EPSILON)
+			i--;
+		return i;
+	}
+
+	/* Smallest step at or above the volume */
+	while (i > 0 && norm[i - 1] >= volume - ELEM_MAP_EPSILON)
+		i--;
+	while (i < last && norm[i] < volume - ELEM_MAP_EPSILON)
+		i++;
+
+	/* Nearest step */
+	if (dir == 0 && i > 0 && volume - norm[i - 1] < norm[i] - volume)
+		i--;
+
+	return i;
+}
+
+/* Find the raw step (as an offset from the minimum) that matches a value
+ * in dB hundredths, following the same rules as above. The dB values
+ * never decrease, so a binary search finds the smallest step at or above
+ * the value. The table must have dB values.
+ */
+static guint
+elem_map_find_db(ElemMap *map, long db, int dir)
+{
+	guint lo = 0, hi = map->n_steps - 1;
+	long *steps = map->db;
+
+	/* Smallest step at or above the value */
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (steps[mid] < db)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (dir < 0) {
+		while (lo < map->n_steps - 1 && steps[lo + 1] <= db)
+			lo++;
+		if (lo > 0 && steps[lo] > db)
+			lo--;
+		return lo;
+	}
+
+	/* Nearest step */
+	if (dir == 0 && lo > 0 && db - steps[lo - 1] < steps[lo] - db)
+		lo--;
+
+	return lo;
+}
+
+/* Get the playback channels of an element, return the number of channels */
+static guint
+elem_get_channels(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t *channels)
+{
+	snd_mixer_selem_channel_id_t channel;
+	guint n = 0;
+
+	if (snd_mixer_selem_is_playback_mono(elem)) {
+		channels[0] = SND_MIXER_SCHN_MONO;
+		return 1;
+	}
+
+	for (channel = 0; channel <= SND_MIXER_SCHN_LAST; channel++)
+		if (snd_mixer_selem_has_playback_channel(elem, channel))
+			channels[n++] = channel;
+
+	return n;
+}
+
+/* Get the mute state, either TRUE or FALSE.
+ * The element is muted only if every channel is muted.
+ */
 static gboolean
 elem_get_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean *muted)
 {
-	snd_mixer_selem_channel_id_t channel = SND_MIXER_SCHN_FRONT_RIGHT;
+	snd_mixer_selem_channel_id_t channels[SND_MIXER_SCHN_LAST + 1];
+	guint i, n;
 	int err;
 	int value;
 
 	*muted = FALSE;
 
 	if (snd_mixer_selem_has_playback_switch(elem)) {
-		err = snd_mixer_selem_get_playback_switch(elem, channel, &value);
-		if (err < 0) {
-			ALSA_CARD_ERR(hctl, err, "Can't get playback switch");
-			return FALSE;
+		n = elem_get_channels(elem, channels);
+		for (value = 0, i = 0; i < n && value == 0; i++) {
+			err = snd_mixer_selem_get_playback_switch(elem, channels[i], &value);
+			if (err < 0) {
+				ALSA_CARD_ERR(hctl, err, "Can't get playback switch");
+				return FALSE;
+			}
 		}
 	} else {
 		/* If there's no playback switch, assume not muted */
@@ -308,516 +644,3347 @@ elem_set_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean mute)
 	return TRUE;
 }
 
-/*
- * Alsa mixer handling (deals with 'snd_mixer_t').
- */
-
-/* Get poll descriptors in a dynamic array (must be freed).
- * The array is terminated by a fd set to -1.
+/* Fill an array with the capture channels of an element,
+ * return the number of channels.
  */
-static struct pollfd *
-mixer_get_poll_descriptors(const char *hctl, snd_mixer_t *mixer)
+static guint
+elem_get_capture_channels(snd_mixer_elem_t *elem, snd_mixer_selem_channel_id_t *channels)
 {
-	int err, count;
-	struct pollfd *fds;
+	snd_mixer_selem_channel_id_t channel;
+	guint n = 0;
 
-	/* Get the number of poll descriptors. Afaik, it's always one. */
-	count = snd_mixer_poll_descriptors_count(mixer);
-
-	/* Get the poll descriptors in a dynamic array */
-	fds = g_new0(struct pollfd, count + 1);
-	err = snd_mixer_poll_descriptors(mixer, fds, count);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Couldn't get poll descriptors");
-		return NULL;
+	if (snd_mixer_selem_is_capture_mono(elem)) {
+		channels[0] = SND_MIXER_SCHN_MONO;
+		return 1;
 	}
 
-	/* Terminate the array with a fd set to -1 */
-	fds[count].fd = -1;
-
-	return fds;
-}
-
-/* Get the list of playable channels */
-static GSList *
-mixer_list_playable(G_GNUC_UNUSED const char *hctl, snd_mixer_t *mixer)
-{
-	GSList *list = NULL;
-	snd_mixer_elem_t *elem = NULL;
-
-	elem = snd_mixer_first_elem(mixer);
-	while (elem) {
-		if (snd_mixer_selem_has_playback_volume(elem)) {
-			const char *chan_name = snd_mixer_selem_get_name(elem);
-			list = g_slist_append(list, g_strdup(chan_name));
-		}
-		elem = snd_mixer_elem_next(elem);
-	}
+	for (channel = 0; channel <= SND_MIXER_SCHN_LAST; channel++)
+		if (snd_mixer_selem_has_capture_channel(elem, channel))
+			channels[n++] = channel;
 
-	return list;
+	return n;
 }
 
-/* Return TRUE if the mixer has at least one playable channel, FALSE otherwise */
+/* Get capture volume, return a value between 0 and 1.
+ * The loudest channel gives the volume.
+ */
 static gboolean
-mixer_is_playable(const char *hctl, snd_mixer_t *mixer)
+elem_get_capture_volume(const char *hctl, snd_mixer_elem_t *elem, double *volume)
 {
-	GSList *playable_chans;
-
-	playable_chans = mixer_list_playable(hctl, mixer);
-	if (playable_chans) {
-		g_slist_free_full(playable_chans, g_free);
-		return TRUE;
-	}
-
-	return FALSE;
-}
+	snd_mixer_selem_channel_id_t channels[SND_MIXER_SCHN_LAST + 1];
+	long min, max, value, loudest;
+	guint i, n;
+	int err;
 
-/* Get a playable mixer element by name */
-static snd_mixer_elem_t *
-mixer_get_playable_elem(const char *hctl, snd_mixer_t *mixer, const char *channel)
-{
-	snd_mixer_elem_t *elem;
-	snd_mixer_selem_id_t *sid;
+	*volume = 0;
 
-	if (!channel)
-		return NULL;
+	if (!snd_mixer_selem_has_capture_volume(elem))
+		return FALSE;
 
-	ALSA_CARD_DEBUG(hctl, "Looking for playable mixer element '%s'", channel);
+	err = snd_mixer_selem_get_capture_volume_range(elem, &min, &max);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't get capture volume range");
+		return FALSE;
+	}
 
-	/* Find the mixer element */
-	snd_mixer_selem_id_alloca(&sid);
-	snd_mixer_selem_id_set_name(sid, channel);
-	elem = snd_mixer_find_selem(mixer, sid);
-	if (elem == NULL) {
-		ALSA_CARD_WARN(hctl, "Can't find mixer element '%s'", channel);
-		return NULL;
+	if (min >= max) {
+		ALSA_CARD_WARN(hctl, "Invalid capture volume range [%ld - %ld]", min, max);
+		return FALSE;
 	}
 
-	/* Check that it's playable */
-	if (!snd_mixer_selem_has_playback_volume(elem)) {
-		ALSA_CARD_WARN(hctl, "Mixer element '%s' is not playable", channel);
-		return NULL;
+	loudest = min;
+	n = elem_get_capture_channels(elem, channels);
+	for (i = 0; i < n; i++) {
+		err = snd_mixer_selem_get_capture_volume(elem, channels[i], &value);
+		if (err < 0) {
+			ALSA_CARD_ERR(hctl, err, "Can't get capture volume");
+			return FALSE;
+		}
+		loudest = MAX(loudest, value);
 	}
 
-	return elem;
+	*volume = (loudest - min) / (double) (max - min);
+
+	return TRUE;
 }
 
-/* Get the first playable mixer element */
-static snd_mixer_elem_t *
-mixer_get_first_playable_elem(const char *hctl, snd_mixer_t *mixer)
+/* Set capture volume, input value between 0 and 1 */
+static gboolean
+elem_set_capture_volume(const char *hctl, snd_mixer_elem_t *elem, double volume, int dir)
 {
-	snd_mixer_elem_t *elem;
+	int err;
+	long min, max, value;
 
-	ALSA_CARD_DEBUG(hctl, "Looking for the first playable mixer element...");
+	if (!snd_mixer_selem_has_capture_volume(elem))
+		return FALSE;
 
-	/* Iterate on mixer elements, get the first playable */
-	elem = snd_mixer_first_elem(mixer);
-	while (elem) {
-		if (snd_mixer_selem_has_playback_volume(elem))
-			break;
-		elem = snd_mixer_elem_next(elem);
+	err = snd_mixer_selem_get_capture_volume_range(elem, &min, &max);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't get capture volume range");
+		return FALSE;
 	}
 
-	if (elem == NULL) {
-		ALSA_CARD_DEBUG(hctl, "No playable mixer element found");
-		return NULL;
+	if (min >= max) {
+		ALSA_CARD_WARN(hctl, "Invalid capture volume range [%ld - %ld]", min, max);
+		return FALSE;
 	}
 
-	return elem;
+	value = lrint_dir(volume * (max - min), dir) + min;
+
+	err = snd_mixer_selem_set_capture_volume_all(elem, value);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't set capture volume to %ld", value);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
-/* Close a mixer */
-static void
-mixer_close(const char *hctl, snd_mixer_t *mixer)
+/* Get the capture mute state, either TRUE or FALSE.
+ * Same as for playback, every channel must be muted.
+ */
+static gboolean
+elem_get_capture_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean *muted)
 {
+	snd_mixer_selem_channel_id_t channels[SND_MIXER_SCHN_LAST + 1];
+	guint i, n;
 	int err;
+	int value;
 
-	ALSA_CARD_DEBUG(hctl, "Closing mixer");
+	*muted = FALSE;
 
-	snd_mixer_free(mixer);
+	if (snd_mixer_selem_has_capture_switch(elem)) {
+		n = elem_get_capture_channels(elem, channels);
+		for (value = 0, i = 0; i < n && value == 0; i++) {
+			err = snd_mixer_selem_get_capture_switch(elem, channels[i], &value);
+			if (err < 0) {
+				ALSA_CARD_ERR(hctl, err, "Can't get capture switch");
+				return FALSE;
+			}
+		}
+	} else {
+		/* If there's no capture switch, assume not muted */
+		value = 1;
+	}
 
-	err = snd_mixer_detach(mixer, hctl);
-	if (err < 0)
-		ALSA_CARD_ERR(hctl, err, "Can't detach mixer");
+	/* Value returned: 0 = muted, 1 = not muted */
+	*muted = value == 0 ? TRUE : FALSE;
 
-	err = snd_mixer_close(mixer);
-	if (err < 0)
-		ALSA_CARD_ERR(hctl, err, "Can't close mixer");
+	return TRUE;
 }
 
-/* Open a mixer */
-static snd_mixer_t *
-mixer_open(const char *hctl)
+/* Set the capture mute state, TRUE or FALSE */
+static gboolean
+elem_set_capture_mute(const char *hctl, snd_mixer_elem_t *elem, gboolean mute)
 {
 	int err;
-	snd_mixer_t *mixer = NULL;
 
-	ALSA_CARD_DEBUG(hctl, "Opening mixer");
+	if (!snd_mixer_selem_has_capture_switch(elem))
+		return FALSE;
 
-	err = snd_mixer_open(&mixer, 0);
+	/* Value to set: 0 = muted, 1 = not muted */
+	err = snd_mixer_selem_set_capture_switch_all(elem, mute ? 0 : 1);
 	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't open mixer");
-		return NULL;
-	}
-
-	err = snd_mixer_attach(mixer, hctl);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't attach card to mixer");
-		goto failure;
-	}
-
-	err = snd_mixer_selem_register(mixer, NULL, NULL);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't register mixer simple element");
-		goto failure;
-	}
-
-	err = snd_mixer_load(mixer);
-	if (err < 0) {
-		ALSA_CARD_ERR(hctl, err, "Can't load mixer elements");
-		goto failure;
+		ALSA_CARD_ERR(hctl, err, "Can't set capture switch");
+		return FALSE;
 	}
 
-	return mixer;
-
-failure:
-	snd_mixer_close(mixer);
-	return NULL;
+	return TRUE;
 }
 
 /*
- * Alsa card iterator.
- * The Alsa API is really awkward when it comes to deal with cards
- * and to get various informations from it.
- * This iterator is here to make it less painful.
+ * Watchdog.
+ * Some alsa calls (opening a mixer, loading its elements, handling its
+ * events) may block for ever if an alsa plugin misbehaves. Since we run
+ * in the Gtk thread, the whole application would freeze with it.
+ * To prevent that, such calls are run in a worker thread, while the
+ * caller waits for a limited amount of time. If the deadline is reached,
+ * the job is abandoned: the worker thread will clean up by itself whenever
+ * the call returns, if it ever does. The device is then quarantined, so
+ * that we don't try to use it again before some time.
  */
 
-struct alsa_card_iter {
-	int number;
-	char *name;
-	char *hctl;
+#define WATCHDOG_DEFAULT_TIMEOUT 3000	/* ms */
+#define QUARANTINE_MIN_BACKOFF   5000	/* ms */
+#define QUARANTINE_MAX_BACKOFF   300000	/* ms */
+
+typedef gint (*WatchdogFunc) (gpointer data);
+
+struct watchdog_job {
+	gint refcount; /* Shared between the caller and the worker, atomic */
+	/* Work to do */
+	WatchdogFunc func;
+	gpointer data;
+	GDestroyNotify cleanup; /* Invoked by the worker if the job was abandoned */
+	/* Synchronization */
+	GMutex mutex;
+	GCond cond;
+	gboolean done;
+	gboolean abandoned;
+	gint result;
 };
 
-typedef struct alsa_card_iter AlsaCardIter;
+typedef struct watchdog_job WatchdogJob;
 
-/* Free an iterator */
+struct quarantine {
+	gint64 until; /* Monotonic time, in microseconds */
+	guint backoff; /* Next backoff, in milliseconds */
+};
+
+typedef struct quarantine Quarantine;
+
+static guint watchdog_timeout = WATCHDOG_DEFAULT_TIMEOUT;
+static GThreadPool *watchdog_pool;
+static GHashTable *quarantined;
+
+/* Drop a reference on a job, free it when nobody holds it anymore */
 static void
-alsa_card_iter_free(AlsaCardIter *iter)
+watchdog_job_unref(WatchdogJob *job)
 {
-	if (iter == NULL)
+	if (!g_atomic_int_dec_and_test(&job->refcount))
 		return;
 
-	g_free(iter->name);
-	g_free(iter->hctl);
-	g_free(iter);
+	g_mutex_clear(&job->mutex);
+	g_cond_clear(&job->cond);
+	g_free(job);
 }
 
-/* Create a new iterator */
-static AlsaCardIter *
-alsa_card_iter_new(void)
+/* Run a job in a worker thread, and notify the caller when done */
+static void
+watchdog_worker(WatchdogJob *job, G_GNUC_UNUSED gpointer user_data)
 {
-	AlsaCardIter *iter;
+	gboolean abandoned;
+	gint result;
 
-	iter = g_new0(AlsaCardIter, 1);
-	iter->number = -2;
+	result = job->func(job->data);
 
-	return iter;
+	g_mutex_lock(&job->mutex);
+	job->result = result;
+	job->done = TRUE;
+	abandoned = job->abandoned;
+	g_cond_signal(&job->cond);
+	g_mutex_unlock(&job->mutex);
+
+	/* Nobody's waiting for us anymore, so we're in charge of the cleanup */
+	if (abandoned && job->cleanup)
+		job->cleanup(job->data);
+
+	watchdog_job_unref(job);
 }
 
-/* Iterate over alsa cards. Return TRUE as long as there is a card,
- * and FALSE when there's no more card.
- * After it returned FALSE, the iterator shouldn't be used anymore and
- * should be freed.
- */
+/* Check whether a device is quarantined. Return TRUE if it is. */
 static gboolean
-alsa_card_iter_loop(AlsaCardIter *iter)
+quarantine_check(const char *hctl)
 {
-	int err;
-
-	/* Free iter data at first */
-	g_free(iter->name);
-	iter->name = NULL;
-	g_free(iter->hctl);
-	iter->hctl = NULL;
-
-	/* First elem is the default alsa soundcard.
-	 * It's not really reachable as it with the ALSA API,
-	 * so we must add it manually here.
-	 */
-	if (iter->number == -2) {
-		iter->number = -1;
-		iter->name = g_strdup(ALSA_DEFAULT_CARD);
-		iter->hctl = g_strdup(ALSA_DEFAULT_HCTL);
-		return TRUE;
-	}
+	Quarantine *q;
+	gint64 now;
 
-	/* Get next alsa soundcard */
-	err = snd_card_next(&iter->number);
-	if (err < 0) {
-		ALSA_ERR(err, "Can't enumerate sound cards");
+	if (quarantined == NULL)
 		return FALSE;
-	}
 
-	/* No more soundcards ? */
-	if (iter->number < 0)
+	q = g_hash_table_lookup(quarantined, hctl);
+	if (q == NULL)
 		return FALSE;
 
-	/* Get card name */
-	err = snd_card_get_name(iter->number, &(iter->name));
-	if (err < 0) {
-		ALSA_ERR(err, "Can't get card name");
+	now = g_get_monotonic_time();
+	if (now >= q->until)
 		return FALSE;
-	}
 
-	/* Get HCTL name */
-	iter->hctl = g_strdup_printf("hw:%d", iter->number);
+	ALSA_CARD_DEBUG(hctl, "Quarantined for %ld more ms",
+	                (long) ((q->until - now) / 1000));
 
 	return TRUE;
 }
 
-/*
- * Alsa poll descriptors handling with GIO.
+/* Put a device in quarantine. The duration of the quarantine doubles
+ * each time the device hangs again.
  */
-
-/* Start watching the poll descriptors provided in the input array */
-static guint *
-watch_poll_descriptors(const char *hctl, struct pollfd *pollfds,
-                       GIOFunc func, gpointer data)
+static void
+quarantine_add(const char *hctl)
 {
-	int nfds, i;
-	guint *watch_ids;
-
-	/* Count the number of poll file descriptors */
-	nfds = i = 0;
-	while (pollfds[i++].fd != -1)
-		nfds++;
+	Quarantine *q;
 
-	/* Allocate a zero-termintated array to hold the watch ids */
-	watch_ids = g_new0(guint, nfds + 1);
-
-	/* Watch every poll fd */
-	for (i = 0; i < nfds; i++) {
-		GIOChannel *gioc;
+	if (quarantined == NULL)
+		quarantined = g_hash_table_new_full(g_str_hash, g_str_equal,
+		                                    g_free, g_free);
 
-		gioc = g_io_channel_unix_new(pollfds[i].fd);
-		watch_ids[i] = g_io_add_watch(gioc, G_IO_IN | G_IO_ERR, func, data);
-		g_io_channel_unref(gioc);
+	q = g_hash_table_lookup(quarantined, hctl);
+	if (q == NULL) {
+		q = g_new0(Quarantine, 1);
+		q->backoff = QUARANTINE_MIN_BACKOFF;
+		g_hash_table_insert(quarantined, g_strdup(hctl), q);
 	}
 
-	ALSA_CARD_DEBUG(hctl, "%d poll descriptors are now watched", nfds);
+	ALSA_CARD_WARN(hctl, "Device hung, quarantined for %u ms", q->backoff);
 
-	return watch_ids;
+	q->until = g_get_monotonic_time() + (gint64) q->backoff * 1000;
+	q->backoff = MIN(q->backoff * 2, QUARANTINE_MAX_BACKOFF);
 }
 
-/* Stop watching poll descriptors */
+/* Release a device from quarantine, after it behaved well */
 static void
-unwatch_poll_descriptors(guint *watch_ids)
+quarantine_remove(const char *hctl)
 {
-	int i;
+	if (quarantined == NULL)
+		return;
 
-	for (i = 0; watch_ids[i] != 0; i++) {
-		g_source_remove(watch_ids[i]);
-		watch_ids[i] = 0;
+	g_hash_table_remove(quarantined, hctl);
+}
+
+/* Run a function under the watchdog.
+ * Return TRUE if the function returned in time, in which case its
+ * return value is stored in 'result'. Return FALSE if the deadline was
+ * reached. In such case, the job is abandoned, the device is quarantined,
+ * and 'cleanup' will be invoked on 'data' from the worker thread,
+ * whenever the function returns.
+ */
+static gboolean
+watchdog_run(const char *hctl, const char *what, WatchdogFunc func,
+             gpointer data, GDestroyNotify cleanup, gint *result)
+{
+	WatchdogJob *job;
+	GError *error = NULL;
+	gint64 deadline;
+	gboolean done;
+
+	/* Create the pool on first use */
+	if (watchdog_pool == NULL) {
+		watchdog_pool = g_thread_pool_new((GFunc) watchdog_worker, NULL,
+		                                  -1, FALSE, &error);
+		if (watchdog_pool == NULL) {
+			ALSA_CARD_WARN(hctl, "Can't create watchdog thread pool: %s",
+			               error->message);
+			g_error_free(error);
+			*result = func(data);
+			return TRUE;
+		}
 	}
+
+	job = g_new0(WatchdogJob, 1);
+	job->refcount = 2; /* One for us, one for the worker */
+	job->func = func;
+	job->data = data;
+	job->cleanup = cleanup;
+	g_mutex_init(&job->mutex);
+	g_cond_init(&job->cond);
+
+	/* Hand the job over to a worker thread */
+	if (!g_thread_pool_push(watchdog_pool, job, &error)) {
+		ALSA_CARD_WARN(hctl, "Can't start watchdog job: %s", error->message);
+		g_error_free(error);
+		watchdog_job_unref(job);
+		watchdog_job_unref(job);
+		*result = func(data);
+		return TRUE;
+	}
+
+	/* Wait for it */
+	deadline = g_get_monotonic_time() + (gint64) watchdog_timeout * 1000;
+
+	g_mutex_lock(&job->mutex);
+	while (!job->done)
+		if (!g_cond_wait_until(&job->cond, &job->mutex, deadline))
+			break;
+	done = job->done;
+	if (done)
+		*result = job->result;
+	else
+		job->abandoned = TRUE;
+	g_mutex_unlock(&job->mutex);
+
+	watchdog_job_unref(job);
+
+	if (!done) {
+		ALSA_CARD_WARN(hctl, "%s didn't return after %u ms, giving up",
+		               what, watchdog_timeout);
+		quarantine_add(hctl);
+	}
+
+	return done;
 }
 
 /*
- * Public functions & signal handling
+ * Alsa mixer handling (deals with 'snd_mixer_t').
  */
 
-struct alsa_card {
-	gboolean normalize; /* Whether we work with normalized volume */
-	/* Card names */
-	char *name; /* Real card name like 'HDA Intel PCH' */
-	char *hctl; /* HTCL device name, like 'hw:0' */
-	/* Alsa data pointers */
-	snd_mixer_t *mixer; /* Alsa mixer */
-	snd_mixer_elem_t *mixer_elem; /* Alsa mixer elem */
-	/* Gio watch ids */
-	guint *watch_ids;
-	/* User callback, to notify when something happens */
-	AlsaCb cb_func;
-	gpointer cb_data;
-};
-
-/**
- * Callback function for volume changes.
- * We forward changes to higher level, through a callback mechanism again.
- *
- * @param source the GIOChannel event source.
- * @param condition the condition which has been satisfied.
- * @param card data set in g_io_add_watch().
- * @return FALSE if the event source should be removed.
+/* Get poll descriptors in a dynamic array (must be freed).
+ * The array is terminated by a fd set to -1.
  */
-static gboolean
-poll_watch_cb(GIOChannel *source, GIOCondition condition, AlsaCard *card)
+static struct pollfd *
+mixer_get_poll_descriptors(const char *hctl, snd_mixer_t *mixer)
 {
-	gchar sbuf[256];
-	gsize sread = 1;
-	AlsaCb callback = card->cb_func;
-	gpointer data = card->cb_data;
-
-	// DEBUG("Entering %s()", __func__);
+	int err, count;
+	struct pollfd *fds;
 
-	/* Handle pending mixer events.
-	 * Everything is broken if we don't do that !
-	 */
-	snd_mixer_handle_events(card->mixer);
+	/* Get the number of poll descriptors. Afaik, it's always one. */
+	count = snd_mixer_poll_descriptors_count(mixer);
 
-	/* Check if the soundcard has been unplugged. In such case,
-	 * the file descriptor we're watching disappeared, causing a G_IO_ERR.
-	 */
-	if (condition == G_IO_ERR) {
-		if (callback)
-			callback(ALSA_CARD_DISCONNECTED, data);
-		return FALSE;
+	/* Get the poll descriptors in a dynamic array */
+	fds = g_new0(struct pollfd, count + 1);
+	err = snd_mixer_poll_descriptors(mixer, fds, count);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Couldn't get poll descriptors");
+		return NULL;
 	}
 
-	/* Now read data from channel */
-	sread = 1;
-	while (sread) {
-		GIOStatus stat;
+	/* Terminate the array with a fd set to -1 */
+	fds[count].fd = -1;
 
-		/* This handles the case where mixer_elem_cb() doesn't read all
-		 * the data on source. If we don't clear it out we'll go into an infinite
-		 * callback loop since there will be data on the channel forever.
-		 */
-		stat = g_io_channel_read_chars(source, sbuf, 256, &sread, NULL);
+	return fds;
+}
 
-		switch (stat) {
-		case G_IO_STATUS_AGAIN:
-			/* Normal, means alsa_cb cleared out the channel */
-			continue;
+/* Get the list of playable channels */
+static GSList *
+mixer_list_playable(G_GNUC_UNUSED const char *hctl, snd_mixer_t *mixer)
+{
+	GSList *list = NULL;
+	snd_mixer_elem_t *elem = NULL;
 
-		case G_IO_STATUS_NORMAL:
-			/* Actually bad, alsa failed to clear channel */
-			ERROR("Alsa failed to clear the channel");
-			if (callback)
-				callback(ALSA_CARD_ERROR, data);
-			break;
+	elem = snd_mixer_first_elem(mixer);
+	while (elem) {
+		if (snd_mixer_selem_has_playback_volume(elem)) {
+			const char *chan_name = snd_mixer_selem_get_name(elem);
+			list = g_slist_append(list, g_strdup(chan_name));
+		}
+		elem = snd_mixer_elem_next(elem);
+	}
 
-		case G_IO_STATUS_ERROR:
-		case G_IO_STATUS_EOF:
-			ERROR("GIO error has occurred");
-			if (callback)
-				callback(ALSA_CARD_ERROR, data);
-			break;
+	return list;
+}
 
-		default:
-			WARN("Unknown status from g_io_channel_read_chars()");
-		}
+/* Return TRUE if the mixer has at least one playable channel, FALSE otherwise */
+static gboolean
+mixer_is_playable(const char *hctl, snd_mixer_t *mixer)
+{
+	GSList *playable_chans;
 
+	playable_chans = mixer_list_playable(hctl, mixer);
+	if (playable_chans) {
+		g_slist_free_full(playable_chans, g_free);
 		return TRUE;
 	}
 
-	/* Arriving here, no errors happened.
-	 * We can safely notify that values changed.
-	 */
-	if (callback)
-		callback(ALSA_CARD_VALUES_CHANGED, data);
-
-	return TRUE;
+	return FALSE;
 }
 
-/**
- * Get the name of the card.
- * This is an internal string that shouldn't be modified.
- *
- * @param card a Card instance.
- * @return the name of the card.
- */
-const char *
-alsa_card_get_name(AlsaCard *card)
+/* Get a playable mixer element by name */
+static snd_mixer_elem_t *
+mixer_get_playable_elem(const char *hctl, snd_mixer_t *mixer, const char *channel)
 {
-	return card->name;
-}
+	snd_mixer_elem_t *elem;
+	snd_mixer_selem_id_t *sid;
 
-/**
- * Get the name of the channel.
- * This is an internal string that shouldn't be modified.
+	if (!channel)
+		return NULL;
+
+	ALSA_CARD_DEBUG(hctl, "Looking for playable mixer element '%s'", channel);
+
+	/* Find the mixer element */
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_name(sid, channel);
+	elem = snd_mixer_find_selem(mixer, sid);
+	if (elem == NULL) {
+		ALSA_CARD_WARN(hctl, "Can't find mixer element '%s'", channel);
+		return NULL;
+	}
+
+	/* Check that it's playable */
+	if (!snd_mixer_selem_has_playback_volume(elem)) {
+		ALSA_CARD_WARN(hctl, "Mixer element '%s' is not playable", channel);
+		return NULL;
+	}
+
+	return elem;
+}
+
+/* Get the first playable mixer element */
+static snd_mixer_elem_t *
+mixer_get_first_playable_elem(const char *hctl, snd_mixer_t *mixer)
+{
+	snd_mixer_elem_t *elem;
+
+	ALSA_CARD_DEBUG(hctl, "Looking for the first playable mixer element...");
+
+	/* Iterate on mixer elements, get the first playable */
+	elem = snd_mixer_first_elem(mixer);
+	while (elem) {
+		if (snd_mixer_selem_has_playback_volume(elem))
+			break;
+		elem = snd_mixer_elem_next(elem);
+	}
+
+	if (elem == NULL) {
+		ALSA_CARD_DEBUG(hctl, "No playable mixer element found");
+		return NULL;
+	}
+
+	return elem;
+}
+
+/* Check whether an element can be used for capture */
+static gboolean
+elem_is_capturable(snd_mixer_elem_t *elem)
+{
+	return snd_mixer_selem_has_capture_volume(elem) ||
+	       snd_mixer_selem_has_capture_switch(elem);
+}
+
+/* Get the list of capturable channels */
+static GSList *
+mixer_list_capturable(G_GNUC_UNUSED const char *hctl, snd_mixer_t *mixer)
+{
+	GSList *list = NULL;
+	snd_mixer_elem_t *elem;
+
+	for (elem = snd_mixer_first_elem(mixer); elem; elem = snd_mixer_elem_next(elem))
+		if (elem_is_capturable(elem))
+			list = g_slist_append(list, g_strdup(snd_mixer_selem_get_name(elem)));
+
+	return list;
+}
+
+/* Get a capturable mixer element by name, quietly */
+static snd_mixer_elem_t *
+mixer_get_capture_elem(const char *hctl, snd_mixer_t *mixer, const char *channel)
+{
+	snd_mixer_elem_t *elem;
+	snd_mixer_selem_id_t *sid;
+
+	if (!channel)
+		return NULL;
+
+	ALSA_CARD_DEBUG(hctl, "Looking for capture mixer element '%s'", channel);
+
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_name(sid, channel);
+	elem = snd_mixer_find_selem(mixer, sid);
+	if (elem == NULL || !elem_is_capturable(elem))
+		return NULL;
+
+	return elem;
+}
+
+/* Get the first capturable mixer element. Elements with a capture
+ * volume are preferred, they're usually the ones controlling the
+ * whole capture path, like 'Capture'.
+ */
+static snd_mixer_elem_t *
+mixer_get_first_capture_elem(const char *hctl, snd_mixer_t *mixer)
+{
+	snd_mixer_elem_t *elem, *fallback = NULL;
+
+	ALSA_CARD_DEBUG(hctl, "Looking for the first capture mixer element...");
+
+	for (elem = snd_mixer_first_elem(mixer); elem; elem = snd_mixer_elem_next(elem)) {
+		if (snd_mixer_selem_has_capture_volume(elem))
+			return elem;
+		if (fallback == NULL && snd_mixer_selem_has_capture_switch(elem))
+			fallback = elem;
+	}
+
+	if (fallback == NULL)
+		ALSA_CARD_DEBUG(hctl, "No capture mixer element found");
+
+	return fallback;
+}
+
+/* Close a mixer */
+static void
+mixer_close(const char *hctl, snd_mixer_t *mixer)
+{
+	int err;
+
+	ALSA_CARD_DEBUG(hctl, "Closing mixer");
+
+	snd_mixer_free(mixer);
+
+	err = snd_mixer_detach(mixer, hctl);
+	if (err < 0)
+		ALSA_CARD_ERR(hctl, err, "Can't detach mixer");
+
+	err = snd_mixer_close(mixer);
+	if (err < 0)
+		ALSA_CARD_ERR(hctl, err, "Can't close mixer");
+}
+
+/* Open a mixer, may block */
+static snd_mixer_t *
+mixer_open_blocking(const char *hctl)
+{
+	int err;
+	snd_mixer_t *mixer = NULL;
+
+	ALSA_CARD_DEBUG(hctl, "Opening mixer");
+
+	err = snd_mixer_open(&mixer, 0);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't open mixer");
+		return NULL;
+	}
+
+	err = snd_mixer_attach(mixer, hctl);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't attach card to mixer");
+		goto failure;
+	}
+
+	err = snd_mixer_selem_register(mixer, NULL, NULL);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't register mixer simple element");
+		goto failure;
+	}
+
+	err = snd_mixer_load(mixer);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't load mixer elements");
+		goto failure;
+	}
+
+	return mixer;
+
+failure:
+	snd_mixer_close(mixer);
+	return NULL;
+}
+
+/* Mixer jobs, to be run under the watchdog */
+
+struct mixer_job {
+	char *hctl;
+	snd_mixer_t *mixer;
+	/* Element write. Everything is copied, as a job that hangs
+	 * outlives the card that started it.
+	 */
+	snd_mixer_elem_t *elem;
+	double value;
+	int dir;
+	gboolean all; /* Write raws[0] to every channel */
+	guint n_channels;
+	snd_mixer_selem_channel_id_t channels[SND_MIXER_SCHN_LAST + 1];
+	long raws[SND_MIXER_SCHN_LAST + 1];
+	/* Jacks, a copy for the same reason */
+	struct card_jack *jacks;
+	guint n_jacks;
+};
+
+typedef struct mixer_job MixerJob;
+
+/* Free a mixer job. If the job still holds a mixer, it's closed. */
+static void
+mixer_job_free(MixerJob *job)
+{
+	if (job->mixer)
+		mixer_close(job->hctl, job->mixer);
+
+	g_free(job->jacks);
+	g_free(job->hctl);
+	g_free(job);
+}
+
+/* Create a new mixer job */
+static MixerJob *
+mixer_job_new(const char *hctl, snd_mixer_t *mixer)
+{
+	MixerJob *job;
+
+	job = g_new0(MixerJob, 1);
+	job->hctl = g_strdup(hctl);
+	job->mixer = mixer;
+
+	return job;
+}
+
+static gint
+mixer_job_open(MixerJob *job)
+{
+	job->mixer = mixer_open_blocking(job->hctl);
+	return job->mixer ? 0 : -1;
+}
+
+static gint
+mixer_job_handle_events(MixerJob *job)
+{
+	return snd_mixer_handle_events(job->mixer);
+}
+
+static gint
+mixer_job_set_volume(MixerJob *job)
+{
+	return elem_set_volume(job->hctl, job->elem, job->value, job->dir);
+}
+
+static gint
+mixer_job_set_volume_normalized(MixerJob *job)
+{
+	return elem_set_volume_normalized(job->hctl, job->elem, job->value, job->dir);
+}
+
+static gint
+mixer_job_set_raws(MixerJob *job)
+{
+	guint i;
+	int err;
+
+	if (job->all) {
+		err = snd_mixer_selem_set_playback_volume_all(job->elem, job->raws[0]);
+		if (err < 0) {
+			ALSA_CARD_ERR(job->hctl, err, "Can't set playback volume to %ld",
+			              job->raws[0]);
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	for (i = 0; i < job->n_channels; i++) {
+		err = snd_mixer_selem_set_playback_volume(job->elem, job->channels[i],
+		                                          job->raws[i]);
+		if (err < 0) {
+			ALSA_CARD_ERR(job->hctl, err, "Can't set playback volume to %ld",
+			              job->raws[i]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gint
+mixer_job_set_mute(MixerJob *job)
+{
+	return elem_set_mute(job->hctl, job->elem, job->value != 0);
+}
+
+static gint
+mixer_job_set_capture_volume(MixerJob *job)
+{
+	return elem_set_capture_volume(job->hctl, job->elem, job->value, job->dir);
+}
+
+static gint
+mixer_job_set_capture_mute(MixerJob *job)
+{
+	return elem_set_capture_mute(job->hctl, job->elem, job->value != 0);
+}
+
+/* Open a mixer, under the watchdog */
+static snd_mixer_t *
+mixer_open(const char *hctl)
+{
+	MixerJob *job;
+	snd_mixer_t *mixer;
+	gint result;
+
+	if (quarantine_check(hctl))
+		return NULL;
+
+	job = mixer_job_new(hctl, NULL);
+	if (!watchdog_run(hctl, "Opening mixer", (WatchdogFunc) mixer_job_open,
+	                  job, (GDestroyNotify) mixer_job_free, &result))
+		return NULL;
+
+	/* The job returned in time, so we own the mixer */
+	mixer = job->mixer;
+	job->mixer = NULL;
+	mixer_job_free(job);
+
+	if (mixer)
+		quarantine_remove(hctl);
+
+	return mixer;
+}
+
+/* Handle pending mixer events, under the watchdog.
+ * Return a negative error code on failure, as alsa does.
+ * If the call hung, -ETIMEDOUT is returned, and the ownership of the mixer
+ * is transferred to the watchdog. The mixer must not be used anymore,
+ * it will be closed whenever the hung call returns.
+ */
+static int
+mixer_handle_events(const char *hctl, snd_mixer_t *mixer)
+{
+	MixerJob *job;
+	gint result;
+
+	job = mixer_job_new(hctl, mixer);
+	if (!watchdog_run(hctl, "Handling mixer events",
+	                  (WatchdogFunc) mixer_job_handle_events,
+	                  job, (GDestroyNotify) mixer_job_free, &result))
+		return -ETIMEDOUT;
+
+	if (result < 0)
+		ALSA_CARD_ERR(hctl, result, "Can't handle mixer events");
+
+	job->mixer = NULL;
+	mixer_job_free(job);
+
+	return result;
+}
+
+/*
+ * Mixer pool.
+ * Opening a mixer and loading its elements is expensive, so mixers are
+ * not closed right away when they're released. Instead, they're kept
+ * in a pool, sorted from the most recently used to the least recently
+ * used, and reused later on. That makes switching between recently used
+ * cards instant. The same mixer may be used by several users at a time,
+ * idle mixers are closed when the pool grows bigger than its size.
+ */
+
+#define MIXER_POOL_DEFAULT_SIZE 4
+
+struct mixer_pool_entry {
+	char *hctl;
+	snd_mixer_t *mixer;
+	guint users;
+	/* Listeners of the mixer events, sharing a single watch */
+	GSList *listeners;
+	guint *watch_ids;
+};
+
+typedef struct mixer_pool_entry MixerPoolEntry;
+
+static GList *mixer_pool;
+static guint mixer_pool_size = MIXER_POOL_DEFAULT_SIZE;
+
+/* Remove an entry from the pool, closing its mixer if 'close' is TRUE */
+static void
+mixer_pool_remove(GList *link, gboolean close)
+{
+	MixerPoolEntry *entry = link->data;
+
+	if (close)
+		mixer_close(entry->hctl, entry->mixer);
+
+	mixer_pool = g_list_delete_link(mixer_pool, link);
+	g_slist_free_full(entry->listeners, g_free);
+	g_free(entry->watch_ids);
+	g_free(entry->hctl);
+	g_free(entry);
+}
+
+/* Close the least recently used idle mixers, until the pool fits its size */
+static void
+mixer_pool_trim(void)
+{
+	GList *link, *prev;
+	guint count;
+
+	count = g_list_length(mixer_pool);
+
+	for (link = g_list_last(mixer_pool); link && count > mixer_pool_size;
+	     link = prev) {
+		MixerPoolEntry *entry = link->data;
+
+		prev = link->prev;
+		if (entry->users > 0)
+			continue;
+
+		ALSA_CARD_DEBUG(entry->hctl, "Evicting mixer from the pool");
+		mixer_pool_remove(link, TRUE);
+		count--;
+	}
+}
+
+/* Find the pool entry for a given hctl */
+static GList *
+mixer_pool_find(const char *hctl)
+{
+	GList *link;
+
+	for (link = mixer_pool; link; link = link->next) {
+		MixerPoolEntry *entry = link->data;
+
+		if (!g_strcmp0(entry->hctl, hctl))
+			return link;
+	}
+
+	return NULL;
+}
+
+/* Find the pool entry for a given mixer */
+static GList *
+mixer_pool_find_mixer(snd_mixer_t *mixer)
+{
+	GList *link;
+
+	for (link = mixer_pool; link; link = link->next) {
+		MixerPoolEntry *entry = link->data;
+
+		if (entry->mixer == mixer)
+			return link;
+	}
+
+	return NULL;
+}
+
+/* Get a mixer from the pool, or open it if it's not there.
+ * Must be released with mixer_pool_release().
+ */
+static snd_mixer_t *
+mixer_pool_acquire(const char *hctl)
+{
+	MixerPoolEntry *entry;
+	snd_mixer_t *mixer;
+	GList *link;
+
+	link = mixer_pool_find(hctl);
+	if (link) {
+		entry = link->data;
+
+		/* An idle mixer missed some events, catch up with them.
+		 * If that fails, the card is probably gone.
+		 */
+		if (entry->users == 0) {
+			int err;
+
+			err = mixer_handle_events(hctl, entry->mixer);
+			if (err < 0) {
+				ALSA_CARD_DEBUG(hctl, "Pooled mixer is broken, dropping it");
+				mixer_pool_remove(link, err != -ETIMEDOUT);
+				link = NULL;
+			}
+		}
+	}
+
+	if (link) {
+		ALSA_CARD_DEBUG(hctl, "Reusing mixer from the pool");
+
+		/* Move it to the front */
+		mixer_pool = g_list_remove_link(mixer_pool, link);
+		mixer_pool = g_list_concat(link, mixer_pool);
+
+		entry->users++;
+		return entry->mixer;
+	}
+
+	mixer = mixer_open(hctl);
+	if (mixer == NULL)
+		return NULL;
+
+	entry = g_new0(MixerPoolEntry, 1);
+	entry->hctl = g_strdup(hctl);
+	entry->mixer = mixer;
+	entry->users = 1;
+	mixer_pool = g_list_prepend(mixer_pool, entry);
+
+	return mixer;
+}
+
+/* Give a mixer back to the pool */
+static void
+mixer_pool_release(const char *hctl, snd_mixer_t *mixer)
+{
+	MixerPoolEntry *entry;
+	GList *link;
+
+	link = mixer_pool_find_mixer(mixer);
+	if (link == NULL) {
+		ALSA_CARD_WARN(hctl, "Mixer not found in the pool");
+		mixer_close(hctl, mixer);
+		return;
+	}
+
+	entry = link->data;
+	entry->users--;
+
+	mixer_pool_trim();
+}
+
+/*
+ * Alsa card iterator.
+ * The Alsa API is really awkward when it comes to deal with cards
+ * and to get various informations from it.
+ * This iterator is here to make it less painful.
+ */
+
+struct alsa_card_iter {
+	int number;
+	char *name;
+	char *longname;
+	char *alsa_id;
+	char *hctl;
+};
+
+typedef struct alsa_card_iter AlsaCardIter;
+
+/* Free an iterator */
+static void
+alsa_card_iter_free(AlsaCardIter *iter)
+{
+	if (iter == NULL)
+		return;
+
+	g_free(iter->name);
+	g_free(iter->longname);
+	g_free(iter->alsa_id);
+	g_free(iter->hctl);
+	g_free(iter);
+}
+
+/* Create a new iterator */
+static AlsaCardIter *
+alsa_card_iter_new(void)
+{
+	AlsaCardIter *iter;
+
+	iter = g_new0(AlsaCardIter, 1);
+	iter->number = -2;
+
+	return iter;
+}
+
+/* Iterate over alsa cards. Return TRUE as long as there is a card,
+ * and FALSE when there's no more card.
+ * After it returned FALSE, the iterator shouldn't be used anymore and
+ * should be freed.
+ */
+static gboolean
+alsa_card_iter_loop(AlsaCardIter *iter)
+{
+	int err;
+	snd_ctl_t *ctl;
+	snd_ctl_card_info_t *info;
+
+	/* Free iter data at first */
+	g_free(iter->name);
+	iter->name = NULL;
+	g_free(iter->longname);
+	iter->longname = NULL;
+	g_free(iter->alsa_id);
+	iter->alsa_id = NULL;
+	g_free(iter->hctl);
+	iter->hctl = NULL;
+
+	/* First elem is the default alsa soundcard.
+	 * It's not really reachable as it with the ALSA API,
+	 * so we must add it manually here.
+	 */
+	if (iter->number == -2) {
+		iter->number = -1;
+		iter->name = g_strdup(ALSA_DEFAULT_CARD);
+		iter->longname = g_strdup(ALSA_DEFAULT_CARD);
+		iter->alsa_id = g_strdup(ALSA_DEFAULT_ID);
+		iter->hctl = g_strdup(ALSA_DEFAULT_HCTL);
+		return TRUE;
+	}
+
+	/* Get next alsa soundcard */
+	err = snd_card_next(&iter->number);
+	if (err < 0) {
+		ALSA_ERR(err, "Can't enumerate sound cards");
+		return FALSE;
+	}
+
+	/* No more soundcards ? */
+	if (iter->number < 0)
+		return FALSE;
+
+	/* Get HCTL name */
+	iter->hctl = g_strdup_printf("hw:%d", iter->number);
+
+	/* Get card names and id, all at once */
+	err = snd_ctl_open(&ctl, iter->hctl, 0);
+	if (err < 0) {
+		ALSA_CARD_ERR(iter->hctl, err, "Can't open control");
+		return FALSE;
+	}
+
+	snd_ctl_card_info_alloca(&info);
+	err = snd_ctl_card_info(ctl, info);
+	if (err < 0) {
+		ALSA_CARD_ERR(iter->hctl, err, "Can't get card info");
+		snd_ctl_close(ctl);
+		return FALSE;
+	}
+
+	iter->name = g_strdup(snd_ctl_card_info_get_name(info));
+	iter->longname = g_strdup(snd_ctl_card_info_get_longname(info));
+	iter->alsa_id = g_strdup(snd_ctl_card_info_get_id(info));
+	snd_ctl_close(ctl);
+
+	return TRUE;
+}
+
+/*
+ * Alsa card index.
+ * Card names are not unique (two identical USB DACs report the same name),
+ * so cards are identified by a stable id made of the alsa card id and the
+ * long name (which contains the bus path). Cards are indexed by this id
+ * in a hash table, so that finding a card doesn't require to go through
+ * every card. Secondary tables allow lookups by long name (the alsa card
+ * id may change depending on the plug order), and by display name, for
+ * compatibility with preferences that used to store it.
+ * The index is rebuilt when a lookup misses, or when an entry turns out
+ * to be stale.
+ */
+
+struct alsa_card_entry {
+	int number;
+	char *id;       /* Stable id, like 'PCH:HDA Intel PCH at 0xf7f10000 irq 32' */
+	char *name;     /* Display name, unique among cards */
+	char *longname; /* Long name, as reported by alsa */
+	char *hctl;     /* HCTL device name, like 'hw:0' */
+};
+
+typedef struct alsa_card_entry AlsaCardEntry;
+
+static GSList *card_index;            /* Entries, ordered by card number */
+static GHashTable *card_index_ids;    /* Id -> entry */
+static GHashTable *card_index_longnames; /* Long name -> entry */
+static GHashTable *card_index_names;  /* Display name -> entry */
+
+/* Free a card entry */
+static void
+card_entry_free(AlsaCardEntry *entry)
+{
+	if (entry == NULL)
+		return;
+
+	g_free(entry->id);
+	g_free(entry->name);
+	g_free(entry->longname);
+	g_free(entry->hctl);
+	g_free(entry);
+}
+
+/* Create a card entry from the current iterator position.
+ * Square brackets are not allowed in the id, since it's used as a group
+ * name in the preferences file.
+ */
+static AlsaCardEntry *
+card_entry_new(AlsaCardIter *iter)
+{
+	AlsaCardEntry *entry;
+
+	entry = g_new0(AlsaCardEntry, 1);
+	entry->number = iter->number;
+	entry->longname = g_strdup(iter->longname);
+	entry->hctl = g_strdup(iter->hctl);
+
+	if (iter->number < 0)
+		entry->id = g_strdup(iter->alsa_id);
+	else
+		entry->id = g_strdup_printf("%s:%s", iter->alsa_id, iter->longname);
+	g_strdelimit(entry->id, "[]", '_');
+
+	return entry;
+}
+
+/* Empty the card index */
+static void
+card_index_clear(void)
+{
+	if (card_index_ids == NULL)
+		return;
+
+	g_hash_table_remove_all(card_index_names);
+	g_hash_table_remove_all(card_index_longnames);
+	g_hash_table_remove_all(card_index_ids);
+	g_slist_free_full(card_index, (GDestroyNotify) card_entry_free);
+	card_index = NULL;
+}
+
+/* Build the card index from scratch */
+static void
+card_index_build(void)
+{
+	AlsaCardIter *iter;
+	GHashTable *dups;
+	GSList *item;
+
+	if (card_index_ids == NULL) {
+		card_index_ids = g_hash_table_new(g_str_hash, g_str_equal);
+		card_index_longnames = g_hash_table_new(g_str_hash, g_str_equal);
+		card_index_names = g_hash_table_new_full(g_str_hash, g_str_equal,
+		                                         g_free, NULL);
+	}
+
+	card_index_clear();
+
+	/* Count the cards sharing the same name */
+	dups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	iter = alsa_card_iter_new();
+	while (alsa_card_iter_loop(iter)) {
+		AlsaCardEntry *entry;
+		guint count;
+
+		entry = card_entry_new(iter);
+		if (g_hash_table_lookup(card_index_ids, entry->id)) {
+			ALSA_CARD_WARN(entry->hctl, "Duplicated card id '%s'", entry->id);
+			card_entry_free(entry);
+			continue;
+		}
+
+		card_index = g_slist_append(card_index, entry);
+		g_hash_table_insert(card_index_ids, entry->id, entry);
+		g_hash_table_insert(card_index_longnames, entry->longname, entry);
+
+		count = GPOINTER_TO_UINT(g_hash_table_lookup(dups, iter->name));
+		g_hash_table_insert(dups, g_strdup(iter->name), GUINT_TO_POINTER(count + 1));
+
+		/* Legacy lookups by name hit the first card with this name */
+		if (count == 0)
+			g_hash_table_insert(card_index_names, g_strdup(iter->name), entry);
+
+		/* Temporarily keep the alsa name, display names are set below */
+		entry->name = g_strdup(iter->name);
+	}
+	alsa_card_iter_free(iter);
+
+	/* Display names must be unique, the alsa card id is appended to
+	 * the name of cards that share the same name.
+	 */
+	for (item = card_index; item; item = item->next) {
+		AlsaCardEntry *entry = item->data;
+		char *alsa_id, *name;
+
+		if (GPOINTER_TO_UINT(g_hash_table_lookup(dups, entry->name)) < 2)
+			continue;
+
+		alsa_id = g_strndup(entry->id, strcspn(entry->id, ":"));
+		name = g_strdup_printf("%s (%s)", entry->name, alsa_id);
+		g_free(alsa_id);
+		g_free(entry->name);
+		entry->name = name;
+
+		g_hash_table_insert(card_index_names, g_strdup(entry->name), entry);
+	}
+
+	g_hash_table_destroy(dups);
+
+	DEBUG("Card index built, %u cards", g_slist_length(card_index));
+}
+
+/* Check that an entry still matches the card behind its number */
+static gboolean
+card_entry_is_valid(AlsaCardEntry *entry)
+{
+	char *longname;
+	gboolean valid;
+
+	if (entry->number < 0)
+		return TRUE;
+
+	if (snd_card_get_longname(entry->number, &longname) < 0)
+		return FALSE;
+
+	valid = !g_strcmp0(longname, entry->longname);
+	free(longname);
+
+	return valid;
+}
+
+/* Look for an entry in the index, without rebuilding it */
+static AlsaCardEntry *
+card_index_find(const char *card_id)
+{
+	AlsaCardEntry *entry;
+	const char *longname;
+
+	if (card_index_ids == NULL)
+		return NULL;
+
+	entry = g_hash_table_lookup(card_index_ids, card_id);
+	if (entry)
+		return entry;
+
+	/* The alsa card id may have changed, try with the long name */
+	longname = strchr(card_id, ':');
+	if (longname) {
+		entry = g_hash_table_lookup(card_index_longnames, longname + 1);
+		if (entry)
+			return entry;
+	}
+
+	return g_hash_table_lookup(card_index_names, card_id);
+}
+
+/* Look for a card, that can be given either by id or by display name.
+ * If the card can't be found, or if it's not the same card anymore,
+ * the index is rebuilt.
+ */
+static AlsaCardEntry *
+card_index_lookup(const char *card_id)
+{
+	AlsaCardEntry *entry;
+
+	if (card_id == NULL)
+		card_id = ALSA_DEFAULT_ID;
+
+	entry = card_index_find(card_id);
+	if (entry && card_entry_is_valid(entry))
+		return entry;
+
+	card_index_build();
+
+	return card_index_find(card_id);
+}
+
+/*
+ * Alsa poll descriptors handling with GIO.
+ */
+
+/* Start watching the poll descriptors provided in the input array */
+static guint *
+watch_poll_descriptors(const char *hctl, struct pollfd *pollfds,
+                       GIOFunc func, gpointer data)
+{
+	int nfds, i;
+	guint *watch_ids;
+
+	/* Count the number of poll file descriptors */
+	nfds = i = 0;
+	while (pollfds[i++].fd != -1)
+		nfds++;
+
+	/* Allocate a zero-termintated array to hold the watch ids */
+	watch_ids = g_new0(guint, nfds + 1);
+
+	/* Watch every poll fd */
+	for (i = 0; i < nfds; i++) {
+		GIOChannel *gioc;
+
+		gioc = g_io_channel_unix_new(pollfds[i].fd);
+		watch_ids[i] = g_io_add_watch(gioc, G_IO_IN | G_IO_ERR, func, data);
+		g_io_channel_unref(gioc);
+	}
+
+	ALSA_CARD_DEBUG(hctl, "%d poll descriptors are now watched", nfds);
+
+	return watch_ids;
+}
+
+/* Stop watching poll descriptors */
+static void
+unwatch_poll_descriptors(guint *watch_ids)
+{
+	int i;
+
+	for (i = 0; watch_ids[i] != 0; i++) {
+		g_source_remove(watch_ids[i]);
+		watch_ids[i] = 0;
+	}
+}
+
+/*
+ * Mixer listeners.
+ * Several users of a pooled mixer, like the elements of a control group
+ * that live on the same card, share a single watch of its descriptors.
+ * The mixer events are handled once, then every listener is told.
+ * Some listeners, like the output monitor, have their own way to know
+ * about events, and don't need the watch. They just must not handle the
+ * events behind the back of the other ones.
+ */
+
+enum mixer_event {
+	MIXER_CHANGED, /* The elements are up to date */
+	MIXER_ERROR,   /* The descriptors couldn't be cleared */
+	MIXER_GONE,    /* The device disappeared */
+	MIXER_LOST     /* Lost to the watchdog, it must not be used anymore */
+};
+
+typedef void (*MixerListenerFunc) (enum mixer_event event, gpointer data);
+
+struct mixer_listener {
+	MixerListenerFunc func;
+	gpointer data;
+	gboolean watch; /* Needs the descriptors to be watched */
+};
+
+typedef struct mixer_listener MixerListener;
+
+/* Get the pool entry of a mixer, NULL if it's not in the pool anymore */
+static MixerPoolEntry *
+mixer_pool_get_entry(snd_mixer_t *mixer)
+{
+	GList *link;
+
+	link = mixer_pool_find_mixer(mixer);
+	return link ? link->data : NULL;
+}
+
+/* Stop watching the descriptors of a mixer */
+static void
+mixer_pool_unwatch(MixerPoolEntry *entry)
+{
+	if (entry->watch_ids == NULL)
+		return;
+
+	unwatch_poll_descriptors(entry->watch_ids);
+	g_free(entry->watch_ids);
+	entry->watch_ids = NULL;
+}
+
+/* Tell every listener of a mixer about an event. The list is checked
+ * again before each call, since a listener may remove other ones.
+ * The entry is held meanwhile, so that it's not evicted from the pool.
+ */
+static void
+mixer_pool_notify(snd_mixer_t *mixer, enum mixer_event event)
+{
+	MixerPoolEntry *entry;
+	GSList *listeners, *item;
+
+	entry = mixer_pool_get_entry(mixer);
+	if (entry == NULL)
+		return;
+
+	entry->users++;
+	listeners = g_slist_copy(entry->listeners);
+
+	for (item = listeners; item; item = item->next) {
+		MixerListener *listener = item->data;
+
+		/* The mixer was lost in the meantime */
+		entry = mixer_pool_get_entry(mixer);
+		if (entry == NULL)
+			break;
+
+		if (g_slist_find(entry->listeners, listener))
+			listener->func(event, listener->data);
+	}
+
+	g_slist_free(listeners);
+
+	entry = mixer_pool_get_entry(mixer);
+	if (entry) {
+		entry->users--;
+		mixer_pool_trim();
+	}
+}
+
+/* Remove a mixer from the pool without closing it, once it's lost to
+ * the watchdog. Every listener is told to let go of it.
+ */
+static void
+mixer_pool_lose(snd_mixer_t *mixer)
+{
+	MixerPoolEntry *entry;
+	GList *link;
+	GSList *item;
+
+	link = mixer_pool_find_mixer(mixer);
+	if (link == NULL)
+		return;
+
+	entry = link->data;
+	mixer_pool_unwatch(entry);
+
+	for (item = entry->listeners; item; item = item->next) {
+		MixerListener *listener = item->data;
+
+		listener->func(MIXER_LOST, listener->data);
+	}
+
+	mixer_pool_remove(link, FALSE);
+}
+
+/* Callback function for the mixer descriptors */
+static gboolean
+mixer_pool_watch_cb(GIOChannel *source, GIOCondition condition,
+                    snd_mixer_t *mixer)
+{
+	MixerPoolEntry *entry;
+	enum mixer_event event = MIXER_CHANGED;
+	gchar sbuf[256];
+	gsize sread;
+	GIOStatus stat;
+
+	/* The mixer was lost while dispatching another descriptor */
+	entry = mixer_pool_get_entry(mixer);
+	if (entry == NULL)
+		return FALSE;
+
+	/* Handle pending mixer events.
+	 * Everything is broken if we don't do that !
+	 * If it hangs, the mixer is lost, so we act as if the card
+	 * had been unplugged.
+	 */
+	if (mixer_handle_events(entry->hctl, mixer) == -ETIMEDOUT) {
+		mixer_pool_lose(mixer);
+		return FALSE;
+	}
+
+	/* Check if the soundcard has been unplugged. In such case,
+	 * the file descriptor we're watching disappeared, causing a G_IO_ERR.
+	 * The other descriptors must not be dispatched anymore.
+	 */
+	if (condition == G_IO_ERR) {
+		mixer_pool_unwatch(entry);
+		mixer_pool_notify(mixer, MIXER_GONE);
+		return FALSE;
+	}
+
+	/* Now read data from channel.
+	 * This handles the case where the mixer doesn't read all the data
+	 * on source. If we don't clear it out we'll go into an infinite
+	 * callback loop since there will be data on the channel forever.
+	 */
+	stat = g_io_channel_read_chars(source, sbuf, sizeof sbuf, &sread, NULL);
+
+	switch (stat) {
+	case G_IO_STATUS_AGAIN:
+		/* Normal, means the mixer cleared out the channel */
+		break;
+
+	case G_IO_STATUS_NORMAL:
+		/* Actually bad, alsa failed to clear channel */
+		ERROR("Alsa failed to clear the channel");
+		event = MIXER_ERROR;
+		break;
+
+	case G_IO_STATUS_ERROR:
+	case G_IO_STATUS_EOF:
+		ERROR("GIO error has occurred");
+		event = MIXER_ERROR;
+		break;
+
+	default:
+		WARN("Unknown status from g_io_channel_read_chars()");
+		return TRUE;
+	}
+
+	mixer_pool_notify(mixer, event);
+
+	return TRUE;
+}
+
+/* Listen to the events of a pooled mixer. Its descriptors are watched
+ * as long as a listener needs it.
+ */
+static gboolean
+mixer_pool_listen(snd_mixer_t *mixer, MixerListenerFunc func, gpointer data,
+                  gboolean watch)
+{
+	MixerPoolEntry *entry;
+	MixerListener *listener;
+
+	entry = mixer_pool_get_entry(mixer);
+	if (entry == NULL)
+		return FALSE;
+
+	/* That's how we get notified from every volume/mute changes,
+	 * may it be external or due to PNMixer.
+	 */
+	if (watch && entry->watch_ids == NULL) {
+		struct pollfd *pollfds;
+
+		pollfds = mixer_get_poll_descriptors(entry->hctl, mixer);
+		if (pollfds == NULL)
+			return FALSE;
+
+		entry->watch_ids = watch_poll_descriptors
+		                   (entry->hctl, pollfds,
+		                    (GIOFunc) mixer_pool_watch_cb, mixer);
+		g_free(pollfds);
+	}
+
+	listener = g_new0(MixerListener, 1);
+	listener->func = func;
+	listener->data = data;
+	listener->watch = watch;
+	entry->listeners = g_slist_append(entry->listeners, listener);
+
+	return TRUE;
+}
+
+/* Stop listening to the events of a pooled mixer */
+static void
+mixer_pool_unlisten(snd_mixer_t *mixer, MixerListenerFunc func, gpointer data)
+{
+	MixerPoolEntry *entry;
+	GSList *item;
+
+	entry = mixer_pool_get_entry(mixer);
+	if (entry == NULL)
+		return;
+
+	for (item = entry->listeners; item; item = item->next) {
+		MixerListener *listener = item->data;
+
+		if (listener->func == func && listener->data == data) {
+			entry->listeners = g_slist_delete_link(entry->listeners, item);
+			g_free(listener);
+			break;
+		}
+	}
+
+	for (item = entry->listeners; item; item = item->next) {
+		MixerListener *listener = item->data;
+
+		if (listener->watch)
+			return;
+	}
+
+	mixer_pool_unwatch(entry);
+}
+
+/* Handle the events of a pooled mixer, unless it's watched, in which
+ * case the watch takes care of it. Either way, the listeners are told.
+ * Return a negative error code on failure, as alsa does.
+ */
+static int
+mixer_pool_handle_events(snd_mixer_t *mixer)
+{
+	MixerPoolEntry *entry;
+	int err;
+
+	entry = mixer_pool_get_entry(mixer);
+	if (entry == NULL)
+		return -ENODEV;
+
+	if (entry->watch_ids)
+		return 0;
+
+	err = mixer_handle_events(entry->hctl, mixer);
+	if (err == -ETIMEDOUT)
+		mixer_pool_lose(mixer);
+	if (err < 0)
+		return err;
+
+	mixer_pool_notify(mixer, MIXER_CHANGED);
+
+	return 0;
+}
+
+/*
+ * Jack-sense controls.
+ * HDA codecs expose a boolean control for each jack, like 'Headphone Jack'
+ * or 'Line Out Jack', that tells whether something is plugged. These
+ * controls live on the same control device as the mixer elements, so
+ * they come with the mixer, and we're notified of their changes through
+ * the poll descriptors we already watch.
+ */
+
+struct card_jack {
+	snd_hctl_elem_t *elem;
+	AlsaJack type;
+	gboolean plugged;
+};
+
+typedef struct card_jack CardJack;
+
+/* Guess the type of a jack from the name of its control */
+static AlsaJack
+jack_type_from_name(const char *name)
+{
+	if (strstr(name, "Headphone"))
+		return ALSA_JACK_HEADPHONE;
+	if (strstr(name, "Line Out"))
+		return ALSA_JACK_LINE_OUT;
+	if (strstr(name, "Speaker"))
+		return ALSA_JACK_SPEAKER;
+	return ALSA_JACK_OTHER;
+}
+
+/* Read the state of a jack */
+static gboolean
+jack_read(snd_hctl_elem_t *elem)
+{
+	snd_ctl_elem_value_t *value;
+
+	snd_ctl_elem_value_alloca(&value);
+
+	if (snd_hctl_elem_read(elem, value) < 0)
+		return FALSE;
+
+	return snd_ctl_elem_value_get_boolean(value, 0) ? TRUE : FALSE;
+}
+
+/* Find the jack-sense controls of a mixer.
+ * Returns a newly allocated array, or NULL if there's none.
+ */
+static CardJack *
+jacks_find(const char *hctl, snd_mixer_t *mixer, guint *n_jacks)
+{
+	snd_hctl_t *handle;
+	snd_hctl_elem_t *elem;
+	GArray *jacks;
+	int err;
+
+	*n_jacks = 0;
+
+	err = snd_mixer_get_hctl(mixer, hctl, &handle);
+	if (err < 0) {
+		ALSA_CARD_ERR(hctl, err, "Can't get hctl");
+		return NULL;
+	}
+
+	jacks = g_array_new(FALSE, FALSE, sizeof(CardJack));
+	for (elem = snd_hctl_first_elem(handle); elem; elem = snd_hctl_elem_next(elem)) {
+		const char *name = snd_hctl_elem_get_name(elem);
+		CardJack jack;
+
+		if (snd_hctl_elem_get_interface(elem) != SND_CTL_ELEM_IFACE_CARD)
+			continue;
+		if (!g_str_has_suffix(name, " Jack"))
+			continue;
+
+		jack.elem = elem;
+		jack.type = jack_type_from_name(name);
+		jack.plugged = jack_read(elem);
+		g_array_append_val(jacks, jack);
+
+		ALSA_CARD_DEBUG(hctl, "Jack '%s' is %s", name,
+		                jack.plugged ? "plugged" : "unplugged");
+	}
+
+	*n_jacks = jacks->len;
+	return (CardJack *) g_array_free(jacks, jacks->len == 0);
+}
+
+/* Read the jacks again, return TRUE if one of them changed */
+static gboolean
+jacks_refresh(CardJack *jacks, guint n_jacks)
+{
+	gboolean changed = FALSE;
+	guint i;
+
+	for (i = 0; i < n_jacks; i++) {
+		gboolean plugged = jack_read(jacks[i].elem);
+
+		if (plugged == jacks[i].plugged)
+			continue;
+
+		jacks[i].plugged = plugged;
+		changed = TRUE;
+	}
+
+	return changed;
+}
+
+/* Check whether any of the jacks is plugged, as last read */
+static gboolean
+jacks_any_plugged(CardJack *jacks, guint n_jacks)
+{
+	guint i;
+
+	for (i = 0; i < n_jacks; i++)
+		if (jacks[i].plugged)
+			return TRUE;
+
+	return FALSE;
+}
+
+static gint
+mixer_job_find_jacks(MixerJob *job)
+{
+	job->jacks = jacks_find(job->hctl, job->mixer, &job->n_jacks);
+	return 0;
+}
+
+static gint
+mixer_job_refresh_jacks(MixerJob *job)
+{
+	return jacks_refresh(job->jacks, job->n_jacks);
+}
+
+/* Find the jacks of a mixer, under the watchdog, since reading them
+ * is an ioctl. Return FALSE if the call hung, in which case the mixer
+ * is lost to the job, and must not be used anymore.
+ */
+static gboolean
+jacks_find_watched(const char *hctl, snd_mixer_t *mixer, CardJack **jacks,
+                   guint *n_jacks)
+{
+	MixerJob *job;
+	gint result;
+
+	*jacks = NULL;
+	*n_jacks = 0;
+
+	job = mixer_job_new(hctl, mixer);
+	if (!watchdog_run(hctl, "Reading jacks", (WatchdogFunc) mixer_job_find_jacks,
+	                  job, (GDestroyNotify) mixer_job_free, &result)) {
+		mixer_pool_lose(mixer);
+		return FALSE;
+	}
+
+	*jacks = job->jacks;
+	*n_jacks = job->n_jacks;
+	job->jacks = NULL;
+	job->mixer = NULL;
+	mixer_job_free(job);
+
+	return TRUE;
+}
+
+/* Read the jacks again under the watchdog, return TRUE if one of them
+ * changed. The job works on a copy, that's brought back if it returned
+ * in time. If it hung, the mixer is lost, and its listeners are told so.
+ */
+static gboolean
+jacks_refresh_watched(const char *hctl, snd_mixer_t *mixer, CardJack *jacks,
+                      guint n_jacks)
+{
+	MixerJob *job;
+	gint result;
+
+	if (n_jacks == 0)
+		return FALSE;
+
+	job = mixer_job_new(hctl, mixer);
+	job->jacks = g_new(CardJack, n_jacks);
+	job->n_jacks = n_jacks;
+	memcpy(job->jacks, jacks, n_jacks * sizeof(CardJack));
+
+	if (!watchdog_run(hctl, "Reading jacks", (WatchdogFunc) mixer_job_refresh_jacks,
+	                  job, (GDestroyNotify) mixer_job_free, &result)) {
+		mixer_pool_lose(mixer);
+		return FALSE;
+	}
+
+	memcpy(jacks, job->jacks, n_jacks * sizeof(CardJack));
+	job->mixer = NULL;
+	mixer_job_free(job);
+
+	return result;
+}
+
+/*
+ * Public functions & signal handling
+ */
+
+struct alsa_card {
+	AlsaCurve curve; /* Volume curve */
+	/* Card names */
+	char *id; /* Stable card id, see the card index */
+	char *name; /* Display card name like 'HDA Intel PCH' */
+	char *hctl; /* HTCL device name, like 'hw:0' */
+	/* Alsa data pointers */
+	snd_mixer_t *mixer; /* Alsa mixer */
+	snd_mixer_elem_t *mixer_elem; /* Alsa mixer elem */
+	ElemMap *elem_map; /* Volume curve mapping table */
+	/* Jack-sense controls */
+	CardJack *jacks;
+	guint n_jacks;
+	/* Playback channels */
+	snd_mixer_selem_channel_id_t channels[SND_MIXER_SCHN_LAST + 1];
+	guint n_channels;
+	long raws[SND_MIXER_SCHN_LAST + 1]; /* Last known raw volumes */
+	double gains[SND_MIXER_SCHN_LAST + 1]; /* Levels relative to the loudest */
+	/* Last known playback state, to classify events */
+	gboolean playback_muted;
+	long playback_raws[SND_MIXER_SCHN_LAST + 1];
+	/* Capture element, on the same mixer, and its last known state */
+	snd_mixer_elem_t *capture_elem;
+	gboolean capture_muted;
+	double capture_volume; /* Between 0 and 1 */
+	gboolean capture_written; /* Changed by us, the event is on its way */
+	/* Listening to the mixer */
+	gboolean listening;
+	guint lost_source; /* Reports a lost mixer */
+	/* User callback, to notify when something happens */
+	AlsaCb cb_func;
+	gpointer cb_data;
+};
+
+/* Read the playback state of the card, return TRUE if it changed
+ * since the last time. This is only used to classify events.
+ */
+static gboolean
+card_playback_refresh(AlsaCard *card)
+{
+	gboolean changed = FALSE;
+	gboolean muted;
+	long raw;
+	guint i;
+
+	elem_get_mute(card->hctl, card->mixer_elem, &muted);
+	if (muted != card->playback_muted) {
+		card->playback_muted = muted;
+		changed = TRUE;
+	}
+
+	for (i = 0; i < card->n_channels; i++) {
+		if (snd_mixer_selem_get_playback_volume(card->mixer_elem,
+		                                        card->channels[i], &raw) < 0)
+			continue;
+		if (raw != card->playback_raws[i]) {
+			card->playback_raws[i] = raw;
+			changed = TRUE;
+		}
+	}
+
+	return changed;
+}
+
+/* Report a lost mixer, from the main loop */
+static gboolean
+on_card_lost(AlsaCard *card)
+{
+	card->lost_source = 0;
+
+	if (card->cb_func)
+		card->cb_func(ALSA_CARD_DISCONNECTED, card->cb_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Create a job to write an element of the card's mixer */
+static MixerJob *
+card_write_job_new(AlsaCard *card, snd_mixer_elem_t *elem, double value, int dir)
+{
+	MixerJob *job;
+
+	job = mixer_job_new(card->hctl, card->mixer);
+	job->elem = elem;
+	job->value = value;
+	job->dir = dir;
+
+	return job;
+}
+
+/* Run a write job under the watchdog, so that the ioctl is made by a
+ * worker thread, and a device that hangs doesn't take the main loop
+ * with it. If it hangs, the mixer is lost to the job, along with every
+ * card using it.
+ * Return TRUE if the write succeeded.
+ */
+static gboolean
+card_write(AlsaCard *card, const char *what, WatchdogFunc func, MixerJob *job)
+{
+	gint result;
+
+	if (!watchdog_run(card->hctl, what, func, job,
+	                  (GDestroyNotify) mixer_job_free, &result)) {
+		mixer_pool_lose(card->mixer);
+		return FALSE;
+	}
+
+	job->mixer = NULL;
+	mixer_job_free(job);
+
+	return result;
+}
+
+/* Read the capture state of the card, return TRUE if it changed */
+static gboolean
+card_capture_refresh(AlsaCard *card)
+{
+	gboolean muted;
+	double volume;
+
+	if (card->capture_elem == NULL)
+		return FALSE;
+
+	elem_get_capture_mute(card->hctl, card->capture_elem, &muted);
+	elem_get_capture_volume(card->hctl, card->capture_elem, &volume);
+
+	if (muted == card->capture_muted && volume == card->capture_volume)
+		return FALSE;
+
+	card->capture_muted = muted;
+	card->capture_volume = volume;
+	return TRUE;
+}
+
+/**
+ * Callback function for the events of the card's mixer.
+ * We forward changes to higher level, through a callback mechanism again.
+ * A lost mixer can't be reported right away, since it may be lost in
+ * the middle of a call from the card's user, so that's done from the
+ * main loop.
+ *
+ * @param event the mixer event.
+ * @param data the card, set in mixer_pool_listen().
+ */
+static void
+on_card_mixer_event(enum mixer_event event, gpointer data)
+{
+	AlsaCard *card = (AlsaCard *) data;
+	gboolean jacks_changed, capture_changed, playback_changed;
+	AlsaCb callback = card->cb_func;
+	gpointer cb_data = card->cb_data;
+
+	switch (event) {
+	case MIXER_LOST:
+		card->mixer = NULL;
+		card->mixer_elem = NULL;
+		card->capture_elem = NULL;
+		card->listening = FALSE;
+		if (card->lost_source == 0)
+			card->lost_source = g_idle_add((GSourceFunc) on_card_lost, card);
+		return;
+
+	case MIXER_GONE:
+		if (callback)
+			callback(ALSA_CARD_DISCONNECTED, cb_data);
+		return;
+
+	case MIXER_ERROR:
+		if (callback)
+			callback(ALSA_CARD_ERROR, cb_data);
+		return;
+
+	case MIXER_CHANGED:
+		break;
+	}
+
+	/* Arriving here, no errors happened.
+	 * Jack and capture changes come on the same descriptors,
+	 * tell them apart. Anything else is reported as a change
+	 * of the playback values, like it has always been.
+	 */
+	jacks_changed = jacks_refresh_watched(card->hctl, card->mixer, card->jacks,
+	                                      card->n_jacks);
+	if (card->mixer == NULL)
+		return;
+
+	capture_changed = card_capture_refresh(card) || card->capture_written;
+	card->capture_written = FALSE;
+	playback_changed = card_playback_refresh(card);
+
+	if (!callback)
+		return;
+
+	if (jacks_changed)
+		callback(ALSA_CARD_JACKS_CHANGED, cb_data);
+
+	if (capture_changed)
+		callback(ALSA_CARD_CAPTURE_CHANGED, cb_data);
+
+	if (playback_changed || !(jacks_changed || capture_changed))
+		callback(ALSA_CARD_VALUES_CHANGED, cb_data);
+}
+
+/*
+ * Output monitor.
+ * Every playable card is watched, not only the hooked one, so that we
+ * always know the state of every output. Mixers come from the pool:
+ * they're kept open and up to date, and hooking another card is instant.
+ * Each card also has a control handle subscribed to its events. All the
+ * control handles go into a single epoll set, and the main loop only
+ * polls the epoll descriptor, whatever the number of cards.
+ * The outputs listen to their mixer, so that a mixer whose events are
+ * handled by a card, like the hooked one, is not drained behind its back.
+ * An output is available if it has no jack-sense control, or if at
+ * least one of them reports something plugged in (phantom jacks of
+ * internal speakers always do). The jacks are found and read the same
+ * way as the ones of the hooked card, from the mixer's hctl.
+ */
+
+#define OUTPUTS_MAX_EVENTS 16
+
+struct output_watch {
+	AlsaOutput output; /* Public part, must come first */
+	char *hctl;
+	snd_ctl_t *ctl;
+	snd_mixer_t *mixer;
+	snd_mixer_elem_t *elem;
+	ElemMap *map;
+	CardJack *jacks; /* Read like the ones of the hooked card */
+	guint n_jacks;
+	gboolean listening;
+	gboolean seen; /* Watched again since the last prune */
+	gboolean gone;
+};
+
+typedef struct output_watch OutputWatch;
+
+static GList *outputs;
+static GSource *outputs_source;
+static GPollFD outputs_pollfd = { -1, G_IO_IN, 0 };
+static gboolean outputs_pending; /* Changed from a mixer listener */
+static AlsaOutputsCb outputs_cb;
+static gpointer outputs_cb_data;
+
+/* Check whether something is plugged in any jack of an output */
+static gboolean
+output_watch_is_available(OutputWatch *watch)
+{
+	if (watch->n_jacks == 0)
+		return TRUE;
+
+	jacks_refresh_watched(watch->hctl, watch->mixer, watch->jacks,
+	                      watch->n_jacks);
+
+	/* The jacks went away with a lost mixer */
+	return watch->n_jacks == 0 || jacks_any_plugged(watch->jacks, watch->n_jacks);
+}
+
+/* Read the state of an output, return TRUE if it changed */
+static gboolean
+output_watch_refresh(OutputWatch *watch)
+{
+	snd_mixer_selem_channel_id_t channels[SND_MIXER_SCHN_LAST + 1];
+	ElemMap *map = watch->map;
+	double volume = 0;
+	gboolean muted, available;
+	guint i, n;
+
+	if (map) {
+		long raw, loudest = map->min;
+
+		n = elem_get_channels(watch->elem, channels);
+		for (i = 0; i < n; i++)
+			if (snd_mixer_selem_get_playback_volume(watch->elem, channels[i],
+			                                        &raw) >= 0)
+				loudest = MAX(loudest, raw);
+
+		loudest = CLAMP(loudest, map->min, map->max);
+		volume = map->norm[loudest - map->min];
+	} else {
+		elem_get_volume(watch->hctl, watch->elem, &volume);
+	}
+
+	elem_get_mute(watch->hctl, watch->elem, &muted);
+	volume *= 100;
+	available = output_watch_is_available(watch);
+
+	if (volume == watch->output.volume && muted == watch->output.muted &&
+	    available == watch->output.available)
+		return FALSE;
+
+	watch->output.volume = volume;
+	watch->output.muted = muted;
+	watch->output.available = available;
+	return TRUE;
+}
+
+/* Callback function for the events of an output's mixer */
+static void
+on_output_mixer_event(enum mixer_event event, gpointer data)
+{
+	OutputWatch *watch = (OutputWatch *) data;
+
+	switch (event) {
+	case MIXER_CHANGED:
+		if (output_watch_refresh(watch))
+			outputs_pending = TRUE;
+		break;
+	case MIXER_LOST:
+		/* The jacks belonged to the mixer */
+		g_free(watch->jacks);
+		watch->jacks = NULL;
+		watch->n_jacks = 0;
+		watch->mixer = NULL;
+		watch->listening = FALSE;
+	/* Fall through */
+	case MIXER_GONE:
+		watch->gone = TRUE;
+		outputs_pending = TRUE;
+		break;
+	case MIXER_ERROR:
+		break;
+	}
+}
+
+/* Free an output watch. Closing the control handle removes
+ * its descriptors from the epoll set.
+ */
+static void
+output_watch_free(OutputWatch *watch)
+{
+	if (watch == NULL)
+		return;
+
+	if (watch->ctl)
+		snd_ctl_close(watch->ctl);
+	if (watch->listening)
+		mixer_pool_unlisten(watch->mixer, on_output_mixer_event, watch);
+	if (watch->mixer)
+		mixer_pool_release(watch->hctl, watch->mixer);
+	elem_map_free(watch->map);
+	g_free(watch->jacks);
+	g_free(watch->output.card_id);
+	g_free(watch->output.card);
+	g_free(watch->output.channel);
+	g_free(watch->hctl);
+	g_free(watch);
+}
+
+/* Start watching a card */
+static OutputWatch *
+output_watch_new(AlsaCardEntry *entry, const char *channel, AlsaCurve curve)
+{
+	OutputWatch *watch;
+	struct pollfd *pollfds;
+	int err, n, i;
+
+	watch = g_new0(OutputWatch, 1);
+	watch->output.card_id = g_strdup(entry->id);
+	watch->output.card = g_strdup(entry->name);
+	watch->hctl = g_strdup(entry->hctl);
+
+	/* Get the mixer and the element */
+	watch->mixer = mixer_pool_acquire(watch->hctl);
+	if (watch->mixer == NULL)
+		goto failure;
+
+	watch->elem = mixer_get_playable_elem(watch->hctl, watch->mixer, channel);
+	if (watch->elem == NULL)
+		watch->elem = mixer_get_first_playable_elem(watch->hctl, watch->mixer);
+	if (watch->elem == NULL)
+		goto failure;
+
+	watch->output.channel = g_strdup(elem_get_name(watch->elem));
+	watch->map = elem_map_new(watch->hctl, watch->elem, curve);
+
+	/* Our control events tell us when to look, no need for a mixer watch */
+	watch->listening = mixer_pool_listen(watch->mixer, on_output_mixer_event,
+	                                     watch, FALSE);
+
+	/* Subscribe to control events */
+	err = snd_ctl_open(&watch->ctl, watch->hctl, SND_CTL_NONBLOCK);
+	if (err < 0) {
+		ALSA_CARD_ERR(watch->hctl, err, "Can't open control");
+		watch->ctl = NULL;
+		goto failure;
+	}
+
+	err = snd_ctl_subscribe_events(watch->ctl, 1);
+	if (err < 0) {
+		ALSA_CARD_ERR(watch->hctl, err, "Can't subscribe to control events");
+		goto failure;
+	}
+
+	n = snd_ctl_poll_descriptors_count(watch->ctl);
+	pollfds = g_new0(struct pollfd, n);
+	n = snd_ctl_poll_descriptors(watch->ctl, pollfds, n);
+	for (i = 0; i < n; i++) {
+		struct epoll_event event = { .events = EPOLLIN, .data.ptr = watch };
+
+		if (epoll_ctl(outputs_pollfd.fd, EPOLL_CTL_ADD, pollfds[i].fd, &event) < 0)
+			ALSA_CARD_WARN(watch->hctl, "Can't watch control: %s",
+			               g_strerror(errno));
+	}
+	g_free(pollfds);
+
+	if (!jacks_find_watched(watch->hctl, watch->mixer, &watch->jacks,
+	                        &watch->n_jacks)) {
+		watch->mixer = NULL;
+		watch->listening = FALSE;
+		goto failure;
+	}
+
+	watch->output.volume = -1;
+	output_watch_refresh(watch);
+	watch->seen = TRUE;
+
+	ALSA_CARD_DEBUG(watch->hctl, "Output '%s' is now watched",
+	                watch->output.channel);
+
+	return watch;
+
+failure:
+	output_watch_free(watch);
+	return NULL;
+}
+
+/* Find the watch of a card */
+static GList *
+outputs_find(const char *card_id)
+{
+	GList *link;
+
+	for (link = outputs; link; link = link->next) {
+		OutputWatch *watch = link->data;
+
+		if (!g_strcmp0(watch->output.card_id, card_id))
+			return link;
+	}
+
+	return NULL;
+}
+
+/* Handle events on a card, return TRUE if its state changed */
+static gboolean
+outputs_handle_events(OutputWatch *watch, guint32 events)
+{
+	snd_ctl_event_t *event;
+	int err;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		ALSA_CARD_DEBUG(watch->hctl, "Output is gone");
+		watch->gone = TRUE;
+		return TRUE;
+	}
+
+	/* Drain the control events, we just need to know there were some */
+	snd_ctl_event_alloca(&event);
+	while ((err = snd_ctl_read(watch->ctl, event)) > 0);
+	if (err < 0 && err != -EAGAIN) {
+		ALSA_CARD_DEBUG(watch->hctl, "Output is gone");
+		watch->gone = TRUE;
+		return TRUE;
+	}
+
+	/* Bring the mixer up to date, unless its watch does it. Then, we're
+	 * told when it's done, and the jacks are read right away meanwhile.
+	 */
+	err = mixer_pool_handle_events(watch->mixer);
+	if (err < 0) {
+		watch->gone = TRUE;
+		return TRUE;
+	}
+
+	return output_watch_refresh(watch);
+}
+
+static gboolean
+outputs_source_prepare(G_GNUC_UNUSED GSource *source, gint *timeout)
+{
+	*timeout = -1;
+	return outputs_pending;
+}
+
+static gboolean
+outputs_source_check(G_GNUC_UNUSED GSource *source)
+{
+	return outputs_pending || outputs_pollfd.revents & G_IO_IN;
+}
+
+static gboolean
+outputs_source_dispatch(G_GNUC_UNUSED GSource *source,
+                        G_GNUC_UNUSED GSourceFunc callback,
+                        G_GNUC_UNUSED gpointer user_data)
+{
+	struct epoll_event events[OUTPUTS_MAX_EVENTS];
+	gboolean changed = FALSE;
+	GList *link, *next;
+	int n, i;
+
+	n = epoll_wait(outputs_pollfd.fd, events, OUTPUTS_MAX_EVENTS, 0);
+	for (i = 0; i < n; i++) {
+		OutputWatch *watch = events[i].data.ptr;
+
+		if (!watch->gone)
+			changed |= outputs_handle_events(watch, events[i].events);
+	}
+
+	/* Some changes were seen by the mixer listeners */
+	changed |= outputs_pending;
+	outputs_pending = FALSE;
+
+	/* Outputs are freed only now, since there might be
+	 * several events for the same output.
+	 */
+	for (link = outputs; link; link = next) {
+		OutputWatch *watch = link->data;
+
+		next = link->next;
+		if (!watch->gone)
+			continue;
+
+		outputs = g_list_delete_link(outputs, link);
+		output_watch_free(watch);
+	}
+
+	if (changed && outputs_cb)
+		outputs_cb(outputs_cb_data);
+
+	return TRUE;
+}
+
+static GSourceFuncs outputs_source_funcs = {
+	outputs_source_prepare,
+	outputs_source_check,
+	outputs_source_dispatch,
+	NULL, NULL, NULL
+};
+
+/* Create the epoll set and its source, if needed */
+static gboolean
+outputs_source_ensure(void)
+{
+	if (outputs_source)
+		return TRUE;
+
+	outputs_pollfd.fd = epoll_create1(EPOLL_CLOEXEC);
+	if (outputs_pollfd.fd < 0) {
+		ERROR("Can't create epoll set: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	outputs_source = g_source_new(&outputs_source_funcs, sizeof(GSource));
+	g_source_add_poll(outputs_source, &outputs_pollfd);
+	g_source_attach(outputs_source, NULL);
+
+	return TRUE;
+}
+
+/*
+ * Card channels handling.
+ * Channels are read and written all together. Each channel has a gain,
+ * which is its level relative to the loudest channel. The volume of the
+ * card is the volume of its loudest channel, and when it changes, every
+ * channel follows according to its gain. That's how the balance (or any
+ * other asymmetric setting) is preserved.
+ * Gains are recomputed when the levels are changed by someone else,
+ * or when they're explicitly set. They're kept as is when the levels are
+ * changed by us, so that they don't drift because of the rounding to
+ * the raw steps. They also survive a volume set to zero.
+ * This needs the mapping table, cards without one only handle their
+ * volume as a whole.
+ */
+
+/* Check whether a channel is on the left or on the right side */
+static gboolean
+channel_is_left(snd_mixer_selem_channel_id_t channel)
+{
+	return channel == SND_MIXER_SCHN_FRONT_LEFT ||
+	       channel == SND_MIXER_SCHN_REAR_LEFT ||
+	       channel == SND_MIXER_SCHN_SIDE_LEFT;
+}
+
+static gboolean
+channel_is_right(snd_mixer_selem_channel_id_t channel)
+{
+	return channel == SND_MIXER_SCHN_FRONT_RIGHT ||
+	       channel == SND_MIXER_SCHN_REAR_RIGHT ||
+	       channel == SND_MIXER_SCHN_SIDE_RIGHT;
+}
+
+/* Read the levels of every channel, between 0 and 1.
+ * Return the level of the loudest channel, or a negative value on error.
+ */
+static double
+card_read_levels(AlsaCard *card, double *levels)
+{
+	ElemMap *map = card->elem_map;
+	gboolean external = FALSE;
+	double loudest = 0;
+	guint i;
+
+	for (i = 0; i < card->n_channels; i++) {
+		long raw;
+		int err;
+
+		err = snd_mixer_selem_get_playback_volume(card->mixer_elem,
+		                card->channels[i], &raw);
+		if (err < 0) {
+			ALSA_CARD_ERR(card->hctl, err, "Can't get playback volume");
+			return -1;
+		}
+
+		if (raw != card->raws[i])
+			external = TRUE;
+		card->raws[i] = raw;
+
+		raw = CLAMP(raw, map->min, map->max);
+		levels[i] = map->norm[raw - map->min];
+		if (levels[i] > loudest)
+			loudest = levels[i];
+	}
+
+	/* Someone else changed the levels, update the gains */
+	if (external && loudest > ELEM_MAP_EPSILON)
+		for (i = 0; i < card->n_channels; i++)
+			card->gains[i] = levels[i] / loudest;
+
+	return loudest;
+}
+
+/* Write the levels of every channel, between 0 and 1.
+ * If every channel gets the same raw value, it's written at once.
+ */
+static gboolean
+card_write_levels(AlsaCard *card, const double *levels, int dir)
+{
+	ElemMap *map = card->elem_map;
+	long raws[SND_MIXER_SCHN_LAST + 1];
+	gboolean uniform = TRUE;
+	MixerJob *job;
+	guint i;
+
+	for (i = 0; i < card->n_channels; i++) {
+		raws[i] = map->min + elem_map_find(map, levels[i], dir);
+		if (raws[i] != raws[0])
+			uniform = FALSE;
+	}
+
+	/* Only write the channels that aren't there yet */
+	job = card_write_job_new(card, card->mixer_elem, 0, dir);
+	for (i = 0; i < card->n_channels; i++) {
+		if (raws[i] == card->raws[i])
+			continue;
+		job->channels[job->n_channels] = card->channels[i];
+		job->raws[job->n_channels] = raws[i];
+		job->n_channels++;
+	}
+
+	if (job->n_channels == 0) {
+		job->mixer = NULL;
+		mixer_job_free(job);
+		return TRUE;
+	}
+
+	if (uniform) {
+		job->all = TRUE;
+		job->raws[0] = raws[0];
+	}
+
+	if (!card_write(card, "Setting volume", (WatchdogFunc) mixer_job_set_raws,
+	                job)) {
+		/* Don't trust the cache anymore */
+		for (i = 0; i < card->n_channels; i++)
+			card->raws[i] = LONG_MIN;
+		return FALSE;
+	}
+
+	for (i = 0; i < card->n_channels; i++)
+		card->raws[i] = raws[i];
+
+	return TRUE;
+}
+
+/* Initialize the channels of a card */
+static void
+card_init_channels(AlsaCard *card)
+{
+	double levels[SND_MIXER_SCHN_LAST + 1];
+	guint i;
+
+	card->n_channels = elem_get_channels(card->mixer_elem, card->channels);
+	for (i = 0; i < card->n_channels; i++) {
+		card->raws[i] = LONG_MIN;
+		card->gains[i] = 1;
+	}
+
+	if (card->elem_map)
+		card_read_levels(card, levels);
+}
+
+/**
+ * Set the deadline for blocking mixer operations (opening a mixer,
+ * loading its elements, handling its events). Past this deadline,
+ * the operation is abandoned and the device is quarantined for a while.
+ *
+ * @param timeout the deadline in milliseconds.
+ */
+void
+alsa_set_watchdog_timeout(guint timeout)
+{
+	if (timeout == 0)
+		timeout = WATCHDOG_DEFAULT_TIMEOUT;
+
+	watchdog_timeout = timeout;
+}
+
+/**
+ * Set the points of the custom volume curve, as a flat list of
+ * (volume percent, dB) pairs. Volumes must increase, and so must dB
+ * values. Raw steps between two points are interpolated linearly in dB,
+ * steps outside the points get the volume of the nearest point.
+ * Cards must be re-created for the change to take effect.
+ *
+ * @param points the list of values.
+ * @param n_values the number of values in the list.
+ */
+void
+alsa_set_custom_curve(const gdouble *points, gsize n_values)
+{
+	guint i, n;
+
+	g_free(custom_curve_norm);
+	custom_curve_norm = NULL;
+	g_free(custom_curve_db);
+	custom_curve_db = NULL;
+	custom_curve_n = 0;
+
+	if (points == NULL || n_values == 0)
+		return;
+
+	n = n_values / 2;
+	if (n_values % 2 || n < 2) {
+		WARN("Custom volume curve needs at least two (volume, dB) pairs");
+		return;
+	}
+
+	for (i = 1; i < n; i++) {
+		if (points[2 * i] <= points[2 * i - 2] ||
+		    points[2 * i + 1] < points[2 * i - 1]) {
+			WARN("Custom volume curve is not increasing at point %u", i);
+			return;
+		}
+	}
+
+	custom_curve_norm = g_new(double, n);
+	custom_curve_db = g_new(long, n);
+	for (i = 0; i < n; i++) {
+		custom_curve_norm[i] = CLAMP(points[2 * i], 0, 100) / 100.0;
+		custom_curve_db[i] = lrint(points[2 * i + 1] * 100);
+	}
+	custom_curve_n = n;
+}
+
+/**
+ * Convert a dB value to a volume in percent, according to a curve.
+ * This is used to spread a volume over several elements.
+ *
+ * @param curve the volume curve.
+ * @param db the dB value.
+ * @param db_min the dB value mapped to the lowest volume.
+ * @param db_max the dB value mapped to the highest volume.
+ * @return the volume in percent.
+ */
+gdouble
+alsa_curve_db_to_volume(AlsaCurve curve, gdouble db, gdouble db_min, gdouble db_max)
+{
+	double normalized;
+
+	if (db_min >= db_max)
+		return 0;
+
+	if (curve == ALSA_CURVE_LINEAR)
+		normalized = (db - db_min) / (db_max - db_min);
+	else
+		normalized = curve_normalize(curve, lrint(db * 100),
+		                             lrint(db_min * 100), lrint(db_max * 100));
+
+	return CLAMP(normalized, 0, 1) * 100;
+}
+
+/**
+ * Set the number of mixers kept open in the pool, so that they can be
+ * reused later on. Mixers in use count, but they're never closed.
+ *
+ * @param size the size of the pool, 0 to close mixers as soon as possible.
+ */
+void
+alsa_set_mixer_pool_size(guint size)
+{
+	mixer_pool_size = size;
+	mixer_pool_trim();
+}
+
+/**
+ * Watch the state of a card, on top of the hooked one.
+ * Watching a card that is already watched with the same channel
+ * keeps the existing watch.
+ *
+ * @param card_id the id of the card.
+ * @param channel the channel to watch, NULL for the first playable one.
+ * @param curve the volume curve.
+ * @return TRUE if the card is watched, FALSE otherwise.
+ */
+gboolean
+alsa_outputs_watch(const char *card_id, const char *channel, AlsaCurve curve)
+{
+	AlsaCardEntry *entry;
+	OutputWatch *watch;
+	GList *link;
+
+	if (!outputs_source_ensure())
+		return FALSE;
+
+	link = outputs_find(card_id);
+	if (link) {
+		watch = link->data;
+
+		if (channel == NULL || !g_strcmp0(channel, watch->output.channel)) {
+			watch->seen = TRUE;
+			return TRUE;
+		}
+
+		outputs = g_list_delete_link(outputs, link);
+		output_watch_free(watch);
+	}
+
+	entry = card_index_lookup(card_id);
+	if (entry == NULL)
+		return FALSE;
+
+	watch = output_watch_new(entry, channel, curve);
+	if (watch == NULL)
+		return FALSE;
+
+	outputs = g_list_append(outputs, watch);
+	return TRUE;
+}
+
+/**
+ * Stop watching the cards that were not watched again
+ * since the last call to this function.
+ */
+void
+alsa_outputs_prune(void)
+{
+	GList *link, *next;
+
+	for (link = outputs; link; link = next) {
+		OutputWatch *watch = link->data;
+
+		next = link->next;
+		if (watch->seen) {
+			watch->seen = FALSE;
+			continue;
+		}
+
+		outputs = g_list_delete_link(outputs, link);
+		output_watch_free(watch);
+	}
+}
+
+/**
+ * Stop watching every card.
+ */
+void
+alsa_outputs_unwatch_all(void)
+{
+	g_list_free_full(outputs, (GDestroyNotify) output_watch_free);
+	outputs = NULL;
+
+	if (outputs_source) {
+		g_source_destroy(outputs_source);
+		g_source_unref(outputs_source);
+		outputs_source = NULL;
+		close(outputs_pollfd.fd);
+		outputs_pollfd.fd = -1;
+	}
+}
+
+/**
+ * Get the list of watched cards, as AlsaOutput pointers.
+ * The list is internal and shouldn't be modified, it's valid
+ * until the state of the outputs changes.
+ *
+ * @return the list of outputs.
+ */
+const GList *
+alsa_outputs_get_list(void)
+{
+	return outputs;
+}
+
+/**
+ * Set a callback invoked when the state of the outputs changes.
+ *
+ * @param callback the callback.
+ * @param data the data passed to the callback.
+ */
+void
+alsa_outputs_install_callback(AlsaOutputsCb callback, gpointer data)
+{
+	outputs_cb = callback;
+	outputs_cb_data = data;
+}
+
+/**
+ * Get the stable id of the card, which should be used to refer to it.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param card a Card instance.
+ * @return the id of the card.
+ */
+const char *
+alsa_card_get_id(AlsaCard *card)
+{
+	return card->id;
+}
+
+/**
+ * Get the name of the card.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param card a Card instance.
+ * @return the name of the card.
+ */
+const char *
+alsa_card_get_name(AlsaCard *card)
+{
+	return card->name;
+}
+
+/**
+ * Get the name of the channel.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param card a Card instance.
+ * @return the name of the channel.
+ */
+const char *
+alsa_card_get_channel(AlsaCard *card)
+{
+	if (card->mixer_elem == NULL)
+		return NULL;
+
+	return elem_get_name(card->mixer_elem);
+}
+
+/**
+ * Check whether the card has a given playable channel.
+ *
+ * @param card a Card instance.
+ * @param channel the name of the channel.
+ * @return TRUE if the channel exists and is playable, FALSE otherwise.
+ */
+gboolean
+alsa_card_has_channel(AlsaCard *card, const char *channel)
+{
+	snd_mixer_elem_t *elem;
+	snd_mixer_selem_id_t *sid;
+
+	if (card->mixer == NULL || channel == NULL)
+		return FALSE;
+
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_name(sid, channel);
+	elem = snd_mixer_find_selem(card->mixer, sid);
+
+	return elem && snd_mixer_selem_has_playback_volume(elem);
+}
+
+/**
+ * Control another channel of the card. The card keeps its current
+ * channel if the new one can't be found.
+ *
+ * @param card a Card instance.
+ * @param channel the name of the channel.
+ * @return TRUE if the channel changed, FALSE otherwise.
+ */
+gboolean
+alsa_card_set_channel(AlsaCard *card, const char *channel)
+{
+	snd_mixer_elem_t *elem;
+
+	if (card->mixer == NULL)
+		return FALSE;
+
+	elem = mixer_get_playable_elem(card->hctl, card->mixer, channel);
+	if (elem == NULL || elem == card->mixer_elem)
+		return FALSE;
+
+	elem_map_free(card->elem_map);
+	card->mixer_elem = elem;
+	card->elem_map = elem_map_new(card->hctl, elem, card->curve);
+	card_init_channels(card);
+	card_playback_refresh(card);
+
+	ALSA_CARD_DEBUG(card->hctl, "Now controlling channel '%s'", channel);
+
+	return TRUE;
+}
+
+/**
+ * Check whether the card has a jack-sense control of a given type.
+ *
+ * @param card a Card instance.
+ * @param jack the type of jack.
+ * @return TRUE if there's such a jack, FALSE otherwise.
+ */
+gboolean
+alsa_card_has_jack(AlsaCard *card, AlsaJack jack)
+{
+	guint i;
+
+	for (i = 0; i < card->n_jacks; i++)
+		if (card->jacks[i].type == jack)
+			return TRUE;
+
+	return FALSE;
+}
+
+/**
+ * Check whether something is plugged in a jack of a given type.
+ * The state is the one cached when the last event was received.
+ *
+ * @param card a Card instance.
+ * @param jack the type of jack.
+ * @return TRUE if one of these jacks is plugged, FALSE otherwise.
+ */
+gboolean
+alsa_card_is_jack_plugged(AlsaCard *card, AlsaJack jack)
+{
+	guint i;
+
+	for (i = 0; i < card->n_jacks; i++)
+		if (card->jacks[i].type == jack && card->jacks[i].plugged)
+			return TRUE;
+
+	return FALSE;
+}
+
+/**
+ * Select the capture element of the card. It's looked up on the same
+ * mixer as the playback element, so no other handle is opened.
+ *
+ * @param card a Card instance.
+ * @param channel the name of the capture channel, or NULL to use the first
+ * capturable channel.
+ * @return TRUE if the card has a capture element, FALSE otherwise.
+ */
+gboolean
+alsa_card_set_capture_channel(AlsaCard *card, const char *channel)
+{
+	card->capture_elem = NULL;
+
+	if (card->mixer == NULL)
+		return FALSE;
+
+	card->capture_elem = mixer_get_capture_elem(card->hctl, card->mixer, channel);
+	if (card->capture_elem == NULL)
+		card->capture_elem = mixer_get_first_capture_elem(card->hctl, card->mixer);
+	if (card->capture_elem == NULL)
+		return FALSE;
+
+	card->capture_volume = -1;
+	card_capture_refresh(card);
+
+	ALSA_CARD_DEBUG(card->hctl, "Capture channel '%s' selected",
+	                elem_get_name(card->capture_elem));
+
+	return TRUE;
+}
+
+/**
+ * Get the name of the capture channel.
+ *
+ * @param card a Card instance.
+ * @return the name of the capture channel, or NULL if there's none.
+ */
+const char *
+alsa_card_get_capture_channel(AlsaCard *card)
+{
+	if (card->capture_elem == NULL)
+		return NULL;
+
+	return elem_get_name(card->capture_elem);
+}
+
+/**
+ * Get the capture mute state, either TRUE or FALSE.
+ *
+ * @param card a Card instance.
+ * @return TRUE if the capture is muted, or if there's no capture element.
+ */
+gboolean
+alsa_card_is_capture_muted(AlsaCard *card)
+{
+	if (card->capture_elem == NULL)
+		return TRUE;
+
+	return card->capture_muted;
+}
+
+/**
+ * Toggle the capture mute state.
+ *
+ * @param card a Card instance.
+ */
+void
+alsa_card_toggle_capture_mute(AlsaCard *card)
+{
+	gboolean muted;
+	MixerJob *job;
+
+	if (card->capture_elem == NULL)
+		return;
+
+	muted = alsa_card_is_capture_muted(card);
+	job = card_write_job_new(card, card->capture_elem, !muted, 0);
+	if (!card_write(card, "Setting capture switch",
+	                (WatchdogFunc) mixer_job_set_capture_mute, job))
+		return;
+
+	/* Keep the cache up to date, the event will tell it's a capture change */
+	card->capture_muted = !muted;
+	card->capture_written = TRUE;
+}
+
+/**
+ * Get the capture volume in percent (value between 0 and 100).
+ *
+ * @param card a Card instance.
+ * @return the capture volume in percent.
+ */
+gdouble
+alsa_card_get_capture_volume(AlsaCard *card)
+{
+	if (card->capture_elem == NULL)
+		return 0;
+
+	return card->capture_volume * 100;
+}
+
+/**
+ * Set the capture volume in percent (value between 0 and 100).
+ *
+ * @param card a Card instance.
+ * @param value the capture volume in percent.
+ * @param dir the rounding direction.
+ */
+void
+alsa_card_set_capture_volume(AlsaCard *card, gdouble value, int dir)
+{
+	MixerJob *job;
+
+	if (card->capture_elem == NULL)
+		return;
+
+	job = card_write_job_new(card, card->capture_elem, value / 100, dir);
+	if (!card_write(card, "Setting capture volume",
+	                (WatchdogFunc) mixer_job_set_capture_volume, job))
+		return;
+
+	/* Read back the rounded value, the event will tell it's a capture change */
+	elem_get_capture_volume(card->hctl, card->capture_elem, &card->capture_volume);
+	card->capture_written = TRUE;
+}
+
+/**
+ * Get the mute state, either TRUE or FALSE.
+ *
+ * @param card a Card instance.
+ * @return TRUE if the card is muted, FALSE otherwise.
+ */
+gboolean
+alsa_card_is_muted(AlsaCard *card)
+{
+	gboolean muted;
+
+	if (card->mixer_elem == NULL)
+		return TRUE;
+
+	elem_get_mute(card->hctl, card->mixer_elem, &muted);
+	return muted;
+}
+
+/**
+ * Toggle the mute state.
+ *
+ * @param card a Card instance.
+ */
+void
+alsa_card_toggle_mute(AlsaCard *card)
+{
+	gboolean muted;
+	MixerJob *job;
+
+	if (card->mixer_elem == NULL)
+		return;
+
+	/* Set mute */
+	muted = alsa_card_is_muted(card);
+	job = card_write_job_new(card, card->mixer_elem, !muted, 0);
+	card_write(card, "Setting playback switch", (WatchdogFunc) mixer_job_set_mute,
+	           job);
+}
+
+/**
+ * Get the volume in percent (value between 0 and 100).
+ *
+ * @param card a Card instance.
+ * @return the volume in percent.
+ */
+gdouble
+alsa_card_get_volume(AlsaCard *card)
+{
+	gdouble volume = 0;
+	gboolean gotten = FALSE;
+
+	if (card->mixer_elem == NULL)
+		return 0;
+
+	if (card->elem_map) {
+		double levels[SND_MIXER_SCHN_LAST + 1];
+
+		volume = card_read_levels(card, levels);
+		gotten = volume >= 0;
+		if (!gotten)
+			volume = 0;
+	} else if (card->curve != ALSA_CURVE_LINEAR)
+		gotten = elem_get_volume_normalized(card->hctl, card->mixer_elem, &volume);
+
+	if (!gotten)
+		elem_get_volume(card->hctl, card->mixer_elem, &volume);
+
+	return volume * 100;
+}
+
+/**
+ * Set the volume in percent (value between 0 and 100).
+ *
+ * @param card a Card instance.
+ * @param value the volume in percent.
+ * @param dir the direction of the volume change
+ *        (-1: lowering, +1: raising, 0: setting).
+ */
+void
+alsa_card_set_volume(AlsaCard *card, gdouble value, int dir)
+{
+	gdouble volume;
+	gboolean set = FALSE;
+	MixerJob *job;
+
+	if (card->mixer_elem == NULL)
+		return;
+
+	volume = value / 100.0;
+
+	/* Set volume */
+	if (card->elem_map) {
+		double levels[SND_MIXER_SCHN_LAST + 1];
+		guint i;
+
+		/* Catch up with external changes, then let every channel
+		 * follow according to its gain.
+		 */
+		if (card_read_levels(card, levels) >= 0) {
+			for (i = 0; i < card->n_channels; i++)
+				levels[i] = volume * card->gains[i];
+			set = card_write_levels(card, levels, dir);
+		}
+	} else if (card->curve != ALSA_CURVE_LINEAR) {
+		job = card_write_job_new(card, card->mixer_elem, volume, dir);
+		set = card_write(card, "Setting volume",
+		                 (WatchdogFunc) mixer_job_set_volume_normalized, job);
+	}
+
+	/* The mixer may have been lost in the meantime */
+	if (!set && card->mixer_elem) {
+		job = card_write_job_new(card, card->mixer_elem, volume, dir);
+		card_write(card, "Setting volume", (WatchdogFunc) mixer_job_set_volume,
+		           job);
+	}
+}
+
+/**
+ * Get the number of playback channels.
+ *
+ * @param card a Card instance.
+ * @return the number of channels.
+ */
+guint
+alsa_card_get_n_channels(AlsaCard *card)
+{
+	if (card->mixer_elem == NULL)
+		return 0;
+
+	return card->n_channels;
+}
+
+/**
+ * Get the name of a playback channel, like 'Front Left'.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param card a Card instance.
+ * @param index the index of the channel.
+ * @return the name of the channel.
+ */
+const char *
+alsa_card_get_channel_name(AlsaCard *card, guint index)
+{
+	g_return_val_if_fail(index < card->n_channels, NULL);
+
+	return snd_mixer_selem_channel_name(card->channels[index]);
+}
+
+/**
+ * Get the volume of a playback channel in percent.
+ *
+ * @param card a Card instance.
+ * @param index the index of the channel.
+ * @return the volume in percent.
+ */
+gdouble
+alsa_card_get_channel_volume(AlsaCard *card, guint index)
+{
+	double levels[SND_MIXER_SCHN_LAST + 1];
+
+	g_return_val_if_fail(index < card->n_channels, 0);
+
+	if (card->elem_map == NULL)
+		return alsa_card_get_volume(card);
+
+	if (card_read_levels(card, levels) < 0)
+		return 0;
+
+	return levels[index] * 100;
+}
+
+/**
+ * Set the volume of a playback channel in percent.
+ * Other channels are left untouched.
+ *
+ * @param card a Card instance.
+ * @param index the index of the channel.
+ * @param value the volume in percent.
+ * @param dir the direction of the volume change
+ *        (-1: lowering, +1: raising, 0: setting).
+ */
+void
+alsa_card_set_channel_volume(AlsaCard *card, guint index, gdouble value, int dir)
+{
+	double levels[SND_MIXER_SCHN_LAST + 1];
+	double loudest = 0;
+	guint i;
+
+	g_return_if_fail(index < card->n_channels);
+
+	if (card->elem_map == NULL) {
+		alsa_card_set_volume(card, value, dir);
+		return;
+	}
+
+	if (card_read_levels(card, levels) < 0)
+		return;
+
+	levels[index] = value / 100.0;
+	if (!card_write_levels(card, levels, dir))
+		return;
+
+	/* Explicit change, update the gains */
+	for (i = 0; i < card->n_channels; i++)
+		if (levels[i] > loudest)
+			loudest = levels[i];
+	if (loudest > ELEM_MAP_EPSILON)
+		for (i = 0; i < card->n_channels; i++)
+			card->gains[i] = levels[i] / loudest;
+}
+
+/**
+ * Get the balance between left and right channels,
+ * from -100 (left only) to 100 (right only).
  *
  * @param card a Card instance.
- * @return the name of the channel.
+ * @return the balance.
  */
-const char *
-alsa_card_get_channel(AlsaCard *card)
+gdouble
+alsa_card_get_balance(AlsaCard *card)
 {
-	return elem_get_name(card->mixer_elem);
+	double levels[SND_MIXER_SCHN_LAST + 1];
+	double left = -1, right = -1;
+	guint i;
+
+	if (card->mixer_elem == NULL || card->elem_map == NULL)
+		return 0;
+
+	/* Make sure gains are up to date */
+	if (card_read_levels(card, levels) < 0)
+		return 0;
+
+	for (i = 0; i < card->n_channels; i++) {
+		if (channel_is_left(card->channels[i]))
+			left = MAX(left, card->gains[i]);
+		else if (channel_is_right(card->channels[i]))
+			right = MAX(right, card->gains[i]);
+	}
+
+	/* A side at gain 0 is a full pan, only a missing side is centered */
+	if (left < 0 || right < 0 || MAX(left, right) <= 0)
+		return 0;
+
+	return (right - left) / MAX(left, right) * 100;
 }
 
 /**
- * Get the mute state, either TRUE or FALSE.
+ * Set the balance between left and right channels, from -100 (left only)
+ * to 100 (right only). The loudest channel keeps its level.
  *
  * @param card a Card instance.
- * @return TRUE if the card is muted, FALSE otherwise.
+ * @param balance the balance.
  */
-gboolean
-alsa_card_is_muted(AlsaCard *card)
+void
+alsa_card_set_balance(AlsaCard *card, gdouble balance)
 {
-	gboolean muted;
+	double levels[SND_MIXER_SCHN_LAST + 1];
+	double loudest;
+	guint i;
 
-	elem_get_mute(card->hctl, card->mixer_elem, &muted);
-	return muted;
+	if (card->mixer_elem == NULL || card->elem_map == NULL)
+		return;
+
+	loudest = card_read_levels(card, levels);
+	if (loudest < 0)
+		return;
+
+	balance = CLAMP(balance, -100, 100) / 100.0;
+
+	for (i = 0; i < card->n_channels; i++) {
+		snd_mixer_selem_channel_id_t channel = card->channels[i];
+
+		if (channel_is_left(channel))
+			card->gains[i] = balance > 0 ? 1 - balance : 1;
+		else if (channel_is_right(channel))
+			card->gains[i] = balance < 0 ? 1 + balance : 1;
+		else
+			card->gains[i] = 1;
+
+		levels[i] = loudest * card->gains[i];
+	}
+
+	card_write_levels(card, levels, 0);
 }
 
 /**
- * Toggle the mute state.
+ * Get the dB range of the card. The lowest value is the lowest
+ * audible step, not the mute step.
  *
  * @param card a Card instance.
+ * @param db_min where to store the lowest value, in dB.
+ * @param db_max where to store the highest value, in dB.
+ * @return TRUE if the card has a dB scale, FALSE otherwise.
  */
-void
-alsa_card_toggle_mute(AlsaCard *card)
+gboolean
+alsa_card_get_db_range(AlsaCard *card, gdouble *db_min, gdouble *db_max)
 {
-	gboolean muted;
+	ElemMap *map = card->elem_map;
+	guint i;
 
-	/* Set mute */
-	muted = alsa_card_is_muted(card);
-	elem_set_mute(card->hctl, card->mixer_elem, !muted);
+	if (card->mixer_elem == NULL || map == NULL || map->db == NULL)
+		return FALSE;
+
+	for (i = 0; i < map->n_steps - 1; i++)
+		if (map->db[i] != SND_CTL_TLV_DB_GAIN_MUTE)
+			break;
+
+	*db_min = map->db[i] / 100.0;
+	*db_max = map->db[map->n_steps - 1] / 100.0;
+
+	return *db_min < *db_max;
 }
 
 /**
- * Get the volume in percent (value between 0 and 100).
+ * Get the level of the loudest channel, in dB.
  *
  * @param card a Card instance.
- * @return the volume in percent.
+ * @return the level in dB, or 0 if the card has no dB scale.
  */
 gdouble
-alsa_card_get_volume(AlsaCard *card)
+alsa_card_get_db(AlsaCard *card)
 {
-	gdouble volume = 0;
-	gboolean gotten = FALSE;
+	double levels[SND_MIXER_SCHN_LAST + 1];
+	ElemMap *map = card->elem_map;
+	long raw;
+	guint i;
 
-	if (card->normalize)
-		gotten = elem_get_volume_normalized(card->hctl, card->mixer_elem, &volume);
+	if (card->mixer_elem == NULL || map == NULL || map->db == NULL)
+		return 0;
 
-	if (!gotten)
-		elem_get_volume(card->hctl, card->mixer_elem, &volume);
+	if (card_read_levels(card, levels) < 0)
+		return 0;
 
-	return volume * 100;
+	for (raw = map->min, i = 0; i < card->n_channels; i++)
+		raw = MAX(raw, card->raws[i]);
+	raw = CLAMP(raw, map->min, map->max);
+
+	return map->db[raw - map->min] / 100.0;
 }
 
 /**
- * Set the volume in percent (value between 0 and 100).
+ * Set the level of the loudest channel, in dB. Other channels follow,
+ * like they do when the volume is set.
  *
  * @param card a Card instance.
- * @param value the volume in percent.
+ * @param db the level in dB.
  * @param dir the direction of the volume change
  *        (-1: lowering, +1: raising, 0: setting).
  */
 void
-alsa_card_set_volume(AlsaCard *card, gdouble value, int dir)
+alsa_card_set_db(AlsaCard *card, gdouble db, int dir)
 {
-	gdouble volume;
-	gboolean set = FALSE;
+	ElemMap *map = card->elem_map;
+	guint i;
 
-	volume = value / 100.0;
+	if (card->mixer_elem == NULL || map == NULL || map->db == NULL)
+		return;
 
-	/* Set volume */
-	if (card->normalize)
-		set = elem_set_volume_normalized(card->hctl, card->mixer_elem, volume, dir);
+	i = elem_map_find_db(map, lrint(db * 100), dir);
 
-	if (!set)
-		elem_set_volume(card->hctl, card->mixer_elem, volume, dir);
+	alsa_card_set_volume(card, map->norm[i] * 100, dir);
 }
 
 /**
@@ -845,14 +4012,20 @@ alsa_card_free(AlsaCard *card)
 	if (card == NULL)
 		return;
 
-	if (card->watch_ids)
-		unwatch_poll_descriptors(card->watch_ids);
+	if (card->lost_source)
+		g_source_remove(card->lost_source);
+
+	if (card->listening)
+		mixer_pool_unlisten(card->mixer, on_card_mixer_event, card);
 
 	if (card->mixer)
-		mixer_close(card->hctl, card->mixer);
+		mixer_pool_release(card->hctl, card->mixer);
 
+	elem_map_free(card->elem_map);
+	g_free(card->jacks);
 	g_free(card->hctl);
 	g_free(card->name);
+	g_free(card->id);
 	g_free(card);
 }
 
@@ -863,42 +4036,36 @@ alsa_card_free(AlsaCard *card)
  * If found, all is well, the card is ready to be used.
  * Otherwise, NULL is returned.
  *
- * @param card_name the name of the card, or NULL to use the default card.
+ * @param card_id the id (or the name) of the card, or NULL to use the default card.
  * @param channel the name of the channel, or NULL to use the first playable channel.
- * @param normalize whether we use normalized volume or not.
+ * @param curve the volume curve to use.
  * @return a newly allocated Card instance, or NULL on failure.
  */
 AlsaCard *
-alsa_card_new(const char *card_name, const char *channel, gboolean normalize)
+alsa_card_new(const char *card_id, const char *channel, AlsaCurve curve)
 {
 	AlsaCard *card;
-	AlsaCardIter *iter;
+	AlsaCardEntry *entry;
 
 	card = g_new0(AlsaCard, 1);
 
-	/* Save normalize parameter */
-	card->normalize = normalize;
-
-	/* Save card name */
-	if (!card_name)
-		card_name = ALSA_DEFAULT_CARD;
-	card->name = g_strdup(card_name);
+	/* Save curve parameter */
+	card->curve = curve;
 
-	/* Get corresponding HCTL name */
-	iter = alsa_card_iter_new();
-	while (alsa_card_iter_loop(iter)) {
-		if (!g_strcmp0(iter->name, card_name)) {
-			card->hctl = g_strdup(iter->hctl);
-			break;
-		}
+	/* Look for the card */
+	entry = card_index_lookup(card_id);
+	if (entry == NULL) {
+		DEBUG("Card '%s' not found", card_id);
+		goto failure;
 	}
-	alsa_card_iter_free(iter);
 
-	if (card->hctl == NULL)
-		goto failure;
+	/* Save card names */
+	card->id = g_strdup(entry->id);
+	card->name = g_strdup(entry->name);
+	card->hctl = g_strdup(entry->hctl);
 
-	/* Open mixer */
-	card->mixer = mixer_open(card->hctl);
+	/* Get mixer */
+	card->mixer = mixer_pool_acquire(card->hctl);
 	if (card->mixer == NULL)
 		goto failure;
 
@@ -909,18 +4076,25 @@ alsa_card_new(const char *card_name, const char *channel, gboolean normalize)
 	if (card->mixer_elem == NULL)
 		goto failure;
 
-	/* Get mixer poll descriptors and watch them using gio.
-	 * That's how we get notified from every volume/mute changes,
-	 * may it be external or due to PNMixer.
-	 */
-	struct pollfd *pollfds;
-	pollfds = mixer_get_poll_descriptors(card->hctl, card->mixer);
-	if (pollfds == NULL)
+	/* Compile the volume curve */
+	card->elem_map = elem_map_new(card->hctl, card->mixer_elem, curve);
+
+	/* Get the channels and their current levels */
+	card_init_channels(card);
+	card_playback_refresh(card);
+
+	/* Get the jack-sense controls */
+	if (!jacks_find_watched(card->hctl, card->mixer, &card->jacks,
+	                        &card->n_jacks)) {
+		card->mixer = NULL;
 		goto failure;
+	}
 
-	card->watch_ids = watch_poll_descriptors(card->hctl, pollfds,
-	                  (GIOFunc) poll_watch_cb, card);
-	g_free(pollfds);
+	/* Listen to the mixer, along with its other users */
+	card->listening = mixer_pool_listen(card->mixer, on_card_mixer_event, card,
+	                                    TRUE);
+	if (!card->listening)
+		goto failure;
 
 	/* Sum up the situation */
 	DEBUG("'%s': Card '%s' with channel '%s' initialized !",
@@ -938,7 +4112,7 @@ failure:
  */
 
 /**
- * Return the list of playable cards as a GSList.
+ * Return the list of playable cards as a GSList of card ids.
  * Must be freed using g_slist_free_full() and g_free().
  *
  * @return a list of playable cards.
@@ -946,74 +4120,392 @@ failure:
 GSList *
 alsa_list_cards(void)
 {
-	AlsaCardIter *iter;
-	GSList *list = NULL;
+	GSList *item, *list = NULL;
 
-	iter = alsa_card_iter_new();
+	/* We're about to open every card anyway, so let's refresh the index */
+	card_index_build();
 
-	while (alsa_card_iter_loop(iter)) {
+	for (item = card_index; item; item = item->next) {
+		AlsaCardEntry *entry = item->data;
 		snd_mixer_t *mixer;
 
-		/* Open mixer */
-		mixer = mixer_open(iter->hctl);
+		/* Get mixer */
+		mixer = mixer_pool_acquire(entry->hctl);
 		if (mixer == NULL)
 			continue;
 
 		/* Only keep cards with playable channels */
-		if (mixer_is_playable(iter->hctl, mixer))
-			list = g_slist_append(list, g_strdup(iter->name));
+		if (mixer_is_playable(entry->hctl, mixer))
+			list = g_slist_append(list, g_strdup(entry->id));
 
-		/* Close mixer */
-		mixer_close(iter->hctl, mixer);
+		/* Release mixer */
+		mixer_pool_release(entry->hctl, mixer);
 	}
 
-	alsa_card_iter_free(iter);
-
 	return list;
 }
 
 /**
- * For a given card name, return the list of playable channels as a GSList.
- * Must be freed using g_slist_free_full() and g_free().
+ * Get the id of a card, given its alsa number, like the 'N' in 'hw:N'.
+ * The index is rebuilt if needed, but cards are not opened.
+ * Must be freed using g_free().
  *
- * @param card_name the name of the card for which we list the channels
- * @return a list of playable channels.
+ * @param number the alsa number of the card.
+ * @return the id of the card, or NULL if the card can't be found.
  */
-GSList *
-alsa_list_channels(const char *card_name)
+char *
+alsa_get_card_id_by_number(int number)
 {
-	AlsaCardIter *iter;
+	GSList *item;
+	gboolean rebuilt = FALSE;
+
+retry:
+	for (item = card_index; item; item = item->next) {
+		AlsaCardEntry *entry = item->data;
+
+		if (entry->number != number)
+			continue;
+
+		if (rebuilt || card_entry_is_valid(entry))
+			return g_strdup(entry->id);
+	}
+
+	if (rebuilt)
+		return NULL;
+
+	card_index_build();
+	rebuilt = TRUE;
+	goto retry;
+}
+
+/**
+ * Get the display name of a card.
+ * Must be freed using g_free().
+ *
+ * @param card_id the id of the card.
+ * @return the name of the card, or NULL if the card can't be found.
+ */
+char *
+alsa_get_card_name(const char *card_id)
+{
+	AlsaCardEntry *entry;
+
+	entry = card_index_lookup(card_id);
+	if (entry == NULL)
+		return NULL;
+
+	return g_strdup(entry->name);
+}
+
+/**
+ * Get the id of a card, given either its id or its name.
+ * This is used to convert card names that were saved in the
+ * preferences before cards were identified by an id.
+ * Must be freed using g_free().
+ *
+ * @param card_id the id or the name of the card.
+ * @return the id of the card, or NULL if the card can't be found.
+ */
+char *
+alsa_get_card_id(const char *card_id)
+{
+	AlsaCardEntry *entry;
+
+	entry = card_index_lookup(card_id);
+	if (entry == NULL)
+		return NULL;
+
+	return g_strdup(entry->id);
+}
+
+/* List some channels of a card, with the given mixer function */
+static GSList *
+list_card_channels(const char *card_id,
+                   GSList *(*list_func) (const char *, snd_mixer_t *))
+{
+	AlsaCardEntry *entry;
 	char *hctl = NULL;
 	snd_mixer_t *mixer = NULL;
 	GSList *list = NULL;
 
-	/* Iterate over cards to find the one provided in argument */
-	iter = alsa_card_iter_new();
-	while (alsa_card_iter_loop(iter)) {
-		if (!g_strcmp0(iter->name, card_name)) {
-			hctl = g_strdup(iter->hctl);
-			break;
-		}
-	}
-	alsa_card_iter_free(iter);
-
-	if (hctl == NULL)
+	/* Find the card provided in argument */
+	entry = card_index_lookup(card_id);
+	if (entry == NULL)
 		goto exit;
 
-	/* Open the mixer */
-	mixer = mixer_open(hctl);
+	hctl = g_strdup(entry->hctl);
+
+	/* Get the mixer */
+	mixer = mixer_pool_acquire(hctl);
 	if (mixer == NULL)
 		goto exit;
 
-	/* Get a list of playable channels */
-	list = mixer_list_playable(hctl, mixer);
+	/* Get the list of channels */
+	list = list_func(hctl, mixer);
 
 exit:
 	/* Cleanup */
 	if (mixer)
-		mixer_close(hctl, mixer);
+		mixer_pool_release(hctl, mixer);
 	if (hctl)
 		g_free(hctl);
 
 	return list;
 }
+
+/**
+ * For a given card id, return the list of playable channels as a GSList.
+ * Must be freed using g_slist_free_full() and g_free().
+ *
+ * @param card_id the id of the card for which we list the channels
+ * @return a list of playable channels.
+ */
+GSList *
+alsa_list_channels(const char *card_id)
+{
+	return list_card_channels(card_id, mixer_list_playable);
+}
+
+/**
+ * For a given card id, return the list of capture channels as a GSList.
+ * Must be freed using g_slist_free_full() and g_free().
+ *
+ * @param card_id the id of the card for which we list the channels
+ * @return a list of capture channels.
+ */
+GSList *
+alsa_list_capture_channels(const char *card_id)
+{
+	return list_card_channels(card_id, mixer_list_capturable);
+}
+
+/*
+ * Backend operations
+ */
+
+/* The backend only knows of opaque cards, these wrappers hand them
+ * back to the typed functions above.
+ */
+
+static BackendCard *
+alsa_backend_card_new(const char *card_id, const char *channel, AlsaCurve curve)
+{
+	return (BackendCard *) alsa_card_new(card_id, channel, curve);
+}
+
+static void
+alsa_backend_card_free(BackendCard *card)
+{
+	alsa_card_free((AlsaCard *) card);
+}
+
+static void
+alsa_backend_card_install_callback(BackendCard *card, AlsaCb callback,
+                                   gpointer data)
+{
+	alsa_card_install_callback((AlsaCard *) card, callback, data);
+}
+
+static const char *
+alsa_backend_card_get_id(BackendCard *card)
+{
+	return alsa_card_get_id((AlsaCard *) card);
+}
+
+static const char *
+alsa_backend_card_get_name(BackendCard *card)
+{
+	return alsa_card_get_name((AlsaCard *) card);
+}
+
+static const char *
+alsa_backend_card_get_channel(BackendCard *card)
+{
+	return alsa_card_get_channel((AlsaCard *) card);
+}
+
+static gboolean
+alsa_backend_card_has_channel(BackendCard *card, const char *channel)
+{
+	return alsa_card_has_channel((AlsaCard *) card, channel);
+}
+
+static gboolean
+alsa_backend_card_set_channel(BackendCard *card, const char *channel)
+{
+	return alsa_card_set_channel((AlsaCard *) card, channel);
+}
+
+static gboolean
+alsa_backend_card_has_jack(BackendCard *card, AlsaJack jack)
+{
+	return alsa_card_has_jack((AlsaCard *) card, jack);
+}
+
+static gboolean
+alsa_backend_card_is_jack_plugged(BackendCard *card, AlsaJack jack)
+{
+	return alsa_card_is_jack_plugged((AlsaCard *) card, jack);
+}
+
+static gboolean
+alsa_backend_card_set_capture_channel(BackendCard *card, const char *channel)
+{
+	return alsa_card_set_capture_channel((AlsaCard *) card, channel);
+}
+
+static const char *
+alsa_backend_card_get_capture_channel(BackendCard *card)
+{
+	return alsa_card_get_capture_channel((AlsaCard *) card);
+}
+
+static gboolean
+alsa_backend_card_is_capture_muted(BackendCard *card)
+{
+	return alsa_card_is_capture_muted((AlsaCard *) card);
+}
+
+static void
+alsa_backend_card_toggle_capture_mute(BackendCard *card)
+{
+	alsa_card_toggle_capture_mute((AlsaCard *) card);
+}
+
+static gdouble
+alsa_backend_card_get_capture_volume(BackendCard *card)
+{
+	return alsa_card_get_capture_volume((AlsaCard *) card);
+}
+
+static void
+alsa_backend_card_set_capture_volume(BackendCard *card, gdouble value, int dir)
+{
+	alsa_card_set_capture_volume((AlsaCard *) card, value, dir);
+}
+
+static gboolean
+alsa_backend_card_is_muted(BackendCard *card)
+{
+	return alsa_card_is_muted((AlsaCard *) card);
+}
+
+static void
+alsa_backend_card_toggle_mute(BackendCard *card)
+{
+	alsa_card_toggle_mute((AlsaCard *) card);
+}
+
+static gdouble
+alsa_backend_card_get_volume(BackendCard *card)
+{
+	return alsa_card_get_volume((AlsaCard *) card);
+}
+
+static void
+alsa_backend_card_set_volume(BackendCard *card, gdouble value, int dir)
+{
+	alsa_card_set_volume((AlsaCard *) card, value, dir);
+}
+
+static guint
+alsa_backend_card_get_n_channels(BackendCard *card)
+{
+	return alsa_card_get_n_channels((AlsaCard *) card);
+}
+
+static const char *
+alsa_backend_card_get_channel_name(BackendCard *card, guint index)
+{
+	return alsa_card_get_channel_name((AlsaCard *) card, index);
+}
+
+static gdouble
+alsa_backend_card_get_channel_volume(BackendCard *card, guint index)
+{
+	return alsa_card_get_channel_volume((AlsaCard *) card, index);
+}
+
+static void
+alsa_backend_card_set_channel_volume(BackendCard *card, guint index,
+                                     gdouble value, int dir)
+{
+	alsa_card_set_channel_volume((AlsaCard *) card, index, value, dir);
+}
+
+static gdouble
+alsa_backend_card_get_balance(BackendCard *card)
+{
+	return alsa_card_get_balance((AlsaCard *) card);
+}
+
+static void
+alsa_backend_card_set_balance(BackendCard *card, gdouble balance)
+{
+	alsa_card_set_balance((AlsaCard *) card, balance);
+}
+
+static gboolean
+alsa_backend_card_get_db_range(BackendCard *card, gdouble *db_min,
+                               gdouble *db_max)
+{
+	return alsa_card_get_db_range((AlsaCard *) card, db_min, db_max);
+}
+
+static gdouble
+alsa_backend_card_get_db(BackendCard *card)
+{
+	return alsa_card_get_db((AlsaCard *) card);
+}
+
+static void
+alsa_backend_card_set_db(BackendCard *card, gdouble db, int dir)
+{
+	alsa_card_set_db((AlsaCard *) card, db, dir);
+}
+
+const Backend alsa_backend = {
+	.name = "alsa",
+	.set_watchdog_timeout = alsa_set_watchdog_timeout,
+	.set_mixer_pool_size = alsa_set_mixer_pool_size,
+	.list_cards = alsa_list_cards,
+	.list_channels = alsa_list_channels,
+	.list_capture_channels = alsa_list_capture_channels,
+	.get_card_name = alsa_get_card_name,
+	.get_card_id = alsa_get_card_id,
+	.get_card_id_by_number = alsa_get_card_id_by_number,
+	.outputs_watch = alsa_outputs_watch,
+	.outputs_prune = alsa_outputs_prune,
+	.outputs_unwatch_all = alsa_outputs_unwatch_all,
+	.outputs_get_list = alsa_outputs_get_list,
+	.outputs_install_callback = alsa_outputs_install_callback,
+	.card_new = alsa_backend_card_new,
+	.card_free = alsa_backend_card_free,
+	.card_install_callback = alsa_backend_card_install_callback,
+	.card_get_id = alsa_backend_card_get_id,
+	.card_get_name = alsa_backend_card_get_name,
+	.card_get_channel = alsa_backend_card_get_channel,
+	.card_has_channel = alsa_backend_card_has_channel,
+	.card_set_channel = alsa_backend_card_set_channel,
+	.card_has_jack = alsa_backend_card_has_jack,
+	.card_is_jack_plugged = alsa_backend_card_is_jack_plugged,
+	.card_set_capture_channel = alsa_backend_card_set_capture_channel,
+	.card_get_capture_channel = alsa_backend_card_get_capture_channel,
+	.card_is_capture_muted = alsa_backend_card_is_capture_muted,
+	.card_toggle_capture_mute = alsa_backend_card_toggle_capture_mute,
+	.card_get_capture_volume = alsa_backend_card_get_capture_volume,
+	.card_set_capture_volume = alsa_backend_card_set_capture_volume,
+	.card_is_muted = alsa_backend_card_is_muted,
+	.card_toggle_mute = alsa_backend_card_toggle_mute,
+	.card_get_volume = alsa_backend_card_get_volume,
+	.card_set_volume = alsa_backend_card_set_volume,
+	.card_get_n_channels = alsa_backend_card_get_n_channels,
+	.card_get_channel_name = alsa_backend_card_get_channel_name,
+	.card_get_channel_volume = alsa_backend_card_get_channel_volume,
+	.card_set_channel_volume = alsa_backend_card_set_channel_volume,
+	.card_get_balance = alsa_backend_card_get_balance,
+	.card_set_balance = alsa_backend_card_set_balance,
+	.card_get_db_range = alsa_backend_card_get_db_range,
+	.card_get_db = alsa_backend_card_get_db,
+	.card_set_db = alsa_backend_card_set_db,
+};
@@ -20,27 +20,96 @@
 #include <glib.h>
 
 GSList *alsa_list_cards(void);
-GSList *alsa_list_channels(const char *card_name);
+GSList *alsa_list_channels(const char *card_id);
+GSList *alsa_list_capture_channels(const char *card_id);
+char *alsa_get_card_name(const char *card_id);
+char *alsa_get_card_id(const char *card_id);
+char *alsa_get_card_id_by_number(int number);
+
+enum alsa_curve {
+	ALSA_CURVE_LINEAR,	/* Linear on raw volume steps */
+	ALSA_CURVE_LINEAR_DB,	/* Linear on the dB scale */
+	ALSA_CURVE_ALSAMIXER,	/* Same mapping as alsamixer */
+	ALSA_CURVE_LOUDNESS,	/* Perceived loudness, doubles every 10 dB */
+	ALSA_CURVE_CUSTOM	/* User-defined (volume, dB) points */
+};
+
+typedef enum alsa_curve AlsaCurve;
+
+void alsa_set_watchdog_timeout(guint timeout);
+void alsa_set_mixer_pool_size(guint size);
+void alsa_set_custom_curve(const gdouble *points, gsize n_values);
+gdouble alsa_curve_db_to_volume(AlsaCurve curve, gdouble db, gdouble db_min, gdouble db_max);
+
+struct alsa_output {
+	char *card_id;
+	char *card;
+	char *channel;
+	gboolean muted;
+	gdouble volume;
+	gboolean available; /* Something is plugged in */
+};
+
+typedef struct alsa_output AlsaOutput;
+
+typedef void (*AlsaOutputsCb) (gpointer data);
+
+gboolean alsa_outputs_watch(const char *card_id, const char *channel, AlsaCurve curve);
+void alsa_outputs_prune(void);
+void alsa_outputs_unwatch_all(void);
+const GList *alsa_outputs_get_list(void);
+void alsa_outputs_install_callback(AlsaOutputsCb callback, gpointer data);
+
+enum alsa_jack {
+	ALSA_JACK_HEADPHONE,
+	ALSA_JACK_LINE_OUT,
+	ALSA_JACK_SPEAKER,
+	ALSA_JACK_OTHER
+};
+
+typedef enum alsa_jack AlsaJack;
 
 typedef struct alsa_card AlsaCard;
 
-AlsaCard *alsa_card_new(const char *card, const char *channel, gboolean normalize);
+AlsaCard *alsa_card_new(const char *card_id, const char *channel, AlsaCurve curve);
 void alsa_card_free(AlsaCard *card);
 
 enum alsa_event {
 	ALSA_CARD_ERROR,
 	ALSA_CARD_DISCONNECTED,
-	ALSA_CARD_VALUES_CHANGED
+	ALSA_CARD_VALUES_CHANGED,
+	ALSA_CARD_JACKS_CHANGED,
+	ALSA_CARD_CAPTURE_CHANGED
 };
 
 typedef void (*AlsaCb) (enum alsa_event event, gpointer data);
 void alsa_card_install_callback(AlsaCard *card, AlsaCb callback, gpointer data);
 
+const char *alsa_card_get_id(AlsaCard *card);
 const char *alsa_card_get_name(AlsaCard *card);
 const char *alsa_card_get_channel(AlsaCard *card);
+gboolean alsa_card_has_channel(AlsaCard *card, const char *channel);
+gboolean alsa_card_set_channel(AlsaCard *card, const char *channel);
+gboolean alsa_card_has_jack(AlsaCard *card, AlsaJack jack);
+gboolean alsa_card_is_jack_plugged(AlsaCard *card, AlsaJack jack);
+gboolean alsa_card_set_capture_channel(AlsaCard *card, const char *channel);
+const char *alsa_card_get_capture_channel(AlsaCard *card);
+gboolean alsa_card_is_capture_muted(AlsaCard *card);
+void alsa_card_toggle_capture_mute(AlsaCard *card);
+gdouble alsa_card_get_capture_volume(AlsaCard *card);
+void alsa_card_set_capture_volume(AlsaCard *card, gdouble value, int dir);
 gboolean alsa_card_is_muted(AlsaCard *card);
 void alsa_card_toggle_mute(AlsaCard *card);
 gdouble alsa_card_get_volume(AlsaCard *card);
 void alsa_card_set_volume(AlsaCard *card, gdouble value, int dir);
+guint alsa_card_get_n_channels(AlsaCard *card);
+const char *alsa_card_get_channel_name(AlsaCard *card, guint index);
+gdouble alsa_card_get_channel_volume(AlsaCard *card, guint index);
+void alsa_card_set_channel_volume(AlsaCard *card, guint index, gdouble value, int dir);
+gdouble alsa_card_get_balance(AlsaCard *card);
+void alsa_card_set_balance(AlsaCard *card, gdouble balance);
+gboolean alsa_card_get_db_range(AlsaCard *card, gdouble *db_min, gdouble *db_max);
+gdouble alsa_card_get_db(AlsaCard *card);
+void alsa_card_set_db(AlsaCard *card, gdouble db, int dir);
 
 #endif				// _ALSA_H_
@@ -11,17 +11,21 @@
 /**
  * @file audio.c
  * This file holds the audio related code.
- * It is a middleman between the low-level audio backend (alsa),
- * and the high-level ui code.
+ * It is a middleman between the low-level audio backend (alsa,
+ * or the mock mixer), and the high-level ui code.
  * This abstraction layer allows the high-level code to be completely
  * unaware of the underlying audio implementation, may it be alsa or whatever.
  * @brief Audio subsystem.
  */
 
+#include <stdio.h>
+#include <string.h>
 #include <glib.h>
+#include <gio/gio.h>
 
 #include "audio.h"
 #include "alsa.h"
+#include "backend.h"
 #include "prefs.h"
 #include "support-log.h"
 
@@ -39,6 +43,8 @@ audio_user_to_str(AudioUser user)
 		return "tray icon";
 	case AUDIO_USER_HOTKEYS:
 		return "hotkeys";
+	case AUDIO_USER_SOCKET:
+		return "socket";
 	default:
 		return "unknown";
 	}
@@ -60,11 +66,89 @@ audio_signal_to_str(AudioSignal signal)
 		return "card error";
 	case AUDIO_VALUES_CHANGED:
 		return "values changed";
+	case AUDIO_OUTPUTS_CHANGED:
+		return "outputs changed";
+	case AUDIO_CAPTURE_CHANGED:
+		return "capture changed";
+	case AUDIO_STREAM_ADDED:
+		return "stream added";
+	case AUDIO_STREAM_CHANGED:
+		return "stream changed";
+	case AUDIO_STREAM_REMOVED:
+		return "stream removed";
 	default:
 		return "unknown";
 	}
 }
 
+/*
+ * Volume curves, as they're named in the preferences.
+ */
+
+static const gchar *audio_curve_names[] = {
+	[ALSA_CURVE_LINEAR] = "linear",
+	[ALSA_CURVE_LINEAR_DB] = "linear-db",
+	[ALSA_CURVE_ALSAMIXER] = "alsamixer",
+	[ALSA_CURVE_LOUDNESS] = "loudness",
+	[ALSA_CURVE_CUSTOM] = "custom"
+};
+
+static const gchar *
+audio_curve_to_str(AlsaCurve curve)
+{
+	if (curve >= G_N_ELEMENTS(audio_curve_names))
+		return "unknown";
+
+	return audio_curve_names[curve];
+}
+
+static AlsaCurve
+audio_curve_from_str(const gchar *str)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(audio_curve_names); i++)
+		if (!g_strcmp0(str, audio_curve_names[i]))
+			return i;
+
+	WARN("Unknown volume curve '%s'", str);
+	return ALSA_CURVE_ALSAMIXER;
+}
+
+/*
+ * Control group policies, as they're named in the preferences.
+ */
+
+enum audio_group_policy {
+	AUDIO_GROUP_LOCKSTEP,
+	AUDIO_GROUP_CASCADE,
+	AUDIO_GROUP_MASTER_FIRST,
+};
+
+typedef enum audio_group_policy AudioGroupPolicy;
+
+static const gchar *audio_group_policy_names[] = {
+	[AUDIO_GROUP_LOCKSTEP] = "lockstep",
+	[AUDIO_GROUP_CASCADE] = "cascade",
+	[AUDIO_GROUP_MASTER_FIRST] = "master-first"
+};
+
+static AudioGroupPolicy
+audio_group_policy_from_str(const gchar *str)
+{
+	guint i;
+
+	if (str == NULL)
+		return AUDIO_GROUP_LOCKSTEP;
+
+	for (i = 0; i < G_N_ELEMENTS(audio_group_policy_names); i++)
+		if (!g_strcmp0(str, audio_group_policy_names[i]))
+			return i;
+
+	WARN("Unknown control group policy '%s'", str);
+	return AUDIO_GROUP_LOCKSTEP;
+}
+
 /*
  * Audio Event.
  * An audio event is a struct that contains the current audio status.
@@ -102,6 +186,9 @@ audio_event_new(Audio *audio, AudioSignal signal, AudioUser user)
 	event->channel = audio_get_channel(audio);
 	event->muted = audio_is_muted(audio);
 	event->volume = audio_get_volume(audio);
+	event->balance = audio_get_balance(audio);
+	event->capture_muted = audio_is_capture_muted(audio);
+	event->capture_volume = audio_get_capture_volume(audio);
 
 	return event;
 }
@@ -197,16 +284,50 @@ audio_handler_list_remove(GSList *list, AudioHandler *handler)
 struct audio {
 	/* Preferences */
 	gdouble scroll_step;
-	gboolean normalize;
-	/* Underlying sound card */
-	AlsaCard *soundcard;
+	AlsaCurve curve;
+	gchar *wanted_card;
+	/* Underlying sound card, and its backend */
+	const Backend *backend;
+	BackendCard *soundcard;
+	/* Control group, elements driven along with the soundcard */
+	GPtrArray *group;
+	AudioGroupPolicy group_policy;
 	/* Cached value (to avoid querying the underlying
 	 * sound card each time we need the info).
 	 */
+	gchar *card_id;
 	gchar *card;
 	gchar *channel;
 	/* Last action performed (volume/mute change) */
 	gint64 last_action_timestamp;
+	gint64 capture_timestamp;
+	/* Volume ramp */
+	guint ramp_source;
+	guint ramp_time; /* ms, for volume steps */
+	AudioUser ramp_user;
+	gint64 ramp_start;
+	gint64 ramp_duration;
+	gdouble ramp_from;
+	gdouble ramp_to;
+	gboolean ramp_mute; /* Mute at the end, then restore the volume */
+	gdouble ramp_restore;
+	/* Reconnection scheduler */
+	guint reconnect_source;
+	guint reconnect_delay;
+	gboolean reconnect_full;
+	GFileMonitor *hotplug_monitor;
+	/* Output monitor */
+	guint outputs_source;
+	gboolean follow_outputs;
+	gboolean follow_jacks;
+	gchar **output_priority;
+	gchar *available_outputs;
+	gint64 hooked_timestamp;
+	gint64 disconnect_timestamp;
+	/* Stream the signal being dispatched is about */
+	const AudioStream *event_stream;
+	/* Changes are part of a burst, see audio_set_repeat() */
+	gboolean repeat;
 	/* User signal handlers.
 	 * To be invoked when the audio status changes.
 	 */
@@ -232,6 +353,8 @@ invoke_handlers(Audio *audio, AudioSignal signal, AudioUser user)
 
 	/* Create a new event */
 	event = audio_event_new(audio, signal, user);
+	event->stream = audio->event_stream;
+	event->repeat = audio->repeat;
 
 	/* Invoke the various handlers around */
 	DEBUG("** Dispatching signal '%s' from '%s', vol=%lg, muted=%s",
@@ -247,6 +370,11 @@ invoke_handlers(Audio *audio, AudioSignal signal, AudioUser user)
 	audio_event_free(event);
 }
 
+static void audio_handle_disconnection(Audio *audio);
+static gboolean audio_follow_jacks(Audio *audio);
+static void audio_group_hook(Audio *audio);
+static void audio_group_unhook(Audio *audio);
+
 /**
  * Callback invoked when an alsa event happens.
  *
@@ -258,6 +386,26 @@ on_alsa_event(enum alsa_event event, gpointer data)
 {
 	Audio *audio = (Audio *) data;
 
+	/* Jacks are never changed by us. If we now control another element,
+	 * the control group is built again around it.
+	 */
+	if (event == ALSA_CARD_JACKS_CHANGED) {
+		if (audio_follow_jacks(audio)) {
+			audio_group_unhook(audio);
+			audio_group_hook(audio);
+			invoke_handlers(audio, AUDIO_VALUES_CHANGED, AUDIO_USER_UNKNOWN);
+		}
+		return;
+	}
+
+	/* Capture changes have their own trace */
+	if (event == ALSA_CARD_CAPTURE_CHANGED) {
+		if (g_get_monotonic_time() - audio->capture_timestamp >= 1000000)
+			invoke_handlers(audio, AUDIO_CAPTURE_CHANGED, AUDIO_USER_UNKNOWN);
+		audio->capture_timestamp = 0;
+		return;
+	}
+
 	/* If we are responsible for this event (aka we changed the volume/mute
 	 * values beforehand), we know that we left a timestamp to indicate
 	 * when the action was performed.
@@ -296,16 +444,325 @@ on_alsa_event(enum alsa_event event, gpointer data)
 		invoke_handlers(audio, AUDIO_CARD_ERROR, AUDIO_USER_UNKNOWN);
 		break;
 	case ALSA_CARD_DISCONNECTED:
-		invoke_handlers(audio, AUDIO_CARD_DISCONNECTED, AUDIO_USER_UNKNOWN);
+		audio_handle_disconnection(audio);
+		break;
+	case ALSA_CARD_VALUES_CHANGED:
+		invoke_handlers(audio, AUDIO_VALUES_CHANGED, AUDIO_USER_UNKNOWN);
+		break;
+	default:
+		WARN("Unhandled alsa event: %d", event);
+	}
+}
+
+/*
+ * Control groups.
+ * A control group binds several elements, possibly from different cards,
+ * to the volume of the hooked soundcard, that we call the master.
+ * The master is the first element of the group, then come the members
+ * in the order given in the preferences. Muting, balance and channels
+ * only concern the master.
+ *
+ * There are several ways to spread the volume over the elements:
+ * - lockstep: every element is set to the same volume.
+ * - cascade: the elements are like faders in a chain. Attenuation is
+ *   applied to the last element first, and when it reaches its lowest
+ *   audible level, the element before takes over, and so on.
+ * - master-first: same as above, but in the opposite order, the master
+ *   takes the attenuation first.
+ * With the last two policies, the levels add up in the dB domain, so the
+ * group has a wider dynamic range than any of its elements. It requires
+ * every element to have a dB scale, otherwise we fall back to lockstep.
+ *
+ * Every element is computed first, then written, all at once.
+ */
+
+struct audio_group_member {
+	Audio *audio;
+	BackendCard *card;
+	gint64 write_timestamp; /* Our last write, until its event comes */
+};
+
+typedef struct audio_group_member AudioGroupMember;
+
+/* Free a group member */
+static void
+audio_group_member_free(AudioGroupMember *member)
+{
+	member->audio->backend->card_free(member->card);
+	g_free(member);
+}
+
+/* Callback invoked when an alsa event happens on a group member.
+ * Our own writes must be ignored. Like for the master, the timestamp
+ * is discarded after use, so that the next change is reported.
+ */
+static void
+on_group_member_event(enum alsa_event event, gpointer data)
+{
+	AudioGroupMember *member = (AudioGroupMember *) data;
+	Audio *audio = member->audio;
+
+	switch (event) {
+	case ALSA_CARD_ERROR:
+	case ALSA_CARD_DISCONNECTED:
+		WARN("Control group member '%s' (%s) is gone, removing it",
+		     audio->backend->card_get_name(member->card),
+		     audio->backend->card_get_channel(member->card));
+		g_ptr_array_remove(audio->group, member);
+		invoke_handlers(audio, AUDIO_VALUES_CHANGED, AUDIO_USER_UNKNOWN);
 		break;
 	case ALSA_CARD_VALUES_CHANGED:
+		if (member->write_timestamp) {
+			gint64 delay = g_get_monotonic_time() - member->write_timestamp;
+
+			member->write_timestamp = 0;
+			if (delay < 1000000)
+				break;
+		}
 		invoke_handlers(audio, AUDIO_VALUES_CHANGED, AUDIO_USER_UNKNOWN);
 		break;
+	case ALSA_CARD_JACKS_CHANGED:
+	case ALSA_CARD_CAPTURE_CHANGED:
+		break;
 	default:
 		WARN("Unhandled alsa event: %d", event);
 	}
 }
 
+/* Get an element of the group, the master being the first one */
+static BackendCard *
+audio_group_get(Audio *audio, guint index)
+{
+	AudioGroupMember *member;
+
+	if (index == 0)
+		return audio->soundcard;
+
+	member = g_ptr_array_index(audio->group, index - 1);
+	return member->card;
+}
+
+/* Get the number of elements in the group, including the master */
+static guint
+audio_group_size(Audio *audio)
+{
+	if (audio->group == NULL)
+		return 1;
+
+	return audio->group->len + 1;
+}
+
+/* Get the dB range of the whole group, that is the sum of the elements
+ * dB ranges. Return FALSE if an element doesn't have a dB scale.
+ */
+static gboolean
+audio_group_get_db_range(Audio *audio, gdouble *db_min, gdouble *db_max)
+{
+	guint i;
+
+	*db_min = *db_max = 0;
+
+	for (i = 0; i < audio_group_size(audio); i++) {
+		gdouble min, max;
+
+		if (!audio->backend->card_get_db_range(audio_group_get(audio, i),
+		                                       &min, &max))
+			return FALSE;
+
+		*db_min += min;
+		*db_max += max;
+	}
+
+	return TRUE;
+}
+
+/* Get the volume of the group, in percent */
+static gdouble
+audio_group_get_volume(Audio *audio)
+{
+	gdouble db_min, db_max, db;
+	guint i;
+
+	if (audio->group == NULL || audio->group_policy == AUDIO_GROUP_LOCKSTEP ||
+	    !audio_group_get_db_range(audio, &db_min, &db_max))
+		return audio->backend->card_get_volume(audio->soundcard);
+
+	/* Silent if any element is down */
+	for (i = 0; i < audio_group_size(audio); i++)
+		if (audio->backend->card_get_volume(audio_group_get(audio, i)) <= 0)
+			return 0;
+
+	for (db = 0, i = 0; i < audio_group_size(audio); i++)
+		db += audio->backend->card_get_db(audio_group_get(audio, i));
+
+	return alsa_curve_db_to_volume(audio->curve, db, db_min, db_max);
+}
+
+/* After writing an element of the group, remember to ignore its event.
+ * Nothing comes if the write didn't change anything, though.
+ */
+static void
+audio_group_written(Audio *audio, guint index, gdouble before)
+{
+	AudioGroupMember *member;
+
+	if (index == 0)
+		return;
+
+	member = g_ptr_array_index(audio->group, index - 1);
+	if (audio->backend->card_get_volume(member->card) != before)
+		member->write_timestamp = g_get_monotonic_time();
+}
+
+/* Set the volume of the group, in percent */
+static void
+audio_group_set_volume(Audio *audio, gdouble volume, gint dir)
+{
+	gdouble db_min, db_max, db_lo, db_hi, attenuation;
+	gdouble *targets;
+	guint i, n;
+
+	if (audio->group == NULL) {
+		audio->backend->card_set_volume(audio->soundcard, volume, dir);
+		return;
+	}
+
+	n = audio_group_size(audio);
+
+	if (audio->group_policy == AUDIO_GROUP_LOCKSTEP || volume <= 0 ||
+	    !audio_group_get_db_range(audio, &db_min, &db_max)) {
+		for (i = 0; i < n; i++) {
+			BackendCard *card = audio_group_get(audio, i);
+			gdouble before = audio->backend->card_get_volume(card);
+
+			audio->backend->card_set_volume(card, volume, dir);
+			audio_group_written(audio, i, before);
+		}
+		return;
+	}
+
+	/* Find the dB level of the group. Curves are increasing,
+	 * so a bisection does the job.
+	 */
+	db_lo = db_min;
+	db_hi = db_max;
+	for (i = 0; i < 32; i++) {
+		gdouble db = (db_lo + db_hi) / 2;
+
+		if (alsa_curve_db_to_volume(audio->curve, db, db_min, db_max) < volume)
+			db_lo = db;
+		else
+			db_hi = db;
+	}
+
+	/* Spread the attenuation over the elements */
+	attenuation = db_max - db_hi;
+	targets = g_new(gdouble, n);
+
+	for (i = 0; i < n; i++) {
+		guint index;
+		gdouble min, max, taken;
+
+		index = audio->group_policy == AUDIO_GROUP_MASTER_FIRST ? i : n - 1 - i;
+		audio->backend->card_get_db_range(audio_group_get(audio, index),
+		                                  &min, &max);
+
+		taken = MIN(attenuation, max - min);
+		targets[index] = max - taken;
+		attenuation -= taken;
+	}
+
+	/* Now write everything */
+	for (i = 0; i < n; i++) {
+		BackendCard *card = audio_group_get(audio, i);
+		gdouble before = audio->backend->card_get_volume(card);
+
+		audio->backend->card_set_db(card, targets[i], dir);
+		audio_group_written(audio, i, before);
+	}
+
+	g_free(targets);
+}
+
+/* Create the members of the group, as given in the preferences */
+static void
+audio_group_hook(Audio *audio)
+{
+	gchar **elements, *policy;
+	guint i;
+
+	g_assert(audio->group == NULL);
+
+	elements = prefs_get_control_group(audio->card_id);
+	if (elements == NULL || elements[0] == NULL) {
+		g_strfreev(elements);
+		return;
+	}
+
+	policy = prefs_get_control_group_policy(audio->card_id);
+	audio->group_policy = audio_group_policy_from_str(policy);
+	g_free(policy);
+
+	audio->group = g_ptr_array_new_with_free_func
+	               ((GDestroyNotify) audio_group_member_free);
+
+	for (i = 0; elements[i]; i++) {
+		AudioGroupMember *member;
+		BackendCard *card;
+		gchar *channel, *card_id;
+
+		/* Elements are 'channel', or 'channel@card id' */
+		channel = elements[i];
+		card_id = strchr(channel, '@');
+		if (card_id)
+			*card_id++ = '\0';
+		else
+			card_id = audio->card_id;
+
+		/* That one is already controlled, when following the jacks */
+		if (!g_strcmp0(card_id, audio->card_id) &&
+		    !g_strcmp0(channel, audio->channel))
+			continue;
+
+		card = audio->backend->card_new(card_id, channel, audio->curve);
+		if (card == NULL) {
+			WARN("Can't add '%s' (%s) to the control group", card_id, channel);
+			continue;
+		}
+
+		member = g_new0(AudioGroupMember, 1);
+		member->audio = audio;
+		member->card = card;
+		audio->backend->card_install_callback(card, on_group_member_event, member);
+		g_ptr_array_add(audio->group, member);
+	}
+
+	DEBUG("Control group hooked (%u elements, policy: %s)",
+	      audio_group_size(audio),
+	      audio_group_policy_names[audio->group_policy]);
+
+	if (audio->group_policy != AUDIO_GROUP_LOCKSTEP) {
+		gdouble db_min, db_max;
+
+		if (!audio_group_get_db_range(audio, &db_min, &db_max))
+			WARN("Some control group elements have no dB scale, "
+			     "falling back to lockstep");
+	}
+
+	g_strfreev(elements);
+}
+
+/* Free the members of the group */
+static void
+audio_group_unhook(Audio *audio)
+{
+	if (audio->group == NULL)
+		return;
+
+	g_ptr_array_free(audio->group, TRUE);
+	audio->group = NULL;
+}
+
 /**
  * Disconnect a signal handler designed by 'callback' and 'data'.
  *
@@ -341,6 +798,46 @@ audio_signals_connect(Audio *audio, AudioCallback callback, gpointer data)
 	audio->handlers = audio_handler_list_append(audio->handlers, handler);
 }
 
+/**
+ * Mark the next changes as part of a burst, like a held hotkey.
+ * Their events have the 'repeat' field set, so that handlers may skip
+ * them. Once the burst is over, audio_signal_values() sends the last
+ * event.
+ *
+ * @param audio an Audio instance.
+ * @param repeat TRUE at the beginning of a burst, FALSE at the end.
+ */
+void
+audio_set_repeat(Audio *audio, gboolean repeat)
+{
+	audio->repeat = repeat;
+}
+
+/**
+ * Send the current values to the handlers, as if they just changed.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performed the last action.
+ */
+void
+audio_signal_values(Audio *audio, AudioUser user)
+{
+	invoke_handlers(audio, AUDIO_VALUES_CHANGED, user);
+}
+
+/**
+ * Get the id of the card currently hooked.
+ * This is an internal string that shouldn't be modified.
+ *
+ * @param audio an Audio instance.
+ * @return the id of the card.
+ */
+const char *
+audio_get_card_id(Audio *audio)
+{
+	return audio->card_id;
+}
+
 /**
  * Get the name of the card currently hooked.
  * This is an internal string that shouldn't be modified.
@@ -376,12 +873,12 @@ audio_get_channel(Audio *audio)
 gboolean
 audio_is_muted(Audio *audio)
 {
-	AlsaCard *soundcard = audio->soundcard;
+	BackendCard *soundcard = audio->soundcard;
 
 	if (!soundcard)
 		return TRUE;
 
-	return alsa_card_is_muted(soundcard);
+	return audio->backend->card_is_muted(soundcard);
 }
 
 /**
@@ -393,17 +890,20 @@ audio_is_muted(Audio *audio)
 void
 audio_toggle_mute(Audio *audio, AudioUser user)
 {
-	AlsaCard *soundcard = audio->soundcard;
+	BackendCard *soundcard = audio->soundcard;
 
 	/* Discard if no soundcard available */
 	if (!soundcard)
 		return;
 
+	/* Stop fading, and toggle right now */
+	audio_ramp_cancel(audio);
+
 	/* Leave a trace */
-	audio->last_action_timestamp = g_get_real_time();
+	audio->last_action_timestamp = g_get_monotonic_time();
 
 	/* Toggle mute state */
-	alsa_card_toggle_mute(soundcard);
+	audio->backend->card_toggle_mute(soundcard);
 
 	/* Invoke the handlers */
 	invoke_handlers(audio, AUDIO_VALUES_CHANGED, user);
@@ -418,12 +918,12 @@ audio_toggle_mute(Audio *audio, AudioUser user)
 gdouble
 audio_get_volume(Audio *audio)
 {
-	AlsaCard *soundcard = audio->soundcard;
+	BackendCard *soundcard = audio->soundcard;
 
 	if (!soundcard)
 		return 0;
 
-	return alsa_card_get_volume(soundcard);
+	return audio_group_get_volume(audio);
 }
 
 /**
@@ -440,7 +940,7 @@ void
 _audio_set_volume(Audio *audio, AudioUser user, gdouble cur_volume,
                   gdouble new_volume, gint dir)
 {
-	AlsaCard *soundcard = audio->soundcard;
+	BackendCard *soundcard = audio->soundcard;
 
 	/* Discard if no soundcard available */
 	if (!soundcard)
@@ -449,23 +949,23 @@ _audio_set_volume(Audio *audio, AudioUser user, gdouble cur_volume,
 	/* Set the volume */
 	DEBUG("Setting volume from %lg to %lg (dir: %d)",
 	      cur_volume, new_volume, dir);
-	alsa_card_set_volume(soundcard, new_volume, dir);
+	audio_group_set_volume(audio, new_volume, dir);
 
 	/* Automatically unmute the volume */
-	if (alsa_card_is_muted(soundcard))
-		alsa_card_toggle_mute(soundcard);
+	if (audio->backend->card_is_muted(soundcard))
+		audio->backend->card_toggle_mute(soundcard);
 
 	/* Check if the volume really changed. If it doesn't,
 	 * there's no need to invoke any handlers. It also means
 	 * that no alsa callback will be triggered, so we don't
 	 * save the 'last_action_timestamp'.
 	 */
-	new_volume = alsa_card_get_volume(soundcard);
+	new_volume = audio_group_get_volume(audio);
 	if (new_volume == cur_volume)
 		return;
 
 	/* Leave a trace */
-	audio->last_action_timestamp = g_get_real_time();
+	audio->last_action_timestamp = g_get_monotonic_time();
 
 	/* Invoke handlers manually.
 	 * In theory, we could skip this step, since the Alsa callback
@@ -481,10 +981,11 @@ _audio_set_volume(Audio *audio, AudioUser user, gdouble cur_volume,
 void
 audio_set_volume(Audio *audio, AudioUser user, gdouble new_volume, gint dir)
 {
-	AlsaCard *soundcard = audio->soundcard;
 	gdouble cur_volume;
 
-	cur_volume = alsa_card_get_volume(soundcard);
+	audio_ramp_cancel(audio);
+
+	cur_volume = audio_get_volume(audio);
 	_audio_set_volume(audio, user, cur_volume, new_volume, dir);
 }
 
@@ -497,11 +998,16 @@ audio_set_volume(Audio *audio, AudioUser user, gdouble new_volume, gint dir)
 void
 audio_lower_volume(Audio *audio, AudioUser user)
 {
-	AlsaCard *soundcard = audio->soundcard;
 	gdouble scroll_step = audio->scroll_step;
 	gdouble cur_volume, new_volume;
 
-	cur_volume = alsa_card_get_volume(soundcard);
+	if (audio->ramp_time) {
+		new_volume = audio->ramp_source ? audio->ramp_to : audio_get_volume(audio);
+		audio_ramp_volume(audio, user, new_volume - scroll_step, audio->ramp_time);
+		return;
+	}
+
+	cur_volume = audio_get_volume(audio);
 	new_volume = cur_volume - scroll_step;
 	if (new_volume < 0)
 		new_volume = 0;
@@ -517,128 +1023,1313 @@ audio_lower_volume(Audio *audio, AudioUser user)
 void
 audio_raise_volume(Audio *audio, AudioUser user)
 {
-	AlsaCard *soundcard = audio->soundcard;
 	gdouble scroll_step = audio->scroll_step;
 	gdouble cur_volume, new_volume;
 
-	cur_volume = alsa_card_get_volume(soundcard);
+	if (audio->ramp_time) {
+		new_volume = audio->ramp_source ? audio->ramp_to : audio_get_volume(audio);
+		audio_ramp_volume(audio, user, new_volume + scroll_step, audio->ramp_time);
+		return;
+	}
+
+	cur_volume = audio_get_volume(audio);
 	new_volume = cur_volume + scroll_step;
 	if (new_volume > 100)
 		new_volume = 100;
 	_audio_set_volume(audio, user, cur_volume, new_volume, +1);
 }
 
-/**
- * Unhook the currently hooked audio card.
- *
- * @param audio an Audio instance.
+/*
+ * Volume ramps.
+ * A ramp drives the volume to a target over a given duration. The
+ * position in the ramp is computed from the monotonic clock, so late
+ * timer ticks don't stretch the ramp. The volume is written on each
+ * tick, but the alsa layer only touches the hardware when the raw step
+ * changes. A new ramp starts from the current volume, cancelling the
+ * previous one, and the timer is removed as soon as the ramp is over.
+ * The ticks are a burst of changes, their events are repeats, and a
+ * last event is sent at the end of the ramp.
  */
-static void
-audio_unhook_soundcard(Audio *audio)
-{
-	if (audio->soundcard == NULL)
-		return;
-
-	DEBUG("Unhooking soundcard from the audio system");
 
-	/* Free the soundcard */
-	alsa_card_free(audio->soundcard);
-	audio->soundcard = NULL;
-
-	/* Invoke user handlers */
-	invoke_handlers(audio, AUDIO_CARD_CLEANED_UP, AUDIO_USER_UNKNOWN);
-}
+#define RAMP_INTERVAL 20 /* ms */
 
-/**
- * Attempt to hook an audio soundcard.
- * Try everything possible, the goal is to have a working soundcard.
- * So if the selected soundcard fails, we try any others until at some
- * point we have a working soundcard.
- *
- * @param audio an Audio instance.
+/* Finish the ramp: mute and restore the volume if it was a fade out,
+ * then send the last event.
  */
 static void
-audio_hook_soundcard(Audio *audio)
+audio_ramp_finish(Audio *audio)
 {
-	AlsaCard *soundcard;
-	GSList *card_list, *item;
+	BackendCard *soundcard = audio->soundcard;
 
-	g_assert(audio->soundcard == NULL);
+	if (audio->ramp_mute) {
+		audio->ramp_mute = FALSE;
 
-	/* Attempt to create the card */
-	DEBUG("Hooking soundcard '%s (%s)' to the audio system", audio->card, audio->channel);
+		if (!audio->backend->card_is_muted(soundcard))
+			audio->backend->card_toggle_mute(soundcard);
+		audio_group_set_volume(audio, audio->ramp_restore, 0);
 
-	soundcard = alsa_card_new(audio->card, audio->channel, audio->normalize);
-	if (soundcard)
-		goto end;
+		audio->last_action_timestamp = g_get_monotonic_time();
+	}
 
-	/* On failure, try to create the card from the list of available cards.
-	 * We don't try with the card name that just failed.
-	 */
-	DEBUG("Could not hook soundcard, trying every card available");
+	invoke_handlers(audio, AUDIO_VALUES_CHANGED, audio->ramp_user);
+}
 
-	card_list = alsa_list_cards();
-	item = g_slist_find_custom(card_list, audio->card, (GCompareFunc) g_strcmp0);
-	if (item) {
-		DEBUG("Removing '%s' from card list", (char *) item->data);
-		card_list = g_slist_remove(card_list, item);
-		g_slist_free_full(item, g_free);
+static gboolean
+on_ramp_timeout(Audio *audio)
+{
+	gint64 elapsed;
+	gdouble progress, volume;
+	gboolean repeat;
+	gint dir;
+
+	if (!audio->soundcard) {
+		audio->ramp_source = 0;
+		return G_SOURCE_REMOVE;
 	}
 
-	/* Now iterate on card list and attempt to get a working soundcard */
-	for (item = card_list; item; item = item->next) {
-		const char *card = item->data;
-		char *channel;
+	elapsed = g_get_monotonic_time() - audio->ramp_start;
+	if (elapsed >= audio->ramp_duration)
+		progress = 1;
+	else
+		progress = (gdouble) elapsed / audio->ramp_duration;
 
-		channel = prefs_get_channel(card);
-		soundcard = alsa_card_new(card, channel, audio->normalize);
-		g_free(channel);
+	volume = audio->ramp_from + (audio->ramp_to - audio->ramp_from) * progress;
+	dir = audio->ramp_to > audio->ramp_from ? +1 : -1;
 
-		if (soundcard)
-			break;
-	}
+	repeat = audio->repeat;
+	audio->repeat = TRUE;
+	_audio_set_volume(audio, audio->ramp_user, audio_get_volume(audio),
+	                  volume, dir);
+	audio->repeat = repeat;
 
-	/* Free card list */
-	g_slist_free_full(card_list, g_free);
+	if (progress < 1)
+		return G_SOURCE_CONTINUE;
 
-end:
-	/* Save soundcard NOW !
-	 * We're going to invoke handlers later on, and these guys
-	 * need a valid soundcard pointer.
-	 */
-	audio->soundcard = soundcard;
+	audio->ramp_source = 0;
+	audio_ramp_finish(audio);
 
-	/* Finish making everything ready */
-	if (soundcard == NULL) {
-		DEBUG("No soundcard could be hooked !");
+	return G_SOURCE_REMOVE;
+}
 
-		/* Card and channel names set to emptry string */
-		g_free(audio->card);
-		audio->card = g_strdup("");
-		g_free(audio->channel);
-		audio->channel = g_strdup("");
+/* Start a ramp from the current volume */
+static void
+audio_ramp_start(Audio *audio, AudioUser user, gdouble volume, guint duration)
+{
+	if (audio->ramp_source)
+		g_source_remove(audio->ramp_source);
 
-		/* Tell the world */
-		invoke_handlers(audio, AUDIO_NO_CARD, AUDIO_USER_UNKNOWN);
-	} else {
-		DEBUG("Soundcard successfully hooked (scroll step: %lg, normalize: %s)",
-		      audio->scroll_step, audio->normalize ? "true" : "false");
+	audio->ramp_from = audio_get_volume(audio);
+	audio->ramp_to = CLAMP(volume, 0, 100);
+	audio->ramp_start = g_get_monotonic_time();
+	audio->ramp_duration = (gint64) duration * 1000;
+	audio->ramp_user = user;
 
-		/* Card and channel names must match the truth.
-		 * Indeed, in case of failure, we may end up using a soundcard
-		 * different from the one specified in the preferences.
+	DEBUG("Ramping volume from %lg to %lg in %u ms",
+	      audio->ramp_from, audio->ramp_to, duration);
+
+	audio->ramp_source = g_timeout_add(RAMP_INTERVAL,
+	                                   (GSourceFunc) on_ramp_timeout, audio);
+}
+
+/**
+ * Cancel the current ramp, if any. The volume stays where it is.
+ *
+ * @param audio an Audio instance.
+ */
+void
+audio_ramp_cancel(Audio *audio)
+{
+	if (audio->ramp_source == 0)
+		return;
+
+	g_source_remove(audio->ramp_source);
+	audio->ramp_source = 0;
+	audio->ramp_mute = FALSE;
+}
+
+/**
+ * Drive the volume to a target over a duration. If a ramp is already
+ * running, the new one takes over from the current volume.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param volume the target volume, in percent.
+ * @param duration the duration of the ramp, in milliseconds.
+ */
+void
+audio_ramp_volume(Audio *audio, AudioUser user, gdouble volume, guint duration)
+{
+	/* Discard if no soundcard available */
+	if (!audio->soundcard)
+		return;
+
+	audio->ramp_mute = FALSE;
+
+	if (duration == 0) {
+		audio_ramp_cancel(audio);
+		audio_set_volume(audio, user, volume, 0);
+		return;
+	}
+
+	audio_ramp_start(audio, user, volume, duration);
+}
+
+/**
+ * Fade out and mute, or unmute and fade in. Once muted, the volume
+ * is restored, so that it's back to its level when unmuting.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param duration the duration of the fade, in milliseconds.
+ */
+void
+audio_fade_toggle_mute(Audio *audio, AudioUser user, guint duration)
+{
+	BackendCard *soundcard = audio->soundcard;
+	gdouble volume;
+
+	/* Discard if no soundcard available */
+	if (!soundcard)
+		return;
+
+	/* A fade out is running, reverse it */
+	if (audio->ramp_source && audio->ramp_mute) {
+		audio->ramp_mute = FALSE;
+		audio_ramp_start(audio, user, audio->ramp_restore, duration);
+		return;
+	}
+
+	if (duration == 0) {
+		audio_ramp_cancel(audio);
+		audio_toggle_mute(audio, user);
+		return;
+	}
+
+	if (audio->backend->card_is_muted(soundcard)) {
+		/* Unmute silently, then fade in */
+		audio_ramp_cancel(audio);
+		volume = audio_get_volume(audio);
+		audio_group_set_volume(audio, 0, -1);
+		audio->backend->card_toggle_mute(soundcard);
+		audio->last_action_timestamp = g_get_monotonic_time();
+		audio_ramp_start(audio, user, volume, duration);
+	} else {
+		/* Fade out, the ramp will mute */
+		volume = audio->ramp_source ? audio->ramp_to : audio_get_volume(audio);
+		audio_ramp_start(audio, user, 0, duration);
+		audio->ramp_restore = volume;
+		audio->ramp_mute = TRUE;
+	}
+}
+
+/**
+ * Get the balance between left and right channels,
+ * from -100 (left only) to 100 (right only).
+ *
+ * @param audio an Audio instance.
+ * @return the balance.
+ */
+gdouble
+audio_get_balance(Audio *audio)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return 0;
+
+	return audio->backend->card_get_balance(soundcard);
+}
+
+/**
+ * Set the balance between left and right channels.
+ * Relative levels are kept when the volume changes afterward.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param balance the balance, from -100 (left only) to 100 (right only).
+ */
+void
+audio_set_balance(Audio *audio, AudioUser user, gdouble balance)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	/* Discard if no soundcard available */
+	if (!soundcard)
+		return;
+
+	DEBUG("Setting balance to %lg", balance);
+	audio->backend->card_set_balance(soundcard, balance);
+
+	/* Leave a trace */
+	audio->last_action_timestamp = g_get_monotonic_time();
+
+	/* Invoke the handlers */
+	invoke_handlers(audio, AUDIO_VALUES_CHANGED, user);
+}
+
+/**
+ * Get the number of channels of the current card.
+ *
+ * @param audio an Audio instance.
+ * @return the number of channels.
+ */
+guint
+audio_get_n_channels(Audio *audio)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return 0;
+
+	return audio->backend->card_get_n_channels(soundcard);
+}
+
+/**
+ * Get the name of a channel, like 'Front Left'.
+ *
+ * @param audio an Audio instance.
+ * @param index the index of the channel.
+ * @return the name of the channel, or NULL.
+ */
+const char *
+audio_get_channel_name(Audio *audio, guint index)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return NULL;
+
+	return audio->backend->card_get_channel_name(soundcard, index);
+}
+
+/**
+ * Get the volume of a channel in percent.
+ *
+ * @param audio an Audio instance.
+ * @param index the index of the channel.
+ * @return the volume in percent.
+ */
+gdouble
+audio_get_channel_volume(Audio *audio, guint index)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return 0;
+
+	return audio->backend->card_get_channel_volume(soundcard, index);
+}
+
+/**
+ * Set the volume of a channel, other channels are left untouched.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param index the index of the channel.
+ * @param volume the volume in percent.
+ */
+void
+audio_set_channel_volume(Audio *audio, AudioUser user, guint index, gdouble volume)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	/* Discard if no soundcard available */
+	if (!soundcard)
+		return;
+
+	DEBUG("Setting volume of channel %u to %lg", index, volume);
+	audio->backend->card_set_channel_volume(soundcard, index, volume, 0);
+
+	/* Leave a trace */
+	audio->last_action_timestamp = g_get_monotonic_time();
+
+	/* Invoke the handlers */
+	invoke_handlers(audio, AUDIO_VALUES_CHANGED, user);
+}
+
+/**
+ * Check whether the hooked card has a capture element.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if there's something to capture from, FALSE otherwise.
+ */
+gboolean
+audio_has_capture(Audio *audio)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return FALSE;
+
+	return audio->backend->card_get_capture_channel(soundcard) != NULL;
+}
+
+/**
+ * Get the name of the capture channel.
+ *
+ * @param audio an Audio instance.
+ * @return the name of the capture channel, or NULL if there's none.
+ */
+const char *
+audio_get_capture_channel(Audio *audio)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return NULL;
+
+	return audio->backend->card_get_capture_channel(soundcard);
+}
+
+/**
+ * Get the capture mute state.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if the capture is muted, FALSE otherwise.
+ */
+gboolean
+audio_is_capture_muted(Audio *audio)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return TRUE;
+
+	return audio->backend->card_is_capture_muted(soundcard);
+}
+
+/**
+ * Toggle the capture mute state.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ */
+void
+audio_toggle_capture_mute(Audio *audio, AudioUser user)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	/* Discard if no soundcard available */
+	if (!soundcard)
+		return;
+
+	/* Leave a trace */
+	audio->capture_timestamp = g_get_monotonic_time();
+
+	/* Toggle capture mute state */
+	audio->backend->card_toggle_capture_mute(soundcard);
+
+	/* Invoke the handlers */
+	invoke_handlers(audio, AUDIO_CAPTURE_CHANGED, user);
+}
+
+/**
+ * Get the capture volume in percent (value between 0 and 100).
+ *
+ * @param audio an Audio instance.
+ * @return the capture volume in percent.
+ */
+gdouble
+audio_get_capture_volume(Audio *audio)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	if (!soundcard)
+		return 0;
+
+	return audio->backend->card_get_capture_volume(soundcard);
+}
+
+/**
+ * Set the capture volume.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param volume the capture volume in percent.
+ */
+void
+audio_set_capture_volume(Audio *audio, AudioUser user, gdouble volume)
+{
+	BackendCard *soundcard = audio->soundcard;
+
+	/* Discard if no soundcard available */
+	if (!soundcard)
+		return;
+
+	volume = CLAMP(volume, 0, 100);
+
+	DEBUG("Setting capture volume to %lg", volume);
+	audio->backend->card_set_capture_volume(soundcard, volume, 0);
+
+	/* Leave a trace */
+	audio->capture_timestamp = g_get_monotonic_time();
+
+	/* Invoke the handlers */
+	invoke_handlers(audio, AUDIO_CAPTURE_CHANGED, user);
+}
+
+/*
+ * Streams.
+ * The backend keeps their state up to date, and tells us about
+ * every change, one stream at a time.
+ */
+
+static void
+audio_stream_from_backend(AudioStream *stream, const BackendStream *bstream)
+{
+	stream->id = bstream->id;
+	stream->name = bstream->name;
+	stream->icon = bstream->icon;
+	stream->muted = bstream->muted;
+	stream->volume = bstream->volume;
+}
+
+/* Dispatch a stream signal */
+static void
+audio_stream_signal(Audio *audio, AudioSignal signal, AudioUser user,
+                    const BackendStream *bstream)
+{
+	AudioStream stream;
+
+	audio_stream_from_backend(&stream, bstream);
+	audio->event_stream = &stream;
+	invoke_handlers(audio, signal, user);
+	audio->event_stream = NULL;
+}
+
+/* Callback invoked when a stream changes on the backend side */
+static void
+on_backend_stream_event(enum backend_stream_event event,
+                        const BackendStream *stream, gpointer data)
+{
+	Audio *audio = (Audio *) data;
+
+	switch (event) {
+	case BACKEND_STREAM_ADDED:
+		audio_stream_signal(audio, AUDIO_STREAM_ADDED, AUDIO_USER_UNKNOWN, stream);
+		break;
+	case BACKEND_STREAM_CHANGED:
+		audio_stream_signal(audio, AUDIO_STREAM_CHANGED, AUDIO_USER_UNKNOWN, stream);
+		break;
+	case BACKEND_STREAM_REMOVED:
+		audio_stream_signal(audio, AUDIO_STREAM_REMOVED, AUDIO_USER_UNKNOWN, stream);
+		break;
+	}
+}
+
+/* Find a stream in the backend list */
+static const BackendStream *
+audio_stream_find(Audio *audio, guint32 id)
+{
+	const GList *item;
+
+	for (item = audio->backend->streams_get_list(); item; item = item->next) {
+		const BackendStream *stream = item->data;
+
+		if (stream->id == id)
+			return stream;
+	}
+
+	return NULL;
+}
+
+/**
+ * Check whether the backend knows about the streams of the applications.
+ *
+ * @param audio an Audio instance.
+ * @return TRUE if streams are available, FALSE otherwise.
+ */
+gboolean
+audio_has_streams(Audio *audio)
+{
+	return audio->backend->streams_get_list != NULL;
+}
+
+/**
+ * Return the state of every stream, as a GSList of AudioStream.
+ * Strings are internal and valid until the streams change,
+ * the list must be freed using g_slist_free_full() and g_free().
+ *
+ * @param audio an Audio instance.
+ * @return a list of streams.
+ */
+GSList *
+audio_get_streams(Audio *audio)
+{
+	const GList *item;
+	GSList *list = NULL;
+
+	if (!audio_has_streams(audio))
+		return NULL;
+
+	for (item = audio->backend->streams_get_list(); item; item = item->next) {
+		AudioStream *stream;
+
+		stream = g_new0(AudioStream, 1);
+		audio_stream_from_backend(stream, item->data);
+		list = g_slist_prepend(list, stream);
+	}
+
+	return g_slist_reverse(list);
+}
+
+/**
+ * Set the volume of a stream.
+ * Like for the card, writes are batched by the backend, so it's fine
+ * to call it on every scroll or slider move.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param id the id of the stream.
+ * @param volume the volume in percent.
+ */
+void
+audio_set_stream_volume(Audio *audio, AudioUser user, guint32 id, gdouble volume)
+{
+	const BackendStream *stream;
+
+	if (!audio_has_streams(audio))
+		return;
+
+	volume = CLAMP(volume, 0, 100);
+
+	DEBUG("Setting stream %u volume to %lg", id, volume);
+	audio->backend->stream_set_volume(id, volume);
+
+	stream = audio_stream_find(audio, id);
+	if (stream)
+		audio_stream_signal(audio, AUDIO_STREAM_CHANGED, user, stream);
+}
+
+/**
+ * Toggle the mute state of a stream.
+ *
+ * @param audio an Audio instance.
+ * @param user the user who performs the action.
+ * @param id the id of the stream.
+ */
+void
+audio_toggle_stream_mute(Audio *audio, AudioUser user, guint32 id)
+{
+	const BackendStream *stream;
+
+	if (!audio_has_streams(audio))
+		return;
+
+	stream = audio_stream_find(audio, id);
+	if (stream == NULL)
+		return;
+
+	audio->backend->stream_set_mute(id, !stream->muted);
+
+	stream = audio_stream_find(audio, id);
+	if (stream)
+		audio_stream_signal(audio, AUDIO_STREAM_CHANGED, user, stream);
+}
+
+/**
+ * Unhook the currently hooked audio card.
+ *
+ * @param audio an Audio instance.
+ */
+static void
+audio_unhook_soundcard(Audio *audio)
+{
+	if (audio->soundcard == NULL)
+		return;
+
+	DEBUG("Unhooking soundcard from the audio system");
+
+	/* The ramp is lost along with the card */
+	audio_ramp_cancel(audio);
+
+	/* Free the soundcard, and the control group along */
+	audio_group_unhook(audio);
+	audio->backend->card_free(audio->soundcard);
+	audio->soundcard = NULL;
+
+	/* Invoke user handlers */
+	invoke_handlers(audio, AUDIO_CARD_CLEANED_UP, AUDIO_USER_UNKNOWN);
+}
+
+/**
+ * Attempt to find a working soundcard.
+ * Try everything possible, the goal is to have a working soundcard.
+ * So if the selected soundcard fails, we try any others until at some
+ * point we have a working soundcard.
+ *
+ * @param audio an Audio instance.
+ * @return a new BackendCard, or NULL if no card could be found.
+ */
+static BackendCard *
+audio_find_soundcard(Audio *audio)
+{
+	BackendCard *soundcard;
+	GSList *card_list, *item;
+	char *channel;
+
+	/* Attempt to create the card */
+	channel = prefs_get_channel(audio->wanted_card);
+	DEBUG("Hooking soundcard '%s (%s)' to the audio system",
+	      audio->wanted_card, channel);
+	soundcard = audio->backend->card_new(audio->wanted_card, channel, audio->curve);
+	g_free(channel);
+
+	if (soundcard)
+		return soundcard;
+
+	/* On failure, try to create the card from the list of available cards.
+	 * We don't try with the card name that just failed.
+	 */
+	DEBUG("Could not hook soundcard, trying every card available");
+
+	card_list = audio->backend->list_cards();
+	item = g_slist_find_custom(card_list, audio->wanted_card, (GCompareFunc) g_strcmp0);
+	if (item) {
+		DEBUG("Removing '%s' from card list", (char *) item->data);
+		card_list = g_slist_remove_link(card_list, item);
+		g_slist_free_full(item, g_free);
+	}
+
+	/* Now iterate on card list and attempt to get a working soundcard */
+	for (item = card_list; item; item = item->next) {
+		const char *card = item->data;
+
+		channel = prefs_get_channel(card);
+		soundcard = audio->backend->card_new(card, channel, audio->curve);
+		g_free(channel);
+
+		if (soundcard)
+			break;
+	}
+
+	/* Free card list */
+	g_slist_free_full(card_list, g_free);
+
+	return soundcard;
+}
+
+/**
+ * Hook a soundcard to the audio system, and tell the world.
+ *
+ * @param audio an Audio instance.
+ * @param soundcard the soundcard to hook, or NULL if none could be found.
+ */
+static void
+audio_attach_soundcard(Audio *audio, BackendCard *soundcard)
+{
+	gchar *channel;
+
+	g_assert(audio->soundcard == NULL);
+
+	/* Save soundcard NOW !
+	 * We're going to invoke handlers later on, and these guys
+	 * need a valid soundcard pointer.
+	 */
+	audio->soundcard = soundcard;
+
+	/* Finish making everything ready */
+	if (soundcard == NULL) {
+		DEBUG("No soundcard could be hooked !");
+
+		/* Card and channel names set to emptry string */
+		g_free(audio->card_id);
+		audio->card_id = g_strdup("");
+		g_free(audio->card);
+		audio->card = g_strdup("");
+		g_free(audio->channel);
+		audio->channel = g_strdup("");
+
+		/* Tell the world */
+		invoke_handlers(audio, AUDIO_NO_CARD, AUDIO_USER_UNKNOWN);
+	} else {
+		DEBUG("Soundcard successfully hooked (scroll step: %lg, curve: %s)",
+		      audio->scroll_step, audio_curve_to_str(audio->curve));
+
+		/* Card and channel names must match the truth.
+		 * Indeed, in case of failure, we may end up using a soundcard
+		 * different from the one specified in the preferences.
 		 */
+		g_free(audio->card_id);
+		audio->card_id = g_strdup(audio->backend->card_get_id(soundcard));
 		g_free(audio->card);
-		audio->card = g_strdup(alsa_card_get_name(soundcard));
+		audio->card = g_strdup(audio->backend->card_get_name(soundcard));
 		g_free(audio->channel);
-		audio->channel = g_strdup(alsa_card_get_channel(soundcard));
+		audio->channel = g_strdup(audio->backend->card_get_channel(soundcard));
+
+		/* Pick the element that matches the jacks */
+		audio_follow_jacks(audio);
+
+		/* Select the capture element */
+		channel = prefs_get_capture_channel(audio->card_id);
+		audio->backend->card_set_capture_channel(soundcard, channel);
+		g_free(channel);
+
+		/* Leave a trace, used to detect flapping cards */
+		audio->hooked_timestamp = g_get_monotonic_time();
+
+		/* Install callbacks */
+		audio->backend->card_install_callback(soundcard, on_alsa_event, audio);
+
+		/* Bring in the rest of the control group */
+		audio_group_hook(audio);
+
+		/* Tell the world */
+		invoke_handlers(audio, AUDIO_CARD_INITIALIZED, AUDIO_USER_UNKNOWN);
+	}
+}
+
+/* Control the element that matches the jacks of the hooked card: the
+ * headphones when they're plugged, then the line out, and the speakers
+ * otherwise. If the card doesn't have such an element, we fall back to
+ * the channel given in the preferences.
+ * Returns TRUE if the controlled element changed.
+ */
+static gboolean
+audio_follow_jacks(Audio *audio)
+{
+	BackendCard *soundcard = audio->soundcard;
+	const char *target = NULL;
+	gchar *channel;
+	gboolean changed;
+
+	if (!audio->follow_jacks || soundcard == NULL)
+		return FALSE;
+
+	if (audio->backend->card_is_jack_plugged(soundcard, ALSA_JACK_HEADPHONE))
+		target = "Headphone";
+	else if (audio->backend->card_is_jack_plugged(soundcard, ALSA_JACK_LINE_OUT))
+		target = "Line Out";
+	else if (audio->backend->card_has_jack(soundcard, ALSA_JACK_HEADPHONE) ||
+	         audio->backend->card_has_jack(soundcard, ALSA_JACK_LINE_OUT))
+		target = "Speaker";
+
+	channel = prefs_get_channel(audio->card_id);
+	if (!audio->backend->card_has_channel(soundcard, target))
+		target = channel;
+
+	changed = audio->backend->card_set_channel(soundcard, target);
+	g_free(channel);
+
+	if (!changed)
+		return FALSE;
+
+	DEBUG("Following jacks, now controlling '%s'",
+	      audio->backend->card_get_channel(soundcard));
+
+	g_free(audio->channel);
+	audio->channel = g_strdup(audio->backend->card_get_channel(soundcard));
+
+	return TRUE;
+}
+
+/**
+ * Attempt to hook an audio soundcard.
+ *
+ * @param audio an Audio instance.
+ */
+static void
+audio_hook_soundcard(Audio *audio)
+{
+	audio_attach_soundcard(audio, audio_find_soundcard(audio));
+}
+
+/*
+ * Output monitor.
+ * Every playable card is watched by the alsa layer, so that we know
+ * the state of all the outputs. The list of cards is refreshed when
+ * a device is plugged in, cards that disappear are dropped by the alsa
+ * layer itself.
+ */
+
+#define OUTPUTS_RESCAN_DELAY 300 /* ms, debounce hotplug bursts */
+
+static void audio_follow_outputs(Audio *audio);
 
-		/* Install callbacks */
-		alsa_card_install_callback(soundcard, on_alsa_event, audio);
+/* Callback invoked when the state of an output changes */
+static void
+on_alsa_outputs_changed(gpointer data)
+{
+	Audio *audio = (Audio *) data;
 
-		/* Tell the world */
-		invoke_handlers(audio, AUDIO_CARD_INITIALIZED, AUDIO_USER_UNKNOWN);
+	invoke_handlers(audio, AUDIO_OUTPUTS_CHANGED, AUDIO_USER_UNKNOWN);
+	audio_follow_outputs(audio);
+}
+
+/* Watch every playable card */
+static void
+audio_outputs_rescan(Audio *audio)
+{
+	GSList *card_list, *item;
+
+	card_list = audio->backend->list_cards();
+	for (item = card_list; item; item = item->next) {
+		const char *card_id = item->data;
+		gchar *channel;
+
+		channel = prefs_get_channel(card_id);
+		audio->backend->outputs_watch(card_id, channel, audio->curve);
+		g_free(channel);
+	}
+	g_slist_free_full(card_list, g_free);
+
+	audio->backend->outputs_prune();
+	audio->backend->outputs_install_callback(on_alsa_outputs_changed, audio);
+
+	on_alsa_outputs_changed(audio);
+}
+
+/* Watch a card that was just plugged in.
+ * Unlike a rescan, other cards are not opened.
+ */
+static gboolean
+audio_outputs_watch_card(Audio *audio, const char *card_id)
+{
+	gchar *channel;
+	gboolean watched;
+
+	channel = prefs_get_channel(card_id);
+	watched = audio->backend->outputs_watch(card_id, channel, audio->curve);
+	g_free(channel);
+
+	if (watched)
+		on_alsa_outputs_changed(audio);
+
+	return watched;
+}
+
+static gboolean
+on_outputs_rescan_timeout(Audio *audio)
+{
+	audio->outputs_source = 0;
+
+	DEBUG("Rescanning outputs");
+	audio_outputs_rescan(audio);
+
+	return FALSE;
+}
+
+/* Rescan the outputs soon */
+static void
+audio_outputs_schedule_rescan(Audio *audio)
+{
+	if (audio->outputs_source)
+		g_source_remove(audio->outputs_source);
+
+	audio->outputs_source = g_timeout_add(OUTPUTS_RESCAN_DELAY,
+	                                      (GSourceFunc) on_outputs_rescan_timeout,
+	                                      audio);
+}
+
+/* Stop watching the outputs */
+static void
+audio_outputs_stop(Audio *audio)
+{
+	if (audio->outputs_source) {
+		g_source_remove(audio->outputs_source);
+		audio->outputs_source = 0;
+	}
+
+	audio->backend->outputs_install_callback(NULL, NULL);
+	audio->backend->outputs_unwatch_all();
+}
+
+/*
+ * Reconnection scheduler.
+ * When the soundcard is disconnected, or when the preferred soundcard
+ * couldn't be hooked, we keep trying to hook it in the background.
+ * Attempts are spaced with an exponential backoff, so that a flapping
+ * device (dock, KVM switch, ...) doesn't end up in a tight loop of card
+ * enumerations and notifications. Hotplug events on /dev/snd wake the
+ * scheduler up early, so that a card is rebound as soon as it reappears.
+ */
+
+#define RECONNECT_MIN_DELAY        500    /* ms */
+#define RECONNECT_MAX_DELAY        30000  /* ms */
+#define RECONNECT_HOTPLUG_DELAY    300    /* ms, debounce hotplug bursts */
+#define RECONNECT_STABLE_PERIOD    60000  /* ms, card considered stable */
+#define DISCONNECT_SIGNAL_INTERVAL 30000  /* ms */
+
+static gboolean on_reconnect_timeout(Audio *audio);
+
+/* Check whether the card currently hooked is the one we want */
+static gboolean
+audio_has_wanted_soundcard(Audio *audio)
+{
+	if (audio->soundcard == NULL)
+		return FALSE;
+
+	if (audio->wanted_card == NULL || audio->wanted_card[0] == '\0')
+		return TRUE;
+
+	return !g_strcmp0(audio->card_id, audio->wanted_card);
+}
+
+/* Schedule the next attempt after 'delay' milliseconds */
+static void
+audio_reconnect_schedule(Audio *audio, guint delay)
+{
+	if (audio->reconnect_source)
+		g_source_remove(audio->reconnect_source);
+
+	audio->reconnect_source = g_timeout_add(delay,
+	                                        (GSourceFunc) on_reconnect_timeout,
+	                                        audio);
+}
+
+/* Schedule the next attempt, with some jitter, and increase the backoff */
+static void
+audio_reconnect_backoff(Audio *audio)
+{
+	guint delay;
+
+	delay = audio->reconnect_delay * g_random_double_range(0.75, 1.25);
+	DEBUG("Next reconnection attempt in %u ms", delay);
+	audio_reconnect_schedule(audio, delay);
+
+	audio->reconnect_delay = MIN(audio->reconnect_delay * 2, RECONNECT_MAX_DELAY);
+}
+
+/* Handle a card that was just plugged in. Its id is NULL if it couldn't
+ * be identified, because it's not accessible yet.
+ */
+static void
+on_card_plugged(const char *card_id, gpointer data)
+{
+	Audio *audio = (Audio *) data;
+
+	/* Watch it right now, or rescan a little later if it's not
+	 * accessible yet. Each new event pushes the rescan a little further.
+	 */
+	if (card_id == NULL || !audio_outputs_watch_card(audio, card_id))
+		audio_outputs_schedule_rescan(audio);
+
+	/* Same for the reconnection attempt, if we need one */
+	if (audio_has_wanted_soundcard(audio))
+		return;
+
+	DEBUG("Sound device plugged in, attempting to reconnect soon");
+	if (audio->soundcard == NULL)
+		audio->reconnect_full = TRUE;
+	audio_reconnect_schedule(audio, RECONNECT_HOTPLUG_DELAY);
+}
+
+/* Handle hotplug events on /dev/snd */
+static void
+on_hotplug_event(G_GNUC_UNUSED GFileMonitor *monitor, GFile *file,
+                 G_GNUC_UNUSED GFile *other_file, GFileMonitorEvent event_type,
+                 Audio *audio)
+{
+	gchar *basename, *card_id;
+	int number;
+
+	if (event_type != G_FILE_MONITOR_EVENT_CREATED)
+		return;
+
+	/* A new control device means a new card */
+	basename = g_file_get_basename(file);
+	if (sscanf(basename, "controlC%d", &number) == 1) {
+		card_id = audio->backend->get_card_id_by_number(number);
+		on_card_plugged(card_id, audio);
+		g_free(card_id);
+	}
+	g_free(basename);
+}
+
+/* Stop monitoring hotplug events */
+static void
+audio_hotplug_stop(Audio *audio)
+{
+	if (audio->backend->install_hotplug_callback)
+		audio->backend->install_hotplug_callback(NULL, NULL);
+
+	if (audio->hotplug_monitor == NULL)
+		return;
+
+	g_file_monitor_cancel(audio->hotplug_monitor);
+	g_object_unref(audio->hotplug_monitor);
+	audio->hotplug_monitor = NULL;
+}
+
+/* Start monitoring hotplug events, if it's not done already.
+ * Unless the backend reports them itself, we monitor /dev/snd.
+ */
+static void
+audio_hotplug_start(Audio *audio)
+{
+	GFile *dir;
+	GError *error = NULL;
+
+	if (audio->backend->install_hotplug_callback) {
+		audio->backend->install_hotplug_callback(on_card_plugged, audio);
+		return;
+	}
+
+	if (audio->hotplug_monitor)
+		return;
+
+	dir = g_file_new_for_path("/dev/snd");
+	audio->hotplug_monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_NONE,
+	                                                  NULL, &error);
+	g_object_unref(dir);
+
+	if (audio->hotplug_monitor == NULL) {
+		DEBUG("Can't monitor /dev/snd: %s", error->message);
+		g_error_free(error);
+		return;
+	}
+
+	g_signal_connect(audio->hotplug_monitor, "changed",
+	                 G_CALLBACK(on_hotplug_event), audio);
+}
+
+/* Stop the reconnection scheduler */
+static void
+audio_reconnect_stop(Audio *audio)
+{
+	if (audio->reconnect_source) {
+		g_source_remove(audio->reconnect_source);
+		audio->reconnect_source = 0;
+	}
+}
+
+/* Start the reconnection scheduler, if it's not running already */
+static void
+audio_reconnect_start(Audio *audio)
+{
+	if (audio->reconnect_source == 0)
+		audio_reconnect_backoff(audio);
+
+	audio_hotplug_start(audio);
+}
+
+/* Attempt to reconnect. The first attempt after a disconnection tries
+ * every card available, then we only try to rebind the preferred card.
+ */
+static gboolean
+on_reconnect_timeout(Audio *audio)
+{
+	BackendCard *soundcard;
+	gboolean full;
+
+	audio->reconnect_source = 0;
+
+	/* Without a preferred card, any card will do */
+	full = audio->reconnect_full ||
+	       audio->wanted_card == NULL || audio->wanted_card[0] == '\0';
+	audio->reconnect_full = FALSE;
+
+	if (full) {
+		DEBUG("Reconnection attempt, trying every card");
+		soundcard = audio_find_soundcard(audio);
+	} else {
+		char *channel;
+
+		DEBUG("Reconnection attempt, trying '%s'", audio->wanted_card);
+		channel = prefs_get_channel(audio->wanted_card);
+		soundcard = audio->backend->card_new(audio->wanted_card, channel,
+		                                     audio->curve);
+		g_free(channel);
+	}
+
+	if (soundcard) {
+		audio_unhook_soundcard(audio);
+		audio_attach_soundcard(audio, soundcard);
+	} else if (full && audio->soundcard == NULL) {
+		/* Nothing out there, say it once */
+		audio_attach_soundcard(audio, NULL);
+	}
+
+	if (audio_has_wanted_soundcard(audio))
+		audio_reconnect_stop(audio);
+	else
+		audio_reconnect_backoff(audio);
+
+	return FALSE;
+}
+
+/* Handle a soundcard disconnection */
+static void
+audio_handle_disconnection(Audio *audio)
+{
+	gint64 now, uptime;
+
+	now = g_get_monotonic_time();
+
+	/* Tell the world, but not too often, in case the card is flapping */
+	if (audio->disconnect_timestamp == 0 ||
+	    now - audio->disconnect_timestamp >= DISCONNECT_SIGNAL_INTERVAL * 1000) {
+		audio->disconnect_timestamp = now;
+		invoke_handlers(audio, AUDIO_CARD_DISCONNECTED, AUDIO_USER_UNKNOWN);
+	} else {
+		DEBUG("Soundcard disconnected again, not signaling it");
+	}
+
+	/* If the card didn't stay long, keep on increasing the backoff */
+	uptime = now - audio->hooked_timestamp;
+	if (uptime >= RECONNECT_STABLE_PERIOD * 1000)
+		audio->reconnect_delay = RECONNECT_MIN_DELAY;
+
+	audio_unhook_soundcard(audio);
+
+	audio->reconnect_full = TRUE;
+	audio_reconnect_start(audio);
+}
+
+/*
+ * Output rules.
+ * When enabled, the audio system follows the outputs: whenever an output
+ * appears or disappears (card plugged or unplugged, jack-sense change),
+ * the first available output of the priority list is hooked. Outputs in
+ * the list can be given by id or by name. Rules are applied only when the
+ * set of available outputs changes, so that the user can still pick
+ * another card by hand.
+ */
+
+/* Compare two string vectors, either of which may be NULL */
+static gboolean
+strv_equal(gchar **strv1, gchar **strv2)
+{
+	guint i;
+
+	if (strv1 == NULL || strv2 == NULL)
+		return strv1 == strv2;
+
+	for (i = 0; strv1[i] && strv2[i]; i++)
+		if (strcmp(strv1[i], strv2[i]))
+			return FALSE;
+
+	return strv1[i] == strv2[i];
+}
+
+/* Hook another card, without changing the preferences */
+static void
+audio_rehook(Audio *audio, const char *card_id)
+{
+	g_free(audio->wanted_card);
+	audio->wanted_card = g_strdup(card_id);
+
+	audio_reconnect_stop(audio);
+	audio_unhook_soundcard(audio);
+	audio_hook_soundcard(audio);
+
+	audio->reconnect_delay = RECONNECT_MIN_DELAY;
+	if (!audio_has_wanted_soundcard(audio))
+		audio_reconnect_start(audio);
+}
+
+/* Hook the best output available according to the priority list */
+static void
+audio_follow_outputs(Audio *audio)
+{
+	const GList *outputs, *item;
+	GString *available;
+	gchar *best = NULL;
+	guint i;
+
+	if (!audio->follow_outputs || audio->output_priority == NULL)
+		return;
+
+	/* Check whether the available outputs changed */
+	outputs = audio->backend->outputs_get_list();
+	available = g_string_new(NULL);
+	for (item = outputs; item; item = item->next) {
+		const AlsaOutput *output = item->data;
+
+		if (output->available)
+			g_string_append_printf(available, "%s\n", output->card_id);
+	}
+
+	if (!g_strcmp0(available->str, audio->available_outputs)) {
+		g_string_free(available, TRUE);
+		return;
+	}
+
+	g_free(audio->available_outputs);
+	audio->available_outputs = g_string_free(available, FALSE);
+
+	/* Find the best one */
+	for (i = 0; audio->output_priority[i] && best == NULL; i++) {
+		const gchar *wanted = audio->output_priority[i];
+
+		for (item = outputs; item; item = item->next) {
+			const AlsaOutput *output = item->data;
+
+			if (!output->available)
+				continue;
+
+			if (!g_strcmp0(wanted, output->card_id) ||
+			    !g_strcmp0(wanted, output->card)) {
+				best = g_strdup(output->card_id);
+				break;
+			}
+		}
+	}
+
+	if (best && g_strcmp0(best, audio->card_id)) {
+		DEBUG("Following output '%s'", best);
+		audio_rehook(audio, best);
+	}
+
+	g_free(best);
+}
+
+/**
+ * Cards used to be saved by name in the preferences, now they're saved by id.
+ * If the card found in the preferences is present, make sure we use its id,
+ * and move its channel to the right place.
+ *
+ * @param audio an Audio instance.
+ */
+static void
+audio_migrate_card_prefs(Audio *audio)
+{
+	gchar *card_id, *channel;
+
+	if (audio->wanted_card == NULL || audio->wanted_card[0] == '\0')
+		return;
+
+	card_id = audio->backend->get_card_id(audio->wanted_card);
+	if (card_id == NULL || !g_strcmp0(card_id, audio->wanted_card)) {
+		g_free(card_id);
+		return;
+	}
+
+	DEBUG("Migrating card preferences from '%s' to '%s'",
+	      audio->wanted_card, card_id);
+
+	channel = prefs_get_channel(card_id);
+	if (channel == NULL) {
+		channel = prefs_get_channel(audio->wanted_card);
+		if (channel)
+			prefs_set_channel(card_id, channel);
 	}
+	g_free(channel);
+
+	prefs_set_string("AlsaCard", card_id);
+	g_free(audio->wanted_card);
+	audio->wanted_card = card_id;
+}
+
+/**
+ * Read the volume curve from the preferences.
+ *
+ * @param audio an Audio instance.
+ */
+static void
+audio_reload_curve(Audio *audio)
+{
+	gchar *curve;
+	gdouble *points;
+	gsize n_points;
+
+	curve = prefs_get_string("VolumeCurve", "alsamixer");
+	audio->curve = audio_curve_from_str(curve);
+	g_free(curve);
+
+	points = prefs_get_double_list("VolumeCurvePoints", &n_points);
+	alsa_set_custom_curve(points, n_points);
+	g_free(points);
 }
 
 /**
@@ -650,17 +2341,52 @@ end:
 void
 audio_reload(Audio *audio)
 {
+	gboolean follow_outputs;
+	gchar **output_priority;
+
 	/* Get preferences */
-	g_free(audio->card);
-	audio->card = prefs_get_string("AlsaCard", NULL);
-	g_free(audio->channel);
-	audio->channel = prefs_get_channel(audio->card);
-	audio->normalize = prefs_get_boolean("NormalizeVolume", TRUE);
+	g_free(audio->wanted_card);
+	audio->wanted_card = prefs_get_string("AlsaCard", NULL);
+	audio_migrate_card_prefs(audio);
+	audio_reload_curve(audio);
 	audio->scroll_step = prefs_get_double("ScrollStep", 5);
+	audio->ramp_time = MAX(prefs_get_integer("VolumeRampTime", 0), 0);
+	if (audio->backend->set_watchdog_timeout)
+		audio->backend->set_watchdog_timeout
+		(MAX(prefs_get_integer("MixerTimeout", 3000), 0));
+	if (audio->backend->set_mixer_pool_size)
+		audio->backend->set_mixer_pool_size
+		(MAX(prefs_get_integer("MixerPoolSize", 4), 0));
+	audio->follow_jacks = prefs_get_boolean("FollowJacks", FALSE);
+
+	/* The rules are applied again only if they changed. Otherwise,
+	 * reloading mustn't bring back a card the user moved away from.
+	 */
+	follow_outputs = prefs_get_boolean("AutoFollowOutputs", FALSE);
+	output_priority = prefs_get_string_list("OutputPriority");
+	if (follow_outputs != audio->follow_outputs ||
+	    !strv_equal(output_priority, audio->output_priority)) {
+		g_free(audio->available_outputs);
+		audio->available_outputs = NULL;
+	}
+	audio->follow_outputs = follow_outputs;
+	g_strfreev(audio->output_priority);
+	audio->output_priority = output_priority;
 
 	/* Rehook soundcard */
+	audio_reconnect_stop(audio);
 	audio_unhook_soundcard(audio);
 	audio_hook_soundcard(audio);
+
+	/* Keep trying in the background if we didn't get the right card */
+	audio->reconnect_delay = RECONNECT_MIN_DELAY;
+	if (!audio_has_wanted_soundcard(audio))
+		audio_reconnect_start(audio);
+
+	/* Watch every output, the curve may have changed */
+	audio_outputs_stop(audio);
+	audio_outputs_rescan(audio);
+	audio_hotplug_start(audio);
 }
 
 /**
@@ -675,9 +2401,18 @@ audio_free(Audio *audio)
 	if (audio == NULL)
 		return;
 
+	audio_reconnect_stop(audio);
+	audio_hotplug_stop(audio);
+	audio_outputs_stop(audio);
+	if (audio->backend->streams_install_callback)
+		audio->backend->streams_install_callback(NULL, NULL);
 	audio_unhook_soundcard(audio);
 	g_free(audio->channel);
 	g_free(audio->card);
+	g_free(audio->card_id);
+	g_free(audio->wanted_card);
+	g_strfreev(audio->output_priority);
+	g_free(audio->available_outputs);
 	g_free(audio);
 }
 
@@ -694,12 +2429,66 @@ audio_new(void)
 	Audio *audio;
 
 	audio = g_new0(Audio, 1);
+	audio->backend = backend_get();
+	audio->reconnect_delay = RECONNECT_MIN_DELAY;
+
+	if (audio->backend->streams_install_callback)
+		audio->backend->streams_install_callback(on_backend_stream_event, audio);
 
 	return audio;
 }
 
 /**
- * Return the list of playable cards as a GSList.
+ * Switch to another card, and make it the preferred one.
+ * The card is most likely watched already, so it's quick.
+ *
+ * @param audio an Audio instance.
+ * @param card_id the id of the card.
+ */
+void
+audio_switch_card(Audio *audio, const char *card_id)
+{
+	if (!g_strcmp0(card_id, audio->card_id))
+		return;
+
+	DEBUG("Switching to card '%s'", card_id);
+
+	prefs_set_string("AlsaCard", card_id);
+	audio_rehook(audio, card_id);
+}
+
+/**
+ * Return the state of every output, as a GSList of AudioOutput.
+ * Strings are internal and valid until the outputs change,
+ * the list must be freed using g_slist_free_full() and g_free().
+ *
+ * @param audio an Audio instance.
+ * @return a list of outputs.
+ */
+GSList *
+audio_get_outputs(G_GNUC_UNUSED Audio *audio)
+{
+	const GList *item;
+	GSList *list = NULL;
+
+	for (item = audio->backend->outputs_get_list(); item; item = item->next) {
+		const AlsaOutput *alsa_output = item->data;
+		AudioOutput *output;
+
+		output = g_new0(AudioOutput, 1);
+		output->card_id = alsa_output->card_id;
+		output->card = alsa_output->card;
+		output->channel = alsa_output->channel;
+		output->muted = alsa_output->muted;
+		output->volume = alsa_output->volume;
+		list = g_slist_prepend(list, output);
+	}
+
+	return g_slist_reverse(list);
+}
+
+/**
+ * Return the list of playable cards as a GSList of card ids.
  * Must be freed using g_slist_free_full() and g_free().
  *
  * @return a list of playable cards.
@@ -707,19 +2496,50 @@ audio_new(void)
 GSList *
 audio_get_card_list(void)
 {
-	return alsa_list_cards();
+	return backend_get()->list_cards();
 }
 
 /**
- * For a given card name, return the list of playable channels as a GSList.
+ * Get the display name of a card.
+ * Must be freed using g_free().
+ *
+ * @param card_id the id of the card.
+ * @return the name of the card, or NULL if it can't be found.
+ */
+gchar *
+audio_get_card_name(const char *card_id)
+{
+	return backend_get()->get_card_name(card_id);
+}
+
+/**
+ * For a given card id, return the list of playable channels as a GSList.
  * Must be freed using g_slist_free_full() and g_free().
  *
- * @param card_name the name of the card for which we list the channels
+ * @param card_id the id of the card for which we list the channels
  * @return a list of playable channels.
  */
 GSList *
-audio_get_channel_list(const char *card_name)
+audio_get_channel_list(const char *card_id)
+{
+	return backend_get()->list_channels(card_id);
+}
+
+/**
+ * For a given card id, return the list of capture channels as a GSList.
+ * Must be freed using g_slist_free_full() and g_free().
+ *
+ * @param card_id the id of the card for which we list the channels
+ * @return a list of capture channels, NULL if the backend can't tell.
+ */
+GSList *
+audio_get_capture_channel_list(const char *card_id)
 {
-	return alsa_list_channels(card_name);
+	const Backend *backend = backend_get();
+
+	if (backend->list_capture_channels == NULL)
+		return NULL;
+
+	return backend->list_capture_channels(card_id);
 }
 
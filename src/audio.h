@@ -22,7 +22,9 @@
 /* High-level audio functions, no need to have a soundcard ready for that */
 
 GSList *audio_get_card_list(void);
-GSList *audio_get_channel_list(const char *card);
+gchar *audio_get_card_name(const char *card_id);
+GSList *audio_get_channel_list(const char *card_id);
+GSList *audio_get_capture_channel_list(const char *card_id);
 
 /* Soundcard management */
 
@@ -31,6 +33,35 @@ typedef struct audio Audio;
 Audio *audio_new(void);
 void audio_free(Audio *audio);
 void audio_reload(Audio *audio);
+void audio_switch_card(Audio *audio, const char *card_id);
+
+/* Outputs: the state of every playable card, not only the hooked one */
+
+struct audio_output {
+	const gchar *card_id;
+	const gchar *card;
+	const gchar *channel;
+	gboolean muted;
+	gdouble volume;
+};
+
+typedef struct audio_output AudioOutput;
+
+GSList *audio_get_outputs(Audio *audio);
+
+/* Streams: the playback streams of the applications, if the backend
+ * knows about them.
+ */
+
+struct audio_stream {
+	guint32 id;
+	const gchar *name;
+	const gchar *icon;
+	gboolean muted;
+	gdouble volume;
+};
+
+typedef struct audio_stream AudioStream;
 
 /* Audio status: card & channel name, mute & volume handling.
  * Everyone who changes the volume must say who he is.
@@ -41,10 +72,12 @@ enum audio_user {
 	AUDIO_USER_POPUP,
 	AUDIO_USER_TRAY_ICON,
 	AUDIO_USER_HOTKEYS,
+	AUDIO_USER_SOCKET,
 };
 
 typedef enum audio_user AudioUser;
 
+const char *audio_get_card_id(Audio *audio);
 const char *audio_get_card(Audio *audio);
 const char *audio_get_channel(Audio *audio);
 gboolean audio_is_muted(Audio *audio);
@@ -53,6 +86,31 @@ gdouble audio_get_volume(Audio *audio);
 void audio_set_volume(Audio *audio, AudioUser user, gdouble volume, gint direction);
 void audio_lower_volume(Audio *audio, AudioUser user);
 void audio_raise_volume(Audio *audio, AudioUser user);
+void audio_ramp_volume(Audio *audio, AudioUser user, gdouble volume, guint duration);
+void audio_ramp_cancel(Audio *audio);
+void audio_fade_toggle_mute(Audio *audio, AudioUser user, guint duration);
+gdouble audio_get_balance(Audio *audio);
+void audio_set_balance(Audio *audio, AudioUser user, gdouble balance);
+guint audio_get_n_channels(Audio *audio);
+const char *audio_get_channel_name(Audio *audio, guint index);
+gdouble audio_get_channel_volume(Audio *audio, guint index);
+void audio_set_channel_volume(Audio *audio, AudioUser user, guint index, gdouble volume);
+
+/* Capture: the microphone of the hooked card */
+
+gboolean audio_has_capture(Audio *audio);
+const char *audio_get_capture_channel(Audio *audio);
+gboolean audio_is_capture_muted(Audio *audio);
+void audio_toggle_capture_mute(Audio *audio, AudioUser user);
+gdouble audio_get_capture_volume(Audio *audio);
+void audio_set_capture_volume(Audio *audio, AudioUser user, gdouble volume);
+
+/* Streams */
+
+gboolean audio_has_streams(Audio *audio);
+GSList *audio_get_streams(Audio *audio);
+void audio_set_stream_volume(Audio *audio, AudioUser user, guint32 id, gdouble volume);
+void audio_toggle_stream_mute(Audio *audio, AudioUser user, guint32 id);
 
 /* Signal handling.
  * The audio system sends signals out there when something happens.
@@ -65,6 +123,11 @@ enum audio_signal {
 	AUDIO_CARD_DISCONNECTED,
 	AUDIO_CARD_ERROR,
 	AUDIO_VALUES_CHANGED,
+	AUDIO_OUTPUTS_CHANGED,
+	AUDIO_CAPTURE_CHANGED,
+	AUDIO_STREAM_ADDED,
+	AUDIO_STREAM_CHANGED,
+	AUDIO_STREAM_REMOVED,
 };
 
 typedef enum audio_signal AudioSignal;
@@ -76,6 +139,11 @@ struct audio_event {
 	const gchar *channel;
 	gboolean muted;
 	gdouble volume;
+	gdouble balance;
+	gboolean capture_muted;
+	gdouble capture_volume;
+	const AudioStream *stream; /* Only for stream signals */
+	gboolean repeat; /* Part of a burst of changes, a last event follows */
 };
 
 typedef struct audio_event AudioEvent;
@@ -84,5 +152,7 @@ typedef void (*AudioCallback) (Audio *audio, AudioEvent *event, gpointer data);
 
 void audio_signals_connect(Audio *audio, AudioCallback callback, gpointer data);
 void audio_signals_disconnect(Audio *audio, AudioCallback callback, gpointer data);
+void audio_set_repeat(Audio *audio, gboolean repeat);
+void audio_signal_values(Audio *audio, AudioUser user);
 
 #endif				// _AUDIO_H
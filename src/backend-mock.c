@@ -0,0 +1,1513 @@
+/* backend-mock.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file backend-mock.c
+ * This file holds the mock audio backend, an in-memory mixer that
+ * doesn't need any sound card. It behaves like the alsa backend:
+ * every write is echoed back as an event, after a configurable latency,
+ * and changes made by others, jacks, hotplug events and the playback
+ * streams of applications can be scripted.
+ * It's deterministic, so that the upper layers can be exercised and
+ * measured on machines without sound hardware.
+ * @brief Mock audio backend.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <glib.h>
+
+#include "alsa.h"
+#include "backend.h"
+
+#include "support-log.h"
+
+#define MOCK_STEPS    64	/* Raw steps, 1 dB each */
+#define MOCK_CHANNELS 2
+#define MOCK_EPSILON  1e-6
+
+/*
+ * In-memory devices.
+ * Devices are created once and never freed, unplugging a device only
+ * hides it. Every element has a volume and a switch, and two channels.
+ */
+
+struct mock_elem {
+	char *name;
+	gboolean capture;
+	long raws[MOCK_CHANNELS];
+	gboolean muted;
+};
+
+typedef struct mock_elem MockElem;
+
+struct mock_device {
+	char *id;
+	char *name;
+	int number;
+	gboolean plugged;
+	GPtrArray *elems;
+	gboolean has_jack[ALSA_JACK_OTHER];
+	gboolean jack_plugged[ALSA_JACK_OTHER];
+	GList *cards; /* Cards opened on this device */
+};
+
+typedef struct mock_device MockDevice;
+
+static GPtrArray *devices;
+static guint latency; /* ms, before events are delivered */
+static BackendHotplugCb hotplug_cb;
+static gpointer hotplug_cb_data;
+
+static MockElem *
+mock_device_add_elem(MockDevice *dev, const char *name, gboolean capture, long raw)
+{
+	MockElem *elem;
+	guint i;
+
+	elem = g_new0(MockElem, 1);
+	elem->name = g_strdup(name);
+	elem->capture = capture;
+	for (i = 0; i < MOCK_CHANNELS; i++)
+		elem->raws[i] = raw;
+
+	g_ptr_array_add(dev->elems, elem);
+	return elem;
+}
+
+static MockDevice *
+mock_device_add(const char *id, const char *name)
+{
+	MockDevice *dev;
+
+	dev = g_new0(MockDevice, 1);
+	dev->id = g_strdup(id);
+	dev->name = g_strdup(name);
+	dev->number = devices->len;
+	dev->plugged = TRUE;
+	dev->elems = g_ptr_array_new();
+
+	g_ptr_array_add(devices, dev);
+	return dev;
+}
+
+/* Create the devices, always the same ones */
+static void
+mock_devices_init(void)
+{
+	MockDevice *dev;
+
+	if (devices)
+		return;
+
+	devices = g_ptr_array_new();
+
+	/* An onboard card, with headphones and speakers */
+	dev = mock_device_add("Mock", "Mock HDA Audio");
+	mock_device_add_elem(dev, "Master", FALSE, 48);
+	mock_device_add_elem(dev, "Headphone", FALSE, 64);
+	mock_device_add_elem(dev, "Speaker", FALSE, 64);
+	mock_device_add_elem(dev, "PCM", FALSE, 64);
+	mock_device_add_elem(dev, "Capture", TRUE, 32);
+	dev->has_jack[ALSA_JACK_HEADPHONE] = TRUE;
+	dev->has_jack[ALSA_JACK_SPEAKER] = TRUE;
+	dev->jack_plugged[ALSA_JACK_SPEAKER] = TRUE;
+
+	/* A USB headset */
+	dev = mock_device_add("MockUSB", "Mock USB Headset");
+	mock_device_add_elem(dev, "PCM", FALSE, 40);
+	mock_device_add_elem(dev, "Mic", TRUE, 48);
+}
+
+/* Find a device given its id or its name, NULL meaning the first one */
+static MockDevice *
+mock_device_lookup(const char *card_id)
+{
+	guint i;
+
+	for (i = 0; i < devices->len; i++) {
+		MockDevice *dev = g_ptr_array_index(devices, i);
+
+		if (!dev->plugged)
+			continue;
+
+		if (card_id == NULL || card_id[0] == '\0' ||
+		    !strcmp(card_id, "default") ||
+		    !strcmp(card_id, dev->id) || !strcmp(card_id, dev->name))
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Find an element, NULL meaning the first one of its kind */
+static MockElem *
+mock_device_find_elem(MockDevice *dev, const char *name, gboolean capture)
+{
+	guint i;
+
+	for (i = 0; i < dev->elems->len; i++) {
+		MockElem *elem = g_ptr_array_index(dev->elems, i);
+
+		if (elem->capture != capture)
+			continue;
+
+		if (name == NULL || !strcmp(name, elem->name))
+			return elem;
+	}
+
+	return NULL;
+}
+
+static gboolean
+mock_device_has_jacks(MockDevice *dev)
+{
+	guint i;
+
+	for (i = 0; i < ALSA_JACK_OTHER; i++)
+		if (dev->has_jack[i])
+			return TRUE;
+
+	return FALSE;
+}
+
+static gboolean
+mock_device_is_available(MockDevice *dev)
+{
+	guint i;
+
+	if (!mock_device_has_jacks(dev))
+		return TRUE;
+
+	for (i = 0; i < ALSA_JACK_OTHER; i++)
+		if (dev->jack_plugged[i])
+			return TRUE;
+
+	return FALSE;
+}
+
+/* Volume of the loudest channel, from 0 to 1, linear on raw steps */
+static gdouble
+mock_elem_get_volume(MockElem *elem)
+{
+	long loudest = 0;
+	guint i;
+
+	for (i = 0; i < MOCK_CHANNELS; i++)
+		loudest = MAX(loudest, elem->raws[i]);
+
+	return (gdouble) loudest / MOCK_STEPS;
+}
+
+/*
+ * Output monitor.
+ * Outputs are refreshed as soon as a device changes, there's no latency.
+ */
+
+struct mock_output {
+	AlsaOutput output; /* Public part, must come first */
+	MockDevice *dev;
+	MockElem *elem;
+	gboolean seen; /* Watched again since the last prune */
+};
+
+typedef struct mock_output MockOutput;
+
+static GList *outputs;
+static AlsaOutputsCb outputs_cb;
+static gpointer outputs_cb_data;
+
+static void
+mock_output_free(MockOutput *watch)
+{
+	if (watch == NULL)
+		return;
+
+	g_free(watch->output.card_id);
+	g_free(watch->output.card);
+	g_free(watch->output.channel);
+	g_free(watch);
+}
+
+/* Read the state of an output, return TRUE if it changed */
+static gboolean
+mock_output_refresh(MockOutput *watch)
+{
+	gdouble volume;
+	gboolean muted, available;
+
+	volume = mock_elem_get_volume(watch->elem) * 100;
+	muted = watch->elem->muted;
+	available = mock_device_is_available(watch->dev);
+
+	if (volume == watch->output.volume && muted == watch->output.muted &&
+	    available == watch->output.available)
+		return FALSE;
+
+	watch->output.volume = volume;
+	watch->output.muted = muted;
+	watch->output.available = available;
+	return TRUE;
+}
+
+/* Refresh the outputs of a device, dropping them if it's unplugged */
+static void
+mock_outputs_refresh(MockDevice *dev)
+{
+	gboolean changed = FALSE;
+	GList *link, *next;
+
+	for (link = outputs; link; link = next) {
+		MockOutput *watch = link->data;
+
+		next = link->next;
+		if (watch->dev != dev)
+			continue;
+
+		if (dev->plugged) {
+			changed |= mock_output_refresh(watch);
+			continue;
+		}
+
+		outputs = g_list_delete_link(outputs, link);
+		mock_output_free(watch);
+		changed = TRUE;
+	}
+
+	if (changed && outputs_cb)
+		outputs_cb(outputs_cb_data);
+}
+
+static gboolean
+mock_outputs_watch(const char *card_id, const char *channel,
+                   G_GNUC_UNUSED AlsaCurve curve)
+{
+	MockOutput *watch;
+	MockDevice *dev;
+	MockElem *elem;
+	GList *link;
+
+	mock_devices_init();
+
+	dev = mock_device_lookup(card_id);
+	if (dev == NULL)
+		return FALSE;
+
+	elem = mock_device_find_elem(dev, channel, FALSE);
+	if (elem == NULL)
+		elem = mock_device_find_elem(dev, NULL, FALSE);
+	if (elem == NULL)
+		return FALSE;
+
+	for (link = outputs; link; link = link->next) {
+		watch = link->data;
+
+		if (watch->dev != dev)
+			continue;
+
+		if (channel == NULL || watch->elem == elem) {
+			watch->seen = TRUE;
+			return TRUE;
+		}
+
+		outputs = g_list_delete_link(outputs, link);
+		mock_output_free(watch);
+		break;
+	}
+
+	watch = g_new0(MockOutput, 1);
+	watch->dev = dev;
+	watch->elem = elem;
+	watch->output.card_id = g_strdup(dev->id);
+	watch->output.card = g_strdup(dev->name);
+	watch->output.channel = g_strdup(elem->name);
+	watch->output.volume = -1;
+	watch->seen = TRUE;
+	mock_output_refresh(watch);
+
+	outputs = g_list_append(outputs, watch);
+	return TRUE;
+}
+
+static void
+mock_outputs_prune(void)
+{
+	GList *link, *next;
+
+	for (link = outputs; link; link = next) {
+		MockOutput *watch = link->data;
+
+		next = link->next;
+		if (watch->seen) {
+			watch->seen = FALSE;
+			continue;
+		}
+
+		outputs = g_list_delete_link(outputs, link);
+		mock_output_free(watch);
+	}
+}
+
+static void
+mock_outputs_unwatch_all(void)
+{
+	g_list_free_full(outputs, (GDestroyNotify) mock_output_free);
+	outputs = NULL;
+}
+
+static const GList *
+mock_outputs_get_list(void)
+{
+	return outputs;
+}
+
+static void
+mock_outputs_install_callback(AlsaOutputsCb callback, gpointer data)
+{
+	outputs_cb = callback;
+	outputs_cb_data = data;
+}
+
+/*
+ * Cards.
+ * Events are queued on each card, and delivered together once the
+ * latency has elapsed, like alsa does when the poll descriptors of
+ * a mixer wake the main loop up.
+ */
+
+struct mock_card {
+	MockDevice *dev;
+	MockElem *elem;
+	MockElem *capture;
+	gdouble norm[MOCK_STEPS + 1]; /* Volume of every raw step */
+	guint pending; /* Mask of pending events */
+	guint notify_source;
+	AlsaCb cb_func;
+	gpointer cb_data;
+};
+
+typedef struct mock_card MockCard;
+
+static gboolean
+on_mock_card_notify(MockCard *card)
+{
+	enum alsa_event events[] = {
+		ALSA_CARD_JACKS_CHANGED,
+		ALSA_CARD_CAPTURE_CHANGED,
+		ALSA_CARD_VALUES_CHANGED
+	};
+	AlsaCb cb_func = card->cb_func;
+	gpointer cb_data = card->cb_data;
+	guint pending = card->pending;
+	guint i;
+
+	card->notify_source = 0;
+	card->pending = 0;
+
+	if (cb_func == NULL)
+		return FALSE;
+
+	/* The card is most likely freed when it's gone */
+	if (pending & (1 << ALSA_CARD_DISCONNECTED)) {
+		cb_func(ALSA_CARD_DISCONNECTED, cb_data);
+		return FALSE;
+	}
+	if (pending & (1 << ALSA_CARD_ERROR)) {
+		cb_func(ALSA_CARD_ERROR, cb_data);
+		return FALSE;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(events); i++)
+		if (pending & (1 << events[i]))
+			cb_func(events[i], cb_data);
+
+	return FALSE;
+}
+
+/* Queue an event on a card */
+static void
+mock_card_notify(MockCard *card, enum alsa_event event)
+{
+	card->pending |= 1 << event;
+	if (card->notify_source)
+		return;
+
+	card->notify_source = g_timeout_add(latency, (GSourceFunc) on_mock_card_notify,
+	                                    card);
+}
+
+/* Queue the events that a change on a device causes on its cards.
+ * Like with alsa, a change on an element the card doesn't control
+ * still wakes it up.
+ */
+static void
+mock_device_changed(MockDevice *dev, MockElem *elem, enum alsa_event event)
+{
+	GList *item;
+
+	for (item = dev->cards; item; item = item->next) {
+		MockCard *card = item->data;
+
+		if (elem && elem == card->capture)
+			mock_card_notify(card, ALSA_CARD_CAPTURE_CHANGED);
+		else
+			mock_card_notify(card, event);
+	}
+
+	mock_outputs_refresh(dev);
+}
+
+/* Write the levels of an element */
+static void
+mock_elem_write(MockDevice *dev, MockElem *elem, const long *raws)
+{
+	gboolean changed = FALSE;
+	guint i;
+
+	for (i = 0; i < MOCK_CHANNELS; i++) {
+		long raw = CLAMP(raws[i], 0, MOCK_STEPS);
+
+		if (elem->raws[i] == raw)
+			continue;
+
+		elem->raws[i] = raw;
+		changed = TRUE;
+	}
+
+	if (changed)
+		mock_device_changed(dev, elem, ALSA_CARD_VALUES_CHANGED);
+}
+
+/* Write the switch of an element */
+static void
+mock_elem_write_mute(MockDevice *dev, MockElem *elem, gboolean muted)
+{
+	if (elem->muted == muted)
+		return;
+
+	elem->muted = muted;
+	mock_device_changed(dev, elem, ALSA_CARD_VALUES_CHANGED);
+}
+
+/* Raw step for a volume from 0 to 1, rounded like alsa does */
+static long
+mock_card_find_step(MockCard *card, gdouble volume, int dir)
+{
+	long i;
+
+	for (i = 0; i < MOCK_STEPS && card->norm[i] < volume - MOCK_EPSILON; i++);
+
+	if (dir < 0 && i > 0 && card->norm[i] > volume + MOCK_EPSILON)
+		i--;
+	else if (dir == 0 && i > 0 && volume - card->norm[i - 1] < card->norm[i] - volume)
+		i--;
+
+	return i;
+}
+
+/* Volume of a raw step, from 0 to 1 */
+static gdouble
+mock_card_get_level(MockCard *card, long raw)
+{
+	return card->norm[CLAMP(raw, 0, MOCK_STEPS)];
+}
+
+static BackendCard *
+mock_card_new(const char *card_id, const char *channel, AlsaCurve curve)
+{
+	MockCard *card;
+	MockDevice *dev;
+	MockElem *elem;
+	long i;
+
+	mock_devices_init();
+
+	dev = mock_device_lookup(card_id);
+	if (dev == NULL) {
+		DEBUG("Card '%s' not found", card_id);
+		return NULL;
+	}
+
+	elem = mock_device_find_elem(dev, channel, FALSE);
+	if (elem == NULL)
+		elem = mock_device_find_elem(dev, NULL, FALSE);
+	if (elem == NULL)
+		return NULL;
+
+	card = g_new0(MockCard, 1);
+	card->dev = dev;
+	card->elem = elem;
+
+	/* One dB per step, from -64 dB to 0 dB */
+	for (i = 0; i <= MOCK_STEPS; i++) {
+		if (curve == ALSA_CURVE_LINEAR)
+			card->norm[i] = (gdouble) i / MOCK_STEPS;
+		else
+			card->norm[i] = alsa_curve_db_to_volume(curve, i - MOCK_STEPS,
+			                                        -MOCK_STEPS, 0);
+	}
+
+	dev->cards = g_list_prepend(dev->cards, card);
+
+	DEBUG("Mock card '%s' opened, controlling '%s'", dev->id, elem->name);
+
+	return (BackendCard *) card;
+}
+
+static void
+mock_card_free(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	if (card == NULL)
+		return;
+
+	if (card->notify_source)
+		g_source_remove(card->notify_source);
+
+	card->dev->cards = g_list_remove(card->dev->cards, card);
+	g_free(card);
+}
+
+static void
+mock_card_install_callback(BackendCard *bcard, AlsaCb callback, gpointer data)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	card->cb_func = callback;
+	card->cb_data = data;
+}
+
+static const char *
+mock_card_get_id(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return card->dev->id;
+}
+
+static const char *
+mock_card_get_name(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return card->dev->name;
+}
+
+static const char *
+mock_card_get_channel(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return card->elem->name;
+}
+
+static gboolean
+mock_card_has_channel(BackendCard *bcard, const char *channel)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return channel && mock_device_find_elem(card->dev, channel, FALSE);
+}
+
+static gboolean
+mock_card_set_channel(BackendCard *bcard, const char *channel)
+{
+	MockCard *card = (MockCard *) bcard;
+	MockElem *elem;
+
+	if (channel == NULL)
+		return FALSE;
+
+	elem = mock_device_find_elem(card->dev, channel, FALSE);
+	if (elem == NULL || elem == card->elem)
+		return FALSE;
+
+	card->elem = elem;
+	return TRUE;
+}
+
+static gboolean
+mock_card_has_jack(BackendCard *bcard, AlsaJack jack)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return jack < ALSA_JACK_OTHER && card->dev->has_jack[jack];
+}
+
+static gboolean
+mock_card_is_jack_plugged(BackendCard *bcard, AlsaJack jack)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return mock_card_has_jack(bcard, jack) && card->dev->jack_plugged[jack];
+}
+
+static gboolean
+mock_card_set_capture_channel(BackendCard *bcard, const char *channel)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	card->capture = mock_device_find_elem(card->dev, channel, TRUE);
+	if (card->capture == NULL)
+		card->capture = mock_device_find_elem(card->dev, NULL, TRUE);
+
+	return card->capture != NULL;
+}
+
+static const char *
+mock_card_get_capture_channel(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return card->capture ? card->capture->name : NULL;
+}
+
+static gboolean
+mock_card_is_capture_muted(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return card->capture && card->capture->muted;
+}
+
+static void
+mock_card_toggle_capture_mute(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	if (card->capture)
+		mock_elem_write_mute(card->dev, card->capture, !card->capture->muted);
+}
+
+static gdouble
+mock_card_get_capture_volume(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	if (card->capture == NULL)
+		return 0;
+
+	return mock_elem_get_volume(card->capture) * 100;
+}
+
+static void
+mock_card_set_capture_volume(BackendCard *bcard, gdouble value, int dir)
+{
+	MockCard *card = (MockCard *) bcard;
+	gdouble volume = value / 100;
+	long raws[MOCK_CHANNELS];
+	guint i;
+
+	if (card->capture == NULL)
+		return;
+
+	for (i = 0; i < MOCK_CHANNELS; i++) {
+		if (dir > 0)
+			raws[i] = ceil(volume * MOCK_STEPS - MOCK_EPSILON);
+		else if (dir < 0)
+			raws[i] = floor(volume * MOCK_STEPS + MOCK_EPSILON);
+		else
+			raws[i] = lround(volume * MOCK_STEPS);
+	}
+
+	mock_elem_write(card->dev, card->capture, raws);
+}
+
+static gboolean
+mock_card_is_muted(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	return card->elem->muted;
+}
+
+static void
+mock_card_toggle_mute(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	mock_elem_write_mute(card->dev, card->elem, !card->elem->muted);
+}
+
+static gdouble
+mock_card_get_volume(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+	long loudest = 0;
+	guint i;
+
+	for (i = 0; i < MOCK_CHANNELS; i++)
+		loudest = MAX(loudest, card->elem->raws[i]);
+
+	return mock_card_get_level(card, loudest) * 100;
+}
+
+/* Set the loudest channel, the other ones keep their gain */
+static void
+mock_card_set_volume(BackendCard *bcard, gdouble value, int dir)
+{
+	MockCard *card = (MockCard *) bcard;
+	gdouble levels[MOCK_CHANNELS], loudest = 0;
+	long raws[MOCK_CHANNELS];
+	guint i;
+
+	for (i = 0; i < MOCK_CHANNELS; i++) {
+		levels[i] = mock_card_get_level(card, card->elem->raws[i]);
+		loudest = MAX(loudest, levels[i]);
+	}
+
+	for (i = 0; i < MOCK_CHANNELS; i++) {
+		gdouble gain = loudest > MOCK_EPSILON ? levels[i] / loudest : 1;
+
+		raws[i] = mock_card_find_step(card, value / 100 * gain, dir);
+	}
+
+	mock_elem_write(card->dev, card->elem, raws);
+}
+
+static guint
+mock_card_get_n_channels(G_GNUC_UNUSED BackendCard *card)
+{
+	return MOCK_CHANNELS;
+}
+
+static const char *
+mock_card_get_channel_name(G_GNUC_UNUSED BackendCard *card, guint index)
+{
+	static const char *names[MOCK_CHANNELS] = { "Front Left", "Front Right" };
+
+	g_return_val_if_fail(index < MOCK_CHANNELS, NULL);
+
+	return names[index];
+}
+
+static gdouble
+mock_card_get_channel_volume(BackendCard *bcard, guint index)
+{
+	MockCard *card = (MockCard *) bcard;
+
+	g_return_val_if_fail(index < MOCK_CHANNELS, 0);
+
+	return mock_card_get_level(card, card->elem->raws[index]) * 100;
+}
+
+static void
+mock_card_set_channel_volume(BackendCard *bcard, guint index, gdouble value,
+                             int dir)
+{
+	MockCard *card = (MockCard *) bcard;
+	long raws[MOCK_CHANNELS];
+
+	g_return_if_fail(index < MOCK_CHANNELS);
+
+	memcpy(raws, card->elem->raws, sizeof(raws));
+	raws[index] = mock_card_find_step(card, value / 100, dir);
+	mock_elem_write(card->dev, card->elem, raws);
+}
+
+static gdouble
+mock_card_get_balance(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+	gdouble left, right;
+
+	left = mock_card_get_level(card, card->elem->raws[0]);
+	right = mock_card_get_level(card, card->elem->raws[1]);
+	if (left <= 0 || right <= 0)
+		return 0;
+
+	return (right - left) / MAX(left, right) * 100;
+}
+
+static void
+mock_card_set_balance(BackendCard *bcard, gdouble balance)
+{
+	MockCard *card = (MockCard *) bcard;
+	gdouble loudest;
+	long raws[MOCK_CHANNELS];
+
+	loudest = mock_card_get_volume(bcard) / 100;
+	balance = CLAMP(balance, -100, 100) / 100;
+
+	raws[0] = mock_card_find_step(card, loudest * MIN(1, 1 - balance), 0);
+	raws[1] = mock_card_find_step(card, loudest * MIN(1, 1 + balance), 0);
+	mock_elem_write(card->dev, card->elem, raws);
+}
+
+static gboolean
+mock_card_get_db_range(G_GNUC_UNUSED BackendCard *card, gdouble *db_min,
+                       gdouble *db_max)
+{
+	*db_min = -MOCK_STEPS;
+	*db_max = 0;
+
+	return TRUE;
+}
+
+static gdouble
+mock_card_get_db(BackendCard *bcard)
+{
+	MockCard *card = (MockCard *) bcard;
+	long loudest = 0;
+	guint i;
+
+	for (i = 0; i < MOCK_CHANNELS; i++)
+		loudest = MAX(loudest, card->elem->raws[i]);
+
+	return loudest - MOCK_STEPS;
+}
+
+static void
+mock_card_set_db(BackendCard *bcard, gdouble db, int dir)
+{
+	MockCard *card = (MockCard *) bcard;
+	long raw;
+
+	db += MOCK_STEPS;
+	if (dir > 0)
+		raw = ceil(db - MOCK_EPSILON);
+	else if (dir < 0)
+		raw = floor(db + MOCK_EPSILON);
+	else
+		raw = lround(db);
+
+	raw = CLAMP(raw, 0, MOCK_STEPS);
+	mock_card_set_volume(bcard, card->norm[raw] * 100, 0);
+}
+
+/*
+ * Streams.
+ * Applications come and go with the script only. Like with a sound
+ * server, writes are applied right away and echo nothing, while the
+ * changes made by the script are delivered one stream at a time,
+ * after the latency.
+ */
+
+struct mock_stream {
+	BackendStream stream; /* Public part, must come first */
+	gchar *name;
+	gchar *icon;
+};
+
+typedef struct mock_stream MockStream;
+
+static GList *streams;
+static BackendStreamsCb streams_cb;
+static gpointer streams_cb_data;
+
+static MockStream *
+mock_stream_find(guint32 id)
+{
+	GList *item;
+
+	for (item = streams; item; item = item->next) {
+		MockStream *stream = item->data;
+
+		if (stream->stream.id == id)
+			return stream;
+	}
+
+	return NULL;
+}
+
+static void
+mock_stream_free(MockStream *stream)
+{
+	g_free(stream->name);
+	g_free(stream->icon);
+	g_free(stream);
+}
+
+static void
+mock_stream_notify(MockStream *stream, enum backend_stream_event event)
+{
+	if (streams_cb)
+		streams_cb(event, &stream->stream, streams_cb_data);
+}
+
+/* Apply a scripted stream command, once the latency has elapsed */
+static gboolean
+on_mock_stream_timeout(gchar **argv)
+{
+	guint32 id = strtoul(argv[2], NULL, 10);
+	MockStream *stream = mock_stream_find(id);
+
+	if (!strcmp(argv[1], "add")) {
+		if (stream) {
+			WARN("Mock script: stream %u already exists", id);
+			goto out;
+		}
+
+		stream = g_new0(MockStream, 1);
+		stream->name = g_strdup(argv[3]);
+		stream->icon = g_strdup(argv[4]);
+		stream->stream.id = id;
+		stream->stream.name = stream->name;
+		stream->stream.icon = stream->icon;
+		stream->stream.volume = 100;
+		streams = g_list_append(streams, stream);
+		mock_stream_notify(stream, BACKEND_STREAM_ADDED);
+		goto out;
+	}
+
+	if (stream == NULL) {
+		WARN("Mock script: no such stream %u", id);
+		goto out;
+	}
+
+	if (!strcmp(argv[1], "remove")) {
+		streams = g_list_remove(streams, stream);
+		mock_stream_notify(stream, BACKEND_STREAM_REMOVED);
+		mock_stream_free(stream);
+	} else if (!strcmp(argv[1], "volume")) {
+		gdouble volume = CLAMP(g_ascii_strtod(argv[3], NULL), 0, 100);
+
+		if (volume != stream->stream.volume) {
+			stream->stream.volume = volume;
+			mock_stream_notify(stream, BACKEND_STREAM_CHANGED);
+		}
+	} else {
+		gboolean muted = !strcmp(argv[3], "on");
+
+		if (muted != stream->stream.muted) {
+			stream->stream.muted = muted;
+			mock_stream_notify(stream, BACKEND_STREAM_CHANGED);
+		}
+	}
+
+out:
+	g_strfreev(argv);
+	return FALSE;
+}
+
+static const GList *
+mock_streams_get_list(void)
+{
+	return streams;
+}
+
+static void
+mock_streams_install_callback(BackendStreamsCb callback, gpointer data)
+{
+	streams_cb = callback;
+	streams_cb_data = data;
+}
+
+static void
+mock_stream_set_volume(guint32 id, gdouble value)
+{
+	MockStream *stream = mock_stream_find(id);
+
+	if (stream)
+		stream->stream.volume = CLAMP(value, 0, 100);
+}
+
+static void
+mock_stream_set_mute(guint32 id, gboolean muted)
+{
+	MockStream *stream = mock_stream_find(id);
+
+	if (stream)
+		stream->stream.muted = muted;
+}
+
+/*
+ * Listing functions.
+ */
+
+static GSList *
+mock_list_cards(void)
+{
+	GSList *list = NULL;
+	guint i;
+
+	mock_devices_init();
+
+	for (i = 0; i < devices->len; i++) {
+		MockDevice *dev = g_ptr_array_index(devices, i);
+
+		if (dev->plugged)
+			list = g_slist_append(list, g_strdup(dev->id));
+	}
+
+	return list;
+}
+
+static GSList *
+mock_list_channels(const char *card_id)
+{
+	GSList *list = NULL;
+	MockDevice *dev;
+	guint i;
+
+	mock_devices_init();
+
+	dev = mock_device_lookup(card_id);
+	if (dev == NULL)
+		return NULL;
+
+	for (i = 0; i < dev->elems->len; i++) {
+		MockElem *elem = g_ptr_array_index(dev->elems, i);
+
+		if (!elem->capture)
+			list = g_slist_append(list, g_strdup(elem->name));
+	}
+
+	return list;
+}
+
+static GSList *
+mock_list_capture_channels(const char *card_id)
+{
+	GSList *list = NULL;
+	MockDevice *dev;
+	guint i;
+
+	mock_devices_init();
+
+	dev = mock_device_lookup(card_id);
+	if (dev == NULL)
+		return NULL;
+
+	for (i = 0; i < dev->elems->len; i++) {
+		MockElem *elem = g_ptr_array_index(dev->elems, i);
+
+		if (elem->capture)
+			list = g_slist_append(list, g_strdup(elem->name));
+	}
+
+	return list;
+}
+
+static char *
+mock_get_card_name(const char *card_id)
+{
+	MockDevice *dev;
+
+	mock_devices_init();
+
+	dev = mock_device_lookup(card_id);
+	return dev ? g_strdup(dev->name) : NULL;
+}
+
+static char *
+mock_get_card_id(const char *card_id)
+{
+	MockDevice *dev;
+
+	mock_devices_init();
+
+	dev = mock_device_lookup(card_id);
+	return dev ? g_strdup(dev->id) : NULL;
+}
+
+static char *
+mock_get_card_id_by_number(int number)
+{
+	MockDevice *dev;
+
+	mock_devices_init();
+
+	if (number < 0 || (guint) number >= devices->len)
+		return NULL;
+
+	dev = g_ptr_array_index(devices, number);
+	return dev->plugged ? g_strdup(dev->id) : NULL;
+}
+
+static void
+mock_install_hotplug_callback(BackendHotplugCb callback, gpointer data)
+{
+	hotplug_cb = callback;
+	hotplug_cb_data = data;
+}
+
+/*
+ * Script.
+ * The script is a text file, each line being a time in milliseconds
+ * since the backend was selected, a command and its arguments:
+ *
+ *   latency MS                      delay before events are delivered
+ *   volume CARD CHANNEL PERCENT     set the volume of an element
+ *   mute CARD CHANNEL on|off        set the switch of an element
+ *   jack CARD headphone|line-out|speaker on|off
+ *   unplug CARD                     the device disappears
+ *   plug CARD                       the device comes back
+ *   error CARD                      the cards opened on it fail
+ *   stream add ID NAME [ICON]       an application starts playing
+ *   stream volume ID PERCENT        set the volume of a stream
+ *   stream mute ID on|off           set the mute of a stream
+ *   stream remove ID                an application stops playing
+ *   repeat                          start the script over
+ *
+ * Arguments are split like a shell does, so names with spaces can be
+ * quoted. Lines starting with '#' are comments.
+ */
+
+struct mock_command {
+	gint64 time; /* us */
+	gchar **argv;
+};
+
+typedef struct mock_command MockCommand;
+
+static GPtrArray *script;
+static guint script_index;
+static gint64 script_start;
+
+static MockDevice *
+mock_script_device(const char *card_id)
+{
+	guint i;
+
+	for (i = 0; i < devices->len; i++) {
+		MockDevice *dev = g_ptr_array_index(devices, i);
+
+		if (!strcmp(card_id, dev->id) || !strcmp(card_id, dev->name))
+			return dev;
+	}
+
+	WARN("Mock script: no such card '%s'", card_id);
+	return NULL;
+}
+
+static MockElem *
+mock_script_elem(MockDevice *dev, const char *name)
+{
+	MockElem *elem;
+
+	elem = mock_device_find_elem(dev, name, FALSE);
+	if (elem == NULL)
+		elem = mock_device_find_elem(dev, name, TRUE);
+	if (elem == NULL)
+		WARN("Mock script: no such channel '%s' on '%s'", name, dev->id);
+
+	return elem;
+}
+
+static void
+mock_script_plug(MockDevice *dev, gboolean plugged)
+{
+	GList *item;
+
+	if (dev->plugged == plugged)
+		return;
+
+	dev->plugged = plugged;
+	mock_outputs_refresh(dev);
+
+	if (plugged) {
+		if (hotplug_cb)
+			hotplug_cb(dev->id, hotplug_cb_data);
+		return;
+	}
+
+	for (item = dev->cards; item; item = item->next)
+		mock_card_notify(item->data, ALSA_CARD_DISCONNECTED);
+}
+
+static gboolean
+mock_script_jack_from_str(const char *str, AlsaJack *jack)
+{
+	if (!strcmp(str, "headphone"))
+		*jack = ALSA_JACK_HEADPHONE;
+	else if (!strcmp(str, "line-out"))
+		*jack = ALSA_JACK_LINE_OUT;
+	else if (!strcmp(str, "speaker"))
+		*jack = ALSA_JACK_SPEAKER;
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+static gboolean
+mock_script_stream_is_valid(gchar **argv, guint argc)
+{
+	const char *action;
+
+	if (argc < 3)
+		return FALSE;
+
+	action = argv[1];
+	if (!strcmp(action, "add"))
+		return argc == 4 || argc == 5;
+	if (!strcmp(action, "remove"))
+		return argc == 3;
+	if (!strcmp(action, "volume"))
+		return argc == 4;
+	if (!strcmp(action, "mute"))
+		return argc == 4;
+
+	return FALSE;
+}
+
+/* Run a command, return FALSE if it's malformed */
+static gboolean
+mock_script_run(gchar **argv)
+{
+	guint argc = g_strv_length(argv);
+	const char *cmd = argv[0];
+	MockDevice *dev = NULL;
+	MockElem *elem = NULL;
+
+	if (!strcmp(cmd, "latency") && argc == 2) {
+		latency = atoi(argv[1]);
+		return TRUE;
+	}
+
+	if (!strcmp(cmd, "stream")) {
+		if (!mock_script_stream_is_valid(argv, argc))
+			return FALSE;
+
+		g_timeout_add(latency, (GSourceFunc) on_mock_stream_timeout,
+		              g_strdupv(argv));
+		return TRUE;
+	}
+
+	if (argc < 2)
+		return FALSE;
+
+	dev = mock_script_device(argv[1]);
+	if (dev == NULL)
+		return TRUE;
+
+	if (!strcmp(cmd, "plug") || !strcmp(cmd, "unplug")) {
+		mock_script_plug(dev, cmd[0] == 'p');
+		return argc == 2;
+	}
+
+	if (!strcmp(cmd, "error")) {
+		GList *item;
+
+		for (item = dev->cards; item; item = item->next)
+			mock_card_notify(item->data, ALSA_CARD_ERROR);
+		return argc == 2;
+	}
+
+	if (argc != 4)
+		return FALSE;
+
+	if (!strcmp(cmd, "jack")) {
+		AlsaJack jack;
+
+		if (!mock_script_jack_from_str(argv[2], &jack))
+			return FALSE;
+
+		dev->has_jack[jack] = TRUE;
+		dev->jack_plugged[jack] = !strcmp(argv[3], "on");
+		mock_device_changed(dev, NULL, ALSA_CARD_JACKS_CHANGED);
+		return TRUE;
+	}
+
+	elem = mock_script_elem(dev, argv[2]);
+	if (elem == NULL)
+		return TRUE;
+
+	if (!strcmp(cmd, "volume")) {
+		long raws[MOCK_CHANNELS];
+		guint i;
+
+		for (i = 0; i < MOCK_CHANNELS; i++)
+			raws[i] = lround(g_ascii_strtod(argv[3], NULL) * MOCK_STEPS / 100);
+		mock_elem_write(dev, elem, raws);
+		return TRUE;
+	}
+
+	if (!strcmp(cmd, "mute")) {
+		mock_elem_write_mute(dev, elem, !strcmp(argv[3], "on"));
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void mock_script_schedule(void);
+
+static gboolean
+on_mock_script_timeout(G_GNUC_UNUSED gpointer data)
+{
+	gint64 elapsed = g_get_monotonic_time() - script_start;
+
+	while (script_index < script->len) {
+		MockCommand *command = g_ptr_array_index(script, script_index);
+
+		if (command->time > elapsed)
+			break;
+
+		script_index++;
+
+		if (!strcmp(command->argv[0], "repeat")) {
+			script_start += command->time;
+			script_index = 0;
+			break;
+		}
+
+		if (!mock_script_run(command->argv))
+			WARN("Mock script: malformed command '%s'", command->argv[0]);
+	}
+
+	mock_script_schedule();
+	return FALSE;
+}
+
+/* Wait for the next command */
+static void
+mock_script_schedule(void)
+{
+	MockCommand *command;
+	gint64 delay;
+
+	if (script_index >= script->len)
+		return;
+
+	command = g_ptr_array_index(script, script_index);
+	delay = script_start + command->time - g_get_monotonic_time();
+	g_timeout_add(MAX(delay, 0) / 1000, on_mock_script_timeout, NULL);
+}
+
+static void
+mock_command_free(MockCommand *command)
+{
+	g_strfreev(command->argv);
+	g_free(command);
+}
+
+static gboolean
+mock_script_load(const char *filename)
+{
+	GError *error = NULL;
+	gchar *contents;
+	gchar **lines;
+	gint64 last = 0;
+	guint i;
+
+	if (!g_file_get_contents(filename, &contents, NULL, &error)) {
+		ERROR("Can't read mock script: %s", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	script = g_ptr_array_new_with_free_func((GDestroyNotify) mock_command_free);
+
+	lines = g_strsplit(contents, "\n", -1);
+	for (i = 0; lines[i]; i++) {
+		MockCommand *command;
+		gchar **argv, *end;
+		gint64 time;
+		gint argc;
+
+		g_strstrip(lines[i]);
+		if (lines[i][0] == '\0' || lines[i][0] == '#')
+			continue;
+
+		if (!g_shell_parse_argv(lines[i], &argc, &argv, NULL) || argc < 2) {
+			WARN("Mock script, line %u: can't parse", i + 1);
+			continue;
+		}
+
+		time = g_ascii_strtoll(argv[0], &end, 10);
+		if (*end != '\0' || time < last) {
+			WARN("Mock script, line %u: bad time '%s'", i + 1, argv[0]);
+			g_strfreev(argv);
+			continue;
+		}
+		last = time;
+
+		/* Drop the time */
+		command = g_new0(MockCommand, 1);
+		command->time = time * 1000;
+		command->argv = g_strdupv(argv + 1);
+		g_ptr_array_add(script, command);
+		g_strfreev(argv);
+	}
+
+	g_strfreev(lines);
+	g_free(contents);
+
+	DEBUG("Mock script loaded (%u commands)", script->len);
+
+	script_start = g_get_monotonic_time();
+	mock_script_schedule();
+
+	return TRUE;
+}
+
+/* Initialize the backend, the arguments being an optional script */
+static gboolean
+mock_init(const char *args)
+{
+	mock_devices_init();
+
+	if (args == NULL || args[0] == '\0')
+		return TRUE;
+
+	return mock_script_load(args);
+}
+
+/*
+ * Backend operations
+ */
+
+const Backend mock_backend = {
+	.name = "mock",
+	.init = mock_init,
+	.install_hotplug_callback = mock_install_hotplug_callback,
+	.list_cards = mock_list_cards,
+	.list_channels = mock_list_channels,
+	.list_capture_channels = mock_list_capture_channels,
+	.get_card_name = mock_get_card_name,
+	.get_card_id = mock_get_card_id,
+	.get_card_id_by_number = mock_get_card_id_by_number,
+	.outputs_watch = mock_outputs_watch,
+	.outputs_prune = mock_outputs_prune,
+	.outputs_unwatch_all = mock_outputs_unwatch_all,
+	.outputs_get_list = mock_outputs_get_list,
+	.outputs_install_callback = mock_outputs_install_callback,
+	.streams_get_list = mock_streams_get_list,
+	.streams_install_callback = mock_streams_install_callback,
+	.stream_set_volume = mock_stream_set_volume,
+	.stream_set_mute = mock_stream_set_mute,
+	.card_new = mock_card_new,
+	.card_free = mock_card_free,
+	.card_install_callback = mock_card_install_callback,
+	.card_get_id = mock_card_get_id,
+	.card_get_name = mock_card_get_name,
+	.card_get_channel = mock_card_get_channel,
+	.card_has_channel = mock_card_has_channel,
+	.card_set_channel = mock_card_set_channel,
+	.card_has_jack = mock_card_has_jack,
+	.card_is_jack_plugged = mock_card_is_jack_plugged,
+	.card_set_capture_channel = mock_card_set_capture_channel,
+	.card_get_capture_channel = mock_card_get_capture_channel,
+	.card_is_capture_muted = mock_card_is_capture_muted,
+	.card_toggle_capture_mute = mock_card_toggle_capture_mute,
+	.card_get_capture_volume = mock_card_get_capture_volume,
+	.card_set_capture_volume = mock_card_set_capture_volume,
+	.card_is_muted = mock_card_is_muted,
+	.card_toggle_mute = mock_card_toggle_mute,
+	.card_get_volume = mock_card_get_volume,
+	.card_set_volume = mock_card_set_volume,
+	.card_get_n_channels = mock_card_get_n_channels,
+	.card_get_channel_name = mock_card_get_channel_name,
+	.card_get_channel_volume = mock_card_get_channel_volume,
+	.card_set_channel_volume = mock_card_set_channel_volume,
+	.card_get_balance = mock_card_get_balance,
+	.card_set_balance = mock_card_set_balance,
+	.card_get_db_range = mock_card_get_db_range,
+	.card_get_db = mock_card_get_db,
+	.card_set_db = mock_card_set_db,
+};
@@ -0,0 +1,1453 @@
+/* backend-pulse.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file backend-pulse.c
+ * This file holds the PulseAudio backend, that also works with the
+ * PipeWire pulse server. Cards are sinks, with a single channel, and
+ * capture elements are sources. The playback streams of the applications
+ * (sink inputs) are published as backend streams.
+ * There's one asynchronous connection to the server, driven by the
+ * glib main loop. The state of every sink, source and stream is cached and kept
+ * up to date by the server's change events, so reads never hit the
+ * server. Writes go to the cache, and are sent once per main loop
+ * iteration, whatever the number of changes in between.
+ * Volumes are the server's own volumes, which are already perceptual,
+ * so the volume curve is not used.
+ * @brief PulseAudio backend.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <pulse/pulseaudio.h>
+#include <pulse/glib-mainloop.h>
+
+#include "alsa.h"
+#include "backend.h"
+
+#include "support-log.h"
+
+#define PULSE_CONNECT_TIMEOUT 2000	/* ms, at startup */
+#define PULSE_RECONNECT_DELAY 1000	/* ms */
+#define PULSE_CHANNEL         "Master"
+#define PULSE_DEFAULT_SINK    "(default)"	/* Like the default alsa card */
+
+/*
+ * Sinks, sources and sink inputs.
+ * They're refcounted, since cards and outputs keep them around after
+ * they're removed from the server.
+ */
+
+enum pulse_kind {
+	PULSE_SINK,
+	PULSE_SOURCE,
+	PULSE_SINK_INPUT
+};
+
+typedef enum pulse_kind PulseKind;
+
+struct pulse_device {
+	BackendStream stream; /* Public part for sink inputs, must come first */
+	guint refs;
+	uint32_t index;
+	PulseKind kind;
+	char *name;
+	char *description; /* Application name for sink inputs */
+	char *icon;
+	pa_cvolume volume;
+	pa_channel_map map;
+	gboolean muted;
+	gboolean has_jack[ALSA_JACK_OTHER];
+	gboolean jack_plugged[ALSA_JACK_OTHER];
+	gboolean dirty_volume; /* Waiting for the next flush */
+	gboolean dirty_mute;
+	guint ops; /* Writes sent to the server, not acknowledged yet */
+	gboolean gone;
+};
+
+typedef struct pulse_device PulseDevice;
+
+struct pulse_card {
+	PulseDevice *sink;
+	gboolean is_default; /* Hooked as the default sink */
+	char *capture; /* Name of the capture source */
+	AlsaCb cb_func;
+	gpointer cb_data;
+};
+
+typedef struct pulse_card PulseCard;
+
+static pa_glib_mainloop *mainloop;
+static pa_context *context;
+static char *server;
+static gboolean ready; /* Connected, and the initial state is known */
+static gboolean was_ready;
+static guint pending_replies;
+static guint reconnect_source;
+static guint flush_source;
+static GList *sinks;
+static GList *sources;
+static GList *inputs;
+static GList *cards;
+static char *default_sink;
+static char *default_source;
+static BackendHotplugCb hotplug_cb;
+static gpointer hotplug_cb_data;
+static BackendStreamsCb streams_cb;
+static gpointer streams_cb_data;
+
+static void pulse_connect(void);
+static void pulse_outputs_refresh(PulseDevice *dev);
+
+static PulseDevice *
+pulse_device_ref(PulseDevice *dev)
+{
+	dev->refs++;
+	return dev;
+}
+
+static void
+pulse_device_unref(PulseDevice *dev)
+{
+	if (--dev->refs > 0)
+		return;
+
+	g_free(dev->name);
+	g_free(dev->description);
+	g_free(dev->icon);
+	g_free(dev);
+}
+
+static PulseDevice *
+pulse_device_find(GList *list, uint32_t index)
+{
+	GList *item;
+
+	for (item = list; item; item = item->next) {
+		PulseDevice *dev = item->data;
+
+		if (dev->index == index)
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Check whether a name means the default device */
+static gboolean
+pulse_name_is_default(const char *name)
+{
+	return name == NULL || name[0] == '\0' || !strcmp(name, "default") ||
+	       !strcmp(name, PULSE_DEFAULT_SINK);
+}
+
+/* Find a device given its name or description, NULL meaning the default */
+static PulseDevice *
+pulse_device_lookup(GList *list, const char *name, const char *fallback)
+{
+	GList *item;
+
+	if (pulse_name_is_default(name))
+		name = fallback;
+
+	for (item = list; item; item = item->next) {
+		PulseDevice *dev = item->data;
+
+		if (name && (!strcmp(name, dev->name) || !strcmp(name, dev->description)))
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Update the cached state of a device, return TRUE if it changed.
+ * While our own writes are pending, the server state is outdated.
+ */
+static gboolean
+pulse_device_update(PulseDevice *dev, const char *name, const char *description,
+                    const pa_cvolume *volume, const pa_channel_map *map, int mute)
+{
+	if (g_strcmp0(dev->name, name)) {
+		g_free(dev->name);
+		dev->name = g_strdup(name);
+	}
+	if (g_strcmp0(dev->description, description)) {
+		g_free(dev->description);
+		dev->description = g_strdup(description ? description : name);
+	}
+	dev->map = *map;
+
+	if (dev->ops || dev->dirty_volume || dev->dirty_mute)
+		return FALSE;
+
+	if (pa_cvolume_equal(&dev->volume, volume) && dev->muted == !!mute)
+		return FALSE;
+
+	dev->volume = *volume;
+	dev->muted = !!mute;
+	return TRUE;
+}
+
+static AlsaJack
+pulse_jack_type_from_name(const char *name)
+{
+	if (strstr(name, "headphone"))
+		return ALSA_JACK_HEADPHONE;
+	if (strstr(name, "lineout") || strstr(name, "line-out"))
+		return ALSA_JACK_LINE_OUT;
+	if (strstr(name, "speaker"))
+		return ALSA_JACK_SPEAKER;
+
+	return ALSA_JACK_OTHER;
+}
+
+/* Update the jacks of a sink from its ports, return TRUE if they changed */
+static gboolean
+pulse_sink_update_jacks(PulseDevice *dev, const pa_sink_info *info)
+{
+	gboolean has_jack[ALSA_JACK_OTHER] = { FALSE };
+	gboolean plugged[ALSA_JACK_OTHER] = { FALSE };
+	gboolean changed;
+	uint32_t i;
+
+	for (i = 0; i < info->n_ports; i++) {
+		AlsaJack jack = pulse_jack_type_from_name(info->ports[i]->name);
+
+		if (jack == ALSA_JACK_OTHER)
+			continue;
+
+		has_jack[jack] = TRUE;
+		if (info->ports[i]->available != PA_PORT_AVAILABLE_NO)
+			plugged[jack] = TRUE;
+	}
+
+	changed = memcmp(has_jack, dev->has_jack, sizeof(has_jack)) ||
+	          memcmp(plugged, dev->jack_plugged, sizeof(plugged));
+
+	memcpy(dev->has_jack, has_jack, sizeof(has_jack));
+	memcpy(dev->jack_plugged, plugged, sizeof(plugged));
+
+	return changed;
+}
+
+/* Invoke the callback of the cards using a device */
+static void
+pulse_device_notify(PulseDevice *dev, enum alsa_event event)
+{
+	GList *list, *item;
+
+	/* Callbacks may free cards, so we hold the device meanwhile */
+	pulse_device_ref(dev);
+	list = g_list_copy(cards);
+
+	for (item = list; item; item = item->next) {
+		PulseCard *card = item->data;
+		gboolean uses;
+
+		if (!g_list_find(cards, card) || card->cb_func == NULL)
+			continue;
+
+		if (dev->kind == PULSE_SOURCE)
+			uses = !g_strcmp0(card->capture, dev->name);
+		else
+			uses = card->sink == dev;
+
+		if (uses)
+			card->cb_func(event, card->cb_data);
+	}
+
+	g_list_free(list);
+	pulse_device_unref(dev);
+}
+
+/* Fill the public part of a sink input from its cached state */
+static void
+pulse_stream_sync(PulseDevice *dev)
+{
+	dev->stream.id = dev->index;
+	dev->stream.name = dev->description;
+	dev->stream.icon = dev->icon;
+	dev->stream.volume = pa_cvolume_max(&dev->volume) * 100.0 / PA_VOLUME_NORM;
+	dev->stream.muted = dev->muted;
+}
+
+/* Publish the state of a sink input to the streams callback */
+static void
+pulse_stream_notify(PulseDevice *dev, enum backend_stream_event event)
+{
+	pulse_stream_sync(dev);
+
+	if (streams_cb)
+		streams_cb(event, &dev->stream, streams_cb_data);
+}
+
+/* A device was removed from the server */
+static void
+pulse_device_remove(GList **list, PulseDevice *dev)
+{
+	static const char *kinds[] = { "Sink", "Source", "Sink input" };
+
+	*list = g_list_remove(*list, dev);
+	dev->gone = TRUE;
+
+	DEBUG("%s '%s' removed", kinds[dev->kind], dev->name);
+
+	switch (dev->kind) {
+	case PULSE_SINK:
+		pulse_device_notify(dev, ALSA_CARD_DISCONNECTED);
+		pulse_outputs_refresh(dev);
+		break;
+	case PULSE_SOURCE:
+		pulse_device_notify(dev, ALSA_CARD_CAPTURE_CHANGED);
+		break;
+	case PULSE_SINK_INPUT:
+		pulse_stream_notify(dev, BACKEND_STREAM_REMOVED);
+		break;
+	}
+
+	pulse_device_unref(dev);
+}
+
+/*
+ * Writes.
+ * They're batched: the cache is updated at once, and the server is told
+ * when the main loop is idle. Once the server acknowledged everything,
+ * the device is read again, in case something else changed meanwhile.
+ */
+
+static void
+pulse_operation_run(pa_operation *op)
+{
+	if (op == NULL) {
+		WARN("PulseAudio operation failed: %s",
+		     pa_strerror(pa_context_errno(context)));
+		return;
+	}
+
+	pa_operation_unref(op);
+}
+
+static void on_sink_info(pa_context *c, const pa_sink_info *info, int eol,
+                         gpointer data);
+static void on_source_info(pa_context *c, const pa_source_info *info, int eol,
+                           gpointer data);
+static void on_sink_input_info(pa_context *c, const pa_sink_input_info *info,
+                               int eol, gpointer data);
+
+/* The list of the devices of a kind */
+static GList **
+pulse_device_list(PulseKind kind)
+{
+	switch (kind) {
+	case PULSE_SOURCE:
+		return &sources;
+	case PULSE_SINK_INPUT:
+		return &inputs;
+	default:
+		return &sinks;
+	}
+}
+
+static void
+on_write_done(G_GNUC_UNUSED pa_context *c, int success, gpointer data)
+{
+	uint32_t index = GPOINTER_TO_UINT(data) >> 2;
+	PulseKind kind = GPOINTER_TO_UINT(data) & 3;
+	PulseDevice *dev;
+
+	if (!success)
+		WARN("PulseAudio write failed: %s", pa_strerror(pa_context_errno(context)));
+
+	dev = pulse_device_find(*pulse_device_list(kind), index);
+	if (dev == NULL || --dev->ops > 0)
+		return;
+
+	switch (kind) {
+	case PULSE_SINK:
+		pulse_operation_run(pa_context_get_sink_info_by_index
+		                    (context, index, on_sink_info, NULL));
+		break;
+	case PULSE_SOURCE:
+		pulse_operation_run(pa_context_get_source_info_by_index
+		                    (context, index, on_source_info, NULL));
+		break;
+	case PULSE_SINK_INPUT:
+		pulse_operation_run(pa_context_get_sink_input_info
+		                    (context, index, on_sink_input_info, NULL));
+		break;
+	}
+}
+
+static void
+pulse_device_flush(PulseDevice *dev)
+{
+	gpointer data = GUINT_TO_POINTER(dev->index << 2 | dev->kind);
+	pa_operation *op;
+
+	if (dev->dirty_volume) {
+		if (dev->kind == PULSE_SOURCE)
+			op = pa_context_set_source_volume_by_index
+			     (context, dev->index, &dev->volume, on_write_done, data);
+		else if (dev->kind == PULSE_SINK_INPUT)
+			op = pa_context_set_sink_input_volume
+			     (context, dev->index, &dev->volume, on_write_done, data);
+		else
+			op = pa_context_set_sink_volume_by_index
+			     (context, dev->index, &dev->volume, on_write_done, data);
+
+		if (op)
+			dev->ops++;
+		pulse_operation_run(op);
+	}
+
+	if (dev->dirty_mute) {
+		if (dev->kind == PULSE_SOURCE)
+			op = pa_context_set_source_mute_by_index
+			     (context, dev->index, dev->muted, on_write_done, data);
+		else if (dev->kind == PULSE_SINK_INPUT)
+			op = pa_context_set_sink_input_mute
+			     (context, dev->index, dev->muted, on_write_done, data);
+		else
+			op = pa_context_set_sink_mute_by_index
+			     (context, dev->index, dev->muted, on_write_done, data);
+
+		if (op)
+			dev->ops++;
+		pulse_operation_run(op);
+	}
+
+	dev->dirty_volume = FALSE;
+	dev->dirty_mute = FALSE;
+}
+
+static gboolean
+on_flush(G_GNUC_UNUSED gpointer data)
+{
+	GList *item;
+
+	flush_source = 0;
+
+	if (!ready)
+		return FALSE;
+
+	for (item = sinks; item; item = item->next)
+		pulse_device_flush(item->data);
+	for (item = sources; item; item = item->next)
+		pulse_device_flush(item->data);
+	for (item = inputs; item; item = item->next)
+		pulse_device_flush(item->data);
+
+	return FALSE;
+}
+
+static void
+pulse_device_set_volume(PulseDevice *dev, const pa_cvolume *volume)
+{
+	if (dev->gone || pa_cvolume_equal(&dev->volume, volume))
+		return;
+
+	dev->volume = *volume;
+	dev->dirty_volume = TRUE;
+	if (flush_source == 0)
+		flush_source = g_idle_add(on_flush, NULL);
+
+	if (dev->kind == PULSE_SINK)
+		pulse_outputs_refresh(dev);
+}
+
+static void
+pulse_device_set_mute(PulseDevice *dev, gboolean muted)
+{
+	if (dev->gone || dev->muted == muted)
+		return;
+
+	dev->muted = muted;
+	dev->dirty_mute = TRUE;
+	if (flush_source == 0)
+		flush_source = g_idle_add(on_flush, NULL);
+
+	if (dev->kind == PULSE_SINK)
+		pulse_outputs_refresh(dev);
+}
+
+static gdouble
+pulse_device_get_volume(PulseDevice *dev)
+{
+	return pa_cvolume_max(&dev->volume) * 100.0 / PA_VOLUME_NORM;
+}
+
+/* Set the loudest channel, the other ones keep their ratio */
+static void
+pulse_device_scale_volume(PulseDevice *dev, gdouble value)
+{
+	pa_cvolume volume = dev->volume;
+	pa_volume_t max;
+
+	if (volume.channels == 0)
+		return;
+
+	max = lround(CLAMP(value, 0, 100) / 100 * PA_VOLUME_NORM);
+	if (pa_cvolume_max(&volume) == PA_VOLUME_MUTED)
+		pa_cvolume_set(&volume, volume.channels, max);
+	else
+		pa_cvolume_scale(&volume, max);
+
+	pulse_device_set_volume(dev, &volume);
+}
+
+/*
+ * Server events.
+ */
+
+/* One of the initial replies was received */
+static void
+pulse_reply_received(void)
+{
+	GList *item;
+
+	if (pending_replies == 0 || --pending_replies > 0)
+		return;
+
+	ready = TRUE;
+	DEBUG("PulseAudio ready (%u sinks, %u sources, %u streams)",
+	      g_list_length(sinks), g_list_length(sources), g_list_length(inputs));
+
+	/* After a reconnection, every sink is new */
+	if (was_ready && hotplug_cb)
+		for (item = sinks; item; item = item->next) {
+			PulseDevice *dev = item->data;
+
+			hotplug_cb(dev->name, hotplug_cb_data);
+		}
+
+	was_ready = TRUE;
+}
+
+static void
+on_server_info(G_GNUC_UNUSED pa_context *c, const pa_server_info *info,
+               gpointer data)
+{
+	if (info) {
+		g_free(default_sink);
+		default_sink = g_strdup(info->default_sink_name);
+		g_free(default_source);
+		default_source = g_strdup(info->default_source_name);
+	}
+
+	if (GPOINTER_TO_UINT(data))
+		pulse_reply_received();
+}
+
+static void
+on_sink_info(G_GNUC_UNUSED pa_context *c, const pa_sink_info *info, int eol,
+             gpointer data)
+{
+	PulseDevice *dev;
+	gboolean is_new, changed, jacks_changed;
+
+	if (eol) {
+		if (GPOINTER_TO_UINT(data))
+			pulse_reply_received();
+		return;
+	}
+
+	dev = pulse_device_find(sinks, info->index);
+	is_new = dev == NULL;
+	if (is_new) {
+		dev = g_new0(PulseDevice, 1);
+		dev->refs = 1;
+		dev->index = info->index;
+		sinks = g_list_append(sinks, dev);
+	}
+
+	changed = pulse_device_update(dev, info->name, info->description,
+	                              &info->volume, &info->channel_map, info->mute);
+	jacks_changed = pulse_sink_update_jacks(dev, info);
+
+	if (is_new) {
+		DEBUG("Sink '%s' added", dev->name);
+		if (ready && hotplug_cb)
+			hotplug_cb(dev->name, hotplug_cb_data);
+	} else {
+		if (jacks_changed)
+			pulse_device_notify(dev, ALSA_CARD_JACKS_CHANGED);
+		if (changed)
+			pulse_device_notify(dev, ALSA_CARD_VALUES_CHANGED);
+	}
+
+	pulse_outputs_refresh(dev);
+}
+
+static void
+on_source_info(G_GNUC_UNUSED pa_context *c, const pa_source_info *info, int eol,
+               gpointer data)
+{
+	PulseDevice *dev;
+	gboolean is_new, changed;
+
+	if (eol) {
+		if (GPOINTER_TO_UINT(data))
+			pulse_reply_received();
+		return;
+	}
+
+	/* Monitors of the sinks are not capture elements */
+	if (info->monitor_of_sink != PA_INVALID_INDEX)
+		return;
+
+	dev = pulse_device_find(sources, info->index);
+	is_new = dev == NULL;
+	if (is_new) {
+		dev = g_new0(PulseDevice, 1);
+		dev->refs = 1;
+		dev->index = info->index;
+		dev->kind = PULSE_SOURCE;
+		sources = g_list_append(sources, dev);
+	}
+
+	changed = pulse_device_update(dev, info->name, info->description,
+	                              &info->volume, &info->channel_map, info->mute);
+
+	if (changed && !is_new)
+		pulse_device_notify(dev, ALSA_CARD_CAPTURE_CHANGED);
+}
+
+static void
+on_sink_input_info(G_GNUC_UNUSED pa_context *c, const pa_sink_input_info *info,
+                   int eol, gpointer data)
+{
+	PulseDevice *dev;
+	const char *app, *icon;
+	gboolean is_new, changed;
+
+	if (eol) {
+		if (GPOINTER_TO_UINT(data))
+			pulse_reply_received();
+		return;
+	}
+
+	/* Some streams, like passthrough ones, have no volume */
+	if (!info->has_volume)
+		return;
+
+	app = pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_NAME);
+	icon = pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_ICON_NAME);
+
+	dev = pulse_device_find(inputs, info->index);
+	is_new = dev == NULL;
+	if (is_new) {
+		dev = g_new0(PulseDevice, 1);
+		dev->refs = 1;
+		dev->index = info->index;
+		dev->kind = PULSE_SINK_INPUT;
+		inputs = g_list_append(inputs, dev);
+	}
+
+	changed = pulse_device_update(dev, info->name, app, &info->volume,
+	                              &info->channel_map, info->mute);
+	if (g_strcmp0(dev->icon, icon)) {
+		g_free(dev->icon);
+		dev->icon = g_strdup(icon);
+		changed = TRUE;
+	}
+
+	if (is_new) {
+		DEBUG("Sink input '%s' added", dev->name);
+		pulse_stream_notify(dev, BACKEND_STREAM_ADDED);
+	} else if (changed) {
+		pulse_stream_notify(dev, BACKEND_STREAM_CHANGED);
+	}
+}
+
+static void
+on_subscribe_event(pa_context *c, pa_subscription_event_type_t type,
+                   uint32_t index, G_GNUC_UNUSED gpointer data)
+{
+	pa_subscription_event_type_t facility = type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+	gboolean removed = (type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) ==
+	                   PA_SUBSCRIPTION_EVENT_REMOVE;
+	PulseDevice *dev;
+
+	switch (facility) {
+	case PA_SUBSCRIPTION_EVENT_SINK:
+		dev = pulse_device_find(sinks, index);
+		if (removed && dev)
+			pulse_device_remove(&sinks, dev);
+		else if (!removed)
+			pulse_operation_run(pa_context_get_sink_info_by_index
+			                    (c, index, on_sink_info, NULL));
+		break;
+	case PA_SUBSCRIPTION_EVENT_SOURCE:
+		dev = pulse_device_find(sources, index);
+		if (removed && dev)
+			pulse_device_remove(&sources, dev);
+		else if (!removed)
+			pulse_operation_run(pa_context_get_source_info_by_index
+			                    (c, index, on_source_info, NULL));
+		break;
+	case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+		dev = pulse_device_find(inputs, index);
+		if (removed && dev)
+			pulse_device_remove(&inputs, dev);
+		else if (!removed)
+			pulse_operation_run(pa_context_get_sink_input_info
+			                    (c, index, on_sink_input_info, NULL));
+		break;
+	case PA_SUBSCRIPTION_EVENT_SERVER:
+		pulse_operation_run(pa_context_get_server_info(c, on_server_info, NULL));
+		break;
+	default:
+		break;
+	}
+}
+
+static gboolean
+on_reconnect_timeout(G_GNUC_UNUSED gpointer data)
+{
+	reconnect_source = 0;
+
+	pa_context_unref(context);
+	context = NULL;
+	pulse_connect();
+
+	return FALSE;
+}
+
+static void
+on_context_state(pa_context *c, G_GNUC_UNUSED gpointer data)
+{
+	switch (pa_context_get_state(c)) {
+	case PA_CONTEXT_READY:
+		DEBUG("Connected to PulseAudio");
+		pa_context_set_subscribe_callback(c, on_subscribe_event, NULL);
+		pulse_operation_run(pa_context_subscribe
+		                    (c, PA_SUBSCRIPTION_MASK_SINK |
+		                     PA_SUBSCRIPTION_MASK_SOURCE |
+		                     PA_SUBSCRIPTION_MASK_SINK_INPUT |
+		                     PA_SUBSCRIPTION_MASK_SERVER, NULL, NULL));
+
+		pending_replies = 4;
+		pulse_operation_run(pa_context_get_server_info
+		                    (c, on_server_info, GUINT_TO_POINTER(TRUE)));
+		pulse_operation_run(pa_context_get_sink_info_list
+		                    (c, on_sink_info, GUINT_TO_POINTER(TRUE)));
+		pulse_operation_run(pa_context_get_source_info_list
+		                    (c, on_source_info, GUINT_TO_POINTER(TRUE)));
+		pulse_operation_run(pa_context_get_sink_input_info_list
+		                    (c, on_sink_input_info, GUINT_TO_POINTER(TRUE)));
+		break;
+	case PA_CONTEXT_FAILED:
+	case PA_CONTEXT_TERMINATED:
+		WARN("Connection to PulseAudio lost: %s",
+		     pa_strerror(pa_context_errno(c)));
+
+		/* Every sink, source and stream is gone */
+		ready = FALSE;
+		pending_replies = 0;
+		while (sinks)
+			pulse_device_remove(&sinks, sinks->data);
+		while (sources)
+			pulse_device_remove(&sources, sources->data);
+		while (inputs)
+			pulse_device_remove(&inputs, inputs->data);
+
+		/* The context can't be freed from its own callback */
+		if (reconnect_source == 0)
+			reconnect_source = g_timeout_add(PULSE_RECONNECT_DELAY,
+			                                 on_reconnect_timeout, NULL);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Connect to the server. If it's not running, we wait for it. */
+static void
+pulse_connect(void)
+{
+	context = pa_context_new(pa_glib_mainloop_get_api(mainloop), PACKAGE);
+	pa_context_set_state_callback(context, on_context_state, NULL);
+
+	if (pa_context_connect(context, server, PA_CONTEXT_NOFAIL, NULL) < 0)
+		WARN("Can't connect to PulseAudio: %s",
+		     pa_strerror(pa_context_errno(context)));
+}
+
+static gboolean
+on_connect_timeout(gpointer data)
+{
+	*((gboolean *) data) = TRUE;
+	return FALSE;
+}
+
+/* Initialize the backend, the arguments being an optional server address */
+static gboolean
+pulse_init(const char *args)
+{
+	gboolean timed_out = FALSE;
+	guint timeout;
+
+	server = g_strdup(args && args[0] ? args : NULL);
+	mainloop = pa_glib_mainloop_new(NULL);
+	pulse_connect();
+
+	/* Wait a little for the initial state, so that there are cards
+	 * to hook at startup. Later on, it's all asynchronous.
+	 */
+	timeout = g_timeout_add(PULSE_CONNECT_TIMEOUT, on_connect_timeout, &timed_out);
+	while (!ready && !timed_out)
+		g_main_context_iteration(NULL, TRUE);
+
+	if (timed_out)
+		WARN("PulseAudio is not available yet, waiting for it");
+	else
+		g_source_remove(timeout);
+
+	return TRUE;
+}
+
+static void
+pulse_install_hotplug_callback(BackendHotplugCb callback, gpointer data)
+{
+	hotplug_cb = callback;
+	hotplug_cb_data = data;
+}
+
+/*
+ * Output monitor.
+ * Every sink is known already, so watching one is just a matter
+ * of publishing its state.
+ */
+
+struct pulse_output {
+	AlsaOutput output; /* Public part, must come first */
+	PulseDevice *dev;
+	gboolean seen; /* Watched again since the last prune */
+};
+
+typedef struct pulse_output PulseOutput;
+
+static GList *outputs;
+static AlsaOutputsCb outputs_cb;
+static gpointer outputs_cb_data;
+
+static void
+pulse_output_free(PulseOutput *watch)
+{
+	if (watch == NULL)
+		return;
+
+	pulse_device_unref(watch->dev);
+	g_free(watch->output.card_id);
+	g_free(watch->output.card);
+	g_free(watch->output.channel);
+	g_free(watch);
+}
+
+/* Read the state of an output, return TRUE if it changed */
+static gboolean
+pulse_output_refresh(PulseOutput *watch)
+{
+	PulseDevice *dev = watch->dev;
+	gboolean has_jacks = FALSE, plugged = FALSE, available;
+	gdouble volume;
+	guint i;
+
+	/* Like with alsa, a sink without jacks is always available */
+	for (i = 0; i < ALSA_JACK_OTHER; i++) {
+		has_jacks |= dev->has_jack[i];
+		plugged |= dev->jack_plugged[i];
+	}
+	available = !has_jacks || plugged;
+
+	volume = pulse_device_get_volume(dev);
+
+	if (volume == watch->output.volume && dev->muted == watch->output.muted &&
+	    available == watch->output.available)
+		return FALSE;
+
+	watch->output.volume = volume;
+	watch->output.muted = dev->muted;
+	watch->output.available = available;
+	return TRUE;
+}
+
+/* Refresh the output of a sink, dropping it if the sink is gone */
+static void
+pulse_outputs_refresh(PulseDevice *dev)
+{
+	gboolean changed = FALSE;
+	GList *link;
+
+	for (link = outputs; link; link = link->next) {
+		PulseOutput *watch = link->data;
+
+		if (watch->dev != dev)
+			continue;
+
+		if (dev->gone) {
+			outputs = g_list_delete_link(outputs, link);
+			pulse_output_free(watch);
+			changed = TRUE;
+		} else {
+			changed = pulse_output_refresh(watch);
+		}
+		break;
+	}
+
+	if (changed && outputs_cb)
+		outputs_cb(outputs_cb_data);
+}
+
+static gboolean
+pulse_outputs_watch(const char *card_id, G_GNUC_UNUSED const char *channel,
+                    G_GNUC_UNUSED AlsaCurve curve)
+{
+	PulseOutput *watch;
+	PulseDevice *dev;
+	GList *link;
+
+	dev = pulse_device_lookup(sinks, card_id, default_sink);
+	if (dev == NULL)
+		return FALSE;
+
+	for (link = outputs; link; link = link->next) {
+		watch = link->data;
+
+		if (watch->dev == dev) {
+			watch->seen = TRUE;
+			return TRUE;
+		}
+	}
+
+	watch = g_new0(PulseOutput, 1);
+	watch->dev = pulse_device_ref(dev);
+	watch->output.card_id = g_strdup(dev->name);
+	watch->output.card = g_strdup(dev->description);
+	watch->output.channel = g_strdup(PULSE_CHANNEL);
+	watch->output.volume = -1;
+	watch->seen = TRUE;
+	pulse_output_refresh(watch);
+
+	outputs = g_list_append(outputs, watch);
+	return TRUE;
+}
+
+static void
+pulse_outputs_prune(void)
+{
+	GList *link, *next;
+
+	for (link = outputs; link; link = next) {
+		PulseOutput *watch = link->data;
+
+		next = link->next;
+		if (watch->seen) {
+			watch->seen = FALSE;
+			continue;
+		}
+
+		outputs = g_list_delete_link(outputs, link);
+		pulse_output_free(watch);
+	}
+}
+
+static void
+pulse_outputs_unwatch_all(void)
+{
+	g_list_free_full(outputs, (GDestroyNotify) pulse_output_free);
+	outputs = NULL;
+}
+
+static const GList *
+pulse_outputs_get_list(void)
+{
+	return outputs;
+}
+
+static void
+pulse_outputs_install_callback(AlsaOutputsCb callback, gpointer data)
+{
+	outputs_cb = callback;
+	outputs_cb_data = data;
+}
+
+/*
+ * Cards.
+ */
+
+static BackendCard *
+pulse_card_new(const char *card_id, G_GNUC_UNUSED const char *channel,
+               G_GNUC_UNUSED AlsaCurve curve)
+{
+	PulseCard *card;
+	PulseDevice *dev;
+
+	dev = pulse_device_lookup(sinks, card_id, default_sink);
+	if (dev == NULL) {
+		DEBUG("Sink '%s' not found", card_id);
+		return NULL;
+	}
+
+	card = g_new0(PulseCard, 1);
+	card->sink = pulse_device_ref(dev);
+	card->is_default = pulse_name_is_default(card_id);
+	cards = g_list_prepend(cards, card);
+
+	return (BackendCard *) card;
+}
+
+static void
+pulse_card_free(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	if (card == NULL)
+		return;
+
+	cards = g_list_remove(cards, card);
+	pulse_device_unref(card->sink);
+	g_free(card->capture);
+	g_free(card);
+}
+
+static void
+pulse_card_install_callback(BackendCard *bcard, AlsaCb callback, gpointer data)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	card->cb_func = callback;
+	card->cb_data = data;
+}
+
+static const char *
+pulse_card_get_id(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return card->is_default ? PULSE_DEFAULT_SINK : card->sink->name;
+}
+
+static const char *
+pulse_card_get_name(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return card->is_default ? PULSE_DEFAULT_SINK : card->sink->description;
+}
+
+static const char *
+pulse_card_get_channel(G_GNUC_UNUSED BackendCard *card)
+{
+	return PULSE_CHANNEL;
+}
+
+static gboolean
+pulse_card_has_channel(G_GNUC_UNUSED BackendCard *card, const char *channel)
+{
+	return !g_strcmp0(channel, PULSE_CHANNEL);
+}
+
+static gboolean
+pulse_card_set_channel(G_GNUC_UNUSED BackendCard *card,
+                       G_GNUC_UNUSED const char *channel)
+{
+	return FALSE;
+}
+
+static gboolean
+pulse_card_has_jack(BackendCard *bcard, AlsaJack jack)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return jack < ALSA_JACK_OTHER && card->sink->has_jack[jack];
+}
+
+static gboolean
+pulse_card_is_jack_plugged(BackendCard *bcard, AlsaJack jack)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return pulse_card_has_jack(bcard, jack) && card->sink->jack_plugged[jack];
+}
+
+static PulseDevice *
+pulse_card_get_capture(PulseCard *card)
+{
+	if (card->capture == NULL)
+		return NULL;
+
+	return pulse_device_lookup(sources, card->capture, NULL);
+}
+
+static gboolean
+pulse_card_set_capture_channel(BackendCard *bcard, const char *channel)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	PulseDevice *dev;
+
+	dev = pulse_device_lookup(sources, channel, default_source);
+	if (dev == NULL)
+		dev = pulse_device_lookup(sources, NULL, default_source);
+	if (dev == NULL && sources)
+		dev = sources->data;
+
+	g_free(card->capture);
+	card->capture = dev ? g_strdup(dev->name) : NULL;
+
+	return dev != NULL;
+}
+
+static const char *
+pulse_card_get_capture_channel(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	PulseDevice *dev = pulse_card_get_capture(card);
+
+	return dev ? dev->description : NULL;
+}
+
+static gboolean
+pulse_card_is_capture_muted(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	PulseDevice *dev = pulse_card_get_capture(card);
+
+	return dev && dev->muted;
+}
+
+static void
+pulse_card_toggle_capture_mute(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	PulseDevice *dev = pulse_card_get_capture(card);
+
+	if (dev)
+		pulse_device_set_mute(dev, !dev->muted);
+}
+
+static gdouble
+pulse_card_get_capture_volume(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	PulseDevice *dev = pulse_card_get_capture(card);
+
+	return dev ? pulse_device_get_volume(dev) : 0;
+}
+
+static void
+pulse_card_set_capture_volume(BackendCard *bcard, gdouble value,
+                              G_GNUC_UNUSED int dir)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	PulseDevice *dev = pulse_card_get_capture(card);
+
+	if (dev)
+		pulse_device_scale_volume(dev, value);
+}
+
+static gboolean
+pulse_card_is_muted(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return card->sink->muted;
+}
+
+static void
+pulse_card_toggle_mute(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	pulse_device_set_mute(card->sink, !card->sink->muted);
+}
+
+static gdouble
+pulse_card_get_volume(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return pulse_device_get_volume(card->sink);
+}
+
+/* The server volume is fine-grained, there's no step to round to */
+static void
+pulse_card_set_volume(BackendCard *bcard, gdouble value, G_GNUC_UNUSED int dir)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	pulse_device_scale_volume(card->sink, value);
+}
+
+static guint
+pulse_card_get_n_channels(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return card->sink->volume.channels;
+}
+
+static const char *
+pulse_card_get_channel_name(BackendCard *bcard, guint index)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	g_return_val_if_fail(index < card->sink->map.channels, NULL);
+
+	return pa_channel_position_to_pretty_string(card->sink->map.map[index]);
+}
+
+static gdouble
+pulse_card_get_channel_volume(BackendCard *bcard, guint index)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	g_return_val_if_fail(index < card->sink->volume.channels, 0);
+
+	return card->sink->volume.values[index] * 100.0 / PA_VOLUME_NORM;
+}
+
+static void
+pulse_card_set_channel_volume(BackendCard *bcard, guint index, gdouble value,
+                              G_GNUC_UNUSED int dir)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	pa_cvolume volume = card->sink->volume;
+
+	g_return_if_fail(index < volume.channels);
+
+	volume.values[index] = lround(CLAMP(value, 0, 100) / 100 * PA_VOLUME_NORM);
+	pulse_device_set_volume(card->sink, &volume);
+}
+
+static gdouble
+pulse_card_get_balance(BackendCard *bcard)
+{
+	PulseCard *card = (PulseCard *) bcard;
+
+	return pa_cvolume_get_balance(&card->sink->volume, &card->sink->map) * 100;
+}
+
+static void
+pulse_card_set_balance(BackendCard *bcard, gdouble balance)
+{
+	PulseCard *card = (PulseCard *) bcard;
+	pa_cvolume volume = card->sink->volume;
+
+	pa_cvolume_set_balance(&volume, &card->sink->map, CLAMP(balance, -100, 100) / 100);
+	pulse_device_set_volume(card->sink, &volume);
+}
+
+/* The software volume goes down to -inf dB, there's no usable range,
+ * so control groups fall back to lockstep.
+ */
+static gboolean
+pulse_card_get_db_range(G_GNUC_UNUSED BackendCard *card,
+                        G_GNUC_UNUSED gdouble *db_min,
+                        G_GNUC_UNUSED gdouble *db_max)
+{
+	return FALSE;
+}
+
+static gdouble
+pulse_card_get_db(G_GNUC_UNUSED BackendCard *card)
+{
+	return 0;
+}
+
+static void
+pulse_card_set_db(G_GNUC_UNUSED BackendCard *card, G_GNUC_UNUSED gdouble db,
+                  G_GNUC_UNUSED int dir)
+{
+}
+
+/*
+ * Streams.
+ * The list is the list of sink inputs, since their public part
+ * comes first.
+ */
+
+static const GList *
+pulse_streams_get_list(void)
+{
+	GList *item;
+
+	for (item = inputs; item; item = item->next)
+		pulse_stream_sync(item->data);
+
+	return inputs;
+}
+
+static void
+pulse_streams_install_callback(BackendStreamsCb callback, gpointer data)
+{
+	streams_cb = callback;
+	streams_cb_data = data;
+}
+
+static void
+pulse_stream_set_volume(guint32 id, gdouble value)
+{
+	PulseDevice *dev = pulse_device_find(inputs, id);
+
+	if (dev)
+		pulse_device_scale_volume(dev, value);
+}
+
+static void
+pulse_stream_set_mute(guint32 id, gboolean muted)
+{
+	PulseDevice *dev = pulse_device_find(inputs, id);
+
+	if (dev)
+		pulse_device_set_mute(dev, muted);
+}
+
+/*
+ * Listing functions.
+ */
+
+static GSList *
+pulse_list_cards(void)
+{
+	GSList *list = NULL;
+	GList *item;
+
+	/* First entry follows the default sink of the server,
+	 * like the default card of the alsa backend.
+	 */
+	if (default_sink)
+		list = g_slist_append(list, g_strdup(PULSE_DEFAULT_SINK));
+
+	for (item = sinks; item; item = item->next) {
+		PulseDevice *dev = item->data;
+
+		list = g_slist_append(list, g_strdup(dev->name));
+	}
+
+	return list;
+}
+
+static GSList *
+pulse_list_channels(const char *card_id)
+{
+	if (pulse_device_lookup(sinks, card_id, default_sink) == NULL)
+		return NULL;
+
+	return g_slist_append(NULL, g_strdup(PULSE_CHANNEL));
+}
+
+/* Sources are not tied to a sink, every sink gets all of them */
+static GSList *
+pulse_list_capture_channels(const char *card_id)
+{
+	GSList *list = NULL;
+	GList *item;
+
+	if (pulse_device_lookup(sinks, card_id, default_sink) == NULL)
+		return NULL;
+
+	for (item = sources; item; item = item->next) {
+		PulseDevice *dev = item->data;
+
+		list = g_slist_append(list, g_strdup(dev->description));
+	}
+
+	return list;
+}
+
+static char *
+pulse_get_card_name(const char *card_id)
+{
+	PulseDevice *dev = pulse_device_lookup(sinks, card_id, default_sink);
+
+	if (dev && pulse_name_is_default(card_id))
+		return g_strdup(PULSE_DEFAULT_SINK);
+
+	return dev ? g_strdup(dev->description) : NULL;
+}
+
+static char *
+pulse_get_card_id(const char *card_id)
+{
+	PulseDevice *dev = pulse_device_lookup(sinks, card_id, default_sink);
+
+	if (dev && pulse_name_is_default(card_id))
+		return g_strdup(PULSE_DEFAULT_SINK);
+
+	return dev ? g_strdup(dev->name) : NULL;
+}
+
+static char *
+pulse_get_card_id_by_number(int number)
+{
+	PulseDevice *dev = pulse_device_find(sinks, number);
+
+	return dev ? g_strdup(dev->name) : NULL;
+}
+
+/*
+ * Backend operations
+ */
+
+const Backend pulse_backend = {
+	.name = "pulse",
+	.init = pulse_init,
+	.install_hotplug_callback = pulse_install_hotplug_callback,
+	.list_cards = pulse_list_cards,
+	.list_channels = pulse_list_channels,
+	.list_capture_channels = pulse_list_capture_channels,
+	.get_card_name = pulse_get_card_name,
+	.get_card_id = pulse_get_card_id,
+	.get_card_id_by_number = pulse_get_card_id_by_number,
+	.outputs_watch = pulse_outputs_watch,
+	.outputs_prune = pulse_outputs_prune,
+	.outputs_unwatch_all = pulse_outputs_unwatch_all,
+	.outputs_get_list = pulse_outputs_get_list,
+	.outputs_install_callback = pulse_outputs_install_callback,
+	.streams_get_list = pulse_streams_get_list,
+	.streams_install_callback = pulse_streams_install_callback,
+	.stream_set_volume = pulse_stream_set_volume,
+	.stream_set_mute = pulse_stream_set_mute,
+	.card_new = pulse_card_new,
+	.card_free = pulse_card_free,
+	.card_install_callback = pulse_card_install_callback,
+	.card_get_id = pulse_card_get_id,
+	.card_get_name = pulse_card_get_name,
+	.card_get_channel = pulse_card_get_channel,
+	.card_has_channel = pulse_card_has_channel,
+	.card_set_channel = pulse_card_set_channel,
+	.card_has_jack = pulse_card_has_jack,
+	.card_is_jack_plugged = pulse_card_is_jack_plugged,
+	.card_set_capture_channel = pulse_card_set_capture_channel,
+	.card_get_capture_channel = pulse_card_get_capture_channel,
+	.card_is_capture_muted = pulse_card_is_capture_muted,
+	.card_toggle_capture_mute = pulse_card_toggle_capture_mute,
+	.card_get_capture_volume = pulse_card_get_capture_volume,
+	.card_set_capture_volume = pulse_card_set_capture_volume,
+	.card_is_muted = pulse_card_is_muted,
+	.card_toggle_mute = pulse_card_toggle_mute,
+	.card_get_volume = pulse_card_get_volume,
+	.card_set_volume = pulse_card_set_volume,
+	.card_get_n_channels = pulse_card_get_n_channels,
+	.card_get_channel_name = pulse_card_get_channel_name,
+	.card_get_channel_volume = pulse_card_get_channel_volume,
+	.card_set_channel_volume = pulse_card_set_channel_volume,
+	.card_get_balance = pulse_card_get_balance,
+	.card_set_balance = pulse_card_set_balance,
+	.card_get_db_range = pulse_card_get_db_range,
+	.card_get_db = pulse_card_get_db,
+	.card_set_db = pulse_card_set_db,
+};
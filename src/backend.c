@@ -0,0 +1,90 @@
+/* backend.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file backend.c
+ * This file holds the list of audio backends, and the selection of
+ * the one in use. A backend is a table of operations on sound cards,
+ * the audio subsystem only talks to the cards through it.
+ * @brief Audio backends.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "backend.h"
+
+#include "support-log.h"
+
+static const Backend *backends[] = {
+	&alsa_backend,
+	&mock_backend,
+#ifdef HAVE_PULSEAUDIO
+	&pulse_backend,
+#endif
+	NULL
+};
+
+static const Backend *current = &alsa_backend;
+
+/**
+ * Select the backend to use. Must be called before the audio
+ * subsystem is created.
+ *
+ * @param spec the name of the backend, optionally followed by a colon
+ * and some arguments for the backend, eg "mock:/path/to/script".
+ * @return TRUE on success, FALSE if the backend doesn't exist or
+ * can't be initialized.
+ */
+gboolean
+backend_select(const char *spec)
+{
+	const Backend **backend;
+	const char *args;
+	gsize len;
+
+	args = strchr(spec, ':');
+	len = args ? (gsize) (args - spec) : strlen(spec);
+	if (args)
+		args++;
+
+	for (backend = backends; *backend; backend++) {
+		if (strlen((*backend)->name) != len ||
+		    strncmp((*backend)->name, spec, len))
+			continue;
+
+		if ((*backend)->init && !(*backend)->init(args)) {
+			ERROR("Can't initialize audio backend '%s'", (*backend)->name);
+			return FALSE;
+		}
+
+		DEBUG("Using audio backend '%s'", (*backend)->name);
+		current = *backend;
+		return TRUE;
+	}
+
+	ERROR("Unknown audio backend '%s'", spec);
+	return FALSE;
+}
+
+/**
+ * Get the backend in use.
+ *
+ * @return the backend.
+ */
+const Backend *
+backend_get(void)
+{
+	return current;
+}
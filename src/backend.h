@@ -0,0 +1,126 @@
+/* backend.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file backend.h
+ * Header for backend.c.
+ * @brief Header for backend.c.
+ */
+
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include <glib.h>
+
+#include "alsa.h"
+
+/* Backends share the vocabulary of the alsa layer (curves, jacks,
+ * events and outputs), only the card handle is opaque. Implementations
+ * take a BackendCard, and cast it back to their own card type.
+ */
+typedef struct backend_card BackendCard;
+
+typedef void (*BackendHotplugCb) (const char *card_id, gpointer data);
+
+/* Per-application playback streams */
+struct backend_stream {
+	guint32 id;
+	const char *name;
+	const char *icon;
+	gdouble volume;
+	gboolean muted;
+};
+
+typedef struct backend_stream BackendStream;
+
+enum backend_stream_event {
+	BACKEND_STREAM_ADDED,
+	BACKEND_STREAM_CHANGED,
+	BACKEND_STREAM_REMOVED
+};
+
+typedef void (*BackendStreamsCb) (enum backend_stream_event event,
+                                  const BackendStream *stream, gpointer data);
+
+struct backend {
+	const char *name;
+	/* Setup, may be NULL */
+	gboolean (*init) (const char *args);
+	void (*set_watchdog_timeout) (guint timeout);
+	void (*set_mixer_pool_size) (guint size);
+	/* Hotplug, may be NULL, in which case /dev/snd is monitored */
+	void (*install_hotplug_callback) (BackendHotplugCb callback, gpointer data);
+	/* Listing */
+	GSList *(*list_cards) (void);
+	GSList *(*list_channels) (const char *card_id);
+	GSList *(*list_capture_channels) (const char *card_id); /* May be NULL */
+	char *(*get_card_name) (const char *card_id);
+	char *(*get_card_id) (const char *card_id);
+	char *(*get_card_id_by_number) (int number);
+	/* Output monitor */
+	gboolean (*outputs_watch) (const char *card_id, const char *channel,
+	                           AlsaCurve curve);
+	void (*outputs_prune) (void);
+	void (*outputs_unwatch_all) (void);
+	const GList *(*outputs_get_list) (void);
+	void (*outputs_install_callback) (AlsaOutputsCb callback, gpointer data);
+	/* Streams, may be NULL if the backend doesn't know about them */
+	const GList *(*streams_get_list) (void);
+	void (*streams_install_callback) (BackendStreamsCb callback, gpointer data);
+	void (*stream_set_volume) (guint32 id, gdouble value);
+	void (*stream_set_mute) (guint32 id, gboolean muted);
+	/* Cards */
+	BackendCard *(*card_new) (const char *card_id, const char *channel,
+	                          AlsaCurve curve);
+	void (*card_free) (BackendCard *card);
+	void (*card_install_callback) (BackendCard *card, AlsaCb callback,
+	                               gpointer data);
+	const char *(*card_get_id) (BackendCard *card);
+	const char *(*card_get_name) (BackendCard *card);
+	const char *(*card_get_channel) (BackendCard *card);
+	gboolean (*card_has_channel) (BackendCard *card, const char *channel);
+	gboolean (*card_set_channel) (BackendCard *card, const char *channel);
+	gboolean (*card_has_jack) (BackendCard *card, AlsaJack jack);
+	gboolean (*card_is_jack_plugged) (BackendCard *card, AlsaJack jack);
+	gboolean (*card_set_capture_channel) (BackendCard *card, const char *channel);
+	const char *(*card_get_capture_channel) (BackendCard *card);
+	gboolean (*card_is_capture_muted) (BackendCard *card);
+	void (*card_toggle_capture_mute) (BackendCard *card);
+	gdouble (*card_get_capture_volume) (BackendCard *card);
+	void (*card_set_capture_volume) (BackendCard *card, gdouble value, int dir);
+	gboolean (*card_is_muted) (BackendCard *card);
+	void (*card_toggle_mute) (BackendCard *card);
+	gdouble (*card_get_volume) (BackendCard *card);
+	void (*card_set_volume) (BackendCard *card, gdouble value, int dir);
+	guint (*card_get_n_channels) (BackendCard *card);
+	const char *(*card_get_channel_name) (BackendCard *card, guint index);
+	gdouble (*card_get_channel_volume) (BackendCard *card, guint index);
+	void (*card_set_channel_volume) (BackendCard *card, guint index,
+	                                 gdouble value, int dir);
+	gdouble (*card_get_balance) (BackendCard *card);
+	void (*card_set_balance) (BackendCard *card, gdouble balance);
+	gboolean (*card_get_db_range) (BackendCard *card, gdouble *db_min,
+	                               gdouble *db_max);
+	gdouble (*card_get_db) (BackendCard *card);
+	void (*card_set_db) (BackendCard *card, gdouble db, int dir);
+};
+
+typedef struct backend Backend;
+
+extern const Backend alsa_backend;
+extern const Backend mock_backend;
+#ifdef HAVE_PULSEAUDIO
+extern const Backend pulse_backend;
+#endif
+
+gboolean backend_select(const char *spec);
+const Backend *backend_get(void);
+
+#endif				// _BACKEND_H_
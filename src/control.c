@@ -0,0 +1,733 @@
+/* control.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file control.c
+ * This file handles the control socket, a UNIX domain socket in the
+ * user runtime directory, that lets scripts and status bars control
+ * the volume without spawning a mixer each time. It's served from the
+ * main loop, with a line protocol. Each command gets a single line
+ * in reply, starting with 'ok' or 'error':
+ *
+ *   get                 ok VOLUME MUTED CARD
+ *   set VOLUME          ok
+ *   step DELTA          ok
+ *   mute [on|off]       ok, toggles without argument
+ *   ramp VOLUME MS      ok, drives the volume to VOLUME over MS ms
+ *   fade-mute MS        ok, toggles mute, fading out over MS ms
+ *   card CARD           ok, switches to another card
+ *   subscribe           ok, then 'event VOLUME MUTED CARD' on each change
+ *
+ * @brief Control socket subsystem.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE /* struct ucred */
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <glib.h>
+
+#include "audio.h"
+#include "prefs.h"
+#include "support-log.h"
+#include "control.h"
+
+#define CONTROL_SOCKET_NAME "pnmixer.sock"
+#define CONTROL_MAX_LINE    256	/* Longer lines close the connection */
+#define CONTROL_MAX_OUTPUT  65536	/* Clients that don't read are dropped */
+#define CONTROL_MAX_RAMP    60000	/* ms */
+#define CONTROL_ACCEPT_DELAY 1000	/* ms, when out of file descriptors */
+
+/* Helpers */
+
+/* Make a file descriptor non-blocking, and close it on exec */
+static gboolean
+set_nonblocking(int fd)
+{
+	return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0 &&
+	       fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+/* Parse a number that must span the whole string */
+static gboolean
+parse_number(const gchar *str, gdouble *value)
+{
+	gchar *end;
+
+	if (str == NULL || *str == '\0')
+		return FALSE;
+
+	*value = g_ascii_strtod(str, &end);
+
+	/* strtod accepts 'nan' and 'inf', that nobody wants here */
+	return *end == '\0' && isfinite(*value);
+}
+
+/* Parse a duration in ms, for ramps and fades */
+static gboolean
+parse_duration(const gchar *str, guint *duration)
+{
+	gdouble value;
+
+	if (!parse_number(str, &value) || value < 0 || value > CONTROL_MAX_RAMP)
+		return FALSE;
+
+	*duration = (guint) value;
+	return TRUE;
+}
+
+/* Check that the peer of a connection is run by the same user */
+static gboolean
+peer_is_trusted(int fd)
+{
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof cred;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+		return FALSE;
+
+	return cred.uid == getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(fd, &uid, &gid) < 0)
+		return FALSE;
+
+	return uid == getuid();
+#endif
+}
+
+/* Make sure the directory of the socket exists, belongs to us, and is
+ * not accessible to anyone else. XDG_RUNTIME_DIR is like that already.
+ */
+static gboolean
+check_private_dir(const gchar *dir)
+{
+	struct stat st;
+
+	if (g_mkdir_with_parents(dir, S_IRWXU) < 0 || lstat(dir, &st) < 0) {
+		WARN("Can't create directory '%s': %s", dir, g_strerror(errno));
+		return FALSE;
+	}
+
+	if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() ||
+	    (st.st_mode & (S_IRWXG | S_IRWXO))) {
+		WARN("Directory '%s' is not private, not creating the control socket",
+		     dir);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Format the volume state, for 'get' and for the events */
+static void
+append_state(GString *line, Audio *audio)
+{
+	const gchar *card_id = audio_get_card_id(audio);
+
+	g_string_append_printf(line, " %ld %d %s", lround(audio_get_volume(audio)),
+	                       audio_is_muted(audio) ? 1 : 0,
+	                       card_id ? card_id : "");
+}
+
+/* Public functions & signal handlers */
+
+struct control {
+	/* Audio system */
+	Audio *audio;
+	/* Listening socket */
+	gchar *dir;
+	gchar *path;
+	int fd;
+	guint watch;
+	guint accept_delay;
+	/* Connected clients */
+	GSList *clients;
+};
+
+struct client {
+	Control *control;
+	int fd;
+	guint watch;
+	guint out_watch;
+	GString *in;
+	GString *out;
+	gboolean subscribed;
+};
+
+typedef struct client Client;
+
+static gboolean
+client_free(Client *client)
+{
+	g_string_free(client->in, TRUE);
+	g_string_free(client->out, TRUE);
+	g_free(client);
+
+	return FALSE;
+}
+
+/* Close the connection of a client. It's freed later, since it may
+ * still be in use up the stack: a command may emit audio signals,
+ * that are sent to every subscribed client.
+ */
+static void
+client_drop(Client *client)
+{
+	Control *control = client->control;
+
+	if (client->fd < 0)
+		return;
+
+	control->clients = g_slist_remove(control->clients, client);
+
+	g_source_remove(client->watch);
+	if (client->out_watch)
+		g_source_remove(client->out_watch);
+
+	close(client->fd);
+	client->fd = -1;
+
+	g_idle_add((GSourceFunc) client_free, client);
+}
+
+/* Write as much of the output as possible, return FALSE on error */
+static gboolean
+client_flush(Client *client)
+{
+	while (client->out->len > 0) {
+		ssize_t n;
+
+		n = send(client->fd, client->out->str, client->out->len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+
+		g_string_erase(client->out, 0, n);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+on_client_writable(G_GNUC_UNUSED GIOChannel *source,
+                   G_GNUC_UNUSED GIOCondition condition, Client *client)
+{
+	if (!client_flush(client)) {
+		client_drop(client);
+		return FALSE;
+	}
+
+	if (client->out->len > 0)
+		return TRUE;
+
+	client->out_watch = 0;
+	return FALSE;
+}
+
+/* Queue a line for a client, and send it right away if possible */
+static void
+client_send(Client *client, const gchar *line, gsize len)
+{
+	GIOChannel *gioc;
+
+	if (client->fd < 0)
+		return;
+
+	g_string_append_len(client->out, line, len);
+
+	if (client->out->len > CONTROL_MAX_OUTPUT) {
+		client_drop(client);
+		return;
+	}
+
+	if (client->out_watch)
+		return;
+
+	if (!client_flush(client)) {
+		client_drop(client);
+		return;
+	}
+
+	if (client->out->len > 0) {
+		gioc = g_io_channel_unix_new(client->fd);
+		client->out_watch = g_io_add_watch(gioc, G_IO_OUT,
+		                                   (GIOFunc) on_client_writable, client);
+		g_io_channel_unref(gioc);
+	}
+}
+
+/* Run a command, and put the reply in 'reply' */
+static void
+run_command(Client *client, gchar *line, GString *reply)
+{
+	Audio *audio = client->control->audio;
+	gchar *cmd, *arg, *param;
+	gdouble value, volume;
+	guint duration;
+	gint dir;
+
+	cmd = line;
+	arg = strchr(line, ' ');
+	if (arg) {
+		*arg++ = '\0';
+		g_strstrip(arg);
+	}
+
+	if (!g_strcmp0(cmd, "get")) {
+		g_string_assign(reply, "ok");
+		append_state(reply, audio);
+	} else if (!g_strcmp0(cmd, "set") || !g_strcmp0(cmd, "step")) {
+		if (arg == NULL || *arg == '\0')
+			goto missing;
+
+		if (!parse_number(arg, &value))
+			goto invalid;
+
+		if (!g_strcmp0(cmd, "step")) {
+			volume = audio_get_volume(audio) + value;
+			dir = value > 0 ? +1 : -1;
+		} else {
+			volume = value;
+			dir = 0;
+		}
+
+		audio_set_volume(audio, AUDIO_USER_SOCKET, CLAMP(volume, 0, 100), dir);
+		g_string_assign(reply, "ok");
+	} else if (!g_strcmp0(cmd, "mute")) {
+		if (arg == NULL || *arg == '\0' ||
+		    (!g_strcmp0(arg, "on") && !audio_is_muted(audio)) ||
+		    (!g_strcmp0(arg, "off") && audio_is_muted(audio)))
+			audio_toggle_mute(audio, AUDIO_USER_SOCKET);
+		else if (g_strcmp0(arg, "on") && g_strcmp0(arg, "off"))
+			goto invalid;
+		g_string_assign(reply, "ok");
+	} else if (!g_strcmp0(cmd, "ramp")) {
+		if (arg == NULL || *arg == '\0')
+			goto missing;
+
+		param = strchr(arg, ' ');
+		if (param == NULL)
+			goto missing;
+		*param++ = '\0';
+
+		if (!parse_number(arg, &volume) || !parse_duration(g_strchug(param), &duration))
+			goto invalid;
+
+		audio_ramp_volume(audio, AUDIO_USER_SOCKET, CLAMP(volume, 0, 100), duration);
+		g_string_assign(reply, "ok");
+	} else if (!g_strcmp0(cmd, "fade-mute")) {
+		if (arg == NULL || *arg == '\0')
+			goto missing;
+
+		if (!parse_duration(arg, &duration))
+			goto invalid;
+
+		audio_fade_toggle_mute(audio, AUDIO_USER_SOCKET, duration);
+		g_string_assign(reply, "ok");
+	} else if (!g_strcmp0(cmd, "card")) {
+		GSList *card_list;
+
+		if (arg == NULL || *arg == '\0')
+			goto missing;
+
+		card_list = audio_get_card_list();
+		if (g_slist_find_custom(card_list, arg, (GCompareFunc) g_strcmp0)) {
+			audio_switch_card(audio, arg);
+			prefs_save();
+			g_string_assign(reply, "ok");
+		} else {
+			g_string_assign(reply, "error unknown card");
+		}
+		g_slist_free_full(card_list, g_free);
+	} else if (!g_strcmp0(cmd, "subscribe")) {
+		client->subscribed = TRUE;
+		g_string_assign(reply, "ok");
+	} else {
+		g_string_assign(reply, "error unknown command");
+	}
+
+	return;
+
+missing:
+	g_string_assign(reply, "error missing argument");
+	return;
+
+invalid:
+	g_string_assign(reply, "error invalid argument");
+}
+
+static gboolean
+on_client_readable(G_GNUC_UNUSED GIOChannel *source,
+                   G_GNUC_UNUSED GIOCondition condition, Client *client)
+{
+	gchar buf[1024];
+	GString *reply;
+	gchar *eol;
+	ssize_t n;
+
+	n = read(client->fd, buf, sizeof buf);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return TRUE;
+
+	/* Connection closed, or error */
+	if (n <= 0)
+		goto drop;
+
+	g_string_append_len(client->in, buf, n);
+
+	/* Run every complete line */
+	reply = g_string_new(NULL);
+	while ((eol = memchr(client->in->str, '\n', client->in->len))) {
+		gsize len = eol - client->in->str + 1;
+
+		*eol = '\0';
+		if (len > 1 && eol[-1] == '\r')
+			eol[-1] = '\0';
+
+		run_command(client, client->in->str, reply);
+		g_string_erase(client->in, 0, len);
+		g_string_append_c(reply, '\n');
+		client_send(client, reply->str, reply->len);
+
+		/* Dropped while running the command */
+		if (client->fd < 0) {
+			g_string_free(reply, TRUE);
+			return FALSE;
+		}
+	}
+	g_string_free(reply, TRUE);
+
+	if (client->in->len > CONTROL_MAX_LINE)
+		goto drop;
+
+	return TRUE;
+
+drop:
+	client_drop(client);
+	return FALSE;
+}
+
+static void control_listen(Control *control);
+
+static gboolean
+on_accept_delay_elapsed(Control *control)
+{
+	control->accept_delay = 0;
+	control_listen(control);
+
+	return FALSE;
+}
+
+static gboolean
+on_accept(G_GNUC_UNUSED GIOChannel *source, G_GNUC_UNUSED GIOCondition condition,
+          Control *control)
+{
+	GIOChannel *gioc;
+	Client *client;
+	int fd;
+
+	fd = accept(control->fd, NULL, NULL);
+	if (fd < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+		    errno == ECONNABORTED)
+			return TRUE;
+
+		/* The pending connection stays there, and the socket would be
+		 * readable again right away. Stop watching it for a while,
+		 * rather than spinning until file descriptors are released.
+		 */
+		WARN("Can't accept a control connection: %s", g_strerror(errno));
+		control->watch = 0;
+		control->accept_delay = g_timeout_add(CONTROL_ACCEPT_DELAY,
+		                                      (GSourceFunc) on_accept_delay_elapsed,
+		                                      control);
+		return FALSE;
+	}
+
+	if (!peer_is_trusted(fd)) {
+		WARN("Rejecting a control connection from another user");
+		close(fd);
+		return TRUE;
+	}
+
+	if (!set_nonblocking(fd)) {
+		close(fd);
+		return TRUE;
+	}
+
+	client = g_new0(Client, 1);
+	client->control = control;
+	client->fd = fd;
+	client->in = g_string_new(NULL);
+	client->out = g_string_new(NULL);
+
+	gioc = g_io_channel_unix_new(fd);
+	client->watch = g_io_add_watch(gioc, G_IO_IN | G_IO_HUP | G_IO_ERR,
+	                               (GIOFunc) on_client_readable, client);
+	g_io_channel_unref(gioc);
+
+	control->clients = g_slist_prepend(control->clients, client);
+
+	return TRUE;
+}
+
+/**
+ * Handle signals from the audio subsystem, and send them to the
+ * subscribed clients. The event line is formatted once for everyone.
+ *
+ * @param audio the Audio instance that emitted the signal.
+ * @param event the AudioEvent containing useful information.
+ * @param data user supplied data.
+ */
+static void
+on_audio_changed(Audio *audio, AudioEvent *event, gpointer data)
+{
+	Control *control = (Control *) data;
+	GString *line = NULL;
+	GSList *item, *next;
+
+	switch (event->signal) {
+	case AUDIO_VALUES_CHANGED:
+		/* A burst of changes gets a single event, at the end */
+		if (event->repeat)
+			return;
+		break;
+	case AUDIO_CARD_INITIALIZED:
+		break;
+	default:
+		return;
+	}
+
+	for (item = control->clients; item; item = next) {
+		Client *client = item->data;
+
+		/* Sending may drop the client from the list */
+		next = item->next;
+
+		if (!client->subscribed)
+			continue;
+
+		if (line == NULL) {
+			line = g_string_new("event");
+			append_state(line, audio);
+			g_string_append_c(line, '\n');
+		}
+
+		client_send(client, line->str, line->len);
+	}
+
+	if (line)
+		g_string_free(line, TRUE);
+}
+
+/* Stop serving, and drop every client */
+static void
+control_stop(Control *control)
+{
+	if (control->fd < 0)
+		return;
+
+	DEBUG("Closing control socket '%s'", control->path);
+
+	while (control->clients)
+		client_drop(control->clients->data);
+
+	if (control->watch) {
+		g_source_remove(control->watch);
+		control->watch = 0;
+	}
+	if (control->accept_delay) {
+		g_source_remove(control->accept_delay);
+		control->accept_delay = 0;
+	}
+	close(control->fd);
+	control->fd = -1;
+	unlink(control->path);
+}
+
+/* Check whether another instance serves the socket already */
+static gboolean
+control_in_use(const struct sockaddr_un *addr)
+{
+	gboolean in_use;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return FALSE;
+
+	in_use = connect(fd, (const struct sockaddr *) addr, sizeof *addr) == 0;
+	close(fd);
+
+	return in_use;
+}
+
+/* Watch the socket for new connections */
+static void
+control_listen(Control *control)
+{
+	GIOChannel *gioc;
+
+	gioc = g_io_channel_unix_new(control->fd);
+	control->watch = g_io_add_watch(gioc, G_IO_IN, (GIOFunc) on_accept, control);
+	g_io_channel_unref(gioc);
+}
+
+/* Start serving */
+static void
+control_start(Control *control)
+{
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd, err;
+
+	if (control->fd >= 0)
+		return;
+
+	if (!check_private_dir(control->dir))
+		return;
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (strlen(control->path) >= sizeof addr.sun_path) {
+		WARN("Control socket path '%s' is too long", control->path);
+		return;
+	}
+	strcpy(addr.sun_path, control->path);
+
+	if (control_in_use(&addr)) {
+		WARN("Control socket '%s' is used by another instance", control->path);
+		return;
+	}
+
+	/* Remove a stale socket */
+	unlink(control->path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		WARN("Can't create control socket: %s", g_strerror(errno));
+		return;
+	}
+
+	if (!set_nonblocking(fd)) {
+		WARN("Can't set up control socket: %s", g_strerror(errno));
+		close(fd);
+		return;
+	}
+
+	/* The socket must never be reachable by others, not even
+	 * for a moment, so it's created with the right permissions.
+	 */
+	mask = umask(S_IRWXG | S_IRWXO);
+	err = bind(fd, (struct sockaddr *) &addr, sizeof addr);
+	umask(mask);
+
+	if (err < 0 || listen(fd, SOMAXCONN) < 0) {
+		WARN("Can't listen on control socket '%s': %s", control->path,
+		     g_strerror(errno));
+		close(fd);
+		return;
+	}
+
+	DEBUG("Listening on control socket '%s'", control->path);
+
+	control->fd = fd;
+	control_listen(control);
+}
+
+/**
+ * Reload control preferences, starting or stopping the socket.
+ * This has to be called each time the preferences are modified.
+ *
+ * @param control a Control instance.
+ */
+void
+control_reload(Control *control)
+{
+	if (prefs_get_boolean("EnableControlSocket", TRUE))
+		control_start(control);
+	else
+		control_stop(control);
+}
+
+/**
+ * Close the control socket, and free any resources.
+ *
+ * @param control a Control instance.
+ */
+void
+control_free(Control *control)
+{
+	if (control == NULL)
+		return;
+
+	audio_signals_disconnect(control->audio, on_audio_changed, control);
+	control_stop(control);
+
+	g_free(control->path);
+	g_free(control->dir);
+	g_free(control);
+}
+
+/**
+ * Creates the control socket subsystem, and start serving if it's
+ * enabled in the preferences.
+ *
+ * @param audio the audio system, needed to control the audio.
+ * @return the newly created Control instance.
+ */
+Control *
+control_new(Audio *audio)
+{
+	Control *control;
+	const gchar *runtime_dir;
+
+	DEBUG("Creating control socket");
+
+	control = g_new0(Control, 1);
+	control->fd = -1;
+
+	/* Without a runtime directory, Glib falls back to the cache
+	 * directory, which may be shared. Use a private one instead.
+	 */
+	runtime_dir = g_getenv("XDG_RUNTIME_DIR");
+	if (runtime_dir && *runtime_dir) {
+		control->dir = g_strdup(runtime_dir);
+	} else {
+		control->dir = g_build_filename(g_get_user_cache_dir(), PACKAGE, NULL);
+		WARN("XDG_RUNTIME_DIR is not set, control socket goes to '%s'",
+		     control->dir);
+	}
+	control->path = g_build_filename(control->dir, CONTROL_SOCKET_NAME, NULL);
+
+	/* Connect audio signals handlers */
+	control->audio = audio;
+	audio_signals_connect(audio, on_audio_changed, control);
+
+	/* Load preferences */
+	control_reload(control);
+
+	return control;
+}
@@ -0,0 +1,28 @@
+/* control.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file control.h
+ * Header for control.c.
+ * @brief Header for control.c.
+ */
+
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+
+#include "audio.h"
+
+typedef struct control Control;
+
+Control *control_new(Audio *audio);
+void control_free(Control *control);
+void control_reload(Control *control);
+
+#endif				// _CONTROL_H_
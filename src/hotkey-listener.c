@@ -0,0 +1,498 @@
+/* hotkey-listener.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file hotkey-listener.c
+ * This file holds the hotkey listener. Hotkeys are grabbed on a
+ * dedicated X connection, and a dedicated thread reads the key events
+ * from it. Key presses are forwarded to the main loop at a high
+ * priority, so they don't wait for GTK to be done with the root window
+ * events, or for a dialog to return.
+ * The grabs and the reads are all done by the thread, on its request.
+ * The main thread only queues requests, and wakes the thread up with
+ * a client message sent on the same connection, which is safe since
+ * Xlib is initialized for threads.
+ * Changes of the keyboard mapping are reported too, so that the hotkeys
+ * can be remapped to their new key codes.
+ * @brief Hotkey listener thread.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+
+#include "support-log.h"
+#include "hotkey.h"
+#include "hotkey-listener.h"
+
+/* Requests to the thread */
+
+enum request_type {
+	REQUEST_GRAB,
+	REQUEST_UNGRAB,
+	REQUEST_REMAP,
+	REQUEST_QUIT
+};
+
+struct request {
+	enum request_type type;
+	Hotkey **hotkeys;
+	guint n;
+	gboolean *grabbed; /* Whether each key is grabbed, or changed */
+	guint n_failed; /* Or the number of changed keys */
+};
+
+typedef struct request Request;
+
+/* Key events from the thread */
+
+struct key_event {
+	HotkeyListenerEvent type;
+	guint id;
+	guint code;
+};
+
+typedef struct key_event KeyEvent;
+
+struct hotkey_listener {
+	/* Own X connection, only used by the thread */
+	Display *disp;
+	Window window; /* Receives the wake-up messages */
+	gboolean detectable_repeat;
+	gint xkb_event; /* Type of the XKB events, -1 without XKB */
+	guint down_code; /* Key being held, 0 if none */
+	/* Thread */
+	GThread *thread;
+	GAsyncQueue *requests;
+	GAsyncQueue *replies;
+	/* Key events, delivered in the main loop */
+	GAsyncQueue *events;
+	gint dispatch_pending; /* Atomic */
+	HotkeyListenerCb callback;
+	gpointer data;
+};
+
+/* Deliver the key events in the main loop */
+static gboolean
+on_dispatch(HotkeyListener *listener)
+{
+	KeyEvent *event;
+
+	g_atomic_int_set(&listener->dispatch_pending, FALSE);
+
+	while ((event = g_async_queue_try_pop(listener->events))) {
+		listener->callback(event->type, event->id, event->code,
+		                   listener->data);
+		g_free(event);
+	}
+
+	return FALSE;
+}
+
+/* Queue an event, and make sure the main loop will deliver it */
+static void
+push_event(HotkeyListener *listener, HotkeyListenerEvent type, guint id, guint code)
+{
+	KeyEvent *event;
+
+	event = g_new0(KeyEvent, 1);
+	event->type = type;
+	event->id = id;
+	event->code = code;
+	g_async_queue_push(listener->events, event);
+
+	if (g_atomic_int_compare_and_exchange(&listener->dispatch_pending, FALSE, TRUE))
+		g_idle_add_full(G_PRIORITY_HIGH, (GSourceFunc) on_dispatch,
+		                listener, NULL);
+}
+
+/* Without detectable auto-repeat, a held key sends a release and a press
+ * with the same timestamp, for each repetition. Check whether a release
+ * is one of those.
+ */
+static gboolean
+is_repeat_release(XKeyEvent *xevent)
+{
+	XEvent next;
+
+	if (!XEventsQueued(xevent->display, QueuedAfterReading))
+		return FALSE;
+
+	XPeekEvent(xevent->display, &next);
+
+	return next.type == KeyPress && next.xkey.time == xevent->time &&
+	       next.xkey.keycode == xevent->keycode;
+}
+
+/* Tell presses, repetitions and releases apart */
+static void
+handle_key_event(HotkeyListener *listener, XKeyEvent *xevent)
+{
+	guint id = hotkey_get_id(xevent->keycode, xevent->state);
+
+	if (xevent->type == KeyPress) {
+		if (xevent->keycode == listener->down_code) {
+			push_event(listener, HOTKEY_LISTENER_REPEAT, id, xevent->keycode);
+		} else {
+			listener->down_code = xevent->keycode;
+			push_event(listener, HOTKEY_LISTENER_PRESS, id, xevent->keycode);
+		}
+		return;
+	}
+
+	if (xevent->keycode != listener->down_code)
+		return;
+
+	if (!listener->detectable_repeat && is_repeat_release(xevent))
+		return;
+
+	listener->down_code = 0;
+	push_event(listener, HOTKEY_LISTENER_RELEASE, id, xevent->keycode);
+}
+
+/* Update the keyboard mapping, and report it if the key codes changed.
+ * A single layout switch sends several of these events, the main
+ * thread is expected to coalesce them.
+ */
+static void
+handle_mapping_event(HotkeyListener *listener, XEvent *xevent)
+{
+	XkbEvent *xkbevent = (XkbEvent *) xevent;
+
+	if (xevent->type == MappingNotify) {
+		XRefreshKeyboardMapping(&xevent->xmapping);
+		if (xevent->xmapping.request != MappingKeyboard)
+			return;
+	} else if (xkbevent->any.xkb_type == XkbMapNotify) {
+		XkbRefreshKeyboardMapping(&xkbevent->map);
+	} else if (xkbevent->any.xkb_type != XkbNewKeyboardNotify) {
+		return;
+	}
+
+	DEBUG("Keyboard mapping changed");
+	push_event(listener, HOTKEY_LISTENER_MAPPING, 0, 0);
+}
+
+/* Look up the key codes of the hotkeys again, from their key symbols.
+ * Only the hotkeys whose key code changed are ungrabbed, and they're
+ * grabbed again in a single batch. Hotkeys whose key symbol isn't on
+ * the keyboard anymore get a key code of 0, and aren't grabbed.
+ */
+static guint
+remap_hotkeys(HotkeyListener *listener, Hotkey **hotkeys, guint n, gboolean *changed)
+{
+	GPtrArray *regrab;
+	guint i, n_changed = 0;
+
+	regrab = g_ptr_array_new();
+
+	for (i = 0; i < n; i++) {
+		Hotkey *hotkey = hotkeys[i];
+		guint code;
+
+		code = XKeysymToKeycode(listener->disp, hotkey->sym);
+		changed[i] = code != hotkey->code;
+		if (!changed[i])
+			continue;
+
+		DEBUG("Hotkey '%s' moved from key code %u to %u",
+		      hotkey->str, hotkey->code, code);
+
+		hotkey_ungrab(listener->disp, hotkey);
+		hotkey_set_code(hotkey, code);
+		if (code != 0)
+			g_ptr_array_add(regrab, hotkey);
+		n_changed++;
+	}
+
+	if (n_changed > 0)
+		listener->down_code = 0;
+
+	if (regrab->len > 0)
+		hotkey_grab_batch(listener->disp, (Hotkey **) regrab->pdata,
+		                  regrab->len, NULL);
+	else if (n_changed > 0)
+		XFlush(listener->disp);
+
+	g_ptr_array_free(regrab, TRUE);
+
+	return n_changed;
+}
+
+/* Run the requests of the main thread, return FALSE if asked to quit */
+static gboolean
+handle_requests(HotkeyListener *listener)
+{
+	Request *request;
+	guint i;
+
+	while ((request = g_async_queue_try_pop(listener->requests))) {
+		switch (request->type) {
+		case REQUEST_GRAB:
+			request->n_failed = hotkey_grab_batch(listener->disp,
+			                                      request->hotkeys,
+			                                      request->n,
+			                                      request->grabbed);
+			break;
+		case REQUEST_UNGRAB:
+			for (i = 0; i < request->n; i++)
+				hotkey_ungrab(listener->disp, request->hotkeys[i]);
+			XFlush(listener->disp);
+			listener->down_code = 0;
+			break;
+		case REQUEST_REMAP:
+			request->n_failed = remap_hotkeys(listener, request->hotkeys,
+			                                  request->n, request->grabbed);
+			break;
+		case REQUEST_QUIT:
+			g_async_queue_push(listener->replies, request);
+			return FALSE;
+		}
+
+		g_async_queue_push(listener->replies, request);
+	}
+
+	return TRUE;
+}
+
+static gpointer
+hotkey_listener_thread(HotkeyListener *listener)
+{
+	XEvent xevent;
+
+	DEBUG("Hotkey listener thread started");
+
+	for (;;) {
+		XNextEvent(listener->disp, &xevent);
+
+		switch (xevent.type) {
+		case KeyPress:
+		case KeyRelease:
+			handle_key_event(listener, &xevent.xkey);
+			break;
+		case ClientMessage:
+			if (!handle_requests(listener))
+				goto out;
+			break;
+		case MappingNotify:
+			handle_mapping_event(listener, &xevent);
+			break;
+		default:
+			if (xevent.type == listener->xkb_event)
+				handle_mapping_event(listener, &xevent);
+			break;
+		}
+	}
+
+out:
+	DEBUG("Hotkey listener thread stopped");
+
+	return NULL;
+}
+
+/* Send a request to the thread, and wait until it's done */
+static void
+send_request(HotkeyListener *listener, Request *request)
+{
+	XClientMessageEvent wakeup = { 0 };
+
+	g_async_queue_push(listener->requests, request);
+
+	wakeup.type = ClientMessage;
+	wakeup.window = listener->window;
+	wakeup.format = 32;
+	XSendEvent(listener->disp, listener->window, False, NoEventMask,
+	           (XEvent *) &wakeup);
+	XFlush(listener->disp);
+
+	(void) g_async_queue_pop(listener->replies);
+}
+
+/* Public functions */
+
+/**
+ * Grab several keys at once on the listener's connection.
+ * See hotkey_grab_batch(). Blocks until it's done.
+ *
+ * @param listener a HotkeyListener instance.
+ * @param hotkeys an array of Hotkey instances.
+ * @param n the number of hotkeys.
+ * @param grabbed where to store whether each hotkey was grabbed,
+ * may be NULL.
+ * @return the number of hotkeys that couldn't be grabbed.
+ */
+guint
+hotkey_listener_grab(HotkeyListener *listener, Hotkey **hotkeys, guint n,
+                     gboolean *grabbed)
+{
+	Request request = { REQUEST_GRAB, hotkeys, n, grabbed, 0 };
+
+	send_request(listener, &request);
+
+	return request.n_failed;
+}
+
+/**
+ * Ungrab several keys at once on the listener's connection.
+ * Blocks until it's done, no event for these keys is received after that.
+ * Events already queued are still delivered though.
+ *
+ * @param listener a HotkeyListener instance.
+ * @param hotkeys an array of Hotkey instances.
+ * @param n the number of hotkeys.
+ */
+void
+hotkey_listener_ungrab(HotkeyListener *listener, Hotkey **hotkeys, guint n)
+{
+	Request request = { REQUEST_UNGRAB, hotkeys, n, NULL, 0 };
+
+	send_request(listener, &request);
+}
+
+/**
+ * Look up the key codes of several keys again, after a change of the
+ * keyboard mapping. Keys whose key code changed are ungrabbed from the
+ * previous key, and grabbed on the new one in a single batch. Check
+ * hotkey->grabbed to know whether it succeeded. Blocks until it's done.
+ *
+ * @param listener a HotkeyListener instance.
+ * @param hotkeys an array of Hotkey instances.
+ * @param n the number of hotkeys.
+ * @param changed where to store whether the key code of each hotkey
+ * changed. A key code of 0 means that the key isn't on the keyboard
+ * anymore.
+ * @return the number of hotkeys whose key code changed.
+ */
+guint
+hotkey_listener_remap(HotkeyListener *listener, Hotkey **hotkeys, guint n,
+                      gboolean *changed)
+{
+	Request request = { REQUEST_REMAP, hotkeys, n, changed, 0 };
+
+	send_request(listener, &request);
+
+	return request.n_failed;
+}
+
+/**
+ * Stop the listener thread, close its connection and free any resources.
+ * The keys must have been ungrabbed beforehand.
+ *
+ * @param listener a HotkeyListener instance.
+ */
+void
+hotkey_listener_free(HotkeyListener *listener)
+{
+	Request request = { REQUEST_QUIT, NULL, 0, NULL, 0 };
+
+	if (listener == NULL)
+		return;
+
+	send_request(listener, &request);
+	g_thread_join(listener->thread);
+
+	/* Drop the events that weren't delivered */
+	g_idle_remove_by_data(listener);
+	g_async_queue_unref(listener->events);
+	g_async_queue_unref(listener->requests);
+	g_async_queue_unref(listener->replies);
+
+	hotkey_set_grab_display(NULL);
+	XDestroyWindow(listener->disp, listener->window);
+	XCloseDisplay(listener->disp);
+
+	g_free(listener);
+}
+
+/**
+ * Create a hotkey listener, and start its thread.
+ * Xlib must have been initialized for threads, see XInitThreads().
+ *
+ * @param callback the function to call for each key event.
+ * @param data user supplied data for the callback.
+ * @return the newly created HotkeyListener instance,
+ * or NULL if the X connection couldn't be opened.
+ */
+HotkeyListener *
+hotkey_listener_new(HotkeyListenerCb callback, gpointer data)
+{
+	HotkeyListener *listener;
+	GError *error = NULL;
+	int opcode, error_base;
+	int major = XkbMajorVersion, minor = XkbMinorVersion;
+
+	DEBUG("Creating hotkey listener");
+
+	listener = g_new0(HotkeyListener, 1);
+	listener->callback = callback;
+	listener->data = data;
+
+	listener->disp = XOpenDisplay(NULL);
+	if (listener->disp == NULL) {
+		WARN("Can't open X display for the hotkeys");
+		g_free(listener);
+		return NULL;
+	}
+
+	/* Window that the wake-up messages are sent to */
+	listener->window = XCreateWindow(listener->disp,
+	                                 DefaultRootWindow(listener->disp),
+	                                 0, 0, 1, 1, 0, 0, InputOnly,
+	                                 CopyFromParent, 0, NULL);
+
+	/* Get a single release at the end of an auto-repeat, instead of
+	 * a release/press pair for each repetition.
+	 */
+	XkbSetDetectableAutoRepeat(listener->disp, True,
+	                           &listener->detectable_repeat);
+	if (!listener->detectable_repeat)
+		DEBUG("Detectable auto-repeat not supported");
+
+	/* Layout switches come as XKB events, the core MappingNotify
+	 * events are always received.
+	 */
+	if (XkbQueryExtension(listener->disp, &opcode, &listener->xkb_event,
+	                      &error_base, &major, &minor))
+		XkbSelectEvents(listener->disp, XkbUseCoreKbd,
+		                XkbNewKeyboardNotifyMask | XkbMapNotifyMask,
+		                XkbNewKeyboardNotifyMask | XkbMapNotifyMask);
+	else
+		listener->xkb_event = -1;
+
+	/* Errors on this connection are now for the grabs */
+	hotkey_set_grab_display(listener->disp);
+	XSync(listener->disp, False);
+
+	listener->requests = g_async_queue_new();
+	listener->replies = g_async_queue_new();
+	listener->events = g_async_queue_new_full(g_free);
+
+	listener->thread = g_thread_try_new("hotkey-listener",
+	                                    (GThreadFunc) hotkey_listener_thread,
+	                                    listener, &error);
+	if (listener->thread == NULL) {
+		WARN("Can't start hotkey listener: %s", error->message);
+		g_error_free(error);
+		g_async_queue_unref(listener->events);
+		g_async_queue_unref(listener->requests);
+		g_async_queue_unref(listener->replies);
+		hotkey_set_grab_display(NULL);
+		XDestroyWindow(listener->disp, listener->window);
+		XCloseDisplay(listener->disp);
+		g_free(listener);
+		return NULL;
+	}
+
+	return listener;
+}
@@ -0,0 +1,47 @@
+/* hotkey-listener.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file hotkey-listener.h
+ * Header for hotkey-listener.c.
+ * @brief Header for hotkey-listener.c.
+ */
+
+#ifndef _HOTKEY_LISTENER_H_
+#define _HOTKEY_LISTENER_H_
+
+#include <glib.h>
+
+#include "hotkey.h"
+
+enum hotkey_listener_event {
+	HOTKEY_LISTENER_PRESS,
+	HOTKEY_LISTENER_REPEAT,
+	HOTKEY_LISTENER_RELEASE,
+	HOTKEY_LISTENER_MAPPING	/* The keyboard mapping changed */
+};
+
+typedef enum hotkey_listener_event HotkeyListenerEvent;
+
+typedef void (*HotkeyListenerCb) (HotkeyListenerEvent event, guint id, guint code,
+                                  gpointer data);
+
+typedef struct hotkey_listener HotkeyListener;
+
+HotkeyListener *hotkey_listener_new(HotkeyListenerCb callback, gpointer data);
+void hotkey_listener_free(HotkeyListener *listener);
+
+guint hotkey_listener_grab(HotkeyListener *listener, Hotkey **hotkeys, guint n,
+                           gboolean *grabbed);
+void hotkey_listener_ungrab(HotkeyListener *listener, Hotkey **hotkeys, guint n);
+guint hotkey_listener_remap(HotkeyListener *listener, Hotkey **hotkeys, guint n,
+                            gboolean *changed);
+
+#endif				// _HOTKEY_LISTENER_H_
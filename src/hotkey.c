@@ -37,87 +37,192 @@ static guint keymasks[] = {
 	GDK_MOD2_MASK | GDK_LOCK_MASK	/* Both */
 };
 
-/* Error that may be set if grabbing hotkey fails. */
-static char grab_error;
+/* Connection that the hotkeys are grabbed on */
+static Display *grab_display;
+static XErrorHandler old_error_handler;
+
+/* Serials of the requests that failed while grabbing hotkeys */
+static GArray *grab_errors;
 
 /* Helpers */
 
 /* When an Xlib error occurs when grabbing the hotkey, this function is called.
  * The error handler should not call any functions (directly or indirectly)
  * on the display that will generate protocol requests or that will look for
- * input events.
+ * input events. The serial of the failed request is recorded, so that the
+ * error can be attributed to a hotkey later on.
+ * Errors on other connections are passed to the previous handler.
  * Return value is ignored.
  */
 static int
-grab_error_handler(G_GNUC_UNUSED Display *disp, G_GNUC_UNUSED XErrorEvent *ev)
+grab_error_handler(Display *disp, XErrorEvent *ev)
 {
-	WARN("Error while grabbing hotkey");
-	grab_error = 1;
+	if (disp != grab_display)
+		return old_error_handler ? old_error_handler(disp, ev) : 0;
+
+	if (grab_errors)
+		g_array_append_val(grab_errors, ev->serial);
+	else
+		WARN("Unexpected X error %d on the hotkeys connection",
+		     ev->error_code);
+
 	return 0;
 }
 
+/* Check whether a request failed, given the range of its serials */
+static gboolean
+grab_failed(unsigned long first, unsigned long last)
+{
+	guint i;
+
+	for (i = 0; i < grab_errors->len; i++) {
+		unsigned long serial = g_array_index(grab_errors, unsigned long, i);
+
+		if (serial >= first && serial < last)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 /* Public functions */
 
+/**
+ * Set the X connection that hotkeys are grabbed on, and install the
+ * error handler that watches it. Errors are reported on the thread that
+ * reads the connection, so every grab must be made from that thread.
+ * To be called from the main thread, before any grab.
+ *
+ * @param disp the X connection, NULL when it's closed.
+ */
+void
+hotkey_set_grab_display(Display *disp)
+{
+	if (old_error_handler == NULL)
+		old_error_handler = XSetErrorHandler(grab_error_handler);
+
+	grab_display = disp;
+}
+
 /**
  * Ungrab a key manually. Should be paired with a hotkey_grab() call.
  *
+ * @param disp the X connection the key was grabbed on.
  * @param hotkey a Hotkey instance.
- * @return TRUE on success, FALSE on error.
  */
 void
-hotkey_ungrab(Hotkey *hotkey)
+hotkey_ungrab(Display *disp, Hotkey *hotkey)
 {
-	Display *disp;
 	guint i;
 
+	if (!hotkey->grabbed)
+		return;
+
 	DEBUG("Ungrabbing hotkey '%s'", hotkey->str);
 
-	disp = gdk_x11_get_default_xdisplay();
+	hotkey->grabbed = FALSE;
 
 	/* Ungrab the key */
 	for (i = 0; i < G_N_ELEMENTS(keymasks); i++)
 		XUngrabKey(disp, hotkey->code, hotkey->mods | keymasks[i],
-		           GDK_ROOT_WINDOW());
+		           DefaultRootWindow(disp));
 }
 
 /**
- * Grab a key manually. Should be paired with a hotkey_ungrab() call.
+ * Grab several keys at once. The grab requests of every hotkey are
+ * sent in a row, and X is synchronized only once at the end, so it
+ * costs a single round trip whatever the number of hotkeys. Errors are
+ * attributed to each hotkey by the serials of its requests.
+ * Hotkeys that are already grabbed are left alone.
+ * The connection must be the one given to hotkey_set_grab_display().
  *
- * @param hotkey a Hotkey instance.
- * @return TRUE on success, FALSE on error.
+ * @param disp the X connection to grab the keys on.
+ * @param hotkeys an array of Hotkey instances.
+ * @param n the number of hotkeys.
+ * @param grabbed where to store whether each hotkey was grabbed,
+ * may be NULL.
+ * @return the number of hotkeys that couldn't be grabbed.
  */
-gboolean
-hotkey_grab(Hotkey *hotkey)
+guint
+hotkey_grab_batch(Display *disp, Hotkey **hotkeys, guint n, gboolean *grabbed)
 {
-	Display *disp;
-	XErrorHandler old_hdlr;
-	guint i;
+	unsigned long *serials;
+	guint i, j, n_failed = 0;
 
-	DEBUG("Grabbing hotkey '%s'", hotkey->str);
-
-	disp = gdk_x11_get_default_xdisplay();
+	serials = g_new0(unsigned long, n * 2);
 
 	/* Init error handling */
-	grab_error = 0;
-	old_hdlr = XSetErrorHandler(grab_error_handler);
+	grab_errors = g_array_new(FALSE, FALSE, sizeof(unsigned long));
 
-	/* Grab the key */
-	for (i = 0; i < G_N_ELEMENTS(keymasks); i++)
-		XGrabKey(disp, hotkey->code, hotkey->mods | keymasks[i],
-		         GDK_ROOT_WINDOW(), 1, GrabModeAsync, GrabModeAsync);
+	/* Grab the keys, keeping track of the serials */
+	for (i = 0; i < n; i++) {
+		Hotkey *hotkey = hotkeys[i];
+
+		if (hotkey->grabbed)
+			continue;
 
-	/* Synchronize X */
-	XFlush(disp);
+		DEBUG("Grabbing hotkey '%s'", hotkey->str);
+
+		serials[i * 2] = XNextRequest(disp);
+		for (j = 0; j < G_N_ELEMENTS(keymasks); j++)
+			XGrabKey(disp, hotkey->code, hotkey->mods | keymasks[j],
+			         DefaultRootWindow(disp), 1, GrabModeAsync, GrabModeAsync);
+		serials[i * 2 + 1] = XNextRequest(disp);
+	}
+
+	/* Synchronize X, errors are all reported by now */
 	XSync(disp, False);
 
-	/* Restore error handler */
-	(void) XSetErrorHandler(old_hdlr);
+	/* Check for errors */
+	for (i = 0; i < n; i++) {
+		Hotkey *hotkey = hotkeys[i];
+
+		if (!hotkey->grabbed) {
+			if (grab_failed(serials[i * 2], serials[i * 2 + 1])) {
+				WARN("Error while grabbing hotkey '%s'", hotkey->str);
+				n_failed++;
+			} else {
+				hotkey->grabbed = TRUE;
+			}
+		}
+
+		if (grabbed)
+			grabbed[i] = hotkey->grabbed;
+	}
 
-	/* Check for error */
-	if (grab_error)
-		return FALSE;
+	g_array_free(grab_errors, TRUE);
+	grab_errors = NULL;
+	g_free(serials);
 
-	return TRUE;
+	return n_failed;
+}
+
+/**
+ * Grab a key manually. Should be paired with a hotkey_ungrab() call.
+ *
+ * @param disp the X connection to grab the key on.
+ * @param hotkey a Hotkey instance.
+ * @return TRUE on success, FALSE on error.
+ */
+gboolean
+hotkey_grab(Display *disp, Hotkey *hotkey)
+{
+	return hotkey_grab_batch(disp, &hotkey, 1, NULL) == 0;
+}
+
+/**
+ * Change the key code of a hotkey, after a change of the keyboard
+ * mapping. The hotkey must be ungrabbed, its key symbol is unchanged.
+ *
+ * @param hotkey a Hotkey instance.
+ * @param code the new key code.
+ */
+void
+hotkey_set_code(Hotkey *hotkey, guint code)
+{
+	g_return_if_fail(!hotkey->grabbed);
+
+	hotkey->code = code;
 }
 
 /**
@@ -146,7 +251,29 @@ hotkey_matches(Hotkey *hotkey, guint code, GdkModifierType mods)
 }
 
 /**
- * Ungrab a key and free any resources.
+ * Get an id for a key code and its modifiers, that ignores the
+ * modifiers listed in keymasks. Thus numlock + o has the same id as o.
+ * Key codes fit in 8 bits, which are shifted to bits 16-23 that no GDK
+ * modifier uses, so two keys have the same id only if they match.
+ *
+ * @param code the key code.
+ * @param mods the key modifiers.
+ * @return the id of the key.
+ */
+guint
+hotkey_get_id(guint code, GdkModifierType mods)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(keymasks); i++)
+		mods &= ~keymasks[i];
+
+	return (code & 0xff) << 16 | (mods & GDK_MODIFIER_MASK);
+}
+
+/**
+ * Free a hotkey and any resources. It must have been ungrabbed
+ * beforehand, see hotkey_ungrab().
  *
  * @param hotkey a Hotkey instance.
  */
@@ -156,14 +283,16 @@ hotkey_free(Hotkey *hotkey)
 	if (hotkey == NULL)
 		return;
 
-	hotkey_ungrab(hotkey);
+	if (hotkey->grabbed)
+		WARN("Freeing hotkey '%s' while it's grabbed", hotkey->str);
 
 	g_free(hotkey->str);
 	g_free(hotkey);
 }
 
 /**
- * Creates a new hotkey and grab it.
+ * Creates a new hotkey. It's not grabbed yet, see hotkey_grab()
+ * and hotkey_grab_batch().
  *
  * @param code the key's code.
  * @param mods the key's modifiers.
@@ -183,11 +312,6 @@ hotkey_new(guint code, GdkModifierType mods)
 	hotkey->sym = XkbKeycodeToKeysym(disp, hotkey->code, 0, 0);
 	hotkey->str = gtk_accelerator_name(hotkey->sym, hotkey->mods);
 
-	if (hotkey_grab(hotkey) == FALSE) {
-		hotkey_free(hotkey);
-		hotkey = NULL;
-	}
-
 	return hotkey;
 }
 
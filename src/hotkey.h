@@ -27,6 +27,7 @@ struct hotkey {
 	GdkModifierType mods; /* Key modifier */
 	unsigned long int sym; /* X Key Symbol */
 	gchar *str; /* Gtk Accelerator string */
+	gboolean grabbed;
 };
 
 typedef struct hotkey Hotkey;
@@ -34,9 +35,13 @@ typedef struct hotkey Hotkey;
 Hotkey *hotkey_new(guint code, GdkModifierType mods);
 void hotkey_free(Hotkey *key);
 gboolean hotkey_matches(Hotkey *hotkey, guint code, GdkModifierType mods);
+guint hotkey_get_id(guint code, GdkModifierType mods);
+void hotkey_set_code(Hotkey *hotkey, guint code);
 
-void hotkey_ungrab(Hotkey *hotkey);
-gboolean hotkey_grab(Hotkey *hotkey);
+void hotkey_set_grab_display(Display *disp);
+void hotkey_ungrab(Display *disp, Hotkey *hotkey);
+gboolean hotkey_grab(Display *disp, Hotkey *hotkey);
+guint hotkey_grab_batch(Display *disp, Hotkey **hotkeys, guint n, gboolean *grabbed);
 
 gchar *hotkey_code_to_accel(guint code, GdkModifierType mods);
 void hotkey_accel_to_code(const gchar *accel, gint *code, GdkModifierType *mods);
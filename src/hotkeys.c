@@ -10,9 +10,12 @@
 
 /**
  * @file hotkeys.c
- * This file handles the hotkeys subsystem, including
- * communication with Xlib and intercepting key presses
- * before they can be interpreted by Gtk/Gdk.
+ * This file handles the hotkeys subsystem. Keys are grabbed and
+ * read by the hotkey listener, in its own thread, and the bindings
+ * are run here, in the main loop. The mixer writes themselves are made
+ * by the watchdog threads of the alsa layer, so a device that hangs
+ * can't hold the main loop for longer than the watchdog timeout. The
+ * UI is updated by the audio signals, in the main loop again.
  * @brief Hotkeys subsystem.
  */
 
@@ -20,46 +23,190 @@
 #include "config.h"
 #endif
 
+#include <stdlib.h>
+#include <string.h>
 #include <gdk/gdkx.h>
-#include <X11/XKBlib.h>
 
 #include "audio.h"
 #include "prefs.h"
 #include "support-intl.h"
 #include "support-log.h"
 #include "hotkey.h"
+#include "hotkey-listener.h"
 #include "hotkeys.h"
 
 #include "main.h"
 
-/* Helpers */
+#define REPEAT_INTERVAL 50	/* ms, between two steps of a held key */
+#define REPEAT_TIMEOUT  1000	/* ms, without key press, the key is released */
+#define REPEAT_RAMP     1000	/* ms, to reach the maximum acceleration */
+#define REPEAT_MAX_RATE 4	/* steps get up to 4 times larger */
+#define REMAP_DELAY     100	/* ms, mapping changes come in bursts */
 
-/* Removes the previously attached key_filter() function from
- * the root window.
+/*
+ * Bindings.
+ * In the preferences, a binding is written 'action[:arg]=accelerator',
+ * for example 'set:50=<Super>5'.
  */
-static void
-hotkeys_remove_filter(GdkFilterFunc filter, gpointer data)
+
+static const gchar *action_names[N_HOTKEY_ACTIONS] = {
+	[HOTKEY_ACTION_MUTE] = "mute",
+	[HOTKEY_ACTION_UP] = "up",
+	[HOTKEY_ACTION_DOWN] = "down",
+	[HOTKEY_ACTION_FINE_UP] = "fine-up",
+	[HOTKEY_ACTION_FINE_DOWN] = "fine-down",
+	[HOTKEY_ACTION_SET] = "set",
+	[HOTKEY_ACTION_NEXT_CARD] = "next-card",
+	[HOTKEY_ACTION_TOGGLE_POPUP] = "toggle-popup",
+	[HOTKEY_ACTION_MIC_MUTE] = "mic-mute"
+};
+
+/**
+ * Parse a binding from the preferences.
+ *
+ * @param binding the binding string.
+ * @param action the action of the binding.
+ * @param arg the argument of the action, 0 if none.
+ * @param code the key code of the binding.
+ * @param mods the key modifiers of the binding.
+ * @return TRUE on success, FALSE if the binding is invalid.
+ */
+gboolean
+hotkeys_parse_binding(const gchar *binding, HotkeyAction *action, gint *arg,
+                      gint *code, GdkModifierType *mods)
 {
-	GdkWindow *window;
+	gchar **parts;
+	gchar *sep;
+	guint i;
+
+	parts = g_strsplit(binding, "=", 2);
+	if (g_strv_length(parts) != 2)
+		goto fail;
+
+	*arg = 0;
+	sep = strchr(parts[0], ':');
+	if (sep) {
+		*sep = '\0';
+		*arg = atoi(sep + 1);
+	}
+
+	for (i = 0; i < N_HOTKEY_ACTIONS; i++)
+		if (!g_strcmp0(parts[0], action_names[i]))
+			break;
+	if (i == N_HOTKEY_ACTIONS)
+		goto fail;
+	*action = i;
+
+	hotkey_accel_to_code(parts[1], code, mods);
+	if (*code < 0)
+		goto fail;
 
-	window = gdk_x11_window_foreign_new_for_display
-	         (gdk_display_get_default(), GDK_ROOT_WINDOW());
+	g_strfreev(parts);
+	return TRUE;
 
-	gdk_window_remove_filter(window, filter, data);
+fail:
+	WARN("Invalid hotkey binding '%s'", binding);
+	g_strfreev(parts);
+	return FALSE;
 }
 
-/* Ataches the key_filter() function as a filter
- * to the root window, so it will intercept window events.
+/**
+ * Make a binding string, to be stored in the preferences.
+ *
+ * @param action the action of the binding.
+ * @param arg the argument of the action, ignored if it doesn't take one.
+ * @param code the key code of the binding.
+ * @param mods the key modifiers of the binding.
+ * @return the binding string, must be freed.
  */
-static void
-hotkeys_add_filter(GdkFilterFunc filter, gpointer data)
+gchar *
+hotkeys_make_binding(HotkeyAction action, gint arg, gint code, GdkModifierType mods)
+{
+	gchar *accel, *binding;
+
+	accel = hotkey_code_to_accel(code, mods);
+	if (action == HOTKEY_ACTION_SET)
+		binding = g_strdup_printf("%s:%d=%s", action_names[action], arg, accel);
+	else
+		binding = g_strdup_printf("%s=%s", action_names[action], accel);
+	g_free(accel);
+
+	return binding;
+}
+
+/* Build the bindings from the hotkeys of the previous versions */
+static gchar **
+hotkeys_migrate_bindings(void)
 {
-	GdkWindow *window;
+	static const struct {
+		const gchar *key;
+		const gchar *mods;
+		HotkeyAction action;
+	} old_keys[] = {
+		{ "VolMuteKey", "VolMuteMods", HOTKEY_ACTION_MUTE },
+		{ "VolUpKey", "VolUpMods", HOTKEY_ACTION_UP },
+		{ "VolDownKey", "VolDownMods", HOTKEY_ACTION_DOWN },
+		{ "MicMuteKey", "MicMuteMods", HOTKEY_ACTION_MIC_MUTE }
+	};
+	GPtrArray *bindings;
+	guint i;
+
+	bindings = g_ptr_array_new();
+	for (i = 0; i < G_N_ELEMENTS(old_keys); i++) {
+		gint code, mods;
+
+		code = prefs_get_integer(old_keys[i].key, -1);
+		mods = prefs_get_integer(old_keys[i].mods, 0);
+		if (code != -1)
+			g_ptr_array_add(bindings, hotkeys_make_binding
+			                (old_keys[i].action, 0, code, mods));
+	}
+	g_ptr_array_add(bindings, NULL);
+
+	DEBUG("Migrating %u hotkeys to bindings", bindings->len - 1);
 
-	window = gdk_x11_window_foreign_new_for_display
-	         (gdk_display_get_default(), GDK_ROOT_WINDOW());
+	prefs_set_string_list("HotkeyBindings",
+	                      (const gchar * const *) bindings->pdata);
 
-	gdk_window_add_filter(window, filter, data);
+	return (gchar **) g_ptr_array_free(bindings, FALSE);
+}
+
+/**
+ * Get the hotkey bindings from the preferences. If there are none yet,
+ * they're made from the hotkeys of the previous versions.
+ *
+ * @return a NULL-terminated array of bindings, must be freed
+ * with g_strfreev().
+ */
+gchar **
+hotkeys_get_bindings(void)
+{
+	gchar **bindings;
+
+	bindings = prefs_get_string_list("HotkeyBindings");
+	if (bindings == NULL)
+		bindings = hotkeys_migrate_bindings();
+
+	return bindings;
+}
+
+struct binding {
+	Hotkey *hotkey;
+	guint id; /* Key id, when in the table */
+	HotkeyAction action;
+	gint arg;
+};
+
+typedef struct binding Binding;
+
+static void
+binding_free(Binding *binding)
+{
+	if (binding == NULL)
+		return;
+
+	hotkey_free(binding->hotkey);
+	g_free(binding);
 }
 
 /* Public functions & callbacks */
@@ -67,45 +214,421 @@ hotkeys_add_filter(GdkFilterFunc filter, gpointer data)
 struct hotkeys {
 	/* Audio system */
 	Audio  *audio;
-	/* Hotkeys */
-	Hotkey *mute_hotkey;
-	Hotkey *up_hotkey;
-	Hotkey *down_hotkey;
+	/* Key grabs and events */
+	HotkeyListener *listener;
+	/* Bindings, by key id */
+	GHashTable *bindings;
+	/* Bindings whose key isn't on the keyboard anymore */
+	GSList *unmapped;
+	guint remap_source;
+	/* Fade out before muting, in ms */
+	guint mute_fade_time;
+	gdouble scroll_step;
+	gdouble fine_scroll_step;
+	/* Held key. X auto-repeat events are swallowed, and the volume
+	 * steps are made by a timer instead, getting larger over time.
+	 */
+	Binding *held;
+	guint held_code;
+	gint64 held_last_press;
+	gint64 repeat_since; /* 0 until the first auto-repeat event */
+	guint repeat_source;
 };
 
+/* Switch to the card after the current one, in the list of cards */
+static void
+hotkeys_next_card(Hotkeys *hotkeys)
+{
+	Audio *audio = hotkeys->audio;
+	GSList *card_list, *item;
+
+	card_list = audio_get_card_list();
+	if (card_list == NULL)
+		return;
+
+	item = g_slist_find_custom(card_list, audio_get_card_id(audio),
+	                           (GCompareFunc) g_strcmp0);
+	item = item && item->next ? item->next : card_list;
+
+	audio_switch_card(audio, item->data);
+	prefs_save();
+
+	g_slist_free_full(card_list, g_free);
+}
+
+/* Run the action of a binding */
+static void
+hotkeys_run_binding(Hotkeys *hotkeys, Binding *binding)
+{
+	Audio *audio = hotkeys->audio;
+	gdouble volume;
+
+	switch (binding->action) {
+	case HOTKEY_ACTION_MUTE:
+		audio_fade_toggle_mute(audio, AUDIO_USER_HOTKEYS,
+		                       hotkeys->mute_fade_time);
+		break;
+	case HOTKEY_ACTION_UP:
+		audio_raise_volume(audio, AUDIO_USER_HOTKEYS);
+		break;
+	case HOTKEY_ACTION_DOWN:
+		audio_lower_volume(audio, AUDIO_USER_HOTKEYS);
+		break;
+	case HOTKEY_ACTION_FINE_UP:
+		volume = audio_get_volume(audio) + hotkeys->fine_scroll_step;
+		audio_set_volume(audio, AUDIO_USER_HOTKEYS, MIN(volume, 100), +1);
+		break;
+	case HOTKEY_ACTION_FINE_DOWN:
+		volume = audio_get_volume(audio) - hotkeys->fine_scroll_step;
+		audio_set_volume(audio, AUDIO_USER_HOTKEYS, MAX(volume, 0), -1);
+		break;
+	case HOTKEY_ACTION_SET:
+		audio_set_volume(audio, AUDIO_USER_HOTKEYS,
+		                 CLAMP(binding->arg, 0, 100), 0);
+		break;
+	case HOTKEY_ACTION_NEXT_CARD:
+		hotkeys_next_card(hotkeys);
+		break;
+	case HOTKEY_ACTION_TOGGLE_POPUP:
+		do_toggle_popup_window();
+		break;
+	case HOTKEY_ACTION_MIC_MUTE:
+		audio_toggle_capture_mute(audio, AUDIO_USER_HOTKEYS);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Whether an action makes sense when repeated */
+static gboolean
+action_is_repeatable(HotkeyAction action)
+{
+	switch (action) {
+	case HOTKEY_ACTION_UP:
+	case HOTKEY_ACTION_DOWN:
+	case HOTKEY_ACTION_FINE_UP:
+	case HOTKEY_ACTION_FINE_DOWN:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* End the burst of a held key, and send a single event for it */
+static void
+hotkeys_release(Hotkeys *hotkeys)
+{
+	if (hotkeys->held == NULL)
+		return;
+
+	if (hotkeys->repeat_source) {
+		g_source_remove(hotkeys->repeat_source);
+		hotkeys->repeat_source = 0;
+	}
+
+	hotkeys->held = NULL;
+	audio_set_repeat(hotkeys->audio, FALSE);
+	audio_signal_values(hotkeys->audio, AUDIO_USER_HOTKEYS);
+}
+
+/* Make one accelerated volume step for the held key */
+static gboolean
+on_repeat_timeout(Hotkeys *hotkeys)
+{
+	Audio *audio = hotkeys->audio;
+	gint64 now = g_get_monotonic_time();
+	gdouble rate, step, volume;
+	gint dir;
+
+	/* Safety net, in case the release was missed (broken grab, ...) */
+	if (now - hotkeys->held_last_press > REPEAT_TIMEOUT * 1000) {
+		hotkeys->repeat_source = 0;
+		hotkeys_release(hotkeys);
+		return FALSE;
+	}
+
+	/* Wait for the key to actually repeat */
+	if (hotkeys->repeat_since == 0)
+		return TRUE;
+
+	rate = 1 + (REPEAT_MAX_RATE - 1) *
+	       MIN((now - hotkeys->repeat_since) / 1000.0 / REPEAT_RAMP, 1);
+
+	switch (hotkeys->held->action) {
+	case HOTKEY_ACTION_UP:
+		step = hotkeys->scroll_step;
+		dir = +1;
+		break;
+	case HOTKEY_ACTION_DOWN:
+		step = hotkeys->scroll_step;
+		dir = -1;
+		break;
+	case HOTKEY_ACTION_FINE_UP:
+		step = hotkeys->fine_scroll_step;
+		dir = +1;
+		break;
+	default:
+		step = hotkeys->fine_scroll_step;
+		dir = -1;
+		break;
+	}
+
+	volume = audio_get_volume(audio) + dir * step * rate;
+	audio_set_volume(audio, AUDIO_USER_HOTKEYS, CLAMP(volume, 0, 100), dir);
+
+	return TRUE;
+}
+
+/* A repeatable hotkey was pressed, start a burst */
+static void
+hotkeys_hold(Hotkeys *hotkeys, Binding *binding, guint code)
+{
+	hotkeys->held = binding;
+	hotkeys->held_code = code;
+	hotkeys->held_last_press = g_get_monotonic_time();
+	hotkeys->repeat_since = 0;
+
+	audio_set_repeat(hotkeys->audio, TRUE);
+	hotkeys_run_binding(hotkeys, binding);
+
+	hotkeys->repeat_source = g_timeout_add(REPEAT_INTERVAL,
+	                                       (GSourceFunc) on_repeat_timeout,
+	                                       hotkeys);
+}
+
+/* Put a binding whose key code changed back in the table */
+static void
+hotkeys_rebind(Hotkeys *hotkeys, Binding *binding)
+{
+	Hotkey *hotkey = binding->hotkey;
+	Binding *other;
+
+	if (hotkey->code == 0) {
+		WARN("Hotkey '%s' isn't on the keyboard anymore", hotkey->str);
+		hotkeys->unmapped = g_slist_prepend(hotkeys->unmapped, binding);
+		return;
+	}
+
+	/* The error was reported when grabbing */
+	if (!hotkey->grabbed) {
+		binding_free(binding);
+		return;
+	}
+
+	binding->id = hotkey_get_id(hotkey->code, hotkey->mods);
+	other = g_hash_table_lookup(hotkeys->bindings, GUINT_TO_POINTER(binding->id));
+	if (other) {
+		Hotkey *both[2] = { hotkey, other->hotkey };
+
+		/* Both grabbed the same key, give it back to the other one */
+		WARN("Hotkey '%s' ignored, key already bound", hotkey->str);
+		hotkey_listener_ungrab(hotkeys->listener, both, 2);
+		hotkey_listener_grab(hotkeys->listener, &other->hotkey, 1, NULL);
+		binding_free(binding);
+		return;
+	}
+
+	g_hash_table_insert(hotkeys->bindings, GUINT_TO_POINTER(binding->id), binding);
+}
+
+/* Move the bindings to their new key codes, after a change of the
+ * keyboard mapping. Only the bindings whose key code changed are
+ * ungrabbed and grabbed again, in a single batch.
+ */
+static gboolean
+on_remap_timeout(Hotkeys *hotkeys)
+{
+	GHashTableIter iter;
+	GPtrArray *bindings, *keys;
+	Binding *binding;
+	GSList *item;
+	gboolean *changed;
+	guint i;
+
+	hotkeys->remap_source = 0;
+
+	if (hotkeys->bindings == NULL || hotkeys->listener == NULL)
+		return FALSE;
+
+	bindings = g_ptr_array_new();
+	keys = g_ptr_array_new();
+	g_hash_table_iter_init(&iter, hotkeys->bindings);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &binding)) {
+		g_ptr_array_add(bindings, binding);
+		g_ptr_array_add(keys, binding->hotkey);
+	}
+	for (item = hotkeys->unmapped; item; item = item->next) {
+		binding = item->data;
+		g_ptr_array_add(bindings, binding);
+		g_ptr_array_add(keys, binding->hotkey);
+	}
+
+	changed = g_new0(gboolean, keys->len);
+	if (hotkey_listener_remap(hotkeys->listener, (Hotkey **) keys->pdata,
+	                          keys->len, changed) > 0) {
+		hotkeys_release(hotkeys);
+
+		/* Take the changed bindings out, then put them back by their new ids */
+		for (i = 0; i < bindings->len; i++) {
+			binding = bindings->pdata[i];
+			if (!changed[i])
+				continue;
+
+			if (!g_hash_table_steal(hotkeys->bindings,
+			                        GUINT_TO_POINTER(binding->id)))
+				hotkeys->unmapped = g_slist_remove(hotkeys->unmapped,
+				                                   binding);
+		}
+
+		for (i = 0; i < bindings->len; i++)
+			if (changed[i])
+				hotkeys_rebind(hotkeys, bindings->pdata[i]);
+	}
+
+	g_free(changed);
+	g_ptr_array_free(keys, TRUE);
+	g_ptr_array_free(bindings, TRUE);
+
+	return FALSE;
+}
+
 /**
- * This function is called before Gtk/Gdk can respond
- * to any(!) window event and handles pressed hotkeys.
+ * Handles the key events of the hotkey listener, in the main loop.
+ * The binding is looked up by key id, whatever the number of bindings.
+ * Auto-repeat events of a held volume key are swallowed, the volume is
+ * stepped by a timer until the key is released.
+ * Changes of the keyboard mapping are coalesced, and the bindings are
+ * remapped once they settle.
  *
- * @param gdk_xevent the native event to filter
- * @param event the GDK event to which the X event will be translated
- * @param data user data set when the filter was installed
- * @return a GdkFilterReturn value, should be GDK_FILTER_CONTINUE only
+ * @param event the kind of key event.
+ * @param id the key id, see hotkey_get_id().
+ * @param code the key code.
+ * @param data user data set when the listener was created.
  */
-static GdkFilterReturn
-key_filter(GdkXEvent *gdk_xevent, G_GNUC_UNUSED GdkEvent *event, gpointer data)
+static void
+on_hotkey_event(HotkeyListenerEvent event, guint id, guint code, gpointer data)
 {
-	gint type;
-	guint key, state;
-	XKeyEvent *xevent = (XKeyEvent *) gdk_xevent;
 	Hotkeys *hotkeys = (Hotkeys *) data;
-	Audio *audio = hotkeys->audio;
+	Binding *binding;
+
+	if (event == HOTKEY_LISTENER_MAPPING) {
+		if (hotkeys->remap_source == 0)
+			hotkeys->remap_source = g_timeout_add
+			                        (REMAP_DELAY, (GSourceFunc) on_remap_timeout,
+			                         hotkeys);
+		return;
+	}
+
+	if (event == HOTKEY_LISTENER_RELEASE) {
+		if (hotkeys->held && code == hotkeys->held_code)
+			hotkeys_release(hotkeys);
+		return;
+	}
+
+	if (hotkeys->bindings == NULL)
+		return;
+
+	binding = g_hash_table_lookup(hotkeys->bindings, GUINT_TO_POINTER(id));
+
+	// just ignore unknown hotkeys
+	if (binding == NULL)
+		return;
 
-	type = xevent->type;
-	key = xevent->keycode;
-	state = xevent->state;
-
-	if (type == KeyPress) {
-		if (hotkey_matches(hotkeys->mute_hotkey, key, state))
-			audio_toggle_mute(audio, AUDIO_USER_HOTKEYS);
-		else if (hotkey_matches(hotkeys->up_hotkey, key, state))
-			audio_raise_volume(audio, AUDIO_USER_HOTKEYS);
-		else if (hotkey_matches(hotkeys->down_hotkey, key, state))
-			audio_lower_volume(audio, AUDIO_USER_HOTKEYS);
-		// just ignore unknown hotkeys
+	/* Auto-repeat of the held key, the timer takes care of it */
+	if (binding == hotkeys->held) {
+		hotkeys->held_last_press = g_get_monotonic_time();
+		if (hotkeys->repeat_since == 0)
+			hotkeys->repeat_since = hotkeys->held_last_press;
+		return;
 	}
 
-	return GDK_FILTER_CONTINUE;
+	/* Other actions don't repeat */
+	if (event == HOTKEY_LISTENER_REPEAT && !action_is_repeatable(binding->action))
+		return;
+
+	/* Another key ends the burst */
+	hotkeys_release(hotkeys);
+
+	if (action_is_repeatable(binding->action))
+		hotkeys_hold(hotkeys, binding, code);
+	else
+		hotkeys_run_binding(hotkeys, binding);
+}
+
+/* Get the hotkeys of every binding, in the order of the table */
+static GPtrArray *
+hotkeys_get_keys(Hotkeys *hotkeys)
+{
+	GHashTableIter iter;
+	GPtrArray *keys;
+	Binding *binding;
+
+	keys = g_ptr_array_new();
+	g_hash_table_iter_init(&iter, hotkeys->bindings);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &binding))
+		g_ptr_array_add(keys, binding->hotkey);
+
+	return keys;
+}
+
+/* Ungrab the hotkeys of every binding */
+static void
+hotkeys_ungrab_bindings(Hotkeys *hotkeys)
+{
+	GPtrArray *keys;
+
+	if (hotkeys->bindings == NULL || hotkeys->listener == NULL)
+		return;
+
+	keys = hotkeys_get_keys(hotkeys);
+	hotkey_listener_ungrab(hotkeys->listener, (Hotkey **) keys->pdata, keys->len);
+	g_ptr_array_free(keys, TRUE);
+}
+
+/* Grab the hotkeys of every binding, in a single batch.
+ * Bindings that can't be grabbed are dropped, and their
+ * accelerators are appended to 'errors' if it's not NULL.
+ */
+static void
+hotkeys_grab_bindings(Hotkeys *hotkeys, GString *errors)
+{
+	GHashTableIter iter;
+	GPtrArray *keys;
+	Binding *binding;
+	gboolean *grabbed;
+	guint i, n_failed;
+
+	if (hotkeys->bindings == NULL)
+		return;
+
+	keys = hotkeys_get_keys(hotkeys);
+	grabbed = g_new0(gboolean, keys->len);
+
+	/* Without listener, nothing can be grabbed */
+	if (hotkeys->listener)
+		n_failed = hotkey_listener_grab(hotkeys->listener,
+		                                (Hotkey **) keys->pdata,
+		                                keys->len, grabbed);
+	else
+		n_failed = keys->len;
+
+	if (n_failed > 0) {
+		/* The table didn't change, so it's iterated in the same order */
+		i = 0;
+		g_hash_table_iter_init(&iter, hotkeys->bindings);
+		while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &binding)) {
+			if (grabbed[i++])
+				continue;
+
+			if (errors)
+				g_string_append_printf(errors, "%s\n", binding->hotkey->str);
+			g_hash_table_iter_remove(&iter);
+		}
+	}
+
+	g_free(grabbed);
+	g_ptr_array_free(keys, TRUE);
 }
 
 /**
@@ -118,66 +641,69 @@ void
 hotkeys_reload(Hotkeys *hotkeys)
 {
 	gboolean enabled;
-	gint key, mods;
-	gboolean mute_err, up_err, down_err;
+	gchar **bindings, **item;
+	GString *errors;
 
 	/* Free any hotkey that may be currently assigned */
-	hotkey_free(hotkeys->mute_hotkey);
-	hotkeys->mute_hotkey = NULL;
-
-	hotkey_free(hotkeys->up_hotkey);
-	hotkeys->up_hotkey = NULL;
+	hotkeys_release(hotkeys);
+	hotkeys_ungrab_bindings(hotkeys);
+	if (hotkeys->bindings) {
+		g_hash_table_destroy(hotkeys->bindings);
+		hotkeys->bindings = NULL;
+	}
+	g_slist_free_full(hotkeys->unmapped, (GDestroyNotify) binding_free);
+	hotkeys->unmapped = NULL;
 
-	hotkey_free(hotkeys->down_hotkey);
-	hotkeys->down_hotkey = NULL;
+	/* Get the fade time, 0 mutes right away */
+	hotkeys->mute_fade_time = MAX(prefs_get_integer("MuteFadeTime", 0), 0);
+	hotkeys->scroll_step = prefs_get_double("ScrollStep", 5);
+	hotkeys->fine_scroll_step = prefs_get_double("FineScrollStep", 1);
 
 	/* Return if hotkeys are disabled */
 	enabled = prefs_get_boolean("EnableHotKeys", FALSE);
 	if (enabled == FALSE)
 		return;
 
-	/* Setup mute hotkey */
-	mute_err = FALSE;
-	key = prefs_get_integer("VolMuteKey", -1);
-	mods = prefs_get_integer("VolMuteMods", 0);
-	if (key != -1) {
-		hotkeys->mute_hotkey = hotkey_new(key, mods);
-		if (hotkeys->mute_hotkey == NULL)
-			mute_err = TRUE;
+	hotkeys->bindings = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+	                                          (GDestroyNotify) binding_free);
+
+	/* Setup each binding */
+	bindings = hotkeys_get_bindings();
+	for (item = bindings; *item; item++) {
+		Binding *binding;
+		HotkeyAction action;
+		GdkModifierType mods;
+		gint code, arg;
+		guint id;
+
+		if (!hotkeys_parse_binding(*item, &action, &arg, &code, &mods))
+			continue;
+
+		id = hotkey_get_id(code, mods);
+		if (g_hash_table_lookup(hotkeys->bindings, GUINT_TO_POINTER(id))) {
+			WARN("Hotkey binding '%s' ignored, key already bound", *item);
+			continue;
+		}
+
+		binding = g_new0(Binding, 1);
+		binding->action = action;
+		binding->arg = arg;
+		binding->hotkey = hotkey_new(code, mods);
+		binding->id = id;
+		g_hash_table_insert(hotkeys->bindings, GUINT_TO_POINTER(id), binding);
 	}
+	g_strfreev(bindings);
 
-	/* Setup volume up hotkey */
-	up_err = FALSE;
-	key = prefs_get_integer("VolUpKey", -1);
-	mods = prefs_get_integer("VolUpMods", 0);
-	if (key != -1) {
-		hotkeys->up_hotkey = hotkey_new(key, mods);
-		if (hotkeys->up_hotkey == NULL)
-			up_err = TRUE;
-	}
-
-	/* Setup volume down hotkey */
-	down_err = FALSE;
-	key = prefs_get_integer("VolDownKey", -1);
-	mods = prefs_get_integer("VolDownMods", 0);
-	if (key != -1) {
-		hotkeys->down_hotkey = hotkey_new(key, mods);
-		if (hotkeys->down_hotkey == NULL)
-			down_err = TRUE;
-	}
+	/* Grab them all at once */
+	errors = g_string_new(NULL);
+	hotkeys_grab_bindings(hotkeys, errors);
 
 	/* Display error message if needed */
-	if (mute_err || up_err || down_err) {
-		run_error_dialog("%s:\n%s%s%s%s%s%s",
-		                 _("Could not grab the following HotKeys"),
-		                 mute_err ? _("Mute/Unmute") : "",
-		                 mute_err ? "\n" : "",
-		                 up_err ? _("Volume Up") : "",
-		                 up_err ? "\n" : "",
-		                 down_err ? _("Volume Down") : "",
-		                 down_err ? "\n" : ""
-		                );
-	}
+	if (errors->len > 0)
+		run_error_dialog("%s:\n%s", _("Could not grab the following HotKeys"),
+		                 errors->str);
+
+	g_string_free(errors, TRUE);
 }
 
 /**
@@ -188,14 +714,13 @@ hotkeys_reload(Hotkeys *hotkeys)
 void
 hotkeys_unbind(Hotkeys *hotkeys)
 {
-	hotkeys_remove_filter(key_filter, hotkeys);
-
-	if (hotkeys->mute_hotkey)
-		hotkey_ungrab(hotkeys->mute_hotkey);
-	if (hotkeys->up_hotkey)
-		hotkey_ungrab(hotkeys->up_hotkey);
-	if (hotkeys->down_hotkey)
-		hotkey_ungrab(hotkeys->down_hotkey);
+	if (hotkeys->remap_source) {
+		g_source_remove(hotkeys->remap_source);
+		hotkeys->remap_source = 0;
+	}
+
+	hotkeys_release(hotkeys);
+	hotkeys_ungrab_bindings(hotkeys);
 }
 
 /**
@@ -206,14 +731,13 @@ hotkeys_unbind(Hotkeys *hotkeys)
 void
 hotkeys_bind(Hotkeys *hotkeys)
 {
-	if (hotkeys->mute_hotkey)
-		hotkey_grab(hotkeys->mute_hotkey);
-	if (hotkeys->up_hotkey)
-		hotkey_grab(hotkeys->up_hotkey);
-	if (hotkeys->down_hotkey)
-		hotkey_grab(hotkeys->down_hotkey);
-
-	hotkeys_add_filter(key_filter, hotkeys);
+	hotkeys_grab_bindings(hotkeys, NULL);
+
+	/* The mapping may have changed in the meantime */
+	if (hotkeys->remap_source == 0)
+		hotkeys->remap_source = g_timeout_add(REMAP_DELAY,
+		                                      (GSourceFunc) on_remap_timeout,
+		                                      hotkeys);
 }
 
 /**
@@ -228,12 +752,16 @@ hotkeys_free(Hotkeys *hotkeys)
 		return;
 
 	/* Disable hotkeys */
-	hotkeys_remove_filter(key_filter, hotkeys);
+	if (hotkeys->remap_source)
+		g_source_remove(hotkeys->remap_source);
+	hotkeys_release(hotkeys);
+	hotkeys_ungrab_bindings(hotkeys);
+	hotkey_listener_free(hotkeys->listener);
 
 	/* Free anything */
-	hotkey_free(hotkeys->mute_hotkey);
-	hotkey_free(hotkeys->up_hotkey);
-	hotkey_free(hotkeys->down_hotkey);
+	if (hotkeys->bindings)
+		g_hash_table_destroy(hotkeys->bindings);
+	g_slist_free_full(hotkeys->unmapped, (GDestroyNotify) binding_free);
 	g_free(hotkeys);
 }
 
@@ -255,11 +783,11 @@ hotkeys_new(Audio *audio)
 	/* Save audio pointer */
 	hotkeys->audio = audio;
 
-	/* Load preferences */
-	hotkeys_reload(hotkeys);
+	/* Start listening for keys, in a dedicated thread */
+	hotkeys->listener = hotkey_listener_new(on_hotkey_event, hotkeys);
 
-	/* Bind hotkeys */
-	hotkeys_add_filter(key_filter, hotkeys);
+	/* Load preferences and bind hotkeys */
+	hotkeys_reload(hotkeys);
 
 	return hotkeys;
 }
@@ -17,8 +17,33 @@
 #ifndef _HOTKEYS_H_
 #define _HOTKEYS_H_
 
+#include <gdk/gdk.h>
+
 #include "audio.h"
 
+/* Actions that can be bound to a hotkey */
+
+enum hotkey_action {
+	HOTKEY_ACTION_MUTE,
+	HOTKEY_ACTION_UP,
+	HOTKEY_ACTION_DOWN,
+	HOTKEY_ACTION_FINE_UP,
+	HOTKEY_ACTION_FINE_DOWN,
+	HOTKEY_ACTION_SET, /* Takes the volume in percent as argument */
+	HOTKEY_ACTION_NEXT_CARD,
+	HOTKEY_ACTION_TOGGLE_POPUP,
+	HOTKEY_ACTION_MIC_MUTE,
+	N_HOTKEY_ACTIONS
+};
+
+typedef enum hotkey_action HotkeyAction;
+
+gchar **hotkeys_get_bindings(void);
+gboolean hotkeys_parse_binding(const gchar *binding, HotkeyAction *action,
+                               gint *arg, gint *code, GdkModifierType *mods);
+gchar *hotkeys_make_binding(HotkeyAction action, gint arg,
+                            gint code, GdkModifierType mods);
+
 typedef struct hotkeys Hotkeys;
 
 Hotkeys *hotkeys_new(Audio *audio);
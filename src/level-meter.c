@@ -0,0 +1,521 @@
+/* level-meter.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file level-meter.c
+ * This file holds the output level meter. Audio is captured from
+ * an ALSA PCM (usually a loopback or a monitor device), or read from
+ * a WAV file, in a dedicated thread. The peak and RMS levels of each
+ * period are handed to the UI through a lock-free triple buffer.
+ * @brief Output level meter.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include <alsa/asoundlib.h>
+
+#include "level-meter.h"
+
+#include "support-log.h"
+
+#define LEVEL_METER_RATE     48000
+#define LEVEL_METER_CHANNELS 2
+#define LEVEL_METER_PERIOD   (LEVEL_METER_RATE / 50)	/* frames, 20 ms */
+#define LEVEL_METER_LATENCY  100000			/* us */
+#define LEVEL_METER_TIMEOUT  50				/* ms, longest wait */
+
+/*
+ * Level computation.
+ */
+
+struct level {
+	gdouble peak; /* Between 0 and 1 */
+	gdouble rms; /* Between 0 and 1 */
+};
+
+typedef struct level Level;
+
+/* Compute the peak and the sum of squares of a block of samples.
+ * This is the hot path, it's kept branch-free so that the compiler
+ * can vectorize it.
+ */
+static void
+level_compute(const gint16 *samples, gsize n, gint *peak, gint64 *sum)
+{
+	gint32 p = 0;
+	gint64 s = 0;
+	gsize i;
+
+	for (i = 0; i < n; i++) {
+		gint32 v = samples[i];
+		gint32 a = v < 0 ? -v : v;
+
+		p = a > p ? a : p;
+		s += v * v;
+	}
+
+	*peak = p;
+	*sum = s;
+}
+
+/* Get the levels of a block of samples */
+static void
+level_from_samples(Level *level, const gint16 *samples, gsize n)
+{
+	gint peak;
+	gint64 sum;
+
+	if (n == 0) {
+		level->peak = level->rms = 0;
+		return;
+	}
+
+	level_compute(samples, n, &peak, &sum);
+
+	level->peak = MIN(peak / 32768.0, 1);
+	level->rms = MIN(sqrt((gdouble) sum / n) / 32768.0, 1);
+}
+
+/*
+ * Level sources.
+ * A source is either an ALSA PCM, opened for capture, or a WAV file.
+ * ALSA plugins such as 'file' or 'null' are just PCMs, but they don't
+ * run at the pace of a sound card, they deliver samples as fast as
+ * they're read. So every source is paced: it never runs ahead of real
+ * time. WAV files are looped, and paced the same way.
+ * PCMs are non-blocking, the capture thread never waits more than
+ * LEVEL_METER_TIMEOUT, so that stopping it never takes long.
+ */
+
+struct level_source {
+	/* ALSA capture */
+	snd_pcm_t *pcm;
+	/* WAV file */
+	FILE *wav;
+	long wav_data; /* Offset of the samples in the file */
+	long wav_size; /* Size of the samples */
+	long wav_pos; /* Current position in the samples */
+	/* Format */
+	guint channels;
+	guint rate;
+	/* Pacing */
+	gint64 clock; /* When the next samples are due, monotonic */
+};
+
+typedef struct level_source LevelSource;
+
+static guint16
+read_le16(const guint8 *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static guint32
+read_le32(const guint8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+/* Don't run ahead of real time. A sound card never does, since its
+ * samples are captured before they're read, but some plugins do.
+ * Wait until the samples just read are due, then account for them.
+ */
+static void
+source_pace(LevelSource *src, gsize frames)
+{
+	gint64 now = g_get_monotonic_time();
+
+	/* First read, or we're late, which is not worth catching up */
+	if (src->clock == 0 || now - src->clock > LEVEL_METER_LATENCY)
+		src->clock = now;
+
+	if (src->clock > now)
+		g_usleep(src->clock - now);
+
+	src->clock += (gint64) frames * G_USEC_PER_SEC / src->rate;
+}
+
+/* Open a WAV file, only 16 bits PCM is supported */
+static gboolean
+source_open_wav(LevelSource *src, const gchar *filename)
+{
+	guint8 header[16];
+	guint format = 0, bits = 0;
+
+	src->wav = fopen(filename, "rb");
+	if (src->wav == NULL) {
+		WARN("Can't open '%s': %s", filename, g_strerror(errno));
+		return FALSE;
+	}
+
+	if (fread(header, 1, 12, src->wav) != 12 ||
+	    memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+		goto invalid;
+
+	/* Look for the format and the samples */
+	while (fread(header, 1, 8, src->wav) == 8) {
+		guint32 size = read_le32(header + 4);
+
+		if (!memcmp(header, "fmt ", 4)) {
+			if (size < 16 || fread(header, 1, 16, src->wav) != 16)
+				goto invalid;
+			format = read_le16(header);
+			src->channels = read_le16(header + 2);
+			src->rate = read_le32(header + 4);
+			bits = read_le16(header + 14);
+			size -= 16;
+		} else if (!memcmp(header, "data", 4)) {
+			src->wav_data = ftell(src->wav);
+			src->wav_size = size;
+			break;
+		}
+
+		if (fseek(src->wav, size + (size & 1), SEEK_CUR) < 0)
+			goto invalid;
+	}
+
+	if (format != 1 || bits != 16 || src->channels == 0 || src->rate == 0 ||
+	    src->wav_size < (long) (src->channels * sizeof(gint16)))
+		goto invalid;
+
+	DEBUG("Level meter reading '%s' (%u channels, %u Hz)",
+	      filename, src->channels, src->rate);
+
+	return TRUE;
+
+invalid:
+	WARN("'%s' is not a 16 bits PCM WAV file", filename);
+	return FALSE;
+}
+
+/* Open an ALSA PCM for capture */
+static gboolean
+source_open_pcm(LevelSource *src, const gchar *device)
+{
+	int err;
+
+	err = snd_pcm_open(&src->pcm, device, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
+	if (err < 0) {
+		WARN("Can't open PCM '%s' for capture: %s", device, snd_strerror(err));
+		src->pcm = NULL;
+		return FALSE;
+	}
+
+	src->channels = LEVEL_METER_CHANNELS;
+	src->rate = LEVEL_METER_RATE;
+
+	err = snd_pcm_set_params(src->pcm, SND_PCM_FORMAT_S16,
+	                         SND_PCM_ACCESS_RW_INTERLEAVED,
+	                         src->channels, src->rate, 1, LEVEL_METER_LATENCY);
+	if (err < 0) {
+		WARN("Can't set PCM '%s' parameters: %s", device, snd_strerror(err));
+		return FALSE;
+	}
+
+	DEBUG("Level meter capturing from '%s'", device);
+
+	return TRUE;
+}
+
+/* Close a source */
+static void
+source_close(LevelSource *src)
+{
+	if (src->pcm)
+		snd_pcm_close(src->pcm);
+	if (src->wav)
+		fclose(src->wav);
+	g_free(src);
+}
+
+/* Open a source: a WAV file if there's such a file, a PCM otherwise */
+static LevelSource *
+source_open(const gchar *source)
+{
+	LevelSource *src;
+	gboolean ok;
+
+	src = g_new0(LevelSource, 1);
+
+	if (g_file_test(source, G_FILE_TEST_IS_REGULAR))
+		ok = source_open_wav(src, source);
+	else
+		ok = source_open_pcm(src, source);
+
+	if (!ok) {
+		source_close(src);
+		return NULL;
+	}
+
+	return src;
+}
+
+/* Read a period of samples from a WAV file, looping at the end.
+ * Samples are delivered in real time.
+ */
+static gssize
+source_read_wav(LevelSource *src, gint16 *buf, gsize frames)
+{
+	gsize frame_size = src->channels * sizeof(gint16);
+	gsize i, n;
+
+	if (src->wav_pos + (long) frame_size > src->wav_size) {
+		if (fseek(src->wav, src->wav_data, SEEK_SET) < 0)
+			return -1;
+		src->wav_pos = 0;
+	}
+
+	frames = MIN(frames, (gsize) (src->wav_size - src->wav_pos) / frame_size);
+	n = fread(buf, frame_size, frames, src->wav);
+	if (n == 0)
+		return -1;
+	src->wav_pos += n * frame_size;
+
+	for (i = 0; i < n * src->channels; i++)
+		buf[i] = GINT16_FROM_LE(buf[i]);
+
+	source_pace(src, n);
+
+	return n;
+}
+
+/* Read a period of samples from a PCM */
+static gssize
+source_read_pcm(LevelSource *src, gint16 *buf, gsize frames)
+{
+	snd_pcm_sframes_t n;
+
+	n = snd_pcm_readi(src->pcm, buf, frames);
+	if (n > 0) {
+		source_pace(src, n);
+		return n;
+	}
+
+	/* Nothing to read yet, wait a bit, and let the thread check
+	 * whether it should stop.
+	 */
+	if (n == 0 || n == -EAGAIN) {
+		n = snd_pcm_wait(src->pcm, LEVEL_METER_TIMEOUT);
+		if (n >= 0)
+			return 0;
+	}
+
+	/* Overruns are expected if we're late, just recover */
+	n = snd_pcm_recover(src->pcm, n, 1);
+	if (n < 0) {
+		WARN("Can't capture: %s", snd_strerror(n));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Read at most a period of samples, return the number of frames */
+static gssize
+source_read(LevelSource *src, gint16 *buf, gsize frames)
+{
+	if (src->wav)
+		return source_read_wav(src, buf, frames);
+	return source_read_pcm(src, buf, frames);
+}
+
+/*
+ * Level meter.
+ * The capture thread owns the back slot of the triple buffer, the UI
+ * owns the front slot. The middle slot is exchanged atomically: the
+ * capture thread swaps its back slot with the middle one after each
+ * period, and sets the 'fresh' flag. The UI swaps its front slot with
+ * the middle one whenever the flag is set. Nobody ever waits.
+ */
+
+#define SLOT_MASK  0x3
+#define SLOT_FRESH 0x4
+
+struct level_meter {
+	/* Capture thread */
+	GThread *thread;
+	gint running; /* Atomic */
+	gchar *source;
+	/* Triple buffer */
+	Level slots[3];
+	gint middle; /* Atomic, the middle slot and the 'fresh' flag */
+	gint front; /* Owned by the UI */
+	gint back; /* Owned by the capture thread */
+};
+
+/* Atomically replace a value, return the previous one */
+static gint
+atomic_int_exchange(gint *atomic, gint value)
+{
+	gint old;
+
+	do {
+		old = g_atomic_int_get(atomic);
+	} while (!g_atomic_int_compare_and_exchange(atomic, old, value));
+
+	return old;
+}
+
+/* Publish the levels of a period */
+static void
+level_meter_publish(LevelMeter *meter)
+{
+	gint old;
+
+	old = atomic_int_exchange(&meter->middle, meter->back | SLOT_FRESH);
+	meter->back = old & SLOT_MASK;
+}
+
+/* Capture thread */
+static gpointer
+level_meter_thread(LevelMeter *meter)
+{
+	LevelSource *src;
+	gint16 *buf;
+
+	src = source_open(meter->source);
+	if (src == NULL)
+		return NULL;
+
+	buf = g_new(gint16, LEVEL_METER_PERIOD * src->channels);
+
+	while (g_atomic_int_get(&meter->running)) {
+		gssize n;
+
+		n = source_read(src, buf, LEVEL_METER_PERIOD);
+		if (n < 0)
+			break;
+		if (n == 0)
+			continue;
+
+		level_from_samples(&meter->slots[meter->back], buf, n * src->channels);
+		level_meter_publish(meter);
+	}
+
+	g_free(buf);
+	source_close(src);
+
+	return NULL;
+}
+
+/**
+ * Get the levels of the last period captured.
+ * To be called from the UI thread, it never blocks.
+ *
+ * @param meter a LevelMeter instance.
+ * @param peak where to store the peak level, between 0 and 1.
+ * @param rms where to store the RMS level, between 0 and 1.
+ * @return TRUE if the levels changed since the last call, FALSE otherwise.
+ */
+gboolean
+level_meter_get_levels(LevelMeter *meter, gdouble *peak, gdouble *rms)
+{
+	gboolean fresh = FALSE;
+
+	if (g_atomic_int_get(&meter->middle) & SLOT_FRESH) {
+		meter->front = atomic_int_exchange(&meter->middle, meter->front) & SLOT_MASK;
+		fresh = TRUE;
+	}
+
+	*peak = meter->slots[meter->front].peak;
+	*rms = meter->slots[meter->front].rms;
+
+	return fresh;
+}
+
+/**
+ * Stop capturing. Does nothing if the meter isn't running.
+ *
+ * @param meter a LevelMeter instance.
+ */
+void
+level_meter_stop(LevelMeter *meter)
+{
+	if (meter->thread == NULL)
+		return;
+
+	g_atomic_int_set(&meter->running, FALSE);
+	g_thread_join(meter->thread);
+	meter->thread = NULL;
+
+	g_free(meter->source);
+	meter->source = NULL;
+}
+
+/**
+ * Start capturing from a source, that is an ALSA PCM name, or the path
+ * of a WAV file. If the meter is already running, it's restarted.
+ *
+ * @param meter a LevelMeter instance.
+ * @param source the source to capture from.
+ * @return TRUE on success, FALSE otherwise.
+ */
+gboolean
+level_meter_start(LevelMeter *meter, const gchar *source)
+{
+	GError *error = NULL;
+
+	level_meter_stop(meter);
+
+	/* Start from silence */
+	memset(meter->slots, 0, sizeof meter->slots);
+	meter->front = 0;
+	meter->middle = 1;
+	meter->back = 2;
+
+	meter->source = g_strdup(source);
+	g_atomic_int_set(&meter->running, TRUE);
+
+	meter->thread = g_thread_try_new("level-meter",
+	                                 (GThreadFunc) level_meter_thread,
+	                                 meter, &error);
+	if (meter->thread == NULL) {
+		WARN("Can't start level meter: %s", error->message);
+		g_error_free(error);
+		g_free(meter->source);
+		meter->source = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Free a level meter, stopping it if needed.
+ *
+ * @param meter a LevelMeter instance.
+ */
+void
+level_meter_free(LevelMeter *meter)
+{
+	if (meter == NULL)
+		return;
+
+	level_meter_stop(meter);
+	g_free(meter);
+}
+
+/**
+ * Create a new level meter, not running yet.
+ *
+ * @return a newly allocated LevelMeter instance.
+ */
+LevelMeter *
+level_meter_new(void)
+{
+	return g_new0(LevelMeter, 1);
+}
@@ -0,0 +1,30 @@
+/* level-meter.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file level-meter.h
+ * Header for level-meter.c.
+ * @brief Header for level-meter.c.
+ */
+
+#ifndef _LEVEL_METER_H_
+#define _LEVEL_METER_H_
+
+#include <glib.h>
+
+typedef struct level_meter LevelMeter;
+
+LevelMeter *level_meter_new(void);
+void level_meter_free(LevelMeter *meter);
+gboolean level_meter_start(LevelMeter *meter, const gchar *source);
+void level_meter_stop(LevelMeter *meter);
+gboolean level_meter_get_levels(LevelMeter *meter, gdouble *peak, gdouble *rms);
+
+#endif				// _LEVEL_METER_H_
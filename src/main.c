@@ -22,15 +22,20 @@
 
 #include <stdlib.h>
 #include <glib.h>
+#include <X11/Xlib.h>
 
 #include "main.h"
 #include "audio.h"
+#include "backend.h"
+#include "control.h"
 #include "notif.h"
 #include "hotkeys.h"
 #include "prefs.h"
 #include "support-intl.h"
 #include "support-log.h"
 #include "ui-about-dialog.h"
+#include "ui-mic-icon.h"
+#include "ui-osd.h"
 #include "ui-prefs-dialog.h"
 #include "ui-popup-menu.h"
 #include "ui-popup-window.h"
@@ -41,8 +46,11 @@ static Audio *audio;
 static PopupMenu *popup_menu;
 static PopupWindow *popup_window;
 static TrayIcon *tray_icon;
+static MicIcon *mic_icon;
+static Osd *osd;
 static Hotkeys *hotkeys;
 static Notif *notif;
+static Control *control;
 
 /* Main window, used as the parent for every other window that needs one.
  * This is also a life-long instance.
@@ -138,8 +146,11 @@ prefs_dialog_response_cb(PrefsDialog *this_dialog, gint response_id)
 		/* Ask every instance to reload its preferences */
 		popup_window_reload(popup_window);
 		tray_icon_reload(tray_icon);
+		mic_icon_reload(mic_icon);
+		osd_reload(osd);
 		hotkeys_reload(hotkeys);
 		notif_reload(notif);
+		control_reload(control);
 		audio_reload(audio);
 
 		/* Save preferences to file */
@@ -291,9 +302,6 @@ static void
 on_audio_changed(Audio *audio, AudioEvent *event, G_GNUC_UNUSED gpointer data)
 {
 	switch (event->signal) {
-	case AUDIO_CARD_DISCONNECTED:
-		audio_reload(audio);
-		break;
 	case AUDIO_CARD_ERROR:
 		if (run_audio_error_dialog() == GTK_RESPONSE_YES)
 			audio_reload(audio);
@@ -308,9 +316,13 @@ on_audio_changed(Audio *audio, AudioEvent *event, G_GNUC_UNUSED gpointer data)
  * Options for command-line invokation.
  */
 static gboolean version = FALSE;
+static gchar *backend = NULL;
 static GOptionEntry option_entries[] = {
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &version, "Show version and exit", NULL },
 	{ "debug", 'd', 0, G_OPTION_ARG_NONE, &want_debug, "Run in debug mode", NULL },
+	{ "backend", 'b', 0, G_OPTION_ARG_STRING, &backend,
+	  "Audio backend to use: alsa (default), pulse[:SERVER] or mock[:SCRIPT]",
+	  "BACKEND" },
 	{ NULL, 0, 0, 0, NULL, NULL, NULL }
 };
 
@@ -327,6 +339,11 @@ main(int argc, char *argv[])
 {
 	GOptionContext *context;
 
+	/* The hotkey listener uses Xlib from its own thread.
+	 * This must be done before any other call to Xlib.
+	 */
+	XInitThreads();
+
 	/* Init internationalization stuff */
 	intl_init();
 
@@ -353,12 +370,19 @@ main(int argc, char *argv[])
 	prefs_load();
 
 	/* Init the low-level (aka the audio system) at first */
+	if (backend) {
+		if (!backend_select(backend))
+			exit(EXIT_FAILURE);
+		g_free(backend);
+	}
 	audio = audio_new();
 
 	/* Init the high-level (aka the ui) */
 	popup_menu = popup_menu_create(audio);
 	popup_window = popup_window_create(audio);
 	tray_icon = tray_icon_create(audio);
+	mic_icon = mic_icon_create(audio);
+	osd = osd_create(audio);
 
 	/* Save the main window */
 	main_window = popup_menu_get_window(popup_menu);
@@ -366,6 +390,7 @@ main(int argc, char *argv[])
 	/* Init what's left */
 	hotkeys = hotkeys_new(audio);
 	notif = notif_new(audio);
+	control = control_new(audio);
 
 	/* Get the audio system ready */
 	audio_signals_connect(audio, on_audio_changed, NULL);
@@ -378,8 +403,11 @@ main(int argc, char *argv[])
 
 	/* Cleanup */
 	audio_signals_disconnect(audio, on_audio_changed, NULL);
+	control_free(control);
 	notif_free(notif);
 	hotkeys_free(hotkeys);
+	osd_destroy(osd);
+	mic_icon_destroy(mic_icon);
 	tray_icon_destroy(tray_icon);
 	popup_window_destroy(popup_window);
 	popup_menu_destroy(popup_menu);
@@ -11,7 +11,7 @@
 /**
  * @file notif.c
  * This file handles the notification subsystem
- * via libnotify and mostly reacts to volume changes.
+ * via D-Bus and mostly reacts to volume changes.
  * @brief Notification subsystem.
  */
 
@@ -23,7 +23,7 @@
 #include <glib.h>
 
 #ifdef HAVE_LIBN
-#include <libnotify/notify.h>
+#include <gio/gio.h>
 #endif
 
 #include "audio.h"
@@ -36,91 +36,235 @@
 
 #ifdef HAVE_LIBN
 
-#if NOTIFY_CHECK_VERSION (0, 7, 0)
-#define NOTIFICATION_NEW(summary, body, icon)	\
-  notify_notification_new(summary, body, icon)
-#define NOTIFICATION_SET_HINT_STRING(notification, key, value)	  \
-  notify_notification_set_hint(notification, key, g_variant_new_string(value))
-#define NOTIFICATION_SET_HINT_INT32(notification, key, value)	  \
-  notify_notification_set_hint(notification, key, g_variant_new_int32(value))
-#else
-#define NOTIFICATION_NEW(summary, body, icon)	\
-  notify_notification_new(summary, body, icon, NULL)
-#define NOTIFICATION_SET_HINT_STRING(notification, key, value)	\
-  notify_notification_set_hint_string(notification, key, value)
-#define NOTIFICATION_SET_HINT_INT32(notification, key, value)	\
-  notify_notification_set_hint_int32(notification, key, value)
-#endif
+#define NOTIFY_NAME  "org.freedesktop.Notifications"
+#define NOTIFY_PATH  "/org/freedesktop/Notifications"
+#define NOTIFY_IFACE "org.freedesktop.Notifications"
+
+/*
+ * Notifications.
+ * They're sent asynchronously to the notification daemon, over D-Bus.
+ * There's at most one request in flight for each notification. Changes
+ * that come in the meantime only update the content, and the latest
+ * content is sent once the daemon replied. Sending is also delayed to
+ * respect a minimum interval between two requests.
+ */
 
-/* Helpers */
+struct notification {
+	struct notif *notif;
+	/* Content */
+	GString *summary;
+	gchar *body;
+	const gchar *icon;
+	gint value; /* Volume hint, -1 if none */
+	gint timeout;
+	/* State */
+	guint32 id; /* Id given by the daemon, 0 until then */
+	gboolean dirty; /* The content wasn't sent yet */
+	gboolean in_flight;
+	gint64 last_sent;
+	guint delay_source;
+	/* Called before sending, to build the content */
+	void (*prepare) (struct notif *notif);
+};
+
+typedef struct notification Notification;
+
+struct notif {
+	/* Audio system */
+	Audio *audio;
+	/* Preferences */
+	gboolean enabled;
+	gboolean popup;
+	gboolean tray;
+	gboolean hotkey;
+	gboolean external;
+	guint min_interval; /* In ms */
+	/* D-Bus */
+	GDBusConnection *connection;
+	GCancellable *cancellable;
+	/* Notifications */
+	Notification volume_notif;
+	Notification text_notif;
+	/* Latest volume state, formatted only when sent */
+	gchar *card;
+	gchar *channel;
+	gboolean muted;
+	gdouble volume;
+};
+
+static void notification_flush(Notification *notification);
 
 static void
-show_volume_notif(NotifyNotification *notification,
-                  const gchar *card, const gchar *channel,
-                  gboolean muted, gdouble volume)
+on_notify_reply(GDBusConnection *connection, GAsyncResult *res,
+                Notification *notification)
 {
 	GError *error = NULL;
-	gchar *icon, *summary;
+	GVariant *reply;
+
+	reply = g_dbus_connection_call_finish(connection, res, &error);
+	if (reply == NULL) {
+		/* Notif is gone, don't touch it */
+		if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_error_free(error);
+			return;
+		}
+
+		ERROR("Could not send notification: %s", error->message);
+		g_error_free(error);
+	} else {
+		g_variant_get(reply, "(u)", &notification->id);
+		g_variant_unref(reply);
+	}
+
+	notification->in_flight = FALSE;
+	notification_flush(notification);
+}
+
+static gboolean
+on_delay_timeout(Notification *notification)
+{
+	notification->delay_source = 0;
+	notification_flush(notification);
+
+	return FALSE;
+}
+
+/* Send the latest content of a notification, if it's possible now */
+static void
+notification_flush(Notification *notification)
+{
+	Notif *notif = notification->notif;
+	static const gchar *no_actions[] = { NULL };
+	GVariantBuilder hints;
+	gint64 now, elapsed;
+
+	if (!notification->dirty || notification->in_flight ||
+	    notification->delay_source || notif->connection == NULL)
+		return;
+
+	/* Wait for the minimum interval */
+	now = g_get_monotonic_time();
+	elapsed = (now - notification->last_sent) / 1000;
+	if (notification->last_sent && elapsed < notif->min_interval) {
+		notification->delay_source = g_timeout_add
+		                             (notif->min_interval - elapsed,
+		                              (GSourceFunc) on_delay_timeout,
+		                              notification);
+		return;
+	}
+
+	if (notification->prepare)
+		notification->prepare(notif);
+
+	g_variant_builder_init(&hints, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&hints, "{sv}", "x-canonical-private-synchronous",
+	                      g_variant_new_string(""));
+	if (notification->value >= 0)
+		g_variant_builder_add(&hints, "{sv}", "value",
+		                      g_variant_new_int32(notification->value));
+
+	g_dbus_connection_call(notif->connection, NOTIFY_NAME, NOTIFY_PATH,
+	                       NOTIFY_IFACE, "Notify",
+	                       g_variant_new("(susss^asa{sv}i)", PACKAGE,
+	                                     notification->id,
+	                                     notification->icon ? notification->icon : "",
+	                                     notification->summary->str,
+	                                     notification->body ? notification->body : "",
+	                                     no_actions, &hints,
+	                                     notification->timeout),
+	                       G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1,
+	                       notif->cancellable,
+	                       (GAsyncReadyCallback) on_notify_reply,
+	                       notification);
+
+	notification->dirty = FALSE;
+	notification->in_flight = TRUE;
+	notification->last_sent = now;
+}
+
+static void
+notification_init(Notification *notification, Notif *notif)
+{
+	notification->notif = notif;
+	notification->summary = g_string_new(NULL);
+	notification->value = -1;
+}
+
+static void
+notification_clear(Notification *notification)
+{
+	if (notification->delay_source)
+		g_source_remove(notification->delay_source);
+
+	g_string_free(notification->summary, TRUE);
+	g_free(notification->body);
+}
+
+/* Helpers */
 
-	if (muted)
-		icon = "audio-volume-muted";
+/* Build the volume notification from the latest volume state */
+static void
+prepare_volume_notif(Notif *notif)
+{
+	Notification *notification = &notif->volume_notif;
+	gdouble volume = notif->volume;
+
+	if (notif->muted)
+		notification->icon = "audio-volume-muted";
 	else if (volume == 0)
-		icon = "audio-volume-off";
+		notification->icon = "audio-volume-off";
 	else if (volume < 33)
-		icon = "audio-volume-low";
+		notification->icon = "audio-volume-low";
 	else if (volume < 66)
-		icon = "audio-volume-medium";
+		notification->icon = "audio-volume-medium";
 	else
-		icon = "audio-volume-high";
+		notification->icon = "audio-volume-high";
 
-	if (muted)
-		summary = g_strdup("Volume muted");
+	if (notif->muted)
+		g_string_assign(notification->summary, "Volume muted");
 	else
-		summary = g_strdup_printf("%s (%s)\nVolume: %ld%%\n",
-		                          card, channel, lround(volume));
+		g_string_printf(notification->summary, "%s (%s)\nVolume: %ld%%\n",
+		                notif->card, notif->channel, lround(volume));
 
-	notify_notification_update(notification, summary, NULL, icon);
-	NOTIFICATION_SET_HINT_INT32(notification, "value", lround(volume));
+	notification->value = lround(volume);
+}
 
-	if (!notify_notification_show(notification, &error)) {
-		ERROR("Could not send notification: %s", error->message);
-		g_error_free(error);
+static void
+show_volume_notif(Notif *notif, const gchar *card, const gchar *channel,
+                  gboolean muted, gdouble volume)
+{
+	if (g_strcmp0(notif->card, card)) {
+		g_free(notif->card);
+		notif->card = g_strdup(card);
+	}
+
+	if (g_strcmp0(notif->channel, channel)) {
+		g_free(notif->channel);
+		notif->channel = g_strdup(channel);
 	}
 
-	g_free(summary);
+	notif->muted = muted;
+	notif->volume = volume;
+
+	notif->volume_notif.dirty = TRUE;
+	notification_flush(&notif->volume_notif);
 }
 
 static void
-show_text_notif(NotifyNotification *notification,
-                const gchar *summary, const gchar *body)
+show_text_notif(Notif *notif, const gchar *summary, const gchar *body)
 {
-	GError *error = NULL;
+	Notification *notification = &notif->text_notif;
 
-	notify_notification_update(notification, summary, body, NULL);
+	g_string_assign(notification->summary, summary);
+	g_free(notification->body);
+	notification->body = g_strdup(body);
 
-	if (!notify_notification_show(notification, &error)) {
-		ERROR("Could not send notification: %s", error->message);
-		g_error_free(error);
-	}
+	notification->dirty = TRUE;
+	notification_flush(notification);
 }
 
 /* Public functions & signal handlers */
 
-struct notif {
-	/* Audio system */
-	Audio *audio;
-	/* Preferences */
-	gboolean enabled;
-	gboolean popup;
-	gboolean tray;
-	gboolean hotkey;
-	gboolean external;
-	/* Notifications */
-	NotifyNotification *volume_notif;
-	NotifyNotification *text_notif;
-
-};
-
 /* Handle signals coming from the audio subsystem. */
 static void
 on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
@@ -129,23 +273,24 @@ on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 
 	switch (event->signal) {
 	case AUDIO_NO_CARD:
-		show_text_notif(notif->text_notif,
+		show_text_notif(notif,
 		                _("No sound card"),
 		                _("No playable soundcard found"));
 		break;
 
 	case AUDIO_CARD_DISCONNECTED:
-		show_text_notif(notif->text_notif,
+		show_text_notif(notif,
 		                _("Soundcard disconnected"),
 		                _("Soundcard has been disconnected, reloading sound system..."));
 		break;
-
 	case AUDIO_VALUES_CHANGED:
-		if (!notif->enabled)
+		/* A burst of changes gets a single notification, at the end */
+		if (!notif->enabled || event->repeat)
 			return;
 
 		switch (event->user) {
 		case AUDIO_USER_UNKNOWN:
+		case AUDIO_USER_SOCKET:
 			if (!notif->external)
 				return;
 			break;
@@ -166,11 +311,23 @@ on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 			return;
 		}
 
-		show_volume_notif(notif->volume_notif,
-		                  event->card, event->channel,
+		show_volume_notif(notif, event->card, event->channel,
 		                  event->muted, event->volume);
 		break;
 
+	case AUDIO_CAPTURE_CHANGED:
+		if (!notif->enabled || !notif->hotkey)
+			return;
+
+		/* Only the mic hotkey deserves a notification */
+		if (event->user != AUDIO_USER_HOTKEYS)
+			return;
+
+		show_text_notif(notif, _("Microphone"),
+		                event->capture_muted ? _("Microphone muted") :
+		                _("Microphone unmuted"));
+		break;
+
 	default:
 		break;
 	}
@@ -185,8 +342,7 @@ on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 void
 notif_reload(Notif *notif)
 {
-	guint timeout;
-	NotifyNotification *notification;
+	gint timeout;
 
 	/* Get preferences */
 	notif->enabled = prefs_get_boolean("EnableNotifications", FALSE);
@@ -194,27 +350,37 @@ notif_reload(Notif *notif)
 	notif->tray = prefs_get_boolean("MouseNotifications", TRUE);
 	notif->hotkey = prefs_get_boolean("HotkeyNotifications", TRUE);
 	notif->external = prefs_get_boolean("ExternalNotifications", FALSE);
+	notif->min_interval = MAX(prefs_get_integer("NotificationMinInterval", 0), 0);
 	timeout = prefs_get_integer("NotificationTimeout", 1500);
 
-	/* Create volume notification */
-	notification = NOTIFICATION_NEW("", NULL, NULL);
-	notify_notification_set_timeout(notification, timeout);
-	NOTIFICATION_SET_HINT_STRING(notification, "x-canonical-private-synchronous", "");
-	if (notif->volume_notif)
-		g_object_unref(notif->volume_notif);
-	notif->volume_notif = notification;
-
-	/* Create text notification */
-	notification = NOTIFICATION_NEW("", NULL, NULL);
-	notify_notification_set_timeout(notification, timeout * 2);
-	NOTIFICATION_SET_HINT_STRING(notification, "x-canonical-private-synchronous", "");
-	if (notif->text_notif)
-		g_object_unref(notif->text_notif);
-	notif->text_notif = notification;
+	notif->volume_notif.timeout = timeout;
+	notif->text_notif.timeout = timeout * 2;
+}
+
+/* The session bus is ready, send what was waiting for it */
+static void
+on_bus_ready(G_GNUC_UNUSED GObject *source, GAsyncResult *res, Notif *notif)
+{
+	GError *error = NULL;
+	GDBusConnection *connection;
+
+	connection = g_bus_get_finish(res, &error);
+	if (connection == NULL) {
+		/* Notif is gone, don't touch it */
+		if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			ERROR("Unable to connect to the session bus: %s. "
+			      "Notifications won't be sent.", error->message);
+		g_error_free(error);
+		return;
+	}
+
+	notif->connection = connection;
+	notification_flush(&notif->volume_notif);
+	notification_flush(&notif->text_notif);
 }
 
 /**
- * Uninitializes libnotify.
+ * Uninitializes the notification subsystem.
  * This should be called only once at cleanup.
  *
  * @param notif a Notif instance.
@@ -225,24 +391,26 @@ notif_free(Notif *notif)
 	if (notif == NULL)
 		return;
 
-	/* Unref any existing notification */
-	if (notif->volume_notif)
-		g_object_unref(notif->volume_notif);
-	if (notif->text_notif)
-		g_object_unref(notif->text_notif);
-
 	/* Disconnect audio signal handlers */
 	audio_signals_disconnect(notif->audio, on_audio_changed, notif);
 
-	/* Uninit libnotify. This should be done only once */
-	g_assert(notify_is_initted() == TRUE);
-	notify_uninit();
+	/* Cancel pending requests, their callbacks won't touch notif */
+	g_cancellable_cancel(notif->cancellable);
+	g_object_unref(notif->cancellable);
+	if (notif->connection)
+		g_object_unref(notif->connection);
+
+	notification_clear(&notif->volume_notif);
+	notification_clear(&notif->text_notif);
+	g_free(notif->card);
+	g_free(notif->channel);
 
 	g_free(notif);
 }
 
 /**
- * Initializes libnotify.
+ * Initializes the notification subsystem, and starts connecting to
+ * the session bus. Notifications are held until it's connected.
  * This should be called only once at startup.
  *
  * @param audio An Audio instance.
@@ -255,11 +423,14 @@ notif_new(Audio *audio)
 
 	notif = g_new0(Notif, 1);
 
-	/* Init libnotify. This should be done only once */
-	g_assert(notify_is_initted() == FALSE);
-	if (!notify_init(PACKAGE))
-		run_error_dialog("Unable to initialize libnotify. "
-		                 "Notifications won't be sent.");
+	notification_init(&notif->volume_notif, notif);
+	notification_init(&notif->text_notif, notif);
+	notif->volume_notif.prepare = prepare_volume_notif;
+
+	/* Connect to the session bus */
+	notif->cancellable = g_cancellable_new();
+	g_bus_get(G_BUS_TYPE_SESSION, notif->cancellable,
+	          (GAsyncReadyCallback) on_bus_ready, notif);
 
 	/* Connect audio signals handlers */
 	notif->audio = audio;
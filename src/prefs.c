@@ -45,11 +45,9 @@ ScrollStep=5\n\
 FineScrollStep=1\n\
 MiddleClickAction=0\n\
 CustomCommand=\n\
-VolMuteKey=-1\n\
-VolUpKey=-1\n\
-VolDownKey=-1\n\
+HotkeyBindings=\n\
 AlsaCard=(default)\n\
-NormalizeVolume=true\n\
+VolumeCurve=alsamixer\n\
 SystemTheme=false"
 
 static GKeyFile *keyFile;
@@ -188,10 +186,35 @@ prefs_get_string(const gchar *key, const gchar *def)
 			return g_strdup(cmd);
 	}
 
+	/* The volume curve used to be a boolean, that decided
+	 * between a linear curve and the alsamixer curve.
+	 */
+	if (!g_strcmp0(key, "VolumeCurve") &&
+	    g_key_file_has_key(keyFile, "PNMixer", "NormalizeVolume", NULL)) {
+		if (prefs_get_boolean("NormalizeVolume", TRUE))
+			return g_strdup("alsamixer");
+		else
+			return g_strdup("linear");
+	}
+
 	/* At last, return default value */
 	return g_strdup(def);
 }
 
+/**
+ * Gets a list of strings from preferences.
+ * On error, returns NULL.
+ *
+ * @param key the specific settings key
+ * @return the preference value or NULL on error. Must be freed
+ * with g_strfreev().
+ */
+gchar **
+prefs_get_string_list(const gchar *key)
+{
+	return g_key_file_get_string_list(keyFile, "PNMixer", key, NULL, NULL);
+}
+
 /**
  * Gets a list of doubles from preferences.
  * On error, returns NULL.
@@ -261,6 +284,55 @@ prefs_get_channel(const gchar *card)
 	return g_key_file_get_string(keyFile, card, "Channel", NULL);
 }
 
+/**
+ * Gets the capture channel of the specified Alsa Card
+ * from the global keyFile and returns the result.
+ *
+ * @param card the Alsa Card to get the capture channel of
+ * @return the capture channel as newly allocated string,
+ * NULL on failure
+ */
+gchar *
+prefs_get_capture_channel(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string(keyFile, card, "CaptureChannel", NULL);
+}
+
+/**
+ * Gets the control group of the specified Alsa Card from the global keyFile,
+ * that is the list of elements driven along with the selected channel.
+ * Elements are given as 'channel', or 'channel@card id' for elements
+ * that belong to another card.
+ *
+ * @param card the Alsa Card to get the control group of
+ * @return the list of elements as a newly allocated string array,
+ * NULL if there's no group
+ */
+gchar **
+prefs_get_control_group(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string_list(keyFile, card, "ControlGroup", NULL, NULL);
+}
+
+/**
+ * Gets the policy used to spread the volume over the control group
+ * of the specified Alsa Card.
+ *
+ * @param card the Alsa Card to get the control group policy of
+ * @return the policy as newly allocated string, NULL on failure
+ */
+gchar *
+prefs_get_control_group_policy(const gchar *card)
+{
+	if (!card)
+		return NULL;
+	return g_key_file_get_string(keyFile, card, "ControlGroupPolicy", NULL);
+}
+
 /**
  * Sets a boolean value to preferences.
  *
@@ -309,6 +381,19 @@ prefs_set_string(const gchar *key, const gchar *value)
 	g_key_file_set_string(keyFile, "PNMixer", key, value);
 }
 
+/**
+ * Sets a list of strings to preferences.
+ *
+ * @param key the specific settings key
+ * @param list the NULL-terminated array of strings to set
+ */
+void
+prefs_set_string_list(const gchar *key, const gchar * const *list)
+{
+	g_key_file_set_string_list(keyFile, "PNMixer", key, list,
+	                           g_strv_length((gchar **) list));
+}
+
 /**
  * Sets a list of doubles to preferences.
  *
@@ -334,6 +419,18 @@ prefs_set_channel(const gchar *card, const gchar *channel)
 	g_key_file_set_string(keyFile, card, "Channel", channel);
 }
 
+/**
+ * Sets the capture channel for a given card in preferences.
+ *
+ * @param card the Alsa Card associated with the channel
+ * @param channel the capture channel to save in the preferences.
+ */
+void
+prefs_set_capture_channel(const gchar *card, const gchar *channel)
+{
+	g_key_file_set_string(keyFile, card, "CaptureChannel", channel);
+}
+
 /**
  * Loads the preferences from the config file to the keyFile object (GKeyFile type).
  * Creates the keyFile object if it doesn't exist.
@@ -27,14 +27,20 @@ gboolean prefs_get_boolean(const gchar *key, gboolean def);
 gint     prefs_get_integer(const gchar *key, gint def);
 gdouble  prefs_get_double(const gchar *key, gdouble def);
 gchar   *prefs_get_string(const gchar *key, const gchar *def);
+gchar  **prefs_get_string_list(const gchar *key);
 gdouble *prefs_get_double_list(const gchar *key, gsize *n);
 gchar   *prefs_get_channel(const gchar *card);
+gchar   *prefs_get_capture_channel(const gchar *card);
+gchar  **prefs_get_control_group(const gchar *card);
+gchar   *prefs_get_control_group_policy(const gchar *card);
 
 void prefs_set_boolean(const gchar *key, gboolean value);
 void prefs_set_integer(const gchar *key, gint value);
 void prefs_set_double(const gchar *key, gdouble value);
 void prefs_set_string(const gchar *key, const gchar *value);
+void prefs_set_string_list(const gchar *key, const gchar * const *list);
 void prefs_set_double_list(const gchar *key, gdouble *list, gsize n);
 void prefs_set_channel(const gchar *card, const gchar *channel);
+void prefs_set_capture_channel(const gchar *card, const gchar *channel);
 
 #endif				// _PREFS_H_
@@ -0,0 +1,247 @@
+/* ui-mic-icon.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file ui-mic-icon.c
+ * This file holds the ui-related code for the microphone tray icon,
+ * a second and optional tray icon that shows the capture state.
+ * @brief Microphone tray icon subsystem.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <math.h>
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "audio.h"
+#include "prefs.h"
+#include "support-intl.h"
+#include "support-log.h"
+#include "ui-mic-icon.h"
+
+#include "main.h"
+
+/* Helpers */
+
+/* Update the icon and the tooltip */
+static void
+update_mic_icon(GtkStatusIcon *status_icon, const gchar *channel,
+                gdouble volume, gboolean muted)
+{
+	const gchar *icon_name;
+	char tooltip[64];
+
+	if (muted)
+		icon_name = "microphone-sensitivity-muted";
+	else if (volume < 33)
+		icon_name = "microphone-sensitivity-low";
+	else if (volume < 66)
+		icon_name = "microphone-sensitivity-medium";
+	else
+		icon_name = "microphone-sensitivity-high";
+
+	gtk_status_icon_set_from_icon_name(status_icon, icon_name);
+
+	if (!muted)
+		snprintf(tooltip, sizeof tooltip, "%s (%s)\n%s: %ld %%",
+		         _("Microphone"), channel, _("Volume"), lround(volume));
+	else
+		snprintf(tooltip, sizeof tooltip, "%s (%s)\n%s: %ld %%\n%s",
+		         _("Microphone"), channel, _("Volume"), lround(volume), _("Muted"));
+
+	gtk_status_icon_set_tooltip_text(status_icon, tooltip);
+}
+
+/* Public functions & signal handlers */
+
+struct mic_icon {
+	/* Audio system */
+	Audio *audio;
+	/* Preferences */
+	gboolean enabled;
+	gdouble scroll_step;
+	/* Widgets */
+	GtkStatusIcon *status_icon;
+};
+
+/**
+ * Handles the 'activate' signal on the GtkStatusIcon, toggling the
+ * capture mute state. Usually triggered by left-click.
+ *
+ * @param status_icon the object which received the signal.
+ * @param icon MicIcon instance set when the signal handler was connected.
+ */
+static void
+on_activate(G_GNUC_UNUSED GtkStatusIcon *status_icon, MicIcon *icon)
+{
+	audio_toggle_capture_mute(icon->audio, AUDIO_USER_TRAY_ICON);
+}
+
+/**
+ * Handles 'scroll-event' signal on the GtkStatusIcon, changing the capture
+ * volume accordingly.
+ *
+ * @param status_icon the object which received the signal.
+ * @param event the GdkEventScroll which triggered this signal.
+ * @param icon MicIcon instance set when the signal handler was connected.
+ * @return TRUE to stop other handlers from being invoked for the event.
+ * FALSE to propagate the event further
+ */
+static gboolean
+on_scroll_event(G_GNUC_UNUSED GtkStatusIcon *status_icon, GdkEventScroll *event,
+                MicIcon *icon)
+{
+	gdouble volume;
+
+	volume = audio_get_capture_volume(icon->audio);
+
+	if (event->direction == GDK_SCROLL_UP)
+		audio_set_capture_volume(icon->audio, AUDIO_USER_TRAY_ICON,
+		                         volume + icon->scroll_step);
+	else if (event->direction == GDK_SCROLL_DOWN)
+		audio_set_capture_volume(icon->audio, AUDIO_USER_TRAY_ICON,
+		                         volume - icon->scroll_step);
+
+	return FALSE;
+}
+
+/**
+ * Handles the 'popup-menu' signal on the GtkStatusIcon, bringing up
+ * the context popup menu. Usually triggered by right-click.
+ *
+ * @param status_icon the object which received the signal.
+ * @param button the button that was pressed, or 0 if the signal
+ * is not emitted in response to a button press event.
+ * @param activate_time the timestamp of the event that triggered
+ * the signal emission.
+ * @param icon MicIcon instance set when the signal handler was connected.
+ */
+static void
+on_popup_menu(GtkStatusIcon *status_icon, guint button,
+              guint activate_time, G_GNUC_UNUSED MicIcon *icon)
+{
+	do_show_popup_menu(gtk_status_icon_position_menu, status_icon, button, activate_time);
+}
+
+/**
+ * Handle signals from the audio subsystem.
+ *
+ * @param audio the Audio instance that emitted the signal.
+ * @param event the AudioEvent containing useful information.
+ * @param data user supplied data.
+ */
+static void
+on_audio_changed(Audio *audio, AudioEvent *event, gpointer data)
+{
+	MicIcon *icon = (MicIcon *) data;
+
+	switch (event->signal) {
+	case AUDIO_CAPTURE_CHANGED:
+		break;
+	case AUDIO_NO_CARD:
+	case AUDIO_CARD_INITIALIZED:
+	case AUDIO_CARD_CLEANED_UP:
+		/* The capture element may come and go with the card */
+		mic_icon_reload(icon);
+		return;
+	default:
+		return;
+	}
+
+	update_mic_icon(icon->status_icon, audio_get_capture_channel(audio),
+	                event->capture_volume, event->capture_muted);
+}
+
+/**
+ * Update the mic icon according to the current preferences
+ * and the current audio status.
+ * This has to be called each time the preferences are modified.
+ *
+ * @param icon a MicIcon instance.
+ */
+void
+mic_icon_reload(MicIcon *icon)
+{
+	Audio *audio = icon->audio;
+	gboolean visible;
+
+	icon->enabled = prefs_get_boolean("DisplayMicIcon", FALSE);
+	icon->scroll_step = prefs_get_double("ScrollStep", 5);
+
+	visible = icon->enabled && audio_has_capture(audio);
+	gtk_status_icon_set_visible(icon->status_icon, visible);
+	if (!visible)
+		return;
+
+	update_mic_icon(icon->status_icon, audio_get_capture_channel(audio),
+	                audio_get_capture_volume(audio),
+	                audio_is_capture_muted(audio));
+}
+
+/**
+ * Destroys the mic icon, freeing any resources.
+ *
+ * @param icon a MicIcon instance.
+ */
+void
+mic_icon_destroy(MicIcon *icon)
+{
+	DEBUG("Destroying");
+
+	audio_signals_disconnect(icon->audio, on_audio_changed, icon);
+	g_object_unref(icon->status_icon);
+	g_free(icon);
+}
+
+/**
+ * Creates the mic icon and connects all the signals.
+ * The icon is only visible if enabled in the preferences.
+ *
+ * @param audio the audio system, needed to control the capture.
+ * @return the newly created MicIcon instance.
+ */
+MicIcon *
+mic_icon_create(Audio *audio)
+{
+	MicIcon *icon;
+
+	DEBUG("Creating mic icon");
+
+	icon = g_new0(MicIcon, 1);
+
+	/* Create everything */
+	icon->status_icon = gtk_status_icon_new();
+	gtk_status_icon_set_visible(icon->status_icon, FALSE);
+
+	/* Connect ui signal handlers */
+
+	// Left-click
+	g_signal_connect(icon->status_icon, "activate",
+	                 G_CALLBACK(on_activate), icon);
+	// Right-click
+	g_signal_connect(icon->status_icon, "popup-menu",
+	                 G_CALLBACK(on_popup_menu), icon);
+	// Mouse scrolling on the icon
+	g_signal_connect(icon->status_icon, "scroll_event",
+	                 G_CALLBACK(on_scroll_event), icon);
+
+	/* Connect audio signals handlers */
+	icon->audio = audio;
+	audio_signals_connect(audio, on_audio_changed, icon);
+
+	/* Load preferences */
+	mic_icon_reload(icon);
+
+	return icon;
+}
@@ -0,0 +1,28 @@
+/* ui-mic-icon.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file ui-mic-icon.h
+ * Header for ui-mic-icon.c.
+ * @brief Header for ui-mic-icon.c.
+ */
+
+#ifndef _UI_MIC_ICON_H_
+#define _UI_MIC_ICON_H_
+
+#include "audio.h"
+
+typedef struct mic_icon MicIcon;
+
+MicIcon *mic_icon_create(Audio *audio);
+void mic_icon_destroy(MicIcon *mic_icon);
+void mic_icon_reload(MicIcon *mic_icon);
+
+#endif				// _UI_MIC_ICON_H_
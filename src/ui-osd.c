@@ -0,0 +1,338 @@
+/* ui-osd.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file ui-osd.c
+ * This file holds the ui-related code for the on-screen display,
+ * an optional alternative to the notifications. It's a popup window
+ * with a level bar, created once, that shows the volume when it changes
+ * and hides itself after a while.
+ * @brief On-screen display subsystem.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <math.h>
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "audio.h"
+#include "prefs.h"
+#include "support-intl.h"
+#include "support-log.h"
+#include "ui-osd.h"
+
+#include "main.h"
+
+#define OSD_WIDTH   240	/* px */
+#define OSD_SPACING 6	/* px */
+#define OSD_OPACITY 0.9
+
+/* Public functions & signal handlers */
+
+struct osd {
+	/* Audio system */
+	Audio *audio;
+	/* Preferences */
+	gboolean enabled;
+	guint timeout; /* In ms */
+	/* Which changes are shown, like for the notifications */
+	gboolean popup;
+	gboolean tray;
+	gboolean hotkey;
+	gboolean external;
+	/* Widgets */
+	GtkWidget *window;
+	GtkWidget *image;
+	GtkWidget *level_bar;
+	/* Latest state, applied on the next frame */
+	gdouble volume;
+	gboolean muted;
+	guint redraw;
+	/* Auto-hide */
+	gint64 hide_time;
+	guint hide_source;
+};
+
+/* Apply the latest state to the widgets */
+static void
+update_osd(Osd *osd)
+{
+	const gchar *icon_name;
+#ifndef WITH_GTK3
+	gchar text[32];
+#endif
+
+	if (osd->muted)
+		icon_name = "audio-volume-muted";
+	else if (osd->volume == 0)
+		icon_name = "audio-volume-off";
+	else if (osd->volume < 33)
+		icon_name = "audio-volume-low";
+	else if (osd->volume < 66)
+		icon_name = "audio-volume-medium";
+	else
+		icon_name = "audio-volume-high";
+
+	gtk_image_set_from_icon_name(GTK_IMAGE(osd->image), icon_name,
+	                             GTK_ICON_SIZE_DIALOG);
+
+#ifdef WITH_GTK3
+	gtk_level_bar_set_value(GTK_LEVEL_BAR(osd->level_bar),
+	                        osd->muted ? 0 : osd->volume / 100);
+#else
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(osd->level_bar),
+	                              osd->muted ? 0 : osd->volume / 100);
+	if (osd->muted)
+		snprintf(text, sizeof text, "%s", _("Muted"));
+	else
+		snprintf(text, sizeof text, "%ld %%", lround(osd->volume));
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(osd->level_bar), text);
+#endif
+}
+
+/* Redraw the OSD with the latest state, once per frame at most.
+ * With Gtk3, it's done on the next frame of the frame clock.
+ */
+#ifdef WITH_GTK3
+static gboolean
+on_redraw_tick(G_GNUC_UNUSED GtkWidget *widget, G_GNUC_UNUSED GdkFrameClock *clock,
+               Osd *osd)
+{
+	osd->redraw = 0;
+	update_osd(osd);
+
+	return G_SOURCE_REMOVE;
+}
+#endif
+
+static gboolean
+on_hide_timeout(Osd *osd)
+{
+	gint64 now = g_get_monotonic_time();
+
+	/* The volume changed in the meantime, wait some more */
+	if (now < osd->hide_time) {
+		osd->hide_source = g_timeout_add((osd->hide_time - now) / 1000 + 1,
+		                                 (GSourceFunc) on_hide_timeout, osd);
+		return G_SOURCE_REMOVE;
+	}
+
+	osd->hide_source = 0;
+	gtk_widget_hide(osd->window);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Place the window at the bottom of the primary monitor */
+static void
+place_osd(Osd *osd)
+{
+	GdkScreen *screen;
+	GdkRectangle geom;
+	gint width, height;
+
+	screen = gtk_widget_get_screen(osd->window);
+	gdk_screen_get_monitor_geometry(screen, gdk_screen_get_primary_monitor(screen),
+	                                &geom);
+	gtk_window_get_size(GTK_WINDOW(osd->window), &width, &height);
+
+	gtk_window_move(GTK_WINDOW(osd->window),
+	                geom.x + (geom.width - width) / 2,
+	                geom.y + geom.height * 4 / 5 - height / 2);
+}
+
+/* Show the latest state, and push back the auto-hide */
+static void
+show_osd(Osd *osd, gdouble volume, gboolean muted)
+{
+	osd->volume = volume;
+	osd->muted = muted;
+	osd->hide_time = g_get_monotonic_time() + osd->timeout * 1000;
+
+	if (!gtk_widget_get_visible(osd->window)) {
+		update_osd(osd);
+		place_osd(osd);
+		gtk_widget_show(osd->window);
+	} else {
+#ifdef WITH_GTK3
+		if (osd->redraw == 0)
+			osd->redraw = gtk_widget_add_tick_callback
+			              (osd->window, (GtkTickCallback) on_redraw_tick,
+			               osd, NULL);
+#else
+		update_osd(osd);
+#endif
+	}
+
+	if (osd->hide_source == 0)
+		osd->hide_source = g_timeout_add(osd->timeout,
+		                                 (GSourceFunc) on_hide_timeout, osd);
+}
+
+/* Hide the window, and stop anything pending */
+static void
+hide_osd(Osd *osd)
+{
+#ifdef WITH_GTK3
+	if (osd->redraw) {
+		gtk_widget_remove_tick_callback(osd->window, osd->redraw);
+		osd->redraw = 0;
+	}
+#endif
+
+	if (osd->hide_source) {
+		g_source_remove(osd->hide_source);
+		osd->hide_source = 0;
+	}
+
+	gtk_widget_hide(osd->window);
+}
+
+/**
+ * Handle signals from the audio subsystem.
+ *
+ * @param audio the Audio instance that emitted the signal.
+ * @param event the AudioEvent containing useful information.
+ * @param data user supplied data.
+ */
+static void
+on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
+{
+	Osd *osd = (Osd *) data;
+
+	if (event->signal != AUDIO_VALUES_CHANGED || !osd->enabled)
+		return;
+
+	switch (event->user) {
+	case AUDIO_USER_UNKNOWN:
+	case AUDIO_USER_SOCKET:
+		if (!osd->external)
+			return;
+		break;
+	case AUDIO_USER_POPUP:
+		if (!osd->popup)
+			return;
+		break;
+	case AUDIO_USER_TRAY_ICON:
+		if (!osd->tray)
+			return;
+		break;
+	case AUDIO_USER_HOTKEYS:
+		if (!osd->hotkey)
+			return;
+		break;
+	default:
+		WARN("Unhandled audio user");
+		return;
+	}
+
+	show_osd(osd, event->volume, event->muted);
+}
+
+/**
+ * Update the OSD according to the current preferences.
+ * This has to be called each time the preferences are modified.
+ *
+ * @param osd an Osd instance.
+ */
+void
+osd_reload(Osd *osd)
+{
+	osd->enabled = prefs_get_boolean("DisplayOSD", FALSE);
+	osd->timeout = MAX(prefs_get_integer("OSDTimeout", 1500), 0);
+	osd->popup = prefs_get_boolean("PopupNotifications", FALSE);
+	osd->tray = prefs_get_boolean("MouseNotifications", TRUE);
+	osd->hotkey = prefs_get_boolean("HotkeyNotifications", TRUE);
+	osd->external = prefs_get_boolean("ExternalNotifications", FALSE);
+
+	if (!osd->enabled)
+		hide_osd(osd);
+}
+
+/**
+ * Destroys the OSD, freeing any resources.
+ *
+ * @param osd an Osd instance.
+ */
+void
+osd_destroy(Osd *osd)
+{
+	DEBUG("Destroying");
+
+	audio_signals_disconnect(osd->audio, on_audio_changed, osd);
+	hide_osd(osd);
+	gtk_widget_destroy(osd->window);
+	g_free(osd);
+}
+
+/**
+ * Creates the OSD window and connects the signals. The window is
+ * created once and for all, it's only shown and hidden afterwards.
+ * The OSD is only shown if enabled in the preferences.
+ *
+ * @param audio the audio system, needed to get the volume changes.
+ * @return the newly created Osd instance.
+ */
+Osd *
+osd_create(Audio *audio)
+{
+	Osd *osd;
+	GtkWidget *box;
+#ifdef WITH_GTK3
+	GdkScreen *screen;
+	GdkVisual *visual;
+#endif
+
+	DEBUG("Creating OSD");
+
+	osd = g_new0(Osd, 1);
+
+	/* A popup window is override-redirect, and never takes the focus */
+	osd->window = gtk_window_new(GTK_WINDOW_POPUP);
+	gtk_widget_set_size_request(osd->window, OSD_WIDTH, -1);
+	gtk_container_set_border_width(GTK_CONTAINER(osd->window), OSD_SPACING * 2);
+
+#ifdef WITH_GTK3
+	/* Let the compositor blend it */
+	screen = gtk_widget_get_screen(osd->window);
+	visual = gdk_screen_get_rgba_visual(screen);
+	if (visual && gdk_screen_is_composited(screen)) {
+		gtk_widget_set_visual(osd->window, visual);
+		gtk_widget_set_opacity(osd->window, OSD_OPACITY);
+	}
+
+	box = gtk_box_new(GTK_ORIENTATION_VERTICAL, OSD_SPACING);
+	osd->level_bar = gtk_level_bar_new_for_interval(0, 1);
+#else
+	gtk_window_set_opacity(GTK_WINDOW(osd->window), OSD_OPACITY);
+
+	box = gtk_vbox_new(FALSE, OSD_SPACING);
+	osd->level_bar = gtk_progress_bar_new();
+#endif
+
+	osd->image = gtk_image_new();
+	gtk_box_pack_start(GTK_BOX(box), osd->image, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(box), osd->level_bar, FALSE, FALSE, 0);
+	gtk_container_add(GTK_CONTAINER(osd->window), box);
+	gtk_widget_show_all(box);
+
+	/* Connect audio signals handlers */
+	osd->audio = audio;
+	audio_signals_connect(audio, on_audio_changed, osd);
+
+	/* Load preferences */
+	osd_reload(osd);
+
+	return osd;
+}
@@ -0,0 +1,28 @@
+/* ui-osd.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file ui-osd.h
+ * Header for ui-osd.c.
+ * @brief Header for ui-osd.c.
+ */
+
+#ifndef _UI_OSD_H_
+#define _UI_OSD_H_
+
+#include "audio.h"
+
+typedef struct osd Osd;
+
+Osd *osd_create(Audio *audio);
+void osd_destroy(Osd *osd);
+void osd_reload(Osd *osd);
+
+#endif				// _UI_OSD_H_
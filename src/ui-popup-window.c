@@ -40,8 +40,10 @@
 #include "config.h"
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <glib.h>
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
@@ -50,7 +52,9 @@
 #endif
 
 #include "audio.h"
+#include "level-meter.h"
 #include "prefs.h"
+#include "support-intl.h"
 #include "support-log.h"
 #include "support-ui.h"
 #include "ui-popup-window.h"
@@ -65,6 +69,9 @@
 #define POPUP_WINDOW_VERTICAL_UI_FILE   "popup-window-vertical-gtk2.glade"
 #endif
 
+#define LEVEL_BAR_FLOOR           -60	/* dB */
+#define LEVEL_BAR_REDRAW_INTERVAL 33	/* ms, Gtk2 only */
+
 /* Helpers */
 
 /* Configure the appearance of the text that is shown around the volume slider,
@@ -134,6 +141,41 @@ update_volume_slider(GtkAdjustment *vol_scale_adj, gdouble volume)
 	gtk_adjustment_set_value(vol_scale_adj, volume);
 }
 
+/* Update the balance slider according to the current audio state. */
+static void
+update_balance_slider(GtkAdjustment *balance_scale_adj, GCallback handler_func,
+                      gpointer handler_data, gdouble balance)
+{
+	gint n_blocked;
+
+	n_blocked = g_signal_handlers_block_by_func
+	            (G_OBJECT(balance_scale_adj), DATA_PTR(handler_func), handler_data);
+	g_assert(n_blocked == 1);
+
+	gtk_adjustment_set_value(balance_scale_adj, balance);
+
+	g_signal_handlers_unblock_by_func
+	(G_OBJECT(balance_scale_adj), DATA_PTR(handler_func), handler_data);
+}
+
+/* Update the level meter bar. The bar shows the RMS level, the text
+ * shows the peak level, both in dBFS.
+ */
+static void
+update_level_bar(GtkProgressBar *level_bar, gdouble peak, gdouble rms)
+{
+	gchar text[16];
+	gdouble db;
+
+	db = rms > 0 ? 20 * log10(rms) : LEVEL_BAR_FLOOR;
+	gtk_progress_bar_set_fraction(level_bar,
+	                              CLAMP(1 - db / LEVEL_BAR_FLOOR, 0, 1));
+
+	db = peak > 0 ? 20 * log10(peak) : LEVEL_BAR_FLOOR;
+	snprintf(text, sizeof text, "%.0f dB", MAX(db, LEVEL_BAR_FLOOR));
+	gtk_progress_bar_set_text(level_bar, text);
+}
+
 /* Grab mouse and keyboard */
 #ifdef WITH_GTK3
 #if GTK_CHECK_VERSION(3,20,0)
@@ -222,8 +264,92 @@ struct popup_window {
 	GtkWidget *vol_scale;
 	GtkAdjustment *vol_scale_adj;
 	GtkWidget *mute_check;
+	GtkWidget *balance_scale;
+	GtkAdjustment *balance_scale_adj;
+	GtkWidget *outputs_box;
+	GtkWidget *streams_box;
+	GtkWidget *level_bar;
+	/* Level meter */
+	LevelMeter *level_meter;
+	guint level_redraw;
 };
 
+/* Redraw the level meter with the last levels captured.
+ * With Gtk3, it's done on each frame of the frame clock.
+ */
+#ifdef WITH_GTK3
+static gboolean
+on_level_bar_tick(GtkWidget *level_bar, G_GNUC_UNUSED GdkFrameClock *clock,
+                  PopupWindow *window)
+{
+	gdouble peak, rms;
+
+	if (level_meter_get_levels(window->level_meter, &peak, &rms))
+		update_level_bar(GTK_PROGRESS_BAR(level_bar), peak, rms);
+
+	return G_SOURCE_CONTINUE;
+}
+#else
+static gboolean
+on_level_bar_timeout(PopupWindow *window)
+{
+	gdouble peak, rms;
+
+	if (level_meter_get_levels(window->level_meter, &peak, &rms))
+		update_level_bar(GTK_PROGRESS_BAR(window->level_bar), peak, rms);
+
+	return G_SOURCE_CONTINUE;
+}
+#endif
+
+/* Start the level meter, if a source is given in the preferences */
+static void
+level_meter_show(PopupWindow *window)
+{
+	GtkWidget *level_bar = window->level_bar;
+	gchar *source;
+
+	source = prefs_get_string("LevelMeterSource", NULL);
+	if (source == NULL || source[0] == '\0') {
+		gtk_widget_hide(level_bar);
+		g_free(source);
+		return;
+	}
+
+	update_level_bar(GTK_PROGRESS_BAR(level_bar), 0, 0);
+	gtk_widget_show(level_bar);
+
+	if (level_meter_start(window->level_meter, source)) {
+#ifdef WITH_GTK3
+		window->level_redraw = gtk_widget_add_tick_callback
+		                       (level_bar, (GtkTickCallback) on_level_bar_tick,
+		                        window, NULL);
+#else
+		window->level_redraw = g_timeout_add
+		                       (LEVEL_BAR_REDRAW_INTERVAL,
+		                        (GSourceFunc) on_level_bar_timeout, window);
+#endif
+	}
+
+	g_free(source);
+}
+
+/* Stop the level meter, so that nothing runs while the popup is hidden */
+static void
+level_meter_hide(PopupWindow *window)
+{
+	if (window->level_redraw) {
+#ifdef WITH_GTK3
+		gtk_widget_remove_tick_callback(window->level_bar, window->level_redraw);
+#else
+		g_source_remove(window->level_redraw);
+#endif
+		window->level_redraw = 0;
+	}
+
+	level_meter_stop(window->level_meter);
+}
+
 /**
  * Handles 'button-press-event', 'key-press-event' and 'grab-broken-event' signals,
  * on the GtkWindow. Used to hide the volume popup window.
@@ -299,6 +425,22 @@ on_vol_scale_value_changed(GtkRange *range, PopupWindow *window)
 	audio_set_volume(window->audio, AUDIO_USER_POPUP, value, 0);
 }
 
+/**
+ * Handles the 'value-changed' signal on the GtkAdjustment 'balance_scale_adj',
+ * changing the balance accordingly.
+ *
+ * @param adj the GtkAdjustment that received the signal.
+ * @param window user data set when the signal handler was connected.
+ */
+void
+on_balance_scale_adj_value_changed(GtkAdjustment *adj, PopupWindow *window)
+{
+	gdouble value;
+
+	value = gtk_adjustment_get_value(adj);
+	audio_set_balance(window->audio, AUDIO_USER_POPUP, value);
+}
+
 /**
  * Handles the 'toggled' signal on the GtkToggleButton 'mute_check',
  * changing the mute status accordingly.
@@ -312,6 +454,317 @@ on_mute_check_toggled(G_GNUC_UNUSED GtkToggleButton *button, PopupWindow *window
 	audio_toggle_mute(window->audio, AUDIO_USER_POPUP);
 }
 
+/**
+ * Handles the 'toggled' signal on the output radio buttons,
+ * switching to the output that was selected.
+ *
+ * @param button the GtkToggleButton that received the signal.
+ * @param window user data set when the signal handler was connected.
+ */
+static void
+on_output_button_toggled(GtkToggleButton *button, PopupWindow *window)
+{
+	const gchar *card_id;
+
+	if (!gtk_toggle_button_get_active(button))
+		return;
+
+	card_id = g_object_get_data(G_OBJECT(button), "card-id");
+	audio_switch_card(window->audio, card_id);
+	prefs_save();
+}
+
+/* Update the list of outputs according to the current audio state.
+ * Buttons are created only when the list of outputs changes,
+ * otherwise they're just updated.
+ */
+static void
+update_outputs_box(PopupWindow *window)
+{
+	GtkWidget *outputs_box = window->outputs_box;
+	const gchar *card_id = audio_get_card_id(window->audio);
+	GList *children, *child;
+	GSList *outputs, *item;
+	gboolean same;
+
+	outputs = audio_get_outputs(window->audio);
+	children = gtk_container_get_children(GTK_CONTAINER(outputs_box));
+
+	/* Check whether the outputs are the same */
+	same = g_list_length(children) == g_slist_length(outputs);
+	for (child = children, item = outputs; same && child;
+	     child = child->next, item = item->next) {
+		AudioOutput *output = item->data;
+		const gchar *id = g_object_get_data(G_OBJECT(child->data), "card-id");
+
+		same = !g_strcmp0(id, output->card_id);
+	}
+
+	/* If not, create the buttons again */
+	if (!same) {
+		GtkWidget *button = NULL;
+
+		for (child = children; child; child = child->next)
+			gtk_widget_destroy(child->data);
+		g_list_free(children);
+		children = NULL;
+
+		for (item = outputs; item; item = item->next) {
+			AudioOutput *output = item->data;
+			GSList *group = NULL;
+
+			if (button)
+				group = gtk_radio_button_get_group(GTK_RADIO_BUTTON(button));
+
+			button = gtk_radio_button_new_with_label(group, output->card);
+			g_object_set_data_full(G_OBJECT(button), "card-id",
+			                       g_strdup(output->card_id), g_free);
+			g_signal_connect(button, "toggled",
+			                 G_CALLBACK(on_output_button_toggled), window);
+			gtk_box_pack_start(GTK_BOX(outputs_box), button, FALSE, FALSE, 0);
+			gtk_widget_show(button);
+
+			children = g_list_append(children, button);
+		}
+	}
+
+	/* Update the buttons */
+	for (child = children, item = outputs; child;
+	     child = child->next, item = item->next) {
+		AudioOutput *output = item->data;
+		GtkWidget *button = child->data;
+		gchar *label;
+
+		if (output->muted)
+			label = g_strdup_printf(_("%s: muted"), output->card);
+		else
+			label = g_strdup_printf("%s: %.0f%%", output->card, output->volume);
+		gtk_button_set_label(GTK_BUTTON(button), label);
+		g_free(label);
+
+		g_signal_handlers_block_by_func(G_OBJECT(button),
+		                                DATA_PTR(on_output_button_toggled), window);
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button),
+		                             !g_strcmp0(output->card_id, card_id));
+		g_signal_handlers_unblock_by_func(G_OBJECT(button),
+		                                  DATA_PTR(on_output_button_toggled), window);
+	}
+
+	/* A list with only one output is useless */
+	gtk_widget_set_visible(outputs_box,
+	                       prefs_get_boolean("DisplayOutputs", TRUE) &&
+	                       g_slist_length(outputs) > 1);
+
+	g_list_free(children);
+	g_slist_free_full(outputs, g_free);
+}
+
+/**
+ * Handles the 'value-changed' signal on the sliders of the streams,
+ * changing the volume of the stream accordingly.
+ *
+ * @param range the GtkRange that received the signal.
+ * @param window user data set when the signal handler was connected.
+ */
+static void
+on_stream_scale_value_changed(GtkRange *range, PopupWindow *window)
+{
+	guint32 id;
+
+	id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(range), "stream-id"));
+	audio_set_stream_volume(window->audio, AUDIO_USER_POPUP, id,
+	                        gtk_range_get_value(range));
+}
+
+/**
+ * Handles the 'toggled' signal on the mute buttons of the streams,
+ * changing the mute status of the stream accordingly.
+ *
+ * @param button the GtkToggleButton that received the signal.
+ * @param window user data set when the signal handler was connected.
+ */
+static void
+on_stream_mute_toggled(GtkToggleButton *button, PopupWindow *window)
+{
+	guint32 id;
+
+	id = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(button), "stream-id"));
+	audio_toggle_stream_mute(window->audio, AUDIO_USER_POPUP, id);
+}
+
+/**
+ * Handles the 'scroll-event' signal on the rows of the streams.
+ * Scrolling anywhere on a row moves its slider, so that it goes
+ * through the same path as the slider itself.
+ *
+ * @param row the row that received the signal.
+ * @param event the GdkEventScroll which triggered this signal.
+ * @param window user data set when the signal handler was connected.
+ * @return TRUE to stop other handlers from being invoked for the event.
+ * FALSE to propagate the event further
+ */
+static gboolean
+on_stream_row_scroll_event(GtkWidget *row, GdkEventScroll *event,
+                           G_GNUC_UNUSED PopupWindow *window)
+{
+	GtkRange *scale = g_object_get_data(G_OBJECT(row), "scale");
+	GtkAdjustment *adj = gtk_range_get_adjustment(scale);
+	gdouble step = gtk_adjustment_get_page_increment(adj);
+
+	if (event->direction == GDK_SCROLL_UP)
+		gtk_adjustment_set_value(adj, gtk_adjustment_get_value(adj) + step);
+	else if (event->direction == GDK_SCROLL_DOWN)
+		gtk_adjustment_set_value(adj, gtk_adjustment_get_value(adj) - step);
+	else
+		return FALSE;
+
+	return TRUE;
+}
+
+/* Find the row of a stream */
+static GtkWidget *
+find_stream_row(PopupWindow *window, guint32 id)
+{
+	GtkWidget *row = NULL;
+	GList *children, *child;
+
+	children = gtk_container_get_children(GTK_CONTAINER(window->streams_box));
+	for (child = children; child; child = child->next) {
+		gpointer data = g_object_get_data(G_OBJECT(child->data), "stream-id");
+
+		if (GPOINTER_TO_UINT(data) == id) {
+			row = child->data;
+			break;
+		}
+	}
+	g_list_free(children);
+
+	return row;
+}
+
+/* Update a row according to the state of its stream */
+static void
+update_stream_row(PopupWindow *window, GtkWidget *row, const AudioStream *stream)
+{
+	GtkWidget *label = g_object_get_data(G_OBJECT(row), "label");
+	GtkWidget *mute = g_object_get_data(G_OBJECT(row), "mute");
+	GtkWidget *scale = g_object_get_data(G_OBJECT(row), "scale");
+
+	gtk_label_set_text(GTK_LABEL(label), stream->name);
+	update_mute_check(GTK_TOGGLE_BUTTON(mute), G_CALLBACK(on_stream_mute_toggled),
+	                  window, stream->muted);
+
+	g_signal_handlers_block_by_func(G_OBJECT(scale),
+	                                DATA_PTR(on_stream_scale_value_changed), window);
+	gtk_range_set_value(GTK_RANGE(scale), stream->volume);
+	g_signal_handlers_unblock_by_func(G_OBJECT(scale),
+	                                  DATA_PTR(on_stream_scale_value_changed), window);
+}
+
+/* Create a row for a stream: icon, name, mute button and slider */
+static void
+add_stream_row(PopupWindow *window, const AudioStream *stream)
+{
+	GtkWidget *row, *box, *icon, *label, *mute, *scale;
+	gpointer id = GUINT_TO_POINTER(stream->id);
+
+	row = gtk_event_box_new();
+#ifdef WITH_GTK3
+	box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+	scale = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0, 100, 1);
+#else
+	box = gtk_hbox_new(FALSE, 4);
+	scale = gtk_hscale_new_with_range(0, 100, 1);
+#endif
+	icon = gtk_image_new_from_icon_name(stream->icon ? stream->icon :
+	                                    "audio-x-generic", GTK_ICON_SIZE_MENU);
+	label = gtk_label_new(NULL);
+	gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+	gtk_label_set_width_chars(GTK_LABEL(label), 12);
+	mute = gtk_check_button_new();
+	gtk_widget_set_tooltip_text(mute, _("Mute"));
+	gtk_scale_set_draw_value(GTK_SCALE(scale), FALSE);
+	gtk_widget_set_size_request(scale, 100, -1);
+	configure_vol_increment(gtk_range_get_adjustment(GTK_RANGE(scale)));
+
+	g_object_set_data(G_OBJECT(row), "stream-id", id);
+	g_object_set_data(G_OBJECT(row), "label", label);
+	g_object_set_data(G_OBJECT(row), "mute", mute);
+	g_object_set_data(G_OBJECT(row), "scale", scale);
+	g_object_set_data(G_OBJECT(mute), "stream-id", id);
+	g_object_set_data(G_OBJECT(scale), "stream-id", id);
+
+	g_signal_connect(row, "scroll-event",
+	                 G_CALLBACK(on_stream_row_scroll_event), window);
+	g_signal_connect(mute, "toggled",
+	                 G_CALLBACK(on_stream_mute_toggled), window);
+	g_signal_connect(scale, "value-changed",
+	                 G_CALLBACK(on_stream_scale_value_changed), window);
+
+	gtk_box_pack_start(GTK_BOX(box), icon, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(box), mute, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(box), scale, TRUE, TRUE, 0);
+	gtk_container_add(GTK_CONTAINER(row), box);
+	gtk_box_pack_start(GTK_BOX(window->streams_box), row, FALSE, FALSE, 0);
+	gtk_widget_show_all(row);
+
+	update_stream_row(window, row, stream);
+}
+
+/* Apply a stream signal to the list of streams.
+ * Only the row of the stream is touched, the list is never rebuilt.
+ */
+static void
+update_streams_box(PopupWindow *window, AudioEvent *event)
+{
+	const AudioStream *stream = event->stream;
+	GtkWidget *row;
+
+	row = find_stream_row(window, stream->id);
+
+	switch (event->signal) {
+	case AUDIO_STREAM_ADDED:
+		if (row == NULL)
+			add_stream_row(window, stream);
+		break;
+	case AUDIO_STREAM_CHANGED:
+		/* The slider reflects the value set by the user, as for the card */
+		if (row && event->user != AUDIO_USER_POPUP)
+			update_stream_row(window, row, stream);
+		break;
+	case AUDIO_STREAM_REMOVED:
+		if (row)
+			gtk_widget_destroy(row);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Build the list of streams from scratch */
+static void
+fill_streams_box(PopupWindow *window)
+{
+	GtkWidget *streams_box = window->streams_box;
+	GList *children, *child;
+	GSList *streams, *item;
+
+	children = gtk_container_get_children(GTK_CONTAINER(streams_box));
+	for (child = children; child; child = child->next)
+		gtk_widget_destroy(child->data);
+	g_list_free(children);
+
+	streams = audio_get_streams(window->audio);
+	for (item = streams; item; item = item->next)
+		add_stream_row(window, item->data);
+	g_slist_free_full(streams, g_free);
+
+	gtk_widget_set_visible(streams_box,
+	                       prefs_get_boolean("DisplayStreams", TRUE) &&
+	                       audio_has_streams(window->audio));
+}
+
 /**
  * Handles the 'clicked' signal on the GtkButton 'mixer_button',
  * therefore opening the mixer application.
@@ -345,6 +798,27 @@ on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 	if (!gtk_widget_get_visible(popup_window))
 		return;
 
+	/* Update the outputs. If only their state changed,
+	 * there's nothing else to do.
+	 */
+	switch (event->signal) {
+	case AUDIO_OUTPUTS_CHANGED:
+		update_outputs_box(window);
+		return;
+	case AUDIO_CAPTURE_CHANGED:
+		return;
+	case AUDIO_STREAM_ADDED:
+	case AUDIO_STREAM_CHANGED:
+	case AUDIO_STREAM_REMOVED:
+		update_streams_box(window, event);
+		return;
+	case AUDIO_CARD_INITIALIZED:
+		update_outputs_box(window);
+		break;
+	default:
+		break;
+	}
+
 	/* Update mute checkbox */
 	update_mute_check(GTK_TOGGLE_BUTTON(window->mute_check),
 	                  G_CALLBACK(on_mute_check_toggled), window, event->muted);
@@ -357,8 +831,12 @@ on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 	 * the slider value reflects the value set by user,
 	 * and not the real value reported by the audio system.
 	 */
-	if (event->user != AUDIO_USER_POPUP)
+	if (event->user != AUDIO_USER_POPUP) {
 		update_volume_slider(window->vol_scale_adj, event->volume);
+		update_balance_slider(window->balance_scale_adj,
+		                      G_CALLBACK(on_balance_scale_adj_value_changed),
+		                      window, event->balance);
+	}
 }
 
 /**
@@ -378,6 +856,20 @@ popup_window_show(PopupWindow *window)
 	                  audio_is_muted(window->audio));
 	update_volume_slider(window->vol_scale_adj,
 	                     audio_get_volume(window->audio));
+	update_balance_slider(window->balance_scale_adj,
+	                      G_CALLBACK(on_balance_scale_adj_value_changed), window,
+	                      audio_get_balance(window->audio));
+
+	update_outputs_box(window);
+	fill_streams_box(window);
+
+	/* The balance slider is optional, and useless for mono cards */
+	gtk_widget_set_visible(window->balance_scale,
+	                       prefs_get_boolean("DisplayBalance", FALSE) &&
+	                       audio_get_n_channels(window->audio) > 1);
+
+	/* The level meter only runs while the window is visible */
+	level_meter_show(window);
 
 	/* Show the window */
 	gtk_widget_show_now(popup_window);
@@ -398,6 +890,7 @@ void
 popup_window_hide(PopupWindow *window)
 {
 	gtk_widget_hide(window->popup_window);
+	level_meter_hide(window);
 }
 
 /**
@@ -427,6 +920,10 @@ popup_window_cleanup(PopupWindow *window)
 	/* Disconnect audio signals */
 	audio_signals_disconnect(window->audio, on_audio_changed, window);
 
+	/* Stop the level meter */
+	level_meter_hide(window);
+	level_meter_free(window->level_meter);
+
 	/* Destroy the Gtk window, freeing any resources */
 	gtk_widget_destroy(window->popup_window);
 
@@ -460,6 +957,11 @@ popup_window_init(PopupWindow *window, Audio *audio)
 	assign_gtk_widget(builder, window, mute_check);
 	assign_gtk_widget(builder, window, vol_scale);
 	assign_gtk_adjustment(builder, window, vol_scale_adj);
+	assign_gtk_widget(builder, window, balance_scale);
+	assign_gtk_adjustment(builder, window, balance_scale_adj);
+	assign_gtk_widget(builder, window, outputs_box);
+	assign_gtk_widget(builder, window, streams_box);
+	assign_gtk_widget(builder, window, level_bar);
 
 	/* Configure some widgets */
 	configure_vol_text(GTK_SCALE(window->vol_scale));
@@ -468,6 +970,9 @@ popup_window_init(PopupWindow *window, Audio *audio)
 	/* Connect ui signal handlers */
 	gtk_builder_connect_signals(builder, window);
 
+	/* Create the level meter, it's started when the window is shown */
+	window->level_meter = level_meter_new();
+
 	/* Connect audio signal handlers */
 	window->audio = audio;
 	audio_signals_connect(audio, on_audio_changed, window);
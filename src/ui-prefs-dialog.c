@@ -76,6 +76,17 @@ set_label_for_keycode(GtkLabel *label, gint code, GdkModifierType mods)
 	g_free(key_accel);
 }
 
+#ifndef WITH_GTK3
+/* Volume curves, in the same order as in the ui file */
+static const gchar *vol_curves[] = {
+	"linear",
+	"linear-db",
+	"alsamixer",
+	"loudness",
+	"custom"
+};
+#endif
+
 /**
  * Fills the GtkComboBoxText 'chan_combo' with the currently available channels
  * for a given card.
@@ -83,19 +94,19 @@ set_label_for_keycode(GtkLabel *label, gint code, GdkModifierType mods)
  * preferences for this card.
  *
  * @param combo the GtkComboBoxText widget for the channels.
- * @param card_name the card to use to get the channels list.
+ * @param card_id the card to use to get the channels list.
  */
 static void
-fill_chan_combo(GtkComboBoxText *combo, const gchar *card_name)
+fill_chan_combo(GtkComboBoxText *combo, const gchar *card_id)
 {
 	int idx, sidx;
 	gchar *selected_channel;
 	GSList *channel_list, *item;
 
-	DEBUG("Filling channels ComboBox for card '%s'", card_name);
+	DEBUG("Filling channels ComboBox for card '%s'", card_id);
 
-	selected_channel = prefs_get_channel(card_name);
-	channel_list = audio_get_channel_list(card_name);
+	selected_channel = prefs_get_channel(card_id);
+	channel_list = audio_get_channel_list(card_id);
 
 	/* Empty the combo box */
 	gtk_combo_box_text_remove_all(combo);
@@ -117,6 +128,77 @@ fill_chan_combo(GtkComboBoxText *combo, const gchar *card_name)
 	g_free(selected_channel);
 }
 
+/**
+ * Fills the GtkComboBoxText 'capture_chan_combo' with the capture channels
+ * for a given card. The active channel is the one found in preferences,
+ * or the first one, which is also what the audio system falls back to.
+ *
+ * @param combo the GtkComboBoxText widget for the capture channels.
+ * @param card_id the card to use to get the channels list.
+ */
+static void
+fill_capture_chan_combo(GtkComboBoxText *combo, const gchar *card_id)
+{
+	int idx, sidx;
+	gchar *selected_channel;
+	GSList *channel_list, *item;
+
+	DEBUG("Filling capture channels ComboBox for card '%s'", card_id);
+
+	selected_channel = prefs_get_capture_channel(card_id);
+	channel_list = audio_get_capture_channel_list(card_id);
+
+	/* Empty the combo box */
+	gtk_combo_box_text_remove_all(combo);
+
+	/* Fill the combo box with the channels, save the selected channel index */
+	for (sidx = idx = 0, item = channel_list; item; idx++, item = item->next) {
+		const char *channel_name = item->data;
+		gtk_combo_box_text_append_text(combo, channel_name);
+
+		if (!g_strcmp0(channel_name, selected_channel))
+			sidx = idx;
+	}
+
+	/* Set the combo box active item, nothing to choose without channels */
+	gtk_combo_box_set_active(GTK_COMBO_BOX(combo), channel_list ? sidx : -1);
+	gtk_widget_set_sensitive(GTK_WIDGET(combo), channel_list != NULL);
+
+	/* Cleanup */
+	g_slist_free_full(channel_list, g_free);
+	g_free(selected_channel);
+}
+
+/* Free the list of card ids attached to the card combo box */
+static void
+card_list_free(GSList *card_list)
+{
+	g_slist_free_full(card_list, g_free);
+}
+
+/**
+ * Get the id of the card that is active in the GtkComboBoxText 'card_combo'.
+ * The combo box displays card names, ids are kept aside since
+ * Gtk2 doesn't support ids in combo boxes.
+ *
+ * @param combo the GtkComboBoxText widget for the cards.
+ * @return the id of the active card, or NULL. Must be freed.
+ */
+static gchar *
+get_active_card_id(GtkComboBoxText *combo)
+{
+	GSList *card_list;
+	gint idx;
+
+	idx = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
+	if (idx < 0)
+		return NULL;
+
+	card_list = g_object_get_data(G_OBJECT(combo), "card-ids");
+
+	return g_strdup(g_slist_nth_data(card_list, idx));
+}
+
 /**
  * Fills the GtkComboBoxText 'card_combo' with the currently available cards.
  * The active card in the combo box is set to the currently ACTIVE card,
@@ -134,7 +216,7 @@ fill_card_combo(GtkComboBoxText *combo, Audio *audio)
 
 	DEBUG("Filling cards ComboBox");
 
-	active_card = audio_get_card(audio);
+	active_card = audio_get_card_id(audio);
 	card_list = audio_get_card_list();
 
 	/* Empty the combo box */
@@ -142,18 +224,23 @@ fill_card_combo(GtkComboBoxText *combo, Audio *audio)
 
 	/* Fill the combo box with the cards, save the active card index */
 	for (sidx = idx = 0, item = card_list; item; idx++, item = item->next) {
-		const char *card_name = item->data;
-		gtk_combo_box_text_append_text(combo, card_name);
+		const char *card_id = item->data;
+		gchar *card_name;
+
+		card_name = audio_get_card_name(card_id);
+		gtk_combo_box_text_append_text(combo, card_name ? card_name : card_id);
+		g_free(card_name);
 
-		if (!g_strcmp0(card_name, active_card))
+		if (!g_strcmp0(card_id, active_card))
 			sidx = idx;
 	}
 
+	/* Keep the card ids along with the combo box, it takes ownership */
+	g_object_set_data_full(G_OBJECT(combo), "card-ids", card_list,
+	                       (GDestroyNotify) card_list_free);
+
 	/* Set the combo box active item */
 	gtk_combo_box_set_active(GTK_COMBO_BOX(combo), sidx);
-
-	/* Cleanup */
-	g_slist_free_full(card_list, g_free);
 }
 
 /* Public functions & signals handlers */
@@ -184,6 +271,7 @@ struct prefs_dialog {
 	GtkWidget *vol_text_check;
 	GtkWidget *vol_pos_label;
 	GtkWidget *vol_pos_combo;
+	GtkWidget *level_meter_entry;
 	GtkWidget *vol_meter_draw_check;
 	GtkWidget *vol_meter_pos_label;
 	GtkWidget *vol_meter_pos_spin;
@@ -191,10 +279,15 @@ struct prefs_dialog {
 	GtkWidget *vol_meter_color_label;
 	GtkWidget *vol_meter_color_button;
 	GtkWidget *system_theme;
+	GtkWidget *osd_enable_check;
+	GtkWidget *osd_timeout_label;
+	GtkWidget *osd_timeout_spin;
 	/* Device panel */
 	GtkWidget *card_combo;
 	GtkWidget *chan_combo;
-	GtkWidget *normalize_vol_check;
+	GtkWidget *vol_curve_combo;
+	GtkWidget *mic_icon_check;
+	GtkWidget *capture_chan_combo;
 	/* Behavior panel */
 	GtkWidget *vol_control_entry;
 	GtkWidget *scroll_step_spin;
@@ -211,6 +304,8 @@ struct prefs_dialog {
 	GtkWidget *hotkeys_up_label;
 	GtkWidget *hotkeys_down_eventbox;
 	GtkWidget *hotkeys_down_label;
+	GtkWidget *hotkeys_mic_mute_eventbox;
+	GtkWidget *hotkeys_mic_mute_label;
 	/* Notifications panel */
 #ifdef HAVE_LIBN
 	GtkWidget *noti_vbox_enabled;
@@ -226,6 +321,32 @@ struct prefs_dialog {
 #endif
 };
 
+/* The actions that have a hotkey label in the dialog */
+static const HotkeyAction hotkey_label_actions[] = {
+	HOTKEY_ACTION_MUTE,
+	HOTKEY_ACTION_UP,
+	HOTKEY_ACTION_DOWN,
+	HOTKEY_ACTION_MIC_MUTE
+};
+
+/* Get the hotkey label of an action, NULL if it has none */
+static GtkWidget *
+hotkey_label_for_action(PrefsDialog *dialog, HotkeyAction action)
+{
+	switch (action) {
+	case HOTKEY_ACTION_MUTE:
+		return dialog->hotkeys_mute_label;
+	case HOTKEY_ACTION_UP:
+		return dialog->hotkeys_up_label;
+	case HOTKEY_ACTION_DOWN:
+		return dialog->hotkeys_down_label;
+	case HOTKEY_ACTION_MIC_MUTE:
+		return dialog->hotkeys_mic_mute_label;
+	default:
+		return NULL;
+	}
+}
+
 /**
  * Handles the 'toggled' signal on the GtkCheckButton 'vol_text_check'.
  * Updates the preferences dialog.
@@ -268,11 +389,12 @@ on_vol_meter_draw_check_toggled(GtkToggleButton *button, PrefsDialog *dialog)
 void
 on_card_combo_changed(GtkComboBoxText *box, PrefsDialog *dialog)
 {
-	gchar *card_name;
+	gchar *card_id;
 
-	card_name = gtk_combo_box_text_get_active_text(box);
-	fill_chan_combo(GTK_COMBO_BOX_TEXT(dialog->chan_combo), card_name);
-	g_free(card_name);
+	card_id = get_active_card_id(box);
+	fill_chan_combo(GTK_COMBO_BOX_TEXT(dialog->chan_combo), card_id);
+	fill_capture_chan_combo(GTK_COMBO_BOX_TEXT(dialog->capture_chan_combo), card_id);
+	g_free(card_id);
 }
 
 /**
@@ -306,7 +428,7 @@ on_hotkeys_enable_check_toggled(GtkToggleButton *button, PrefsDialog *dialog)
 
 /**
  * Handles 'button-press-event' signal on one of the GtkEventBoxes used to
- * define a hotkey: 'hotkeys_mute/up/down_eventbox'.
+ * define a hotkey: 'hotkeys_mute/up/down/mic_mute_eventbox'.
  * Runs a dialog dialog where user can define a new hotkey.
  * User should double-click on the event box to define a new hotkey.
  *
@@ -343,6 +465,9 @@ on_hotkey_event_box_button_press_event(GtkWidget *widget, GdkEventButton *event,
 	} else if (widget == dialog->hotkeys_down_eventbox) {
 		hotkey_label = GTK_LABEL(dialog->hotkeys_down_label);
 		hotkey = _("Volume Down");
+	} else if (widget == dialog->hotkeys_mic_mute_eventbox) {
+		hotkey_label = GTK_LABEL(dialog->hotkeys_mic_mute_label);
+		hotkey = _("Mic Mute/Unmute");
 	}
 	g_assert(hotkey);
 
@@ -394,6 +519,10 @@ on_noti_enable_check_toggled(GtkToggleButton *button, PrefsDialog *dialog)
 	gboolean active = gtk_toggle_button_get_active(button);
 	gtk_widget_set_sensitive(dialog->noti_timeout_label, active);
 	gtk_widget_set_sensitive(dialog->noti_timeout_spin, active);
+
+	/* The on-screen display shows up for the same changes */
+	active |= gtk_toggle_button_get_active
+	          (GTK_TOGGLE_BUTTON(dialog->osd_enable_check));
 	gtk_widget_set_sensitive(dialog->noti_hotkey_check, active);
 	gtk_widget_set_sensitive(dialog->noti_mouse_check, active);
 	gtk_widget_set_sensitive(dialog->noti_popup_check, active);
@@ -407,6 +536,26 @@ on_noti_enable_check_toggled(G_GNUC_UNUSED GtkToggleButton *button,
 }
 #endif
 
+/**
+ * Handles the 'toggled' signal on the GtkCheckButton 'osd_enable_check'.
+ * Updates the preferences dialog.
+ *
+ * @param button the button which received the signal.
+ * @param dialog user data set when the signal handler was connected.
+ */
+void
+on_osd_enable_check_toggled(GtkToggleButton *button, PrefsDialog *dialog)
+{
+	gboolean active = gtk_toggle_button_get_active(button);
+	gtk_widget_set_sensitive(dialog->osd_timeout_label, active);
+	gtk_widget_set_sensitive(dialog->osd_timeout_spin, active);
+
+#ifdef HAVE_LIBN
+	on_noti_enable_check_toggled
+	(GTK_TOGGLE_BUTTON(dialog->noti_enable_check), dialog);
+#endif
+}
+
 /**
  * Handles the 'response' signal from the GtkDialog.
  * Just invoke the user callback.
@@ -435,13 +584,16 @@ on_audio_changed(Audio *audio, AudioEvent *event, gpointer data)
 	PrefsDialog *dialog = (PrefsDialog *) data;
 	GtkComboBoxText *card_combo = GTK_COMBO_BOX_TEXT(dialog->card_combo);
 	GtkComboBoxText *chan_combo = GTK_COMBO_BOX_TEXT(dialog->chan_combo);
+	GtkComboBoxText *capture_chan_combo =
+	        GTK_COMBO_BOX_TEXT(dialog->capture_chan_combo);
 
 	switch (event->signal) {
 	case AUDIO_CARD_INITIALIZED:
 	case AUDIO_CARD_CLEANED_UP:
 		/* A card may have appeared or disappeared */
 		fill_card_combo(card_combo, audio);
-		fill_chan_combo(chan_combo, audio_get_card(audio));
+		fill_chan_combo(chan_combo, audio_get_card_id(audio));
+		fill_capture_chan_combo(capture_chan_combo, audio_get_card_id(audio));
 		break;
 	default:
 		break;
@@ -480,6 +632,11 @@ prefs_dialog_retrieve(PrefsDialog *dialog)
 	gint idx = gtk_combo_box_get_active(GTK_COMBO_BOX(vpc));
 	prefs_set_integer("TextVolumePosition", idx);
 
+	// level meter source
+	GtkWidget *lme = dialog->level_meter_entry;
+	const gchar *lm_source = gtk_entry_get_text(GTK_ENTRY(lme));
+	prefs_set_string("LevelMeterSource", lm_source);
+
 	// volume meter display
 	GtkWidget *dvc = dialog->vol_meter_draw_check;
 	active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(dvc));
@@ -513,23 +670,49 @@ prefs_dialog_retrieve(PrefsDialog *dialog)
 	active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(system_theme));
 	prefs_set_boolean("SystemTheme", active);
 
+	// on-screen display
+	GtkWidget *oc = dialog->osd_enable_check;
+	active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(oc));
+	prefs_set_boolean("DisplayOSD", active);
+
+	GtkWidget *os = dialog->osd_timeout_spin;
+	gint osd_timeout = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(os));
+	prefs_set_integer("OSDTimeout", osd_timeout);
+
 	// audio card
 	GtkWidget *acc = dialog->card_combo;
-	gchar *card = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(acc));
+	gchar *card = get_active_card_id(GTK_COMBO_BOX_TEXT(acc));
 	prefs_set_string("AlsaCard", card);
 
 	// audio channel
 	GtkWidget *ccc = dialog->chan_combo;
 	gchar *chan = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(ccc));
 	prefs_set_channel(card, chan);
+	g_free(chan);
+
+	// capture channel, some cards have none
+	GtkWidget *cpc = dialog->capture_chan_combo;
+	chan = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(cpc));
+	if (chan)
+		prefs_set_capture_channel(card, chan);
 	g_free(card);
 	g_free(chan);
 
-	// normalize volume
-	GtkWidget *vnorm = dialog->normalize_vol_check;
-	gboolean is_pressed;
-	is_pressed = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(vnorm));
-	prefs_set_boolean("NormalizeVolume", is_pressed);
+	// microphone icon
+	GtkWidget *mic = dialog->mic_icon_check;
+	active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mic));
+	prefs_set_boolean("DisplayMicIcon", active);
+
+	// volume curve
+	GtkWidget *vcc = dialog->vol_curve_combo;
+	const gchar *curve;
+#ifdef WITH_GTK3
+	curve = gtk_combo_box_get_active_id(GTK_COMBO_BOX(vcc));
+#else
+	/* Gtk2 ComboBoxes don't have item ids */
+	curve = vol_curves[gtk_combo_box_get_active(GTK_COMBO_BOX(vcc))];
+#endif
+	prefs_set_string("VolumeCurve", curve);
 
 	// volume control command
 	GtkWidget *ve = dialog->vol_control_entry;
@@ -560,25 +743,41 @@ prefs_dialog_retrieve(PrefsDialog *dialog)
 	active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(hkc));
 	prefs_set_boolean("EnableHotKeys", active);
 
-	// hotkeys
-	GtkWidget *kl;
-	gint keycode;
-	GdkModifierType mods;
+	// hotkeys, the ones that are not in the dialog are kept
+	GPtrArray *bindings = g_ptr_array_new_with_free_func(g_free);
+	gchar **old_bindings = hotkeys_get_bindings();
+	gchar **binding;
+	guint i;
+
+	for (binding = old_bindings; *binding; binding++) {
+		HotkeyAction action;
+		GdkModifierType mods;
+		gint keycode, arg;
+
+		if (hotkeys_parse_binding(*binding, &action, &arg, &keycode, &mods) &&
+		    hotkey_label_for_action(dialog, action))
+			continue;
+
+		g_ptr_array_add(bindings, g_strdup(*binding));
+	}
+	g_strfreev(old_bindings);
+
+	for (i = 0; i < G_N_ELEMENTS(hotkey_label_actions); i++) {
+		GtkWidget *kl = hotkey_label_for_action(dialog, hotkey_label_actions[i]);
+		GdkModifierType mods;
+		gint keycode;
 
-	kl = dialog->hotkeys_mute_label;
-	get_keycode_for_label(GTK_LABEL(kl), &keycode, &mods);
-	prefs_set_integer("VolMuteKey", keycode);
-	prefs_set_integer("VolMuteMods", mods);
+		get_keycode_for_label(GTK_LABEL(kl), &keycode, &mods);
+		if (keycode < 0)
+			continue;
 
-	kl = dialog->hotkeys_up_label;
-	get_keycode_for_label(GTK_LABEL(kl), &keycode, &mods);
-	prefs_set_integer("VolUpKey", keycode);
-	prefs_set_integer("VolUpMods", mods);
+		g_ptr_array_add(bindings, hotkeys_make_binding
+		                (hotkey_label_actions[i], 0, keycode, mods));
+	}
 
-	kl = dialog->hotkeys_down_label;
-	get_keycode_for_label(GTK_LABEL(kl), &keycode, &mods);
-	prefs_set_integer("VolDownKey", keycode);
-	prefs_set_integer("VolDownMods", mods);
+	g_ptr_array_add(bindings, NULL);
+	prefs_set_string_list("HotkeyBindings", (const gchar * const *) bindings->pdata);
+	g_ptr_array_free(bindings, TRUE);
 
 	// notifications
 #ifdef HAVE_LIBN
@@ -617,7 +816,9 @@ void
 prefs_dialog_populate(PrefsDialog *dialog)
 {
 	gdouble *vol_meter_clrs;
-	gchar *slider_orientation, *vol_cmd, *custcmd;
+	gchar *slider_orientation, *vol_curve, *vol_cmd, *custcmd, *lm_source;
+	gchar **bindings, **binding;
+	guint i;
 
 	DEBUG("Populating prefs dialog values");
 
@@ -651,6 +852,13 @@ prefs_dialog_populate(PrefsDialog *dialog)
 	(GTK_COMBO_BOX(dialog->vol_pos_combo),
 	 prefs_get_integer("TextVolumePosition", 0));
 
+	// level meter source
+	lm_source = prefs_get_string("LevelMeterSource", NULL);
+	if (lm_source) {
+		gtk_entry_set_text(GTK_ENTRY(dialog->level_meter_entry), lm_source);
+		g_free(lm_source);
+	}
+
 	// volume meter display
 	gtk_toggle_button_set_active
 	(GTK_TOGGLE_BUTTON(dialog->vol_meter_draw_check),
@@ -691,6 +899,18 @@ prefs_dialog_populate(PrefsDialog *dialog)
 	(GTK_TOGGLE_BUTTON(dialog->system_theme),
 	 prefs_get_boolean("SystemTheme", FALSE));
 
+	// on-screen display
+	gtk_toggle_button_set_active
+	(GTK_TOGGLE_BUTTON(dialog->osd_enable_check),
+	 prefs_get_boolean("DisplayOSD", FALSE));
+
+	gtk_spin_button_set_value
+	(GTK_SPIN_BUTTON(dialog->osd_timeout_spin),
+	 prefs_get_integer("OSDTimeout", 1500));
+
+	on_osd_enable_check_toggled
+	(GTK_TOGGLE_BUTTON(dialog->osd_enable_check), dialog);
+
 	// fill in card & channel combo boxes
 	fill_card_combo(GTK_COMBO_BOX_TEXT(dialog->card_combo), dialog->audio);
 #ifdef GTK3
@@ -698,13 +918,32 @@ prefs_dialog_populate(PrefsDialog *dialog)
 	 * therefore we must refill channel combo explicitely.
 	 */
 	fill_chan_combo(GTK_COMBO_BOX_TEXT(dialog->chan_combo),
-	                audio_get_card(dialog->audio));
+	                audio_get_card_id(dialog->audio));
+	fill_capture_chan_combo(GTK_COMBO_BOX_TEXT(dialog->capture_chan_combo),
+	                        audio_get_card_id(dialog->audio));
 #endif
 
-	// normalize volume
+	// microphone icon
 	gtk_toggle_button_set_active
-	(GTK_TOGGLE_BUTTON(dialog->normalize_vol_check),
-	 prefs_get_boolean("NormalizeVolume", FALSE));
+	(GTK_TOGGLE_BUTTON(dialog->mic_icon_check),
+	 prefs_get_boolean("DisplayMicIcon", FALSE));
+
+	// volume curve
+	vol_curve = prefs_get_string("VolumeCurve", "alsamixer");
+	if (vol_curve) {
+		GtkComboBox *combo_box = GTK_COMBO_BOX(dialog->vol_curve_combo);
+#ifndef WITH_GTK3
+		/* Gtk2 ComboBoxes don't have item ids */
+		guint i;
+
+		for (i = 0; i < G_N_ELEMENTS(vol_curves); i++)
+			if (!strcmp(vol_curve, vol_curves[i]))
+				gtk_combo_box_set_active(combo_box, i);
+#else
+		gtk_combo_box_set_active_id(combo_box, vol_curve);
+#endif
+		g_free(vol_curve);
+	}
 
 	// volume control command
 	vol_cmd = prefs_get_string("VolumeControlCommand", NULL);
@@ -744,18 +983,24 @@ prefs_dialog_populate(PrefsDialog *dialog)
 	(GTK_TOGGLE_BUTTON(dialog->hotkeys_enable_check),
 	 prefs_get_boolean("EnableHotKeys", FALSE));
 
-	// hotkeys
-	set_label_for_keycode(GTK_LABEL(dialog->hotkeys_mute_label),
-	                      prefs_get_integer("VolMuteKey", -1),
-	                      prefs_get_integer("VolMuteMods", 0));
-
-	set_label_for_keycode(GTK_LABEL(dialog->hotkeys_up_label),
-	                      prefs_get_integer("VolUpKey", -1),
-	                      prefs_get_integer("VolUpMods", 0));
-
-	set_label_for_keycode(GTK_LABEL(dialog->hotkeys_down_label),
-	                      prefs_get_integer("VolDownKey", -1),
-	                      prefs_get_integer("VolDownMods", 0));
+	// hotkeys, the first binding of each action shows up
+	bindings = hotkeys_get_bindings();
+	for (i = 0; i < G_N_ELEMENTS(hotkey_label_actions); i++) {
+		GtkWidget *kl = hotkey_label_for_action(dialog, hotkey_label_actions[i]);
+
+		for (binding = bindings; *binding; binding++) {
+			HotkeyAction action;
+			GdkModifierType mods;
+			gint keycode, arg;
+
+			if (hotkeys_parse_binding(*binding, &action, &arg, &keycode, &mods) &&
+			    action == hotkey_label_actions[i]) {
+				set_label_for_keycode(GTK_LABEL(kl), keycode, mods);
+				break;
+			}
+		}
+	}
+	g_strfreev(bindings);
 
 	on_hotkeys_enable_check_toggled
 	(GTK_TOGGLE_BUTTON(dialog->hotkeys_enable_check), dialog);
@@ -877,6 +1122,7 @@ prefs_dialog_create(GtkWindow *parent, Audio *audio, Hotkeys *hotkeys,
 	assign_gtk_widget(builder, dialog, vol_text_check);
 	assign_gtk_widget(builder, dialog, vol_pos_label);
 	assign_gtk_widget(builder, dialog, vol_pos_combo);
+	assign_gtk_widget(builder, dialog, level_meter_entry);
 	assign_gtk_widget(builder, dialog, vol_meter_draw_check);
 	assign_gtk_widget(builder, dialog, vol_meter_pos_label);
 	assign_gtk_widget(builder, dialog, vol_meter_pos_spin);
@@ -884,10 +1130,15 @@ prefs_dialog_create(GtkWindow *parent, Audio *audio, Hotkeys *hotkeys,
 	assign_gtk_widget(builder, dialog, vol_meter_color_label);
 	assign_gtk_widget(builder, dialog, vol_meter_color_button);
 	assign_gtk_widget(builder, dialog, system_theme);
+	assign_gtk_widget(builder, dialog, osd_enable_check);
+	assign_gtk_widget(builder, dialog, osd_timeout_label);
+	assign_gtk_widget(builder, dialog, osd_timeout_spin);
 	// Device panel
 	assign_gtk_widget(builder, dialog, card_combo);
 	assign_gtk_widget(builder, dialog, chan_combo);
-	assign_gtk_widget(builder, dialog, normalize_vol_check);
+	assign_gtk_widget(builder, dialog, vol_curve_combo);
+	assign_gtk_widget(builder, dialog, mic_icon_check);
+	assign_gtk_widget(builder, dialog, capture_chan_combo);
 	// Behavior panel
 	assign_gtk_widget(builder, dialog, vol_control_entry);
 	assign_gtk_widget(builder, dialog, scroll_step_spin);
@@ -904,6 +1155,8 @@ prefs_dialog_create(GtkWindow *parent, Audio *audio, Hotkeys *hotkeys,
 	assign_gtk_widget(builder, dialog, hotkeys_up_label);
 	assign_gtk_widget(builder, dialog, hotkeys_down_eventbox);
 	assign_gtk_widget(builder, dialog, hotkeys_down_label);
+	assign_gtk_widget(builder, dialog, hotkeys_mic_mute_eventbox);
+	assign_gtk_widget(builder, dialog, hotkeys_mic_mute_label);
 	// Notifications panel
 #ifdef HAVE_LIBN
 	assign_gtk_widget(builder, dialog, noti_vbox_enabled);
@@ -507,6 +507,19 @@ static void
 on_audio_changed(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
 {
 	TrayIcon *icon = (TrayIcon *) data;
+
+	/* Only the playback of the hooked card matters here */
+	switch (event->signal) {
+	case AUDIO_OUTPUTS_CHANGED:
+	case AUDIO_CAPTURE_CHANGED:
+	case AUDIO_STREAM_ADDED:
+	case AUDIO_STREAM_CHANGED:
+	case AUDIO_STREAM_REMOVED:
+		return;
+	default:
+		break;
+	}
+
 	update_status_icon_pixbuf(icon->status_icon, icon->pixbufs, icon->vol_meter,
 	                          event->volume, event->muted);
 	update_status_icon_tooltip(icon->status_icon, event->card, event->channel,
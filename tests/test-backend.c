@@ -0,0 +1,329 @@
+/* test-backend.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-backend.c
+ * Tests for the audio system, on top of the mock backend: switching
+ * backends and cards, volume round trips, changes made by others, and
+ * the playback streams of applications.
+ * @brief Audio system tests.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <glib.h>
+
+#include "audio.h"
+#include "backend.h"
+#include "test-support.h"
+
+#define TEST_PREFS "[PNMixer]\n\
+AlsaCard=Mock\n\
+VolumeCurve=alsamixer\n"
+
+#define TEST_EPSILON 1e-6
+#define TEST_TIMEOUT 2000	/* ms */
+
+static Audio *
+audio_setup(TestEvents *events)
+{
+	Audio *audio;
+
+	test_prefs_load(TEST_PREFS);
+
+	audio = audio_new();
+	test_events_connect(audio, events);
+	audio_reload(audio);
+
+	return audio;
+}
+
+static void
+audio_teardown(Audio *audio, TestEvents *events)
+{
+	test_events_disconnect(audio, events);
+	audio_free(audio);
+}
+
+/* Unknown backends are refused, and the current one is kept. The mock
+ * backend then provides its cards to the audio system.
+ */
+static void
+test_backend_switch(void)
+{
+	TestEvents events;
+	Audio *audio;
+	GSList *cards;
+
+	g_assert_true(backend_get() == &alsa_backend);
+	g_assert_false(backend_select("nosuchbackend"));
+	g_assert_true(backend_get() == &alsa_backend);
+
+	g_assert_true(backend_select("mock"));
+	g_assert_true(backend_get() == &mock_backend);
+
+	/* A script that can't be read is an error */
+	g_assert_false(backend_select("mock:/nonexistent/script"));
+	g_assert_true(backend_get() == &mock_backend);
+
+	cards = audio_get_card_list();
+	g_assert_cmpuint(g_slist_length(cards), ==, 2);
+	g_assert_cmpstr(cards->data, ==, "Mock");
+	g_assert_cmpstr(cards->next->data, ==, "MockUSB");
+	g_slist_free_full(cards, g_free);
+
+	audio = audio_setup(&events);
+	g_assert_cmpuint(events.count[AUDIO_CARD_INITIALIZED], ==, 1);
+	g_assert_cmpstr(audio_get_card_id(audio), ==, "Mock");
+	g_assert_cmpstr(audio_get_channel(audio), ==, "Master");
+
+	/* Switching cards hooks the new one right away */
+	audio_switch_card(audio, "MockUSB");
+	g_assert_cmpuint(events.count[AUDIO_CARD_INITIALIZED], ==, 2);
+	g_assert_cmpstr(audio_get_card_id(audio), ==, "MockUSB");
+	g_assert_cmpstr(audio_get_card(audio), ==, "Mock USB Headset");
+	g_assert_cmpstr(audio_get_channel(audio), ==, "PCM");
+
+	audio_switch_card(audio, "Mock");
+	g_assert_cmpuint(events.count[AUDIO_CARD_INITIALIZED], ==, 3);
+	g_assert_cmpstr(audio_get_card_id(audio), ==, "Mock");
+
+	audio_teardown(audio, &events);
+}
+
+/* Every volume must be rounded in the direction of the change, and
+ * reading a volume then writing it back must not move the element.
+ * Changes are signalled once, by us: the echoes of the backend must
+ * not come back as changes made by someone else.
+ */
+static void
+test_volume_round_trip(void)
+{
+	TestEvents events;
+	Audio *audio;
+	guint changes = 0;
+	int i, dir;
+
+	g_assert_true(backend_select("mock"));
+	audio = audio_setup(&events);
+	test_events_reset(&events);
+
+	for (dir = -1; dir <= 1; dir++) {
+		for (i = 0; i <= 100; i++) {
+			gdouble before, volume;
+
+			before = audio_get_volume(audio);
+			audio_set_volume(audio, AUDIO_USER_POPUP, i, dir);
+			volume = audio_get_volume(audio);
+			if (volume != before)
+				changes++;
+
+			if (dir > 0)
+				g_assert_cmpfloat(volume, >=, i - TEST_EPSILON);
+			else if (dir < 0)
+				g_assert_cmpfloat(volume, <=, i + TEST_EPSILON);
+			g_assert_cmpfloat(volume, >=, 0);
+			g_assert_cmpfloat(volume, <=, 100);
+
+			/* Write back what we read */
+			audio_set_volume(audio, AUDIO_USER_POPUP, volume, 0);
+			g_assert_cmpfloat(fabs(audio_get_volume(audio) - volume), <,
+			                  TEST_EPSILON);
+
+			/* Let the echoes come back */
+			test_run_for(1);
+		}
+	}
+
+	test_run_for(50);
+
+	g_assert_cmpuint(events.changes[AUDIO_USER_POPUP], ==, changes);
+	g_assert_cmpuint(events.changes[AUDIO_USER_UNKNOWN], ==, 0);
+	g_assert_cmpuint(events.count[AUDIO_VALUES_CHANGED], ==, changes);
+
+	/* The last event has the volume we read */
+	g_assert_cmpfloat(fabs(events.last_change.volume - audio_get_volume(audio)),
+	                  <, TEST_EPSILON);
+	g_assert_false(events.last_change.muted);
+
+	audio_teardown(audio, &events);
+}
+
+static gboolean
+is_muted_by_others(gpointer data)
+{
+	TestEvents *events = data;
+
+	return events->changes[AUDIO_USER_UNKNOWN] > 0 &&
+	       events->last_change.muted;
+}
+
+/* Changes made by others, here by a script, are signalled after
+ * the latency of the backend.
+ */
+static void
+test_external_changes(void)
+{
+	static const gchar *script = "\
+0 latency 20\n\
+10 volume Mock Master 25\n\
+60 mute Mock Master on\n\
+100 mute Mock Master off\n";
+	GError *error = NULL;
+	TestEvents events;
+	gchar *filename, *spec;
+	gint64 start;
+	Audio *audio;
+
+	filename = g_build_filename(test_get_tmp_dir(), "script", NULL);
+	g_file_set_contents(filename, script, -1, &error);
+	g_assert_no_error(error);
+
+	audio = audio_setup(&events);
+	test_events_reset(&events);
+
+	start = g_get_monotonic_time();
+	spec = g_strdup_printf("mock:%s", filename);
+	g_assert_true(backend_select(spec));
+
+	g_assert_true(test_run_until(is_muted_by_others, &events, TEST_TIMEOUT));
+	g_assert_cmpint(g_get_monotonic_time() - start, >=, 80 * 1000);
+	g_assert_true(audio_is_muted(audio));
+	g_assert_cmpfloat(fabs(events.last_change.volume - audio_get_volume(audio)),
+	                  <, TEST_EPSILON);
+	g_assert_cmpuint(events.changes[AUDIO_USER_UNKNOWN], ==,
+	                 events.count[AUDIO_VALUES_CHANGED]);
+	g_assert_cmpuint(events.count[AUDIO_OUTPUTS_CHANGED], >, 0);
+
+	/* Leave the mixer like we found it */
+	test_run_for(150);
+	g_assert_false(audio_is_muted(audio));
+
+	audio_teardown(audio, &events);
+	g_free(spec);
+	g_free(filename);
+}
+
+struct stream_wait {
+	TestEvents *events;
+	AudioSignal signal;
+	guint count;
+};
+
+static gboolean
+is_stream_signalled(gpointer data)
+{
+	struct stream_wait *wait = data;
+
+	return wait->events->count[wait->signal] >= wait->count;
+}
+
+static void
+wait_for_stream(TestEvents *events, AudioSignal signal, guint count)
+{
+	struct stream_wait wait = { events, signal, count };
+
+	g_assert_true(test_run_until(is_stream_signalled, &wait, TEST_TIMEOUT));
+}
+
+/* Streams changed by others are signalled one at a time, after the
+ * latency of the backend. Our own writes are signalled once, right
+ * away, and are not echoed.
+ */
+static void
+test_streams(void)
+{
+	static const gchar *script = "\
+0 latency 10\n\
+0 stream add 1 Music audio-x-generic\n\
+0 stream add 2 \"Web Browser\"\n\
+20 stream volume 1 25\n\
+40 stream mute 2 on\n\
+60 stream remove 2\n";
+	GError *error = NULL;
+	TestEvents events;
+	gchar *filename, *spec;
+	AudioStream *stream;
+	GSList *list;
+	Audio *audio;
+
+	filename = g_build_filename(test_get_tmp_dir(), "streams", NULL);
+	g_file_set_contents(filename, script, -1, &error);
+	g_assert_no_error(error);
+
+	spec = g_strdup_printf("mock:%s", filename);
+	g_assert_true(backend_select(spec));
+	audio = audio_setup(&events);
+	g_assert_true(audio_has_streams(audio));
+	g_assert_null(audio_get_streams(audio));
+
+	wait_for_stream(&events, AUDIO_STREAM_ADDED, 2);
+	g_assert_cmpuint(events.last_stream_id, ==, 2);
+	g_assert_cmpuint(events.count[AUDIO_STREAM_CHANGED], ==, 0);
+
+	wait_for_stream(&events, AUDIO_STREAM_CHANGED, 1);
+	g_assert_cmpuint(events.last_stream_id, ==, 1);
+	wait_for_stream(&events, AUDIO_STREAM_CHANGED, 2);
+	g_assert_cmpuint(events.last_stream_id, ==, 2);
+
+	wait_for_stream(&events, AUDIO_STREAM_REMOVED, 1);
+	g_assert_cmpuint(events.last_stream_id, ==, 2);
+	g_assert_cmpuint(events.count[AUDIO_STREAM_ADDED], ==, 2);
+	g_assert_cmpuint(events.count[AUDIO_STREAM_CHANGED], ==, 2);
+
+	list = audio_get_streams(audio);
+	g_assert_cmpuint(g_slist_length(list), ==, 1);
+	stream = list->data;
+	g_assert_cmpuint(stream->id, ==, 1);
+	g_assert_cmpstr(stream->name, ==, "Music");
+	g_assert_cmpstr(stream->icon, ==, "audio-x-generic");
+	g_assert_cmpfloat(fabs(stream->volume - 25), <, TEST_EPSILON);
+	g_assert_false(stream->muted);
+	g_slist_free_full(list, g_free);
+
+	/* Round trip, the write is signalled once */
+	test_events_reset(&events);
+	audio_set_stream_volume(audio, AUDIO_USER_POPUP, 1, 60);
+	audio_toggle_stream_mute(audio, AUDIO_USER_POPUP, 1);
+	g_assert_cmpuint(events.count[AUDIO_STREAM_CHANGED], ==, 2);
+	g_assert_cmpuint(events.last_stream_id, ==, 1);
+
+	/* A stream that's gone is left alone */
+	audio_set_stream_volume(audio, AUDIO_USER_POPUP, 2, 60);
+	audio_toggle_stream_mute(audio, AUDIO_USER_POPUP, 2);
+	test_run_for(50);
+	g_assert_cmpuint(events.count[AUDIO_STREAM_CHANGED], ==, 2);
+
+	list = audio_get_streams(audio);
+	stream = list->data;
+	g_assert_cmpfloat(fabs(stream->volume - 60), <, TEST_EPSILON);
+	g_assert_true(stream->muted);
+	g_slist_free_full(list, g_free);
+
+	audio_teardown(audio, &events);
+	g_free(spec);
+	g_free(filename);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_support_init(&argc, &argv);
+
+	g_test_add_func("/backend/switch", test_backend_switch);
+	g_test_add_func("/backend/volume-round-trip", test_volume_round_trip);
+	g_test_add_func("/backend/external-changes", test_external_changes);
+	g_test_add_func("/backend/streams", test_streams);
+
+	return g_test_run();
+}
@@ -0,0 +1,259 @@
+/* test-level-meter.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-level-meter.c
+ * Tests for the level meter: the levels of known sines, computed
+ * directly and read back from a WAV file by the capture thread, and
+ * the triple buffer between the capture thread and the UI.
+ * The level computation and the triple buffer are static, so
+ * level-meter.c is included right here.
+ * @brief Level meter tests.
+ */
+
+#include "../src/level-meter.c"
+
+#include "test-support.h"
+
+#define SINE_FREQ     1000	/* Hz, a period holds a whole number of cycles */
+#define SINE_FRAMES   LEVEL_METER_PERIOD
+#define TEST_EPSILON  1e-3
+#define TEST_TIMEOUT  2000	/* ms */
+#define RACE_DURATION 500	/* ms */
+
+static const gdouble amplitudes[] = { 0, 0.25, 0.5, 1 };
+
+/* Fill a stereo buffer with a sine, return its peak sample */
+static gint
+sine_fill(gint16 *samples, gsize frames, gdouble amplitude)
+{
+	gint peak = 0;
+	gsize i;
+
+	for (i = 0; i < frames; i++) {
+		gint16 v = lrint(amplitude * 32767 *
+		                 sin(2 * G_PI * SINE_FREQ * i / LEVEL_METER_RATE));
+
+		samples[2 * i] = samples[2 * i + 1] = v;
+		peak = MAX(peak, ABS(v));
+	}
+
+	return peak;
+}
+
+/* The peak is the loudest sample, the RMS level of a sine is its
+ * amplitude divided by the square root of 2.
+ */
+static void
+test_sine(void)
+{
+	gint16 samples[SINE_FRAMES * 2];
+	guint a;
+
+	for (a = 0; a < G_N_ELEMENTS(amplitudes); a++) {
+		gdouble amplitude = amplitudes[a];
+		gint peak, expected_peak;
+		gint64 sum, expected_sum = 0;
+		Level level;
+		guint i;
+
+		expected_peak = sine_fill(samples, SINE_FRAMES, amplitude);
+		for (i = 0; i < G_N_ELEMENTS(samples); i++)
+			expected_sum += samples[i] * samples[i];
+
+		level_compute(samples, G_N_ELEMENTS(samples), &peak, &sum);
+		g_assert_cmpint(peak, ==, expected_peak);
+		g_assert_cmpint(sum, ==, expected_sum);
+
+		level_from_samples(&level, samples, G_N_ELEMENTS(samples));
+		g_assert_cmpfloat(fabs(level.peak - amplitude), <, TEST_EPSILON);
+		g_assert_cmpfloat(fabs(level.rms - amplitude / G_SQRT2), <,
+		                  TEST_EPSILON);
+	}
+
+	/* Full scale negative samples don't overflow */
+	for (a = 0; a < G_N_ELEMENTS(samples); a++)
+		samples[a] = G_MININT16;
+	{
+		Level level;
+
+		level_from_samples(&level, samples, G_N_ELEMENTS(samples));
+		g_assert_cmpfloat(level.peak, ==, 1);
+		g_assert_cmpfloat(level.rms, ==, 1);
+	}
+}
+
+static void
+put_le16(FILE *file, guint16 value)
+{
+	fputc(value & 0xff, file);
+	fputc(value >> 8, file);
+}
+
+static void
+put_le32(FILE *file, guint32 value)
+{
+	put_le16(file, value & 0xffff);
+	put_le16(file, value >> 16);
+}
+
+/* Write a second of a stereo sine to a WAV file */
+static gchar *
+sine_write_wav(gdouble amplitude)
+{
+	guint32 frames = LEVEL_METER_RATE, size = frames * 2 * sizeof(gint16);
+	gint16 *samples;
+	gchar *filename;
+	FILE *file;
+	guint32 i;
+
+	filename = g_build_filename(test_get_tmp_dir(), "sine.wav", NULL);
+	file = fopen(filename, "wb");
+	g_assert_nonnull(file);
+
+	fwrite("RIFF", 1, 4, file);
+	put_le32(file, 36 + size);
+	fwrite("WAVEfmt ", 1, 8, file);
+	put_le32(file, 16);
+	put_le16(file, 1);                     /* PCM */
+	put_le16(file, 2);                     /* Channels */
+	put_le32(file, LEVEL_METER_RATE);
+	put_le32(file, LEVEL_METER_RATE * 4);  /* Bytes per second */
+	put_le16(file, 4);                     /* Bytes per frame */
+	put_le16(file, 16);                    /* Bits per sample */
+	fwrite("data", 1, 4, file);
+	put_le32(file, size);
+
+	samples = g_new(gint16, frames * 2);
+	sine_fill(samples, frames, amplitude);
+	for (i = 0; i < frames * 2; i++)
+		put_le16(file, samples[i]);
+	g_free(samples);
+
+	g_assert_cmpint(fclose(file), ==, 0);
+
+	return filename;
+}
+
+/* The capture thread reads a WAV file, and publishes the same levels */
+static void
+test_wav(void)
+{
+	LevelMeter *meter;
+	gchar *filename;
+	gdouble peak = 0, rms = 0;
+	gint64 deadline;
+	gboolean fresh = FALSE;
+
+	filename = sine_write_wav(0.5);
+
+	meter = level_meter_new();
+	g_assert_true(level_meter_start(meter, filename));
+
+	deadline = g_get_monotonic_time() + TEST_TIMEOUT * 1000;
+	while (!fresh && g_get_monotonic_time() < deadline) {
+		fresh = level_meter_get_levels(meter, &peak, &rms);
+		if (!fresh)
+			g_usleep(1000);
+	}
+
+	g_assert_true(fresh);
+	g_assert_cmpfloat(fabs(peak - 0.5), <, TEST_EPSILON);
+	g_assert_cmpfloat(fabs(rms - 0.5 / G_SQRT2), <, TEST_EPSILON);
+
+	level_meter_free(meter);
+	g_free(filename);
+}
+
+/* Triple buffer */
+
+static gint publisher_stop;
+static gint published;
+
+/* Publish as fast as possible, each slot holding the same value twice */
+static gpointer
+publisher_thread(LevelMeter *meter)
+{
+	gint i;
+
+	for (i = 1; !g_atomic_int_get(&publisher_stop); i++) {
+		Level *slot = &meter->slots[meter->back];
+
+		slot->peak = i;
+		slot->rms = i;
+		level_meter_publish(meter);
+	}
+
+	published = i - 1;
+
+	return NULL;
+}
+
+/* The reader must never see a slot that's being written, which would
+ * show up as a peak that differs from the RMS level. It must never go
+ * back in time either, and it must end up with the last levels.
+ */
+static void
+test_triple_buffer(void)
+{
+	LevelMeter *meter;
+	GThread *thread;
+	gdouble peak, rms, last = 0;
+	guint torn = 0, backwards = 0, fresh = 0;
+	gint64 deadline;
+
+	meter = level_meter_new();
+	meter->front = 0;
+	meter->middle = 1;
+	meter->back = 2;
+
+	publisher_stop = FALSE;
+	thread = g_thread_new("publisher", (GThreadFunc) publisher_thread, meter);
+
+	deadline = g_get_monotonic_time() + RACE_DURATION * 1000;
+	while (g_get_monotonic_time() < deadline) {
+		if (level_meter_get_levels(meter, &peak, &rms))
+			fresh++;
+		if (peak != rms)
+			torn++;
+		if (peak < last)
+			backwards++;
+		last = peak;
+	}
+
+	g_atomic_int_set(&publisher_stop, TRUE);
+	g_thread_join(thread);
+
+	g_test_message("%u fresh levels read out of %d", fresh, published);
+	g_assert_cmpuint(fresh, >, 0);
+	g_assert_cmpuint(torn, ==, 0);
+	g_assert_cmpuint(backwards, ==, 0);
+
+	level_meter_get_levels(meter, &peak, &rms);
+	g_assert_cmpfloat(peak, ==, published);
+	g_assert_cmpfloat(rms, ==, published);
+
+	/* Nothing new since */
+	g_assert_false(level_meter_get_levels(meter, &peak, &rms));
+
+	level_meter_free(meter);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_support_init(&argc, &argv);
+
+	g_test_add_func("/level-meter/sine", test_sine);
+	g_test_add_func("/level-meter/wav", test_wav);
+	g_test_add_func("/level-meter/triple-buffer", test_triple_buffer);
+
+	return g_test_run();
+}
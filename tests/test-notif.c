@@ -0,0 +1,315 @@
+/* test-notif.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-notif.c
+ * Tests for the notifications, on top of the mock backend. A private
+ * dbus-daemon is started, and the test itself plays the notification
+ * daemon on it. The tests are skipped if dbus-daemon is not installed.
+ * @brief Notifications tests.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "audio.h"
+#include "backend.h"
+#include "notif.h"
+#include "test-support.h"
+
+#define NOTIFY_NAME  "org.freedesktop.Notifications"
+#define NOTIFY_PATH  "/org/freedesktop/Notifications"
+
+#define TEST_PREFS "[PNMixer]\n\
+AlsaCard=Mock\n\
+VolumeCurve=alsamixer\n\
+EnableNotifications=true\n\
+HotkeyNotifications=true\n\
+NotificationMinInterval=0\n"
+
+#define TEST_TIMEOUT 5000	/* ms */
+#define TEST_CHANGES 100
+
+static const gchar introspection_xml[] =
+	"<node>"
+	"  <interface name='org.freedesktop.Notifications'>"
+	"    <method name='Notify'>"
+	"      <arg type='s' name='app_name' direction='in'/>"
+	"      <arg type='u' name='replaces_id' direction='in'/>"
+	"      <arg type='s' name='app_icon' direction='in'/>"
+	"      <arg type='s' name='summary' direction='in'/>"
+	"      <arg type='s' name='body' direction='in'/>"
+	"      <arg type='as' name='actions' direction='in'/>"
+	"      <arg type='a{sv}' name='hints' direction='in'/>"
+	"      <arg type='i' name='expire_timeout' direction='in'/>"
+	"      <arg type='u' name='id' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+/*
+ * Notification daemon.
+ * It only records the calls, and the volume hint of the last one.
+ */
+
+struct notify_server {
+	GDBusConnection *connection;
+	GDBusNodeInfo *info;
+	guint registration;
+	guint calls;
+	gint last_value;
+};
+
+typedef struct notify_server NotifyServer;
+
+static void
+on_method_call(G_GNUC_UNUSED GDBusConnection *connection,
+               G_GNUC_UNUSED const gchar *sender,
+               G_GNUC_UNUSED const gchar *path,
+               G_GNUC_UNUSED const gchar *iface,
+               G_GNUC_UNUSED const gchar *method,
+               GVariant *params, GDBusMethodInvocation *invocation,
+               gpointer data)
+{
+	NotifyServer *server = data;
+	GVariant *hints;
+	guint32 id;
+
+	g_variant_get_child(params, 1, "u", &id);
+	hints = g_variant_get_child_value(params, 6);
+	if (!g_variant_lookup(hints, "value", "i", &server->last_value))
+		server->last_value = -1;
+	g_variant_unref(hints);
+
+	server->calls++;
+	g_dbus_method_invocation_return_value(invocation,
+	                                      g_variant_new("(u)", id ? id : 1));
+}
+
+static const GDBusInterfaceVTable vtable = { on_method_call, NULL, NULL };
+
+static void
+notify_server_start(NotifyServer *server)
+{
+	GError *error = NULL;
+	GVariant *reply;
+	guint32 result;
+
+	/* Ours is the connection that notif will share */
+	server->connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+	g_assert_no_error(error);
+
+	/* Don't exit when the daemon is killed at the end */
+	g_dbus_connection_set_exit_on_close(server->connection, FALSE);
+
+	server->info = g_dbus_node_info_new_for_xml(introspection_xml, &error);
+	g_assert_no_error(error);
+
+	server->registration = g_dbus_connection_register_object
+	                       (server->connection, NOTIFY_PATH,
+	                        server->info->interfaces[0], &vtable,
+	                        server, NULL, &error);
+	g_assert_no_error(error);
+
+	reply = g_dbus_connection_call_sync(server->connection,
+	                                    "org.freedesktop.DBus",
+	                                    "/org/freedesktop/DBus",
+	                                    "org.freedesktop.DBus", "RequestName",
+	                                    g_variant_new("(su)", NOTIFY_NAME, 4),
+	                                    G_VARIANT_TYPE("(u)"),
+	                                    G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+	                                    &error);
+	g_assert_no_error(error);
+	g_variant_get(reply, "(u)", &result);
+	g_assert_cmpuint(result, ==, 1); /* Primary owner */
+	g_variant_unref(reply);
+}
+
+static void
+notify_server_stop(NotifyServer *server)
+{
+	g_dbus_connection_unregister_object(server->connection,
+	                                    server->registration);
+	g_dbus_node_info_unref(server->info);
+	g_object_unref(server->connection);
+}
+
+/*
+ * Message bus.
+ */
+
+static GPid bus_pid;
+
+static gboolean
+file_exists(gpointer data)
+{
+	return g_file_test(data, G_FILE_TEST_EXISTS);
+}
+
+/* Start a session bus on a private socket, and make it ours */
+static gboolean
+bus_start(void)
+{
+	GError *error = NULL;
+	gchar *dbus_daemon, *socket, *address, *address_arg;
+	gboolean started;
+
+	dbus_daemon = g_find_program_in_path("dbus-daemon");
+	if (dbus_daemon == NULL)
+		return FALSE;
+
+	socket = g_build_filename(test_get_tmp_dir(), "bus", NULL);
+	address = g_strdup_printf("unix:path=%s", socket);
+	address_arg = g_strconcat("--address=", address, NULL);
+
+	{
+		gchar *argv[] = {
+			dbus_daemon, "--session", "--nofork", address_arg, NULL
+		};
+
+		started = g_spawn_async(NULL, argv, NULL,
+		                        G_SPAWN_DO_NOT_REAP_CHILD |
+		                        G_SPAWN_STDERR_TO_DEV_NULL,
+		                        NULL, NULL, &bus_pid, &error);
+	}
+
+	g_assert_no_error(error);
+	g_assert_true(started);
+	g_assert_true(test_run_until(file_exists, socket, TEST_TIMEOUT));
+
+	g_setenv("DBUS_SESSION_BUS_ADDRESS", address, TRUE);
+
+	g_free(address_arg);
+	g_free(address);
+	g_free(socket);
+	g_free(dbus_daemon);
+
+	return TRUE;
+}
+
+static void
+bus_stop(void)
+{
+	kill(bus_pid, SIGCONT);
+	kill(bus_pid, SIGTERM);
+	waitpid(bus_pid, NULL, 0);
+	g_spawn_close_pid(bus_pid);
+}
+
+struct calls_wait {
+	NotifyServer *server;
+	guint calls;
+	gint value;
+};
+
+static gboolean
+is_notified(gpointer data)
+{
+	struct calls_wait *wait = data;
+
+	return wait->server->calls >= wait->calls &&
+	       wait->server->last_value == wait->value;
+}
+
+static void
+wait_for_notification(NotifyServer *server, guint calls, gint value)
+{
+	struct calls_wait wait = { server, calls, value };
+
+	g_assert_true(test_run_until(is_notified, &wait, TEST_TIMEOUT));
+}
+
+/* While the bus is stalled, volume changes must still take effect
+ * right away, and the main loop must keep running. Notifications
+ * can't get through, they're coalesced, and the latest one is sent
+ * once the bus is back.
+ */
+static void
+test_stalled_bus(void)
+{
+	NotifyServer server = { 0 };
+	Audio *audio;
+	Notif *notif;
+	gdouble volume;
+	gint64 start, elapsed;
+	guint calls, i;
+
+	if (!bus_start()) {
+		g_test_skip("dbus-daemon is not installed");
+		return;
+	}
+	notify_server_start(&server);
+
+	g_assert_true(backend_select("mock"));
+	test_prefs_load(TEST_PREFS);
+	audio = audio_new();
+	audio_reload(audio);
+	notif = notif_new(audio);
+
+	/* The bus works */
+	audio_set_volume(audio, AUDIO_USER_HOTKEYS, 50, 0);
+	volume = audio_get_volume(audio);
+	wait_for_notification(&server, 1, lround(volume));
+
+	/* Let the reply come back */
+	test_run_for(100);
+	calls = server.calls;
+
+	kill(bus_pid, SIGSTOP);
+
+	start = g_get_monotonic_time();
+	for (i = 0; i < TEST_CHANGES; i++) {
+		gdouble wanted = 20 + i % 60;
+
+		audio_set_volume(audio, AUDIO_USER_HOTKEYS, wanted, 1);
+		volume = audio_get_volume(audio);
+		g_assert_cmpfloat(volume, >=, wanted - 1e-6);
+		g_assert_cmpfloat(volume, <, wanted + 5);
+	}
+	elapsed = g_get_monotonic_time() - start;
+	g_test_message("%u changes on a stalled bus: %" G_GINT64_FORMAT " us",
+	               TEST_CHANGES, elapsed);
+	g_assert_cmpint(elapsed, <, 500 * 1000);
+
+	/* Nothing gets through, yet the main loop runs */
+	test_run_for(200);
+	g_assert_cmpuint(server.calls, ==, calls);
+	g_assert_cmpfloat(audio_get_volume(audio), ==, volume);
+
+	kill(bus_pid, SIGCONT);
+
+	/* The request stuck in flight, then the latest volume */
+	wait_for_notification(&server, calls + 1, lround(volume));
+	test_run_for(200);
+	g_assert_cmpuint(server.calls - calls, <=, 2);
+	g_assert_cmpint(server.last_value, ==, lround(volume));
+
+	notif_free(notif);
+	audio_free(audio);
+	notify_server_stop(&server);
+	bus_stop();
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_support_init(&argc, &argv);
+
+	g_test_add_func("/notif/stalled-bus", test_stalled_bus);
+
+	return g_test_run();
+}
@@ -0,0 +1,227 @@
+/* test-pulse.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-pulse.c
+ * Tests for the PulseAudio backend, against a private server with
+ * a null sink. Changes made by others are made with pactl. The tests
+ * are skipped if pulseaudio or pactl are not installed.
+ * @brief PulseAudio backend tests.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <glib.h>
+
+#include "audio.h"
+#include "backend.h"
+#include "test-support.h"
+
+#define TEST_SINK    "pnmixer_test"
+#define TEST_EPSILON 0.01	/* Percent, the server has 65536 steps */
+#define TEST_TIMEOUT 5000	/* ms */
+
+#define TEST_PREFS "[PNMixer]\n\
+AlsaCard=(default)\n"
+
+static GPid server_pid;
+static gchar *server_address;
+
+static gboolean
+file_exists(gpointer data)
+{
+	return g_file_test(data, G_FILE_TEST_EXISTS);
+}
+
+/* Start a server with a single null sink, listening on a private socket */
+static gboolean
+server_start(void)
+{
+	GError *error = NULL;
+	gchar *pulseaudio, *socket, *protocol, *sink;
+	gboolean started;
+
+	pulseaudio = g_find_program_in_path("pulseaudio");
+	if (pulseaudio == NULL)
+		return FALSE;
+
+	socket = g_build_filename(test_get_tmp_dir(), "pulse-native", NULL);
+	protocol = g_strdup_printf("module-native-protocol-unix auth-anonymous=1 "
+	                           "socket=%s", socket);
+	sink = g_strdup_printf("module-null-sink sink_name=%s", TEST_SINK);
+
+	{
+		gchar *argv[] = {
+			pulseaudio, "-n", "--daemonize=no", "--exit-idle-time=-1",
+			"--use-pid-file=no", "--disable-shm", "--log-level=error",
+			"-L", protocol, "-L", sink, NULL
+		};
+
+		started = g_spawn_async(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+		                        NULL, NULL, &server_pid, &error);
+	}
+
+	g_assert_no_error(error);
+	g_assert_true(started);
+	g_assert_true(test_run_until(file_exists, socket, TEST_TIMEOUT));
+
+	server_address = g_strdup_printf("unix:%s", socket);
+
+	g_free(sink);
+	g_free(protocol);
+	g_free(socket);
+	g_free(pulseaudio);
+
+	return TRUE;
+}
+
+static void
+server_stop(void)
+{
+	kill(server_pid, SIGTERM);
+	waitpid(server_pid, NULL, 0);
+	g_spawn_close_pid(server_pid);
+	g_free(server_address);
+}
+
+/* Change the sink behind our back */
+static void
+pactl(const gchar *command, const gchar *value)
+{
+	GError *error = NULL;
+	gchar *server;
+	gint status;
+
+	server = g_strdup_printf("--server=%s", server_address);
+
+	{
+		gchar *argv[] = {
+			"pactl", server, (gchar *) command, TEST_SINK, (gchar *) value, NULL
+		};
+
+		g_spawn_sync(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL,
+		             NULL, NULL, &status, &error);
+	}
+
+	g_assert_no_error(error);
+	g_assert_cmpint(status, ==, 0);
+	g_free(server);
+}
+
+struct change {
+	TestEvents *events;
+	gdouble volume;
+	gboolean muted;
+};
+
+static gboolean
+is_changed_by_others(gpointer data)
+{
+	struct change *change = data;
+	TestEvents *events = change->events;
+
+	return events->changes[AUDIO_USER_UNKNOWN] > 0 &&
+	       fabs(events->last_change.volume - change->volume) < TEST_EPSILON &&
+	       events->last_change.muted == change->muted;
+}
+
+static void
+wait_for_change(TestEvents *events, gdouble volume, gboolean muted)
+{
+	struct change change = { events, volume, muted };
+
+	g_assert_true(test_run_until(is_changed_by_others, &change, TEST_TIMEOUT));
+	test_events_reset(events);
+}
+
+/* Our writes must reach the server, and its changes must reach us */
+static void
+test_round_trip(void)
+{
+	static const gdouble volumes[] = { 0, 10, 37, 50, 99.5, 100, 64 };
+	TestEvents events;
+	Audio *audio;
+	gchar *spec, *pactl_path;
+	GSList *cards;
+	guint i;
+
+	pactl_path = g_find_program_in_path("pactl");
+	if (pactl_path == NULL || !server_start()) {
+		g_test_skip("pulseaudio or pactl is not installed");
+		g_free(pactl_path);
+		return;
+	}
+	g_free(pactl_path);
+
+	spec = g_strdup_printf("pulse:%s", server_address);
+	g_assert_true(backend_select(spec));
+	g_assert_true(backend_get() == &pulse_backend);
+
+	/* The default sink comes first */
+	cards = audio_get_card_list();
+	g_assert_cmpuint(g_slist_length(cards), >=, 2);
+	g_assert_cmpstr(cards->data, ==, "(default)");
+	g_assert_nonnull(g_slist_find_custom(cards, TEST_SINK, (GCompareFunc) g_strcmp0));
+	g_slist_free_full(cards, g_free);
+
+	test_prefs_load(TEST_PREFS);
+	audio = audio_new();
+	test_events_connect(audio, &events);
+	audio_reload(audio);
+	g_assert_cmpstr(audio_get_card_id(audio), ==, "(default)");
+
+	/* Writes are cached until they're sent, the echoes mustn't
+	 * bring back an older volume.
+	 */
+	for (i = 0; i < G_N_ELEMENTS(volumes); i++) {
+		audio_set_volume(audio, AUDIO_USER_POPUP, volumes[i], 0);
+		g_assert_cmpfloat(fabs(audio_get_volume(audio) - volumes[i]), <,
+		                  TEST_EPSILON);
+		test_run_for(20);
+		g_assert_cmpfloat(fabs(audio_get_volume(audio) - volumes[i]), <,
+		                  TEST_EPSILON);
+	}
+	test_run_for(200);
+
+	/* Changes made by others */
+	test_events_reset(&events);
+	pactl("set-sink-volume", "30%");
+	wait_for_change(&events, 30, FALSE);
+	pactl("set-sink-mute", "1");
+	wait_for_change(&events, 30, TRUE);
+	g_assert_true(audio_is_muted(audio));
+
+	/* Our write went through, since the server tells it back */
+	audio_set_volume(audio, AUDIO_USER_POPUP, 64, 0);
+	test_run_for(200);
+	test_events_reset(&events);
+	pactl("set-sink-mute", "0");
+	wait_for_change(&events, 64, FALSE);
+
+	test_events_disconnect(audio, &events);
+	audio_free(audio);
+	server_stop();
+	g_free(spec);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_support_init(&argc, &argv);
+
+	g_test_add_func("/pulse/round-trip", test_round_trip);
+
+	return g_test_run();
+}
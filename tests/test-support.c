@@ -0,0 +1,230 @@
+/* test-support.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-support.c
+ * Helpers shared by the tests: a private configuration directory,
+ * main loop helpers, and a record of the audio signals. It also stands
+ * in for the parts of main.c that the audio system needs.
+ * @brief Test helpers.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "audio.h"
+#include "prefs.h"
+#include "support-log.h"
+#include "test-support.h"
+
+#include "main.h"
+
+static gchar *tmp_dir;
+
+/* Errors that would show up in a dialog fail the test */
+void
+run_error_dialog(const char *fmt, ...)
+{
+	va_list args;
+	gchar *msg;
+
+	va_start(args, fmt);
+	msg = g_strdup_vprintf(fmt, args);
+	va_end(args);
+
+	g_test_message("Error dialog: %s", msg);
+	g_test_fail();
+	g_free(msg);
+}
+
+static void
+remove_tmp_dir(void)
+{
+	gchar *cmd;
+
+	cmd = g_strdup_printf("rm -rf '%s'", tmp_dir);
+	if (system(cmd) != 0)
+		g_printerr("Can't remove '%s'\n", tmp_dir);
+	g_free(cmd);
+}
+
+/**
+ * Initialize the test program. The configuration and the runtime
+ * directories are moved to a private temporary directory, so that
+ * the user's preferences are never touched. This must be called
+ * before anything else.
+ *
+ * @param argc pointer to the number of command line arguments.
+ * @param argv pointer to the command line arguments.
+ */
+void
+test_support_init(int *argc, char ***argv)
+{
+	GError *error = NULL;
+
+	g_test_init(argc, argv, NULL);
+
+	tmp_dir = g_dir_make_tmp("pnmixer-test-XXXXXX", &error);
+	g_assert_no_error(error);
+	atexit(remove_tmp_dir);
+
+	g_setenv("XDG_CONFIG_HOME", tmp_dir, TRUE);
+	g_setenv("XDG_RUNTIME_DIR", tmp_dir, TRUE);
+	g_assert_cmpstr(g_get_user_config_dir(), ==, tmp_dir);
+
+	want_debug = g_getenv("PNMIXER_TEST_DEBUG") != NULL;
+}
+
+/**
+ * Get the private temporary directory of the test program.
+ *
+ * @return the path of the directory.
+ */
+const gchar *
+test_get_tmp_dir(void)
+{
+	return tmp_dir;
+}
+
+/**
+ * Write a configuration file, and load it as the preferences.
+ *
+ * @param contents the contents of the configuration file.
+ */
+void
+test_prefs_load(const gchar *contents)
+{
+	GError *error = NULL;
+	gchar *filename;
+
+	prefs_ensure_save_dir();
+
+	filename = g_build_filename(tmp_dir, "pnmixer", "config", NULL);
+	g_file_set_contents(filename, contents, -1, &error);
+	g_assert_no_error(error);
+	g_free(filename);
+
+	prefs_load();
+}
+
+static gboolean
+on_run_timeout(gpointer data)
+{
+	gboolean *timed_out = data;
+
+	*timed_out = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Run the main loop until a condition is met, or until a timeout.
+ *
+ * @param condition the function that checks the condition.
+ * @param data the data passed to the function.
+ * @param timeout the timeout, in ms.
+ * @return TRUE if the condition is met, FALSE on timeout.
+ */
+gboolean
+test_run_until(TestCondition condition, gpointer data, guint timeout)
+{
+	gboolean timed_out = FALSE;
+	guint source;
+
+	source = g_timeout_add(timeout, on_run_timeout, &timed_out);
+
+	while (!condition(data) && !timed_out)
+		g_main_context_iteration(NULL, TRUE);
+
+	if (!timed_out)
+		g_source_remove(source);
+
+	return condition(data);
+}
+
+static gboolean
+never(G_GNUC_UNUSED gpointer data)
+{
+	return FALSE;
+}
+
+/**
+ * Run the main loop for a while, so that pending events are delivered.
+ *
+ * @param duration the duration, in ms.
+ */
+void
+test_run_for(guint duration)
+{
+	test_run_until(never, NULL, duration);
+}
+
+static void
+on_audio_event(G_GNUC_UNUSED Audio *audio, AudioEvent *event, gpointer data)
+{
+	TestEvents *events = data;
+
+	events->count[event->signal]++;
+
+	/* Strings and streams don't outlive the signal */
+	if (event->stream)
+		events->last_stream_id = event->stream->id;
+
+	if (event->signal != AUDIO_VALUES_CHANGED)
+		return;
+
+	events->changes[event->user]++;
+	events->last_change = *event;
+	events->last_change.card = NULL;
+	events->last_change.channel = NULL;
+	events->last_change.stream = NULL;
+}
+
+/**
+ * Record the signals sent by an audio system.
+ *
+ * @param audio an Audio instance.
+ * @param events where to record the signals.
+ */
+void
+test_events_connect(Audio *audio, TestEvents *events)
+{
+	test_events_reset(events);
+	audio_signals_connect(audio, on_audio_event, events);
+}
+
+/**
+ * Stop recording the signals sent by an audio system.
+ *
+ * @param audio an Audio instance.
+ * @param events where the signals were recorded.
+ */
+void
+test_events_disconnect(Audio *audio, TestEvents *events)
+{
+	audio_signals_disconnect(audio, on_audio_event, events);
+}
+
+/**
+ * Forget about the signals recorded so far.
+ *
+ * @param events where the signals are recorded.
+ */
+void
+test_events_reset(TestEvents *events)
+{
+	memset(events, 0, sizeof *events);
+}
@@ -0,0 +1,46 @@
+/* test-support.h
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-support.h
+ * Header for test-support.c.
+ * @brief Header for test-support.c.
+ */
+
+#ifndef _TEST_SUPPORT_H_
+#define _TEST_SUPPORT_H_
+
+#include <glib.h>
+
+#include "audio.h"
+
+/* Record of the signals sent by the audio system */
+struct test_events {
+	guint count[AUDIO_STREAM_REMOVED + 1]; /* Signals */
+	guint changes[AUDIO_USER_SOCKET + 1]; /* Value changes, by user */
+	AudioEvent last_change; /* Strings are not kept */
+	guint32 last_stream_id;
+};
+
+typedef struct test_events TestEvents;
+
+typedef gboolean (*TestCondition) (gpointer data);
+
+void test_support_init(int *argc, char ***argv);
+const gchar *test_get_tmp_dir(void);
+void test_prefs_load(const gchar *contents);
+gboolean test_run_until(TestCondition condition, gpointer data, guint timeout);
+void test_run_for(guint duration);
+
+void test_events_connect(Audio *audio, TestEvents *events);
+void test_events_disconnect(Audio *audio, TestEvents *events);
+void test_events_reset(TestEvents *events);
+
+#endif				// _TEST_SUPPORT_H_
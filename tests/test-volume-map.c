@@ -0,0 +1,286 @@
+/* test-volume-map.c
+ * PNmixer is written by Nick Lanham, a fork of OBmixer
+ * which was programmed by Lee Ferrett, derived
+ * from the program "AbsVolume" by Paul Sherman
+ * This program is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General
+ * Public License v3. source code is available at
+ * <http://github.com/nicklan/pnmixer>
+ */
+
+/**
+ * @file test-volume-map.c
+ * Tests for the volume mapping tables of the alsa layer. The tables are
+ * compiled from synthetic elements, so that no sound card is needed.
+ * Every raw step of every element goes through a round trip, and the
+ * rounding of in-between values is checked against lrint_dir().
+ * The mapping code is static, so alsa.c is included right here.
+ * Run with '-m perf' for the microbenchmark.
+ * @brief Volume mapping tables tests.
+ */
+
+#include "../src/alsa.c"
+
+#define BENCH_LOOPS 1000000
+
+/* A synthetic element, with a regular dB scale */
+struct synthetic_elem {
+	const char *name;
+	long min, max;  /* Raw volume range */
+	long db_base;   /* dB hundredths of the lowest step, if not muted */
+	long db_step;   /* dB hundredths between two steps */
+	gboolean mute;  /* Whether the lowest step is a mute */
+};
+
+typedef struct synthetic_elem SyntheticElem;
+
+static const SyntheticElem elems[] = {
+	/* Onboard card, 0.75 dB steps, muted at the bottom */
+	{ "hda", 0, 87, -6525, 75, TRUE },
+	/* USB card, 0.5 dB steps, an offset range */
+	{ "usb", 16, 271, -12750, 50, FALSE },
+	/* Small range, where alsamixer is linear on dB */
+	{ "small", 0, 31, -1550, 50, FALSE },
+	/* As many steps as a table can have */
+	{ "huge", 0, ELEM_MAP_MAX_STEPS - 1, -6553500, 100, FALSE },
+};
+
+static const AlsaCurve curves[] = {
+	ALSA_CURVE_LINEAR,
+	ALSA_CURVE_LINEAR_DB,
+	ALSA_CURVE_ALSAMIXER,
+	ALSA_CURVE_LOUDNESS,
+	ALSA_CURVE_CUSTOM,
+};
+
+/* Whether neighbour steps are far enough apart to tell them from their
+ * normalized volume. Exponential curves squeeze the bottom of huge
+ * ranges below the precision of the tables.
+ */
+static gboolean
+curve_is_resolved(const SyntheticElem *elem, AlsaCurve curve)
+{
+	if (elem->max - elem->min < 1024)
+		return TRUE;
+
+	return curve == ALSA_CURVE_LINEAR || curve == ALSA_CURVE_LINEAR_DB;
+}
+
+static long
+synthetic_elem_db(const SyntheticElem *elem, guint step)
+{
+	if (step == 0 && elem->mute)
+		return SND_CTL_TLV_DB_GAIN_MUTE;
+
+	return elem->db_base + (long) step * elem->db_step;
+}
+
+/* Compile the table of a synthetic element. The custom curve goes
+ * through the whole dB range, with a knee at a quarter.
+ */
+static ElemMap *
+synthetic_elem_compile(const SyntheticElem *elem, AlsaCurve curve)
+{
+	guint i, n_steps = elem->max - elem->min + 1;
+	long *db;
+
+	if (curve == ALSA_CURVE_CUSTOM) {
+		gdouble db_min = elem->db_base / 100.0;
+		gdouble db_max = synthetic_elem_db(elem, n_steps - 1) / 100.0;
+		gdouble points[] = {
+			0, db_min,
+			25, db_min + (db_max - db_min) * 0.75,
+			100, db_max
+		};
+
+		alsa_set_custom_curve(points, G_N_ELEMENTS(points));
+	}
+
+	db = g_new(long, n_steps);
+	for (i = 0; i < n_steps; i++)
+		db[i] = synthetic_elem_db(elem, i);
+
+	return elem_map_compile(elem->min, elem->max, db, curve);
+}
+
+/* Every raw step must map to a volume that maps back to the same step,
+ * whatever the direction, and the same goes for its dB value.
+ */
+static void
+test_round_trip(void)
+{
+	guint e, c;
+
+	for (e = 0; e < G_N_ELEMENTS(elems); e++) {
+		for (c = 0; c < G_N_ELEMENTS(curves); c++) {
+			const SyntheticElem *elem = &elems[e];
+			ElemMap *map;
+			guint i;
+			int dir;
+
+			if (!curve_is_resolved(elem, curves[c]))
+				continue;
+
+			map = synthetic_elem_compile(elem, curves[c]);
+			g_assert_cmpuint(map->n_steps, ==, elem->max - elem->min + 1);
+
+			for (i = 0; i < map->n_steps; i++) {
+				if (i > 0)
+					g_assert_cmpfloat(map->norm[i], >, map->norm[i - 1]);
+
+				for (dir = -1; dir <= 1; dir++) {
+					g_assert_cmpuint(elem_map_find(map, map->norm[i], dir),
+					                 ==, i);
+					g_assert_cmpuint(elem_map_find_db(map, map->db[i], dir),
+					                 ==, i);
+				}
+			}
+
+			g_assert_cmpfloat(map->norm[0], ==, 0);
+			g_assert_cmpfloat(fabs(map->norm[map->n_steps - 1] - 1), <,
+			                  ELEM_MAP_EPSILON);
+
+			/* Audible steps spread over the whole range, even
+			 * above a mute step.
+			 */
+			if (curves[c] == ALSA_CURVE_LINEAR_DB) {
+				g_assert_cmpfloat(fabs(map->norm[1] - 1.0 / (map->n_steps - 1)),
+				                  <, ELEM_MAP_EPSILON);
+				g_assert_cmpfloat(fabs(map->norm[map->n_steps / 2] - 0.5),
+				                  <, 0.02);
+			}
+
+			elem_map_free(map);
+		}
+	}
+
+	alsa_set_custom_curve(NULL, 0);
+}
+
+/* Volumes between two steps must be rounded like lrint_dir() does:
+ * up when raising, down when lowering, to the nearest otherwise.
+ * Halves are left out, lrint() rounds them to even and we round them up.
+ */
+static void
+test_rounding(void)
+{
+	static const double fractions[] = { 0.01, 0.25, 0.49, 0.51, 0.75, 0.99 };
+	guint e;
+
+	for (e = 0; e < G_N_ELEMENTS(elems); e++) {
+		const SyntheticElem *elem = &elems[e];
+		ElemMap *map;
+		guint i, f, last;
+		int dir;
+
+		map = synthetic_elem_compile(elem, ALSA_CURVE_LINEAR);
+		last = map->n_steps - 1;
+
+		for (i = 0; i < last; i++) {
+			for (f = 0; f < G_N_ELEMENTS(fractions); f++) {
+				double position = i + fractions[f];
+
+				for (dir = -1; dir <= 1; dir++)
+					g_assert_cmpint(elem_map_find(map, position / last, dir),
+					                ==, lrint_dir(position, dir));
+			}
+		}
+
+		/* Out of range volumes stick to the ends */
+		for (dir = -1; dir <= 1; dir++) {
+			g_assert_cmpuint(elem_map_find(map, -0.5, dir), ==, 0);
+			g_assert_cmpuint(elem_map_find(map, 1.5, dir), ==, last);
+		}
+
+		/* Same thing in dB, on the audible steps */
+		for (i = elem->mute ? 1 : 0; i < last; i++) {
+			for (f = 0; f < G_N_ELEMENTS(fractions); f++) {
+				double position = i + fractions[f];
+				long db = elem->db_base + lrint(position * elem->db_step);
+
+				/* dB values are integers, that may be a step */
+				position = (db - elem->db_base) / (double) elem->db_step;
+				if (position - floor(position) == 0.5)
+					continue;
+
+				for (dir = -1; dir <= 1; dir++)
+					g_assert_cmpint(elem_map_find_db(map, db, dir),
+					                ==, lrint_dir(position, dir));
+			}
+		}
+
+		elem_map_free(map);
+	}
+}
+
+/* Compare the tables with the maths they replace, on the alsamixer curve.
+ * Volumes are spread over the whole range, so that every bucket is hit.
+ */
+static void
+test_benchmark(void)
+{
+	const SyntheticElem *elem = &elems[1];
+	volatile double sink_norm = 0;
+	volatile long sink_raw = 0;
+	long db_min, db_max;
+	double min_norm, elapsed;
+	ElemMap *map;
+	guint i;
+
+	map = synthetic_elem_compile(elem, ALSA_CURVE_ALSAMIXER);
+	db_min = map->db[0];
+	db_max = map->db[map->n_steps - 1];
+	min_norm = exp10((db_min - db_max) / 6000.0);
+
+	/* Raw step to normalized volume */
+	g_test_timer_start();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		sink_norm += curve_exponential(map->db[i % map->n_steps],
+		                               db_min, db_max, 6000.0);
+	elapsed = g_test_timer_elapsed();
+	g_test_message("Raw to volume, computed: %.1f ns", elapsed * 1e9 / BENCH_LOOPS);
+
+	g_test_timer_start();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		sink_norm += map->norm[i % map->n_steps];
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed * 1e9 / BENCH_LOOPS,
+	                        "Raw to volume, table: %.1f ns",
+	                        elapsed * 1e9 / BENCH_LOOPS);
+
+	/* Normalized volume to dB, then to a raw step */
+	g_test_timer_start();
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		double volume = (i % 1000) / 1000.0;
+		long db;
+
+		volume = volume * (1 - min_norm) + min_norm;
+		db = lrint_dir(6000.0 * log10(volume), 1) + db_max;
+		sink_raw += elem_map_find_db(map, db, 1);
+	}
+	elapsed = g_test_timer_elapsed();
+	g_test_message("Volume to raw, computed: %.1f ns", elapsed * 1e9 / BENCH_LOOPS);
+
+	g_test_timer_start();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		sink_raw += elem_map_find(map, (i % 1000) / 1000.0, 1);
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed * 1e9 / BENCH_LOOPS,
+	                        "Volume to raw, table: %.1f ns",
+	                        elapsed * 1e9 / BENCH_LOOPS);
+
+	elem_map_free(map);
+}
+
+int
+main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/volume-map/round-trip", test_round_trip);
+	g_test_add_func("/volume-map/rounding", test_rounding);
+	if (g_test_perf())
+		g_test_add_func("/volume-map/benchmark", test_benchmark);
+
+	return g_test_run();
+}